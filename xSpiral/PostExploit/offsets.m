@@ -1,108 +1,62 @@
-#import <Foundation/Foundation.h>
-
 #include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/sysctl.h>
-#include <sys/utsname.h>
 
 #include "offsets.h"
+#include "parameters.h"
 
-int* offsets = NULL;
-
-int kstruct_offsets_11_0[] = {
-  0xb,   // KSTRUCT_OFFSET_TASK_LCK_MTX_TYPE,
-  0x10,  // KSTRUCT_OFFSET_TASK_REF_COUNT,
-  0x14,  // KSTRUCT_OFFSET_TASK_ACTIVE,
-  0x20,  // KSTRUCT_OFFSET_TASK_VM_MAP,
-  0x28,  // KSTRUCT_OFFSET_TASK_NEXT,
-  0x30,  // KSTRUCT_OFFSET_TASK_PREV,
-  0x308, // KSTRUCT_OFFSET_TASK_ITK_SPACE
-  0x368, // KSTRUCT_OFFSET_TASK_BSD_INFO,
-  
-  0x0,   // KSTRUCT_OFFSET_IPC_PORT_IO_BITS,
-  0x4,   // KSTRUCT_OFFSET_IPC_PORT_IO_REFERENCES,
-  0x40,  // KSTRUCT_OFFSET_IPC_PORT_IKMQ_BASE,
-  0x50,  // KSTRUCT_OFFSET_IPC_PORT_MSG_COUNT,
-  0x60,  // KSTRUCT_OFFSET_IPC_PORT_IP_RECEIVER,
-  0x68,  // KSTRUCT_OFFSET_IPC_PORT_IP_KOBJECT,
-  0x88,  // KSTRUCT_OFFSET_IPC_PORT_IP_PREMSG,
-  0x90,  // KSTRUCT_OFFSET_IPC_PORT_IP_CONTEXT,
-  0xa0,  // KSTRUCT_OFFSET_IPC_PORT_IP_SRIGHTS,
-  
-  0x10,  // KSTRUCT_OFFSET_PROC_PID,
-  0x108, // KSTRUCT_OFFSET_PROC_P_FD
-  
-  0x0,   // KSTRUCT_OFFSET_FILEDESC_FD_OFILES
-  
-  0x8,   // KSTRUCT_OFFSET_FILEPROC_F_FGLOB
-  
-  0x38,  // KSTRUCT_OFFSET_FILEGLOB_FG_DATA
-  
-  0x10,  // KSTRUCT_OFFSET_SOCKET_SO_PCB
-  
-  0x10,  // KSTRUCT_OFFSET_PIPE_BUFFER
-  
-  0x14,  // KSTRUCT_OFFSET_IPC_SPACE_IS_TABLE_SIZE
-  0x20,  // KSTRUCT_OFFSET_IPC_SPACE_IS_TABLE
-  
-  0x6c,  // KFREE_ADDR_OFFSET
-};
-
-int kstruct_offsets_11_3[] = {
-  0xb,   // KSTRUCT_OFFSET_TASK_LCK_MTX_TYPE,
-  0x10,  // KSTRUCT_OFFSET_TASK_REF_COUNT,
-  0x14,  // KSTRUCT_OFFSET_TASK_ACTIVE,
-  0x20,  // KSTRUCT_OFFSET_TASK_VM_MAP,
-  0x28,  // KSTRUCT_OFFSET_TASK_NEXT,
-  0x30,  // KSTRUCT_OFFSET_TASK_PREV,
-  0x308, // KSTRUCT_OFFSET_TASK_ITK_SPACE
-  0x368, // KSTRUCT_OFFSET_TASK_BSD_INFO,
+// Where each offset lives in struct kstruct_offsets. The values themselves are in
+// kstruct_offsets.in, selected from its koffset() table.
+static const size_t koffset_fields[] = {
+  [KSTRUCT_OFFSET_TASK_LCK_MTX_TYPE]         = offsetof(struct kstruct_offsets, task__lck_mtx_type),
+  [KSTRUCT_OFFSET_TASK_REF_COUNT]            = offsetof(struct kstruct_offsets, task__ref_count),
+  [KSTRUCT_OFFSET_TASK_ACTIVE]               = offsetof(struct kstruct_offsets, task__active),
+  [KSTRUCT_OFFSET_TASK_VM_MAP]               = offsetof(struct kstruct_offsets, task__map),
+  [KSTRUCT_OFFSET_TASK_NEXT]                 = offsetof(struct kstruct_offsets, task__next),
+  [KSTRUCT_OFFSET_TASK_PREV]                 = offsetof(struct kstruct_offsets, task__prev),
+  [KSTRUCT_OFFSET_TASK_ITK_SPACE]            = offsetof(struct kstruct_offsets, task__itk_space),
+  [KSTRUCT_OFFSET_TASK_BSD_INFO]             = offsetof(struct kstruct_offsets, task__bsd_info),
   
-  0x0,   // KSTRUCT_OFFSET_IPC_PORT_IO_BITS,
-  0x4,   // KSTRUCT_OFFSET_IPC_PORT_IO_REFERENCES,
-  0x40,  // KSTRUCT_OFFSET_IPC_PORT_IKMQ_BASE,
-  0x50,  // KSTRUCT_OFFSET_IPC_PORT_MSG_COUNT,
-  0x60,  // KSTRUCT_OFFSET_IPC_PORT_IP_RECEIVER,
-  0x68,  // KSTRUCT_OFFSET_IPC_PORT_IP_KOBJECT,
-  0x88,  // KSTRUCT_OFFSET_IPC_PORT_IP_PREMSG,
-  0x90,  // KSTRUCT_OFFSET_IPC_PORT_IP_CONTEXT,
-  0xa0,  // KSTRUCT_OFFSET_IPC_PORT_IP_SRIGHTS,
+  [KSTRUCT_OFFSET_IPC_PORT_IO_BITS]          = offsetof(struct kstruct_offsets, ipc_port__ip_bits),
+  [KSTRUCT_OFFSET_IPC_PORT_IO_REFERENCES]    = offsetof(struct kstruct_offsets, ipc_port__ip_references),
+  [KSTRUCT_OFFSET_IPC_PORT_IKMQ_BASE]        = offsetof(struct kstruct_offsets, ipc_port__imq_messages),
+  [KSTRUCT_OFFSET_IPC_PORT_MSG_COUNT]        = offsetof(struct kstruct_offsets, ipc_port__imq_msgcount),
+  [KSTRUCT_OFFSET_IPC_PORT_IP_RECEIVER]      = offsetof(struct kstruct_offsets, ipc_port__ip_receiver),
+  [KSTRUCT_OFFSET_IPC_PORT_IP_KOBJECT]       = offsetof(struct kstruct_offsets, ipc_port__ip_kobject),
+  [KSTRUCT_OFFSET_IPC_PORT_IP_PREMSG]        = offsetof(struct kstruct_offsets, ipc_port__ip_premsg),
+  [KSTRUCT_OFFSET_IPC_PORT_IP_CONTEXT]       = offsetof(struct kstruct_offsets, ipc_port__ip_context),
+  [KSTRUCT_OFFSET_IPC_PORT_IP_SRIGHTS]       = offsetof(struct kstruct_offsets, ipc_port__ip_srights),
   
-  0x10,  // KSTRUCT_OFFSET_PROC_PID,
-  0x108, // KSTRUCT_OFFSET_PROC_P_FD
+  [KSTRUCT_OFFSET_PROC_PID]                  = offsetof(struct kstruct_offsets, proc__p_pid),
+  [KSTRUCT_OFFSET_PROC_P_FD]                 = offsetof(struct kstruct_offsets, proc__p_fd),
   
-  0x0,   // KSTRUCT_OFFSET_FILEDESC_FD_OFILES
+  [KSTRUCT_OFFSET_FILEDESC_FD_OFILES]        = offsetof(struct kstruct_offsets, filedesc__fd_ofiles),
   
-  0x8,   // KSTRUCT_OFFSET_FILEPROC_F_FGLOB
+  [KSTRUCT_OFFSET_FILEPROC_F_FGLOB]          = offsetof(struct kstruct_offsets, fileproc__f_fglob),
   
-  0x38,  // KSTRUCT_OFFSET_FILEGLOB_FG_DATA
+  [KSTRUCT_OFFSET_FILEGLOB_FG_DATA]          = offsetof(struct kstruct_offsets, fileglob__fg_data),
   
-  0x10,  // KSTRUCT_OFFSET_SOCKET_SO_PCB
+  [KSTRUCT_OFFSET_SOCKET_SO_PCB]             = offsetof(struct kstruct_offsets, socket__so_pcb),
   
-  0x10,  // KSTRUCT_OFFSET_PIPE_BUFFER
+  [KSTRUCT_OFFSET_PIPE_BUFFER]               = offsetof(struct kstruct_offsets, pipe__buffer),
   
-  0x14,  // KSTRUCT_OFFSET_IPC_SPACE_IS_TABLE_SIZE
-  0x20,  // KSTRUCT_OFFSET_IPC_SPACE_IS_TABLE
+  [KSTRUCT_OFFSET_IPC_SPACE_IS_TABLE_SIZE]   = offsetof(struct kstruct_offsets, ipc_space__is_table_size),
+  [KSTRUCT_OFFSET_IPC_SPACE_IS_TABLE]        = offsetof(struct kstruct_offsets, ipc_space__is_table),
   
-  0x7c,  // KFREE_ADDR_OFFSET
+  [KFREE_ADDR_OFFSET]                        = offsetof(struct kstruct_offsets, kfree_addr_offset),
 };
 
 int koffset(enum kstruct_offset offset) {
-  if (offsets == NULL) {
+  if (koffset_offsets == NULL) {
     printf("need to call offsets_init() prior to querying offsets\n");
     return 0;
   }
-  return offsets[offset];
+  return *(const uint32_t *)((const uint8_t *)koffset_offsets + koffset_fields[offset]);
 }
 
 int offsets_init() {
-  if (kCFCoreFoundationVersionNumber <= 1451.51) {
-    printf("offsets selected for iOS 11.0 to 11.2.6\n");
-    offsets = kstruct_offsets_11_0;
-  } else {
-    printf("offsets selected for iOS 11.3 or above\n");
-    offsets = kstruct_offsets_11_3;
+  if (!parameters_select_offsets()) {
+    printf("no offsets for this device\n");
+    return 1;
   }
+  printf("offsets selected for %s\n", koffset_offsets->name);
   return 0;
 }
@@ -12,27 +12,6 @@
 
 // ---- Initialization routines -------------------------------------------------------------------
 
-// A struct describing an initialization.
-struct initialization {
-	const char *devices;
-	const char *builds;
-	void (*init)(void);
-};
-
-// Run initializations matching this platform.
-static size_t
-run_initializations(struct initialization *inits, size_t count) {
-	size_t match_count = 0;
-	for (size_t i = 0; i < count; i++) {
-		struct initialization *init = &inits[i];
-		if (platform_matches(init->devices, init->builds)) {
-			init->init();
-			match_count++;
-		}
-	}
-	return match_count;
-}
-
 // A helper macro to get the number of elements in a static array.
 #define ARRAY_COUNT(x)	(sizeof(x) / sizeof((x)[0]))
 
@@ -55,10 +34,12 @@ offsets__iphone11_8__16C50() {
 }
 
 // A list of offset initializations by platform.
-static struct initialization offsets[] = {
-	{ "*", "*", offsets__iphone11_8__16C50 },
+static const struct platform_initialization offsets[] = {
+	{ { "*", "*" }, offsets__iphone11_8__16C50 },
 };
 
+static struct platform_match_table offsets_table;
+
 // ---- Address initialization --------------------------------------------------------------------
 
 #define SLIDE(address)		(address == 0 ? 0 : address + kernel_slide)
@@ -117,13 +98,15 @@ addresses__iphone10_1__16C101() {
 }
 
 // A list of address initializations by platform.
-static struct initialization addresses[] = {
-	{ "iPhone11,8", "16C50-16C104", addresses__iphone11_8__16C50  },
-	{ "iPhone11,2", "16C50-16C104", addresses__iphone11_2__16C50  },
-	{ "iPhone10,1", "16B92",        addresses__iphone10_1__16B92  },
-	{ "*",          "*",       addresses__iphone10_1__16C101 },
+static const struct platform_initialization addresses[] = {
+	{ { "iPhone11,8", "16C50-16C104" }, addresses__iphone11_8__16C50  },
+	{ { "iPhone11,2", "16C50-16C104" }, addresses__iphone11_2__16C50  },
+	{ { "iPhone10,1", "16B92"        }, addresses__iphone10_1__16B92  },
+	{ { "*",          "*"            }, addresses__iphone10_1__16C101 },
 };
 
+static struct platform_match_table addresses_table;
+
 // ---- PAC initialization ------------------------------------------------------------------------
 
 #if __arm64e__
@@ -158,10 +141,12 @@ pac__iphone11_8__16C50() {
 }
 
 // A list of PAC initializations by platform.
-static struct initialization pac_codes[] = {
-	{ "iPhone11,*", "*", pac__iphone11_8__16C50 },
+static const struct platform_initialization pac_codes[] = {
+	{ { "iPhone11,*", "*" }, pac__iphone11_8__16C50 },
 };
 
+static struct platform_match_table pac_codes_table;
+
 #endif // __arm64e__
 
 // ---- Public API --------------------------------------------------------------------------------
@@ -172,20 +157,22 @@ kernel_call_parameters_init() {
 	if (!ok) {
 		return false;
 	}
-	size_t count = run_initializations(offsets, ARRAY_COUNT(offsets));
+	size_t count = platform_run_initializations(&offsets_table, offsets, ARRAY_COUNT(offsets));
 	if (count < 1) {
 		ERROR("no kernel_call %s for %s %s", "offsets",
 				platform.machine, platform.osversion);
 		return false;
 	}
-	count = run_initializations(addresses, ARRAY_COUNT(addresses));
+	count = platform_run_initializations(&addresses_table, addresses,
+			ARRAY_COUNT(addresses));
 	if (count < 1) {
 		ERROR("no kernel_call %s for %s %s", "addresses",
 				platform.machine, platform.osversion);
 		return false;
 	}
 #if __arm64e__
-	count = run_initializations(pac_codes, ARRAY_COUNT(pac_codes));
+	count = platform_run_initializations(&pac_codes_table, pac_codes,
+			ARRAY_COUNT(pac_codes));
 	if (count < 1) {
 		ERROR("no kernel_call %s for %s %s", "PAC codes",
 				platform.machine, platform.osversion);
@@ -0,0 +1,277 @@
+/*
+ * kstruct_check.c
+ * xSpiral
+ *
+ * Host test for the offsets parameters_init() and koffset() use. For each (machine, build) pair
+ * below it runs parameters_init() as that platform and checks both against what they were before
+ * kstruct_offsets.in: the OFFSET(), SIZE() and BLOCK_SIZE() globals against the values the old
+ * parameters.c ended up with, which were the iPhone10,1 16B92 ones on every platform since its
+ * catch-all row ran last, and every koffset() value against the int arrays offsets.m used,
+ * picked the way offsets_init() picked them: the iOS 11.0 array up to 11.2.6 and the iOS 11.3
+ * array from then on. The only differences allowed are the ones listed with each pair, and the
+ * exit status is nonzero on any other.
+ */
+
+/*
+ * Not part of the app. Build from this directory with
+ *     cc -O2 -D_GNU_SOURCE '-D__printflike(f,a)=__attribute__((format(printf,f,a)))' -I. -I../.. \
+ *        -o kstruct_check kstruct_check.c parameters.c platform_match.c kstruct_offsets.c \
+ *        offsets_db.c log.c -x c ../../offsets.m
+ * and run "./kstruct_check". Each pair runs in its own process, since the platform is parsed
+ * only once per process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "offsets.h"
+#include "parameters.h"
+#include "platform.h"
+
+struct platform platform;
+size_t page_size;
+
+// Stands in for the sysctl-based one; main() fills in platform before each run.
+void
+platform_init() {
+}
+
+#define NUM_KOFFSETS	(KFREE_ADDR_OFFSET + 1)
+
+// offsets.m before kstruct_offsets.in.
+static const int kstruct_offsets_11_0[NUM_KOFFSETS] = {
+	0xb, 0x10, 0x14, 0x20, 0x28, 0x30, 0x308, 0x368,
+	0x0, 0x4, 0x40, 0x50, 0x60, 0x68, 0x88, 0x90, 0xa0,
+	0x10, 0x108,
+	0x0,
+	0x8,
+	0x38,
+	0x10,
+	0x10,
+	0x14, 0x20,
+	0x6c,
+};
+
+static const int kstruct_offsets_11_3[NUM_KOFFSETS] = {
+	0xb, 0x10, 0x14, 0x20, 0x28, 0x30, 0x308, 0x368,
+	0x0, 0x4, 0x40, 0x50, 0x60, 0x68, 0x88, 0x90, 0xa0,
+	0x10, 0x108,
+	0x0,
+	0x8,
+	0x38,
+	0x10,
+	0x10,
+	0x14, 0x20,
+	0x7c,
+};
+
+static const char *const koffset_names[NUM_KOFFSETS] = {
+	"task.lck_mtx_type", "task.ref_count", "task.active", "task.map", "task.next", "task.prev",
+	"task.itk_space", "task.bsd_info",
+	"ipc_port.ip_bits", "ipc_port.ip_references", "ipc_port.imq_messages",
+	"ipc_port.imq_msgcount", "ipc_port.ip_receiver", "ipc_port.ip_kobject",
+	"ipc_port.ip_premsg", "ipc_port.ip_context", "ipc_port.ip_srights",
+	"proc.p_pid", "proc.p_fd",
+	"filedesc.fd_ofiles",
+	"fileproc.f_fglob",
+	"fileglob.fg_data",
+	"socket.so_pcb",
+	"pipe.buffer",
+	"ipc_space.is_table_size", "ipc_space.is_table",
+	"kfree_addr_offset",
+};
+
+// The globals the old parameters.c set, with the values it left in them.
+static const struct {
+	const char *name;
+	const size_t *global;
+	size_t value;
+} old_parameters[] = {
+#define OLD_OFFSET(struct_, field_, value_)	{ #struct_ "." #field_, &OFFSET(struct_, field_), value_ }
+#define OLD_SIZE(struct_, value_)		{ #struct_ ".size", &SIZE(struct_), value_ }
+#define OLD_BLOCK_SIZE(struct_, value_)		{ #struct_ ".block_size", &BLOCK_SIZE(struct_), value_ }
+	OLD_SIZE(ipc_entry, 0x18),
+	OLD_OFFSET(ipc_entry, ie_object, 0),
+	OLD_OFFSET(ipc_entry, ie_bits, 8),
+	OLD_OFFSET(ipc_entry, ie_request, 16),
+	OLD_SIZE(ipc_port, 0xa8),
+	OLD_BLOCK_SIZE(ipc_port, 0x4000),
+	OLD_OFFSET(ipc_port, ip_bits, 0),
+	OLD_OFFSET(ipc_port, ip_references, 4),
+	OLD_OFFSET(ipc_port, waitq_flags, 24),
+	OLD_OFFSET(ipc_port, imq_messages, 64),
+	OLD_OFFSET(ipc_port, imq_msgcount, 80),
+	OLD_OFFSET(ipc_port, imq_qlimit, 82),
+	OLD_OFFSET(ipc_port, ip_receiver, 96),
+	OLD_OFFSET(ipc_port, ip_kobject, 104),
+	OLD_OFFSET(ipc_port, ip_nsrequest, 112),
+	OLD_OFFSET(ipc_port, ip_requests, 128),
+	OLD_OFFSET(ipc_port, ip_mscount, 156),
+	OLD_OFFSET(ipc_port, ip_srights, 160),
+	OLD_SIZE(ipc_port_request, 0x10),
+	OLD_OFFSET(ipc_port_request, ipr_soright, 0),
+	OLD_OFFSET(ipc_space, is_table_size, 0x14),
+	OLD_OFFSET(ipc_space, is_table, 0x20),
+	OLD_SIZE(ipc_voucher, 0x50),
+	OLD_BLOCK_SIZE(ipc_voucher, 0x4000),
+	OLD_OFFSET(proc, p_pid, 0x60),
+	OLD_OFFSET(proc, p_ucred, 0xf8),
+	OLD_SIZE(sysctl_oid, 0x50),
+	OLD_OFFSET(sysctl_oid, oid_parent, 0x0),
+	OLD_OFFSET(sysctl_oid, oid_link, 0x8),
+	OLD_OFFSET(sysctl_oid, oid_kind, 0x14),
+	OLD_OFFSET(sysctl_oid, oid_handler, 0x30),
+	OLD_OFFSET(sysctl_oid, oid_version, 0x48),
+	OLD_OFFSET(sysctl_oid, oid_refcnt, 0x4c),
+	OLD_OFFSET(task, lck_mtx_type, 0xb),
+	OLD_OFFSET(task, ref_count, 0x10),
+	OLD_OFFSET(task, active, 0x14),
+	OLD_OFFSET(task, map, 0x20),
+	OLD_OFFSET(task, itk_space, 0x300),
+	OLD_OFFSET(task, bsd_info, 0x358),
+	{ "ipc_port.count_per_block", &COUNT_PER_BLOCK(ipc_port), 0x4000 / 0xa8 },
+	{ "ipc_voucher.count_per_block", &COUNT_PER_BLOCK(ipc_voucher), 0x4000 / 0x50 },
+#undef OLD_OFFSET
+#undef OLD_SIZE
+#undef OLD_BLOCK_SIZE
+};
+
+// A deliberate difference from the old koffset() arrays.
+struct change {
+	enum kstruct_offset offset;
+	int value;
+};
+
+// A deliberate difference from the old parameters.c.
+struct parameter_change {
+	const size_t *global;
+	size_t value;
+};
+
+// iOS 12 moved p_pid and itk_space; the old arrays applied the iOS 11.3 values to it.
+#define IOS_12_CHANGES		{ KSTRUCT_OFFSET_PROC_PID, 0x60 }, { KSTRUCT_OFFSET_TASK_ITK_SPACE, 0x300 }
+
+// The iPhone11,x row keeps the task.bsd_info it was written with, which the old parameters.c
+// overwrote with its catch-all.
+#define IPHONE11_CHANGES	{ &OFFSET(task, bsd_info), 0x368 }
+
+static const struct {
+	const char *machine;
+	const char *build;
+	const char *selected;
+	const char *koffset_selected;
+	const int *old;
+	struct change changes[4];
+	struct parameter_change parameter_changes[2];
+} pairs[] = {
+	{ "iPhone10,1", "15A372", "generic",           "ios_11_0",          kstruct_offsets_11_0, { }, { } },
+	{ "iPhone9,3",  "15D60",  "generic",           "ios_11_0",          kstruct_offsets_11_0, { }, { } },
+	{ "iPhone8,1",  "15E216", "generic",           "ios_11_3",          kstruct_offsets_11_3, { }, { } },
+	{ "iPhone10,6", "15G77",  "generic",           "ios_11_3",          kstruct_offsets_11_3, { }, { } },
+	{ "iPhone11,8", "16C50",  "iphone11_8__16C50", "iphone11_8__16C50", kstruct_offsets_11_3,
+		{ IOS_12_CHANGES }, { IPHONE11_CHANGES } },
+	{ "iPhone11,2", "16A366", "iphone11_8__16C50", "iphone11_8__16C50", kstruct_offsets_11_3,
+		{ IOS_12_CHANGES }, { IPHONE11_CHANGES } },
+	// Measured on this device; see kstruct_offsets.in.
+	{ "iPhone10,1", "16B92",  "iphone10_1__16B92", "iphone10_1__16B92", kstruct_offsets_11_3,
+		{ IOS_12_CHANGES, { KSTRUCT_OFFSET_TASK_BSD_INFO, 0x358 } }, { } },
+	{ "iPhone10,4", "16B92",  "generic",           "ios_12",            kstruct_offsets_11_3,
+		{ IOS_12_CHANGES }, { } },
+	{ "iPhone10,1", "16D57",  "generic",           "ios_12",            kstruct_offsets_11_3,
+		{ IOS_12_CHANGES }, { } },
+	{ "iPhone11,8", "16D57",  "generic",           "ios_12",            kstruct_offsets_11_3,
+		{ IOS_12_CHANGES }, { } },
+	{ "iPad7,5",    "16A366", "generic",           "ios_12",            kstruct_offsets_11_3,
+		{ IOS_12_CHANGES }, { } },
+};
+
+#define ARRAY_COUNT(x)	(sizeof(x) / sizeof((x)[0]))
+
+// Compare the globals parameters_init() set with the old parameters.c. Returns the number of
+// mismatches.
+static int
+check_parameters(size_t index) {
+	int mismatches = 0;
+	for (size_t i = 0; i < ARRAY_COUNT(old_parameters); i++) {
+		size_t want = old_parameters[i].value;
+		for (size_t j = 0; j < ARRAY_COUNT(pairs[index].parameter_changes); j++) {
+			const struct parameter_change *change = &pairs[index].parameter_changes[j];
+			if (change->global == old_parameters[i].global) {
+				want = change->value;
+			}
+		}
+		size_t got = *old_parameters[i].global;
+		if (got != want) {
+			printf("\n    %s = 0x%zx, want 0x%zx", old_parameters[i].name, got, want);
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+// Compare the koffset() values with the old offsets.m arrays. Returns the number of mismatches.
+static int
+check_koffsets(size_t index) {
+	int mismatches = 0;
+	for (int i = 0; i < NUM_KOFFSETS; i++) {
+		int want = pairs[index].old[i];
+		for (size_t j = 0; j < ARRAY_COUNT(pairs[index].changes); j++) {
+			const struct change *change = &pairs[index].changes[j];
+			if (change->value != 0 && change->offset == (enum kstruct_offset) i) {
+				want = change->value;
+			}
+		}
+		int got = koffset(i);
+		if (got != want) {
+			printf("\n    koffset %s = 0x%x, want 0x%x", koffset_names[i], got, want);
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+// Initialize the parameters as the given platform and compare them. Returns the number of
+// mismatches.
+static int
+check_pair(size_t index) {
+	strncpy((char *)platform.machine, pairs[index].machine, sizeof(platform.machine) - 1);
+	strncpy((char *)platform.osversion, pairs[index].build, sizeof(platform.osversion) - 1);
+	printf("%-10s %-7s ", pairs[index].machine, pairs[index].build);
+	if (!parameters_init()) {
+		printf("no offsets selected  MISMATCH\n");
+		return 1;
+	}
+	if (strcmp(kernel_offsets->name, pairs[index].selected) != 0
+			|| strcmp(koffset_offsets->name, pairs[index].koffset_selected) != 0) {
+		printf("selected %s and %s, want %s and %s  MISMATCH\n", kernel_offsets->name,
+				koffset_offsets->name, pairs[index].selected, pairs[index].koffset_selected);
+		return 1;
+	}
+	printf("%-18s %-18s", kernel_offsets->name, koffset_offsets->name);
+	int mismatches = check_parameters(index) + check_koffsets(index);
+	printf("%s\n", mismatches ? "\n    MISMATCH" : "  ok");
+	return mismatches;
+}
+
+int
+main() {
+	int failures = 0;
+	for (size_t i = 0; i < ARRAY_COUNT(pairs); i++) {
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid == 0) {
+			exit(check_pair(i) ? 2 : 0);
+		}
+		int status = 0;
+		if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)
+				|| WEXITSTATUS(status) != 0) {
+			failures++;
+		}
+	}
+	printf("%d of %zu pairs differ from the old offsets beyond the listed changes\n", failures,
+			ARRAY_COUNT(pairs));
+	return failures ? 2 : 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * kstruct_fields.h
+ * Generated by kstruct_gen from kstruct_offsets.in. Do not edit.
+ */
+#ifndef VOUCHER_SWAP__KSTRUCT_FIELDS_H_
+#define VOUCHER_SWAP__KSTRUCT_FIELDS_H_
+
+#define KSTRUCT_OFFSETS(X)	\
+	X(ipc_entry, ie_object)	\
+	X(ipc_entry, ie_bits)	\
+	X(ipc_entry, ie_request)	\
+	X(ipc_port, ip_bits)	\
+	X(ipc_port, ip_references)	\
+	X(ipc_port, waitq_flags)	\
+	X(ipc_port, imq_messages)	\
+	X(ipc_port, imq_msgcount)	\
+	X(ipc_port, imq_qlimit)	\
+	X(ipc_port, ip_receiver)	\
+	X(ipc_port, ip_kobject)	\
+	X(ipc_port, ip_premsg)	\
+	X(ipc_port, ip_context)	\
+	X(ipc_port, ip_nsrequest)	\
+	X(ipc_port, ip_requests)	\
+	X(ipc_port, ip_mscount)	\
+	X(ipc_port, ip_srights)	\
+	X(ipc_port_request, ipr_soright)	\
+	X(ipc_space, is_table_size)	\
+	X(ipc_space, is_table)	\
+	X(proc, p_pid)	\
+	X(proc, p_ucred)	\
+	X(proc, p_fd)	\
+	X(filedesc, fd_ofiles)	\
+	X(fileproc, f_fglob)	\
+	X(fileglob, fg_data)	\
+	X(socket, so_pcb)	\
+	X(pipe, buffer)	\
+	X(sysctl_oid, oid_parent)	\
+	X(sysctl_oid, oid_link)	\
+	X(sysctl_oid, oid_kind)	\
+	X(sysctl_oid, oid_handler)	\
+	X(sysctl_oid, oid_version)	\
+	X(sysctl_oid, oid_refcnt)	\
+	X(task, lck_mtx_type)	\
+	X(task, ref_count)	\
+	X(task, active)	\
+	X(task, map)	\
+	X(task, next)	\
+	X(task, prev)	\
+	X(task, itk_space)	\
+	X(task, bsd_info)
+
+#define KSTRUCT_SIZES(X)	\
+	X(ipc_entry)	\
+	X(ipc_port)	\
+	X(ipc_port_request)	\
+	X(ipc_voucher)	\
+	X(sysctl_oid)
+
+#define KSTRUCT_BLOCK_SIZES(X)	\
+	X(ipc_port)	\
+	X(ipc_voucher)
+
+#define KSTRUCT_VALUES(X)	\
+	X(kfree_addr_offset)
+
+#endif
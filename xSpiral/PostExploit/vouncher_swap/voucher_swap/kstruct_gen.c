@@ -0,0 +1,529 @@
+/*
+ * kstruct_gen.c
+ * xSpiral
+ *
+ * Host tool that turns kstruct_offsets.in into kstruct_fields.h (the field lists) and
+ * kstruct_offsets.c (one const struct kstruct_offsets per build plus the device and build
+ * tables that select one for parameters_init() and one for koffset()). Before writing anything it checks that every build sets every field,
+ * that offsets lie inside their structure and that no build is shadowed by an earlier catch-all;
+ * with -c it also fails if the checked-in outputs differ from what it would write.
+ */
+
+/*
+ * Not part of the app. Build from this directory with
+ *     cc -O2 -o kstruct_gen kstruct_gen.c
+ * and run "./kstruct_gen [-c] [-o output-dir] kstruct_offsets.in". The outputs go next to the
+ * input unless -o is given.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// ---- Model -------------------------------------------------------------------------------------
+
+enum field_kind {
+	FIELD_OFFSET,
+	FIELD_SIZE,
+	FIELD_BLOCK_SIZE,
+	FIELD_VALUE,
+};
+
+// A field every build provides. ref is how builds name it, member the C member name.
+struct field {
+	enum field_kind kind;
+	char *object;
+	char *name;
+	char *ref;
+	char *member;
+};
+
+// The tables a build is listed in.
+enum build_user {
+	USER_PARAMETERS = 1,
+	USER_KOFFSET    = 2,
+};
+
+struct build {
+	char *name;
+	char *devices;
+	char *builds;
+	int parent;
+	unsigned users;
+	unsigned line;
+	uint64_t *values;
+	bool *set;
+};
+
+static struct field *fields;
+static size_t field_count;
+static struct build *builds;
+static size_t build_count;
+
+static const char *input_path;
+static unsigned error_count;
+
+// Report an error at a line of the input. Processing continues so that every problem is listed.
+static void
+error_at(unsigned line, const char *format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	if (line > 0) {
+		fprintf(stderr, "%s:%u: ", input_path, line);
+	} else {
+		fprintf(stderr, "%s: ", input_path);
+	}
+	vfprintf(stderr, format, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+	error_count++;
+}
+
+static void *
+xrealloc(void *p, size_t size) {
+	p = realloc(p, size);
+	if (p == NULL) {
+		perror("realloc");
+		exit(1);
+	}
+	return p;
+}
+
+static char *
+xstrdup(const char *s) {
+	char *p = strdup(s);
+	if (p == NULL) {
+		perror("strdup");
+		exit(1);
+	}
+	return p;
+}
+
+static int
+find_field(const char *ref) {
+	for (size_t i = 0; i < field_count; i++) {
+		if (strcmp(fields[i].ref, ref) == 0) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+static int
+find_build(const char *name) {
+	for (size_t i = 0; i < build_count; i++) {
+		if (strcmp(builds[i].name, name) == 0) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+// Whether s is usable as part of a C identifier.
+static bool
+is_identifier(const char *s) {
+	if (*s == 0 || ('0' <= *s && *s <= '9')) {
+		return false;
+	}
+	for (; *s != 0; s++) {
+		if (!(*s == '_' || ('a' <= *s && *s <= 'z') || ('A' <= *s && *s <= 'Z')
+				|| ('0' <= *s && *s <= '9'))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+add_field(unsigned line, enum field_kind kind, const char *object, const char *name) {
+	static const char *const suffix[] = { NULL, "size", "block_size", NULL };
+	struct field f = { .kind = kind };
+	if (!is_identifier(object) || (name != NULL && !is_identifier(name))) {
+		error_at(line, "bad field name");
+		return;
+	}
+	if (kind == FIELD_VALUE) {
+		f.object = NULL;
+		f.name = xstrdup(object);
+		f.ref = xstrdup(object);
+		f.member = xstrdup(object);
+	} else {
+		f.object = xstrdup(object);
+		f.name = xstrdup(kind == FIELD_OFFSET ? name : suffix[kind]);
+		if (asprintf(&f.ref, "%s.%s", f.object, f.name) < 0
+				|| asprintf(&f.member, "%s__%s", f.object, f.name) < 0) {
+			exit(1);
+		}
+	}
+	if (find_field(f.ref) >= 0) {
+		error_at(line, "%s declared twice", f.ref);
+		return;
+	}
+	fields = xrealloc(fields, (field_count + 1) * sizeof(*fields));
+	fields[field_count++] = f;
+}
+
+// ---- Parsing -----------------------------------------------------------------------------------
+
+#define MAX_WORDS 16
+
+// Split a line into whitespace-separated words, dropping any comment.
+static size_t
+split(char *line, char **words) {
+	size_t count = 0;
+	char *hash = strchr(line, '#');
+	if (hash != NULL) {
+		*hash = 0;
+	}
+	for (char *w = strtok(line, " \t\r\n"); w != NULL; w = strtok(NULL, " \t\r\n")) {
+		if (count == MAX_WORDS) {
+			return MAX_WORDS + 1;
+		}
+		words[count++] = w;
+	}
+	return count;
+}
+
+static void
+parse_build(unsigned line, char **words, size_t count) {
+	struct build b = { .parent = -1, .users = USER_PARAMETERS | USER_KOFFSET, .line = line };
+	size_t i = 4;
+	const char *parent = NULL;
+	if (i + 2 <= count && strcmp(words[i], "from") == 0) {
+		parent = words[i + 1];
+		i += 2;
+	}
+	if (i + 2 <= count && strcmp(words[i], "for") == 0) {
+		if (strcmp(words[i + 1], "parameters") == 0) {
+			b.users = USER_PARAMETERS;
+		} else if (strcmp(words[i + 1], "koffset") == 0) {
+			b.users = USER_KOFFSET;
+		} else {
+			error_at(line, "a build is for parameters or koffset, not %s", words[i + 1]);
+		}
+		i += 2;
+	}
+	if (count < 4 || i != count) {
+		error_at(line, "expected \"build <name> <devices> <builds> [from <parent>] "
+				"[for parameters|koffset]\"");
+		return;
+	}
+	if (!is_identifier(words[1])) {
+		error_at(line, "bad build name %s", words[1]);
+		return;
+	}
+	if (find_build(words[1]) >= 0) {
+		error_at(line, "build %s defined twice", words[1]);
+		return;
+	}
+	if (parent != NULL) {
+		b.parent = find_build(parent);
+		if (b.parent < 0) {
+			error_at(line, "parent %s is not defined above", parent);
+		}
+	}
+	b.name = xstrdup(words[1]);
+	b.devices = xstrdup(words[2]);
+	b.builds = xstrdup(words[3]);
+	b.values = xrealloc(NULL, (field_count + 1) * sizeof(*b.values));
+	b.set = xrealloc(NULL, (field_count + 1) * sizeof(*b.set));
+	memset(b.set, 0, (field_count + 1) * sizeof(*b.set));
+	builds = xrealloc(builds, (build_count + 1) * sizeof(*builds));
+	builds[build_count++] = b;
+}
+
+static void
+parse_setting(unsigned line, char **words, size_t count) {
+	struct build *b = &builds[build_count - 1];
+	char *end;
+	if (count != 2) {
+		error_at(line, "expected \"<field> <value>\"");
+		return;
+	}
+	int f = find_field(words[0]);
+	if (f < 0) {
+		error_at(line, "unknown field %s", words[0]);
+		return;
+	}
+	if (b->set[f]) {
+		error_at(line, "%s set twice in %s", words[0], b->name);
+		return;
+	}
+	errno = 0;
+	unsigned long long value = strtoull(words[1], &end, 0);
+	if (errno != 0 || *end != 0 || words[1][0] == '-' || value > UINT32_MAX) {
+		error_at(line, "bad value %s", words[1]);
+		return;
+	}
+	b->values[f] = value;
+	b->set[f] = true;
+}
+
+static void
+parse(FILE *in) {
+	char *line = NULL;
+	size_t cap = 0;
+	unsigned lineno = 0;
+	while (getline(&line, &cap, in) > 0) {
+		char *words[MAX_WORDS];
+		lineno++;
+		bool indented = (line[0] == ' ' || line[0] == '\t');
+		size_t count = split(line, words);
+		if (count == 0) {
+			continue;
+		}
+		if (count > MAX_WORDS) {
+			error_at(lineno, "line too long");
+			continue;
+		}
+		if (indented) {
+			if (build_count == 0) {
+				error_at(lineno, "setting outside a build");
+			} else {
+				parse_setting(lineno, words, count);
+			}
+			continue;
+		}
+		if (strcmp(words[0], "build") == 0) {
+			parse_build(lineno, words, count);
+			continue;
+		}
+		// Builds size their value arrays by the fields declared so far.
+		if (build_count > 0) {
+			error_at(lineno, "fields must be declared before the first build");
+			continue;
+		}
+		if (strcmp(words[0], "offset") == 0 && count >= 3) {
+			for (size_t i = 2; i < count; i++) {
+				add_field(lineno, FIELD_OFFSET, words[1], words[i]);
+			}
+		} else if (strcmp(words[0], "size") == 0 && count == 2) {
+			add_field(lineno, FIELD_SIZE, words[1], NULL);
+		} else if (strcmp(words[0], "block_size") == 0 && count == 2) {
+			add_field(lineno, FIELD_BLOCK_SIZE, words[1], NULL);
+		} else if (strcmp(words[0], "value") == 0 && count == 2) {
+			add_field(lineno, FIELD_VALUE, words[1], NULL);
+		} else {
+			error_at(lineno, "unknown directive %s", words[0]);
+		}
+	}
+	free(line);
+}
+
+// ---- Checks ------------------------------------------------------------------------------------
+
+// Fill in inherited fields and check each build for completeness and consistency.
+static void
+resolve(void) {
+	for (size_t i = 0; i < build_count; i++) {
+		struct build *b = &builds[i];
+		for (size_t f = 0; f < field_count; f++) {
+			if (!b->set[f] && b->parent >= 0 && builds[b->parent].set[f]) {
+				b->values[f] = builds[b->parent].values[f];
+				b->set[f] = true;
+			}
+			if (!b->set[f]) {
+				error_at(b->line, "%s does not set %s", b->name, fields[f].ref);
+			}
+		}
+		for (size_t f = 0; f < field_count; f++) {
+			const struct field *fd = &fields[f];
+			char ref[256];
+			if (fd->kind == FIELD_VALUE || !b->set[f]) {
+				continue;
+			}
+			snprintf(ref, sizeof(ref), "%s.size", fd->object);
+			int size = find_field(ref);
+			if (size < 0 || !b->set[size]) {
+				continue;
+			}
+			if (fd->kind == FIELD_OFFSET && b->values[f] >= b->values[size]) {
+				error_at(b->line, "%s: %s is 0x%llx, outside the 0x%llx-byte structure",
+						b->name, fd->ref, (unsigned long long) b->values[f],
+						(unsigned long long) b->values[size]);
+			}
+			if (fd->kind == FIELD_BLOCK_SIZE && b->values[f] < b->values[size]) {
+				error_at(b->line, "%s: %s is smaller than %s", b->name, fd->ref, ref);
+			}
+			if (fd->kind == FIELD_SIZE && b->values[f] == 0) {
+				error_at(b->line, "%s: %s is 0", b->name, fd->ref);
+			}
+		}
+		// A build after a catch-all in the same table can never be selected.
+		for (size_t j = 0; j < i; j++) {
+			if ((builds[j].users & b->users) != 0 && strcmp(builds[j].devices, "*") == 0
+					&& strcmp(builds[j].builds, "*") == 0) {
+				error_at(b->line, "%s is unreachable after %s", b->name, builds[j].name);
+				break;
+			}
+		}
+	}
+	unsigned users = 0;
+	for (size_t i = 0; i < build_count; i++) {
+		users |= builds[i].users;
+	}
+	if ((users & USER_PARAMETERS) == 0) {
+		error_at(0, "no builds for parameters");
+	}
+	if ((users & USER_KOFFSET) == 0) {
+		error_at(0, "no builds for koffset");
+	}
+}
+
+// ---- Output ------------------------------------------------------------------------------------
+
+static void
+emit_list(FILE *out, const char *macro, enum field_kind kind) {
+	fprintf(out, "#define %s(X)", macro);
+	for (size_t f = 0; f < field_count; f++) {
+		if (fields[f].kind != kind) {
+			continue;
+		}
+		if (kind == FIELD_OFFSET) {
+			fprintf(out, "\t\\\n\tX(%s, %s)", fields[f].object, fields[f].name);
+		} else if (kind == FIELD_VALUE) {
+			fprintf(out, "\t\\\n\tX(%s)", fields[f].name);
+		} else {
+			fprintf(out, "\t\\\n\tX(%s)", fields[f].object);
+		}
+	}
+	fprintf(out, "\n\n");
+}
+
+static void
+emit_fields_h(FILE *out, const char *input) {
+	fprintf(out, "/*\n * kstruct_fields.h\n * Generated by kstruct_gen from %s. Do not edit.\n */\n",
+			input);
+	fprintf(out, "#ifndef VOUCHER_SWAP__KSTRUCT_FIELDS_H_\n#define VOUCHER_SWAP__KSTRUCT_FIELDS_H_\n\n");
+	emit_list(out, "KSTRUCT_OFFSETS", FIELD_OFFSET);
+	emit_list(out, "KSTRUCT_SIZES", FIELD_SIZE);
+	emit_list(out, "KSTRUCT_BLOCK_SIZES", FIELD_BLOCK_SIZE);
+	emit_list(out, "KSTRUCT_VALUES", FIELD_VALUE);
+	fprintf(out, "#endif\n");
+}
+
+// The device and build table of the builds for one user, in kstruct_offsets.in order.
+static void
+emit_table(FILE *out, const char *table, enum build_user user) {
+	size_t count = 0;
+	fprintf(out, "\nconst struct kstruct_offsets_entry %s[] = {\n", table);
+	for (size_t i = 0; i < build_count; i++) {
+		if ((builds[i].users & user) == 0) {
+			continue;
+		}
+		fprintf(out, "\t{ { \"%s\", \"%s\" }, &offsets__%s },\n",
+				builds[i].devices, builds[i].builds, builds[i].name);
+		count++;
+	}
+	fprintf(out, "};\n\n");
+	fprintf(out, "const size_t %s_count = %zu;\n", table, count);
+}
+
+static void
+emit_offsets_c(FILE *out, const char *input) {
+	fprintf(out, "/*\n * kstruct_offsets.c\n * Generated by kstruct_gen from %s. Do not edit.\n */\n",
+			input);
+	fprintf(out, "#include \"kstruct_offsets.h\"\n");
+	for (size_t i = 0; i < build_count; i++) {
+		fprintf(out, "\nstatic const struct kstruct_offsets offsets__%s = {\n", builds[i].name);
+		fprintf(out, "\t.name = \"%s\",\n", builds[i].name);
+		for (size_t f = 0; f < field_count; f++) {
+			fprintf(out, "\t.%s = 0x%llx,\n", fields[f].member,
+					(unsigned long long) builds[i].values[f]);
+		}
+		fprintf(out, "};\n");
+	}
+	emit_table(out, "kstruct_offsets_db", USER_PARAMETERS);
+	emit_table(out, "koffset_db", USER_KOFFSET);
+}
+
+// Write the output to path, or with check set compare it against what is there already.
+static bool
+write_output(const char *path, bool check, void (*emit)(FILE *, const char *), const char *input) {
+	char *data = NULL;
+	size_t size = 0;
+	FILE *mem = open_memstream(&data, &size);
+	if (mem == NULL) {
+		perror("open_memstream");
+		exit(1);
+	}
+	emit(mem, input);
+	fclose(mem);
+	bool ok = true;
+	if (check) {
+		FILE *f = fopen(path, "rb");
+		char *old = xrealloc(NULL, size + 1);
+		ok = (f != NULL && fread(old, 1, size + 1, f) == size && memcmp(old, data, size) == 0);
+		if (f != NULL) {
+			fclose(f);
+		}
+		if (!ok) {
+			fprintf(stderr, "%s: out of date, run kstruct_gen\n", path);
+		}
+		free(old);
+	} else {
+		FILE *f = fopen(path, "wb");
+		if (f == NULL || fwrite(data, 1, size, f) != size || fclose(f) != 0) {
+			perror(path);
+			ok = false;
+		}
+	}
+	free(data);
+	return ok;
+}
+
+// ---- Main --------------------------------------------------------------------------------------
+
+int
+main(int argc, char **argv) {
+	bool check = false;
+	const char *outdir = NULL;
+	int ch;
+	while ((ch = getopt(argc, argv, "co:")) != -1) {
+		switch (ch) {
+			case 'c': check = true; break;
+			case 'o': outdir = optarg; break;
+			default: goto usage;
+		}
+	}
+	if (optind != argc - 1) {
+usage:
+		fprintf(stderr, "usage: %s [-c] [-o output-dir] kstruct_offsets.in\n", argv[0]);
+		return 1;
+	}
+	input_path = argv[optind];
+	FILE *in = fopen(input_path, "r");
+	if (in == NULL) {
+		perror(input_path);
+		return 1;
+	}
+	parse(in);
+	fclose(in);
+	resolve();
+	if (error_count > 0) {
+		return 2;
+	}
+	// Outputs default to the input's directory; the generated comments name the input only by
+	// its basename so that they do not depend on where the tool was run from.
+	const char *slash = strrchr(input_path, '/');
+	const char *base = (slash != NULL ? slash + 1 : input_path);
+	char *dir = (outdir != NULL ? xstrdup(outdir)
+			: slash != NULL ? strndup(input_path, slash - input_path) : xstrdup("."));
+	char *fields_path, *offsets_path;
+	if (dir == NULL || asprintf(&fields_path, "%s/kstruct_fields.h", dir) < 0
+			|| asprintf(&offsets_path, "%s/kstruct_offsets.c", dir) < 0) {
+		return 1;
+	}
+	bool ok = write_output(fields_path, check, emit_fields_h, base);
+	ok &= write_output(offsets_path, check, emit_offsets_c, base);
+	if (ok && !check) {
+		printf("%zu fields, %zu builds\n", field_count, build_count);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,347 @@
+/*
+ * kstruct_offsets.c
+ * Generated by kstruct_gen from kstruct_offsets.in. Do not edit.
+ */
+#include "kstruct_offsets.h"
+
+static const struct kstruct_offsets offsets__iphone11_8__16C50 = {
+	.name = "iphone11_8__16C50",
+	.ipc_entry__ie_object = 0x0,
+	.ipc_entry__ie_bits = 0x8,
+	.ipc_entry__ie_request = 0x10,
+	.ipc_entry__size = 0x18,
+	.ipc_port__ip_bits = 0x0,
+	.ipc_port__ip_references = 0x4,
+	.ipc_port__waitq_flags = 0x18,
+	.ipc_port__imq_messages = 0x40,
+	.ipc_port__imq_msgcount = 0x50,
+	.ipc_port__imq_qlimit = 0x52,
+	.ipc_port__ip_receiver = 0x60,
+	.ipc_port__ip_kobject = 0x68,
+	.ipc_port__ip_premsg = 0x88,
+	.ipc_port__ip_context = 0x90,
+	.ipc_port__ip_nsrequest = 0x70,
+	.ipc_port__ip_requests = 0x80,
+	.ipc_port__ip_mscount = 0x9c,
+	.ipc_port__ip_srights = 0xa0,
+	.ipc_port__size = 0xa8,
+	.ipc_port__block_size = 0x4000,
+	.ipc_port_request__ipr_soright = 0x0,
+	.ipc_port_request__size = 0x10,
+	.ipc_space__is_table_size = 0x14,
+	.ipc_space__is_table = 0x20,
+	.ipc_voucher__size = 0x50,
+	.ipc_voucher__block_size = 0x4000,
+	.proc__p_pid = 0x60,
+	.proc__p_ucred = 0xf8,
+	.proc__p_fd = 0x108,
+	.filedesc__fd_ofiles = 0x0,
+	.fileproc__f_fglob = 0x8,
+	.fileglob__fg_data = 0x38,
+	.socket__so_pcb = 0x10,
+	.pipe__buffer = 0x10,
+	.sysctl_oid__oid_parent = 0x0,
+	.sysctl_oid__oid_link = 0x8,
+	.sysctl_oid__oid_kind = 0x14,
+	.sysctl_oid__oid_handler = 0x30,
+	.sysctl_oid__oid_version = 0x48,
+	.sysctl_oid__oid_refcnt = 0x4c,
+	.sysctl_oid__size = 0x50,
+	.task__lck_mtx_type = 0xb,
+	.task__ref_count = 0x10,
+	.task__active = 0x14,
+	.task__map = 0x20,
+	.task__next = 0x28,
+	.task__prev = 0x30,
+	.task__itk_space = 0x300,
+	.task__bsd_info = 0x368,
+	.kfree_addr_offset = 0x7c,
+};
+
+static const struct kstruct_offsets offsets__iphone10_1__16B92 = {
+	.name = "iphone10_1__16B92",
+	.ipc_entry__ie_object = 0x0,
+	.ipc_entry__ie_bits = 0x8,
+	.ipc_entry__ie_request = 0x10,
+	.ipc_entry__size = 0x18,
+	.ipc_port__ip_bits = 0x0,
+	.ipc_port__ip_references = 0x4,
+	.ipc_port__waitq_flags = 0x18,
+	.ipc_port__imq_messages = 0x40,
+	.ipc_port__imq_msgcount = 0x50,
+	.ipc_port__imq_qlimit = 0x52,
+	.ipc_port__ip_receiver = 0x60,
+	.ipc_port__ip_kobject = 0x68,
+	.ipc_port__ip_premsg = 0x88,
+	.ipc_port__ip_context = 0x90,
+	.ipc_port__ip_nsrequest = 0x70,
+	.ipc_port__ip_requests = 0x80,
+	.ipc_port__ip_mscount = 0x9c,
+	.ipc_port__ip_srights = 0xa0,
+	.ipc_port__size = 0xa8,
+	.ipc_port__block_size = 0x4000,
+	.ipc_port_request__ipr_soright = 0x0,
+	.ipc_port_request__size = 0x10,
+	.ipc_space__is_table_size = 0x14,
+	.ipc_space__is_table = 0x20,
+	.ipc_voucher__size = 0x50,
+	.ipc_voucher__block_size = 0x4000,
+	.proc__p_pid = 0x60,
+	.proc__p_ucred = 0xf8,
+	.proc__p_fd = 0x108,
+	.filedesc__fd_ofiles = 0x0,
+	.fileproc__f_fglob = 0x8,
+	.fileglob__fg_data = 0x38,
+	.socket__so_pcb = 0x10,
+	.pipe__buffer = 0x10,
+	.sysctl_oid__oid_parent = 0x0,
+	.sysctl_oid__oid_link = 0x8,
+	.sysctl_oid__oid_kind = 0x14,
+	.sysctl_oid__oid_handler = 0x30,
+	.sysctl_oid__oid_version = 0x48,
+	.sysctl_oid__oid_refcnt = 0x4c,
+	.sysctl_oid__size = 0x50,
+	.task__lck_mtx_type = 0xb,
+	.task__ref_count = 0x10,
+	.task__active = 0x14,
+	.task__map = 0x20,
+	.task__next = 0x28,
+	.task__prev = 0x30,
+	.task__itk_space = 0x300,
+	.task__bsd_info = 0x358,
+	.kfree_addr_offset = 0x7c,
+};
+
+static const struct kstruct_offsets offsets__ios_11_0 = {
+	.name = "ios_11_0",
+	.ipc_entry__ie_object = 0x0,
+	.ipc_entry__ie_bits = 0x8,
+	.ipc_entry__ie_request = 0x10,
+	.ipc_entry__size = 0x18,
+	.ipc_port__ip_bits = 0x0,
+	.ipc_port__ip_references = 0x4,
+	.ipc_port__waitq_flags = 0x18,
+	.ipc_port__imq_messages = 0x40,
+	.ipc_port__imq_msgcount = 0x50,
+	.ipc_port__imq_qlimit = 0x52,
+	.ipc_port__ip_receiver = 0x60,
+	.ipc_port__ip_kobject = 0x68,
+	.ipc_port__ip_premsg = 0x88,
+	.ipc_port__ip_context = 0x90,
+	.ipc_port__ip_nsrequest = 0x70,
+	.ipc_port__ip_requests = 0x80,
+	.ipc_port__ip_mscount = 0x9c,
+	.ipc_port__ip_srights = 0xa0,
+	.ipc_port__size = 0xa8,
+	.ipc_port__block_size = 0x4000,
+	.ipc_port_request__ipr_soright = 0x0,
+	.ipc_port_request__size = 0x10,
+	.ipc_space__is_table_size = 0x14,
+	.ipc_space__is_table = 0x20,
+	.ipc_voucher__size = 0x50,
+	.ipc_voucher__block_size = 0x4000,
+	.proc__p_pid = 0x10,
+	.proc__p_ucred = 0xf8,
+	.proc__p_fd = 0x108,
+	.filedesc__fd_ofiles = 0x0,
+	.fileproc__f_fglob = 0x8,
+	.fileglob__fg_data = 0x38,
+	.socket__so_pcb = 0x10,
+	.pipe__buffer = 0x10,
+	.sysctl_oid__oid_parent = 0x0,
+	.sysctl_oid__oid_link = 0x8,
+	.sysctl_oid__oid_kind = 0x14,
+	.sysctl_oid__oid_handler = 0x30,
+	.sysctl_oid__oid_version = 0x48,
+	.sysctl_oid__oid_refcnt = 0x4c,
+	.sysctl_oid__size = 0x50,
+	.task__lck_mtx_type = 0xb,
+	.task__ref_count = 0x10,
+	.task__active = 0x14,
+	.task__map = 0x20,
+	.task__next = 0x28,
+	.task__prev = 0x30,
+	.task__itk_space = 0x308,
+	.task__bsd_info = 0x368,
+	.kfree_addr_offset = 0x6c,
+};
+
+static const struct kstruct_offsets offsets__ios_11_3 = {
+	.name = "ios_11_3",
+	.ipc_entry__ie_object = 0x0,
+	.ipc_entry__ie_bits = 0x8,
+	.ipc_entry__ie_request = 0x10,
+	.ipc_entry__size = 0x18,
+	.ipc_port__ip_bits = 0x0,
+	.ipc_port__ip_references = 0x4,
+	.ipc_port__waitq_flags = 0x18,
+	.ipc_port__imq_messages = 0x40,
+	.ipc_port__imq_msgcount = 0x50,
+	.ipc_port__imq_qlimit = 0x52,
+	.ipc_port__ip_receiver = 0x60,
+	.ipc_port__ip_kobject = 0x68,
+	.ipc_port__ip_premsg = 0x88,
+	.ipc_port__ip_context = 0x90,
+	.ipc_port__ip_nsrequest = 0x70,
+	.ipc_port__ip_requests = 0x80,
+	.ipc_port__ip_mscount = 0x9c,
+	.ipc_port__ip_srights = 0xa0,
+	.ipc_port__size = 0xa8,
+	.ipc_port__block_size = 0x4000,
+	.ipc_port_request__ipr_soright = 0x0,
+	.ipc_port_request__size = 0x10,
+	.ipc_space__is_table_size = 0x14,
+	.ipc_space__is_table = 0x20,
+	.ipc_voucher__size = 0x50,
+	.ipc_voucher__block_size = 0x4000,
+	.proc__p_pid = 0x10,
+	.proc__p_ucred = 0xf8,
+	.proc__p_fd = 0x108,
+	.filedesc__fd_ofiles = 0x0,
+	.fileproc__f_fglob = 0x8,
+	.fileglob__fg_data = 0x38,
+	.socket__so_pcb = 0x10,
+	.pipe__buffer = 0x10,
+	.sysctl_oid__oid_parent = 0x0,
+	.sysctl_oid__oid_link = 0x8,
+	.sysctl_oid__oid_kind = 0x14,
+	.sysctl_oid__oid_handler = 0x30,
+	.sysctl_oid__oid_version = 0x48,
+	.sysctl_oid__oid_refcnt = 0x4c,
+	.sysctl_oid__size = 0x50,
+	.task__lck_mtx_type = 0xb,
+	.task__ref_count = 0x10,
+	.task__active = 0x14,
+	.task__map = 0x20,
+	.task__next = 0x28,
+	.task__prev = 0x30,
+	.task__itk_space = 0x308,
+	.task__bsd_info = 0x368,
+	.kfree_addr_offset = 0x7c,
+};
+
+static const struct kstruct_offsets offsets__generic = {
+	.name = "generic",
+	.ipc_entry__ie_object = 0x0,
+	.ipc_entry__ie_bits = 0x8,
+	.ipc_entry__ie_request = 0x10,
+	.ipc_entry__size = 0x18,
+	.ipc_port__ip_bits = 0x0,
+	.ipc_port__ip_references = 0x4,
+	.ipc_port__waitq_flags = 0x18,
+	.ipc_port__imq_messages = 0x40,
+	.ipc_port__imq_msgcount = 0x50,
+	.ipc_port__imq_qlimit = 0x52,
+	.ipc_port__ip_receiver = 0x60,
+	.ipc_port__ip_kobject = 0x68,
+	.ipc_port__ip_premsg = 0x88,
+	.ipc_port__ip_context = 0x90,
+	.ipc_port__ip_nsrequest = 0x70,
+	.ipc_port__ip_requests = 0x80,
+	.ipc_port__ip_mscount = 0x9c,
+	.ipc_port__ip_srights = 0xa0,
+	.ipc_port__size = 0xa8,
+	.ipc_port__block_size = 0x4000,
+	.ipc_port_request__ipr_soright = 0x0,
+	.ipc_port_request__size = 0x10,
+	.ipc_space__is_table_size = 0x14,
+	.ipc_space__is_table = 0x20,
+	.ipc_voucher__size = 0x50,
+	.ipc_voucher__block_size = 0x4000,
+	.proc__p_pid = 0x60,
+	.proc__p_ucred = 0xf8,
+	.proc__p_fd = 0x108,
+	.filedesc__fd_ofiles = 0x0,
+	.fileproc__f_fglob = 0x8,
+	.fileglob__fg_data = 0x38,
+	.socket__so_pcb = 0x10,
+	.pipe__buffer = 0x10,
+	.sysctl_oid__oid_parent = 0x0,
+	.sysctl_oid__oid_link = 0x8,
+	.sysctl_oid__oid_kind = 0x14,
+	.sysctl_oid__oid_handler = 0x30,
+	.sysctl_oid__oid_version = 0x48,
+	.sysctl_oid__oid_refcnt = 0x4c,
+	.sysctl_oid__size = 0x50,
+	.task__lck_mtx_type = 0xb,
+	.task__ref_count = 0x10,
+	.task__active = 0x14,
+	.task__map = 0x20,
+	.task__next = 0x28,
+	.task__prev = 0x30,
+	.task__itk_space = 0x300,
+	.task__bsd_info = 0x358,
+	.kfree_addr_offset = 0x7c,
+};
+
+static const struct kstruct_offsets offsets__ios_12 = {
+	.name = "ios_12",
+	.ipc_entry__ie_object = 0x0,
+	.ipc_entry__ie_bits = 0x8,
+	.ipc_entry__ie_request = 0x10,
+	.ipc_entry__size = 0x18,
+	.ipc_port__ip_bits = 0x0,
+	.ipc_port__ip_references = 0x4,
+	.ipc_port__waitq_flags = 0x18,
+	.ipc_port__imq_messages = 0x40,
+	.ipc_port__imq_msgcount = 0x50,
+	.ipc_port__imq_qlimit = 0x52,
+	.ipc_port__ip_receiver = 0x60,
+	.ipc_port__ip_kobject = 0x68,
+	.ipc_port__ip_premsg = 0x88,
+	.ipc_port__ip_context = 0x90,
+	.ipc_port__ip_nsrequest = 0x70,
+	.ipc_port__ip_requests = 0x80,
+	.ipc_port__ip_mscount = 0x9c,
+	.ipc_port__ip_srights = 0xa0,
+	.ipc_port__size = 0xa8,
+	.ipc_port__block_size = 0x4000,
+	.ipc_port_request__ipr_soright = 0x0,
+	.ipc_port_request__size = 0x10,
+	.ipc_space__is_table_size = 0x14,
+	.ipc_space__is_table = 0x20,
+	.ipc_voucher__size = 0x50,
+	.ipc_voucher__block_size = 0x4000,
+	.proc__p_pid = 0x60,
+	.proc__p_ucred = 0xf8,
+	.proc__p_fd = 0x108,
+	.filedesc__fd_ofiles = 0x0,
+	.fileproc__f_fglob = 0x8,
+	.fileglob__fg_data = 0x38,
+	.socket__so_pcb = 0x10,
+	.pipe__buffer = 0x10,
+	.sysctl_oid__oid_parent = 0x0,
+	.sysctl_oid__oid_link = 0x8,
+	.sysctl_oid__oid_kind = 0x14,
+	.sysctl_oid__oid_handler = 0x30,
+	.sysctl_oid__oid_version = 0x48,
+	.sysctl_oid__oid_refcnt = 0x4c,
+	.sysctl_oid__size = 0x50,
+	.task__lck_mtx_type = 0xb,
+	.task__ref_count = 0x10,
+	.task__active = 0x14,
+	.task__map = 0x20,
+	.task__next = 0x28,
+	.task__prev = 0x30,
+	.task__itk_space = 0x300,
+	.task__bsd_info = 0x368,
+	.kfree_addr_offset = 0x7c,
+};
+
+const struct kstruct_offsets_entry kstruct_offsets_db[] = {
+	{ { "iPhone11,*", "16A366-16C104" }, &offsets__iphone11_8__16C50 },
+	{ { "iPhone10,1", "16A366-16C101" }, &offsets__iphone10_1__16B92 },
+	{ { "*", "*" }, &offsets__generic },
+};
+
+const size_t kstruct_offsets_db_count = 3;
+
+const struct kstruct_offsets_entry koffset_db[] = {
+	{ { "iPhone11,*", "16A366-16C104" }, &offsets__iphone11_8__16C50 },
+	{ { "iPhone10,1", "16A366-16C101" }, &offsets__iphone10_1__16B92 },
+	{ { "*", "*-15D99999" }, &offsets__ios_11_0 },
+	{ { "*", "15E0-15Z99999" }, &offsets__ios_11_3 },
+	{ { "*", "*" }, &offsets__ios_12 },
+};
+
+const size_t koffset_db_count = 5;
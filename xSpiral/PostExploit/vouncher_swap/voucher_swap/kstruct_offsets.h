@@ -0,0 +1,85 @@
+/*
+ * kstruct_offsets.h
+ * xSpiral
+ */
+#ifndef VOUCHER_SWAP__KSTRUCT_OFFSETS_H_
+#define VOUCHER_SWAP__KSTRUCT_OFFSETS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kstruct_fields.h"
+#include "platform_match.h"
+
+/*
+ * struct kstruct_offsets
+ *
+ * Description:
+ * 	The kernel structure offsets and sizes for one build, generated from kstruct_offsets.in.
+ * 	Offsets are named <struct>__<field>, sizes <struct>__size and zalloc block sizes
+ * 	<struct>__block_size; the KSTRUCT_* lists in kstruct_fields.h enumerate them.
+ */
+struct kstruct_offsets {
+	const char *name;
+#define KSTRUCT_OFFSET_MEMBER(struct_, field_)	uint32_t struct_##__##field_;
+#define KSTRUCT_SIZE_MEMBER(struct_)		uint32_t struct_##__size;
+#define KSTRUCT_BLOCK_SIZE_MEMBER(struct_)	uint32_t struct_##__block_size;
+#define KSTRUCT_VALUE_MEMBER(name_)		uint32_t name_;
+	KSTRUCT_OFFSETS(KSTRUCT_OFFSET_MEMBER)
+	KSTRUCT_SIZES(KSTRUCT_SIZE_MEMBER)
+	KSTRUCT_BLOCK_SIZES(KSTRUCT_BLOCK_SIZE_MEMBER)
+	KSTRUCT_VALUES(KSTRUCT_VALUE_MEMBER)
+#undef KSTRUCT_OFFSET_MEMBER
+#undef KSTRUCT_SIZE_MEMBER
+#undef KSTRUCT_BLOCK_SIZE_MEMBER
+#undef KSTRUCT_VALUE_MEMBER
+};
+
+/*
+ * struct kstruct_offsets_entry
+ *
+ * Description:
+ * 	The platforms a build's offsets apply to, in the platform_matches() formats.
+ */
+struct kstruct_offsets_entry {
+	struct platform_match_spec match;
+	const struct kstruct_offsets *offsets;
+};
+
+/*
+ * kstruct_offsets_db
+ *
+ * Description:
+ * 	The table parameters_init() selects from, generated in kstruct_offsets.c from the builds in
+ * 	kstruct_offsets.in that are not marked "for koffset", in that order. The first entry that
+ * 	matches the platform applies. Edit kstruct_offsets.in and regenerate with kstruct_gen
+ * 	rather than editing the table by hand.
+ */
+extern const struct kstruct_offsets_entry kstruct_offsets_db[];
+
+/*
+ * kstruct_offsets_db_count
+ *
+ * Description:
+ * 	The number of entries in kstruct_offsets_db.
+ */
+extern const size_t kstruct_offsets_db_count;
+
+/*
+ * koffset_db
+ *
+ * Description:
+ * 	The table koffset() selects from, generated the same way from the builds in
+ * 	kstruct_offsets.in that are not marked "for parameters".
+ */
+extern const struct kstruct_offsets_entry koffset_db[];
+
+/*
+ * koffset_db_count
+ *
+ * Description:
+ * 	The number of entries in koffset_db.
+ */
+extern const size_t koffset_db_count;
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * log_bench.c
+ * xSpiral
+ *
+ * Host tool that checks log_ring against the stderr backend and times the two. Every message in
+ * a table of formats is logged through the ring and dumped, and the text after the prefix must
+ * equal what vsnprintf makes of the same arguments. Several threads then log at once into the
+ * ring, and every message has to come out as either dumped or dropped. Last, the same message is
+ * logged through both backends, with stderr sent to /dev/null, and the cost per message is
+ * reported. The exit status is nonzero on any mismatch.
+ */
+
+/*
+ * Not part of the app. Build from this directory with
+ *     cc -O2 -pthread -D_GNU_SOURCE '-D__printflike(f,a)=__attribute__((format(printf,f,a)))' \
+ *        -o log_bench log_bench.c log.c log_ring.c
+ * (the define stands in for the one in Apple's <sys/cdefs.h>) and run e.g. "./log_bench -n 1000000 -t 4".
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "log_ring.h"
+
+static unsigned failures;
+
+static double
+now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Log one message through the ring and compare the dumped text with vsnprintf's.
+static void __printflike(1, 2)
+check(const char *format, ...) {
+	char expected[512];
+	char *dump = NULL;
+	size_t size = 0;
+	va_list ap;
+	va_start(ap, format);
+	vsnprintf(expected, sizeof(expected), format, ap);
+	va_end(ap);
+
+	log_ring_reset();
+	va_start(ap, format);
+	log_ring('I', format, ap);
+	va_end(ap);
+	FILE *stream = open_memstream(&dump, &size);
+	size_t count = log_ring_dump(stream);
+	fclose(stream);
+
+	// "[+] 0.000000 " and a newline around the message.
+	const char *message = (dump != NULL ? strchr(dump, ' ') : NULL);
+	message = (message != NULL ? strchr(message + 1, ' ') : NULL);
+	int ok = (count == 1 && message != NULL && size > 0 && dump[size - 1] == '\n'
+			&& strlen(message + 1) == strlen(expected) + 1
+			&& strncmp(message + 1, expected, strlen(expected)) == 0);
+	if (!ok) {
+		printf("MISMATCH %-24s expected \"%s\", got \"%s\"\n", format, expected,
+				dump != NULL ? dump : "");
+		failures++;
+	}
+	free(dump);
+}
+
+static void
+check_conversions() {
+	int n = -42;
+	check("plain text");
+	check("100%% done");
+	check("%d %i %d", 0, -1, n);
+	check("%d %d", 2147483647, (int) -2147483647 - 1);
+	check("%hhd %hd %hhu %hu", (char) -5, (short) -300, (unsigned char) 250, (unsigned short) 65000);
+	check("%ld %lld %jd %zd %td", -1L, -9223372036854775807LL - 1, (intmax_t) 7,
+			(ssize_t) -8, (ptrdiff_t) -9);
+	check("%u %lu %llu %zu", 4294967295u, 123456789UL, 18446744073709551615ULL, (size_t) 3);
+	check("%x %X %#x %08x %-8x|", 0xdeadbeefu, 0xcafeu, 0x10u, 0x1234u, 0xabu);
+	check("%llx %016llx %#llx", 0xfffffff007004000ULL, 0x1ULL, 0xfffffff00741c100ULL);
+	check("%o %#o", 8u, 64u);
+	check("%c%c%c", 'a', 'b', 'c');
+	check("%p %p", (void *) 0x1000, (void *) 0);
+	check("%f %.3f %e %g %a", 1.5, -2.0 / 3, 12345.678, 0.0001, 1.0);
+	check("%s and %s", "one", "two");
+	check("%-10s|%10s|%.2s", "left", "right", "truncated");
+	check("%s", (const char *) "");
+	check("%*d|%-*d|%.*s", 6, 42, 6, 42, 3, "abcdef");
+	check("[%s] %s: 0x%llx (%d)", "task", "bsd_info", 0x368ULL, 3);
+	check("%d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8);
+	check("%+d % d %05d", 5, 5, -5);
+}
+
+// ---- Concurrency -------------------------------------------------------------------------------
+
+struct producer {
+	unsigned id;
+	unsigned count;
+};
+
+static void *
+produce(void *arg) {
+	struct producer *p = arg;
+	for (unsigned i = 0; i < p->count; i++) {
+		log_internal('D', "thread %u message %u of %s", p->id, i, "producer");
+	}
+	return NULL;
+}
+
+static void
+check_threads(unsigned nthreads, unsigned count) {
+	pthread_t threads[nthreads];
+	struct producer producers[nthreads];
+	log_ring_reset();
+	uint64_t dropped = log_ring_dropped();
+	log_implementation = log_ring;
+	for (unsigned i = 0; i < nthreads; i++) {
+		producers[i] = (struct producer) { i, count };
+		pthread_create(&threads[i], NULL, produce, &producers[i]);
+	}
+	for (unsigned i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	FILE *null = fopen("/dev/null", "w");
+	size_t dumped = log_ring_dump(null);
+	fclose(null);
+	dropped = log_ring_dropped() - dropped;
+	uint64_t total = (uint64_t) nthreads * count;
+	printf("%u threads x %u messages: %zu dumped, %llu dropped  %s\n", nthreads, count, dumped,
+			(unsigned long long) dropped, dumped + dropped == total ? "ok" : "MISMATCH");
+	if (dumped + dropped != total || dumped > LOG_RING_SIZE) {
+		failures++;
+	}
+}
+
+// ---- Benchmark ---------------------------------------------------------------------------------
+
+static double
+time_backend(void (*backend)(char, const char *, va_list), unsigned count) {
+	log_implementation = backend;
+	double t = now_ns();
+	for (unsigned i = 0; i < count; i++) {
+		log_internal('I', "%s: port 0x%x, kaddr 0x%llx, %u of %u", "voucher_swap", 0x1103u,
+				0xfffffff0073c1000ULL, i, count);
+	}
+	return (now_ns() - t) / count;
+}
+
+int
+main(int argc, char **argv) {
+	unsigned count = 1000000, nthreads = 4;
+	int ch;
+	while ((ch = getopt(argc, argv, "n:t:")) != -1) {
+		switch (ch) {
+			case 'n': count = strtoul(optarg, NULL, 0); break;
+			case 't': nthreads = strtoul(optarg, NULL, 0); break;
+			default: goto usage;
+		}
+	}
+	if (optind != argc || count == 0 || nthreads == 0) {
+usage:
+		fprintf(stderr, "usage: %s [-n messages] [-t threads]\n", argv[0]);
+		return 1;
+	}
+	void (*log_stderr)(char, const char *, va_list) = log_implementation;
+
+	check_conversions();
+	printf("conversions: %s\n", failures ? "MISMATCH" : "ok");
+	check_threads(nthreads, count / nthreads > 100000 ? 100000 : count / nthreads);
+
+	// stderr goes to /dev/null for the timing, so only the cost of the call is measured.
+	fflush(stderr);
+	int saved = dup(STDERR_FILENO);
+	int null = open("/dev/null", O_WRONLY);
+	dup2(null, STDERR_FILENO);
+	close(null);
+	double stderr_ns = time_backend(log_stderr, count);
+	log_ring_reset();
+	double ring_ns = time_backend(log_ring, count);
+	fflush(stderr);
+	dup2(saved, STDERR_FILENO);
+	close(saved);
+	log_implementation = log_stderr;
+
+	FILE *devnull = fopen("/dev/null", "w");
+	double t = now_ns();
+	size_t dumped = log_ring_dump(devnull);
+	t = now_ns() - t;
+	fclose(devnull);
+
+	printf("%u messages: log_stderr %.1f ns each, log_ring %.1f ns each (%.1fx)\n", count,
+			stderr_ns, ring_ns, ring_ns > 0 ? stderr_ns / ring_ns : 0);
+	printf("dumping the %zu kept messages later took %.1f ns each\n", dumped,
+			dumped ? t / dumped : 0);
+	return failures ? 2 : 0;
+}
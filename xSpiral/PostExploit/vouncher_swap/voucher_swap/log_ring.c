@@ -0,0 +1,405 @@
+/*
+ * log_ring.c
+ * xSpiral
+ */
+#include "log_ring.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+// ---- Ring storage ------------------------------------------------------------------------------
+
+// The maximum number of raw argument words stored per message. Each '*' width or precision
+// counts as one argument.
+#define LOG_RING_MAX_ARGS	8
+
+// The space for copies of %s arguments in each message.
+#define LOG_RING_STRING_SIZE	96
+
+// Stored in place of a string offset for a NULL %s argument.
+#define NULL_STRING		((uint64_t)(-1))
+
+// The sequence of a record that a producer is writing.
+#define SLOT_BUSY		((uint64_t)(-1))
+
+// One captured message.
+struct log_record {
+	// The message's index in the ring plus one, stored after everything else is written. It
+	// is SLOT_BUSY while a producer is writing the record.
+	_Atomic uint64_t sequence;
+	uint64_t timestamp;
+	const char *format;
+	char type;
+	uint8_t arg_count;
+	uint8_t string_length;
+	uint64_t args[LOG_RING_MAX_ARGS];
+	char strings[LOG_RING_STRING_SIZE];
+};
+
+// The ring itself. Producers claim slots by incrementing head; the dumper starts at tail.
+static struct log_record ring[LOG_RING_SIZE];
+static _Atomic uint64_t ring_head;
+static uint64_t ring_tail;
+static uint64_t ring_dropped;
+
+// A monotonic timestamp in nanoseconds.
+static uint64_t
+timestamp_ns() {
+#ifdef __APPLE__
+	static mach_timebase_info_data_t timebase;
+	if (timebase.denom == 0) {
+		mach_timebase_info(&timebase);
+	}
+	return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// ---- Format parsing ----------------------------------------------------------------------------
+
+// The length modifier of a conversion.
+enum length {
+	LENGTH_NONE,
+	LENGTH_HH,
+	LENGTH_H,
+	LENGTH_L,
+	LENGTH_LL,
+	LENGTH_J,
+	LENGTH_Z,
+	LENGTH_T,
+	LENGTH_BIG_L,
+};
+
+// A single parsed conversion specification.
+struct conversion {
+	const char *start;	// The '%'.
+	const char *end;	// Just past the conversion character.
+	unsigned stars;		// The number of '*' widths and precisions.
+	enum length length;
+	char conversion;	// 0 if the format ended in the middle of the specification.
+};
+
+// Find the next conversion in the format, skipping literal text. Returns false at the end of
+// the format.
+static bool
+next_conversion(const char **format, struct conversion *conv) {
+	const char *p = strchr(*format, '%');
+	if (p == NULL) {
+		*format += strlen(*format);
+		return false;
+	}
+	conv->start = p++;
+	conv->stars = 0;
+	conv->length = LENGTH_NONE;
+	// Flags, width and precision.
+	while (*p != 0 && strchr("-+ #0123456789.*'", *p) != NULL) {
+		conv->stars += (*p == '*');
+		p++;
+	}
+	// Length modifier.
+	switch (*p) {
+		case 'h': conv->length = (p[1] == 'h' ? LENGTH_HH : LENGTH_H);  break;
+		case 'l': conv->length = (p[1] == 'l' ? LENGTH_LL : LENGTH_L);  break;
+		case 'q': conv->length = LENGTH_LL;                             break;
+		case 'j': conv->length = LENGTH_J;                              break;
+		case 'z': conv->length = LENGTH_Z;                              break;
+		case 't': conv->length = LENGTH_T;                              break;
+		case 'L': conv->length = LENGTH_BIG_L;                          break;
+	}
+	if (conv->length == LENGTH_HH || conv->length == LENGTH_LL) {
+		p += (*p == 'q' ? 1 : 2);
+	} else if (conv->length != LENGTH_NONE) {
+		p++;
+	}
+	conv->conversion = *p;
+	if (*p != 0) {
+		p++;
+	}
+	conv->end = p;
+	*format = p;
+	return true;
+}
+
+// ---- Capture -----------------------------------------------------------------------------------
+
+// Pull one argument for the conversion off the va_list, as a raw 64-bit word.
+static uint64_t
+capture_arg(const struct conversion *conv, va_list *ap, struct log_record *record) {
+	switch (conv->conversion) {
+		case 'd': case 'i':
+			switch (conv->length) {
+				case LENGTH_L:  return (uint64_t) va_arg(*ap, long);
+				case LENGTH_LL: return (uint64_t) va_arg(*ap, long long);
+				case LENGTH_J:  return (uint64_t) va_arg(*ap, intmax_t);
+				case LENGTH_Z:  return (uint64_t) va_arg(*ap, ssize_t);
+				case LENGTH_T:  return (uint64_t) va_arg(*ap, ptrdiff_t);
+				default:        return (uint64_t) va_arg(*ap, int);
+			}
+		case 'o': case 'u': case 'x': case 'X':
+			switch (conv->length) {
+				case LENGTH_L:  return va_arg(*ap, unsigned long);
+				case LENGTH_LL: return va_arg(*ap, unsigned long long);
+				case LENGTH_J:  return va_arg(*ap, uintmax_t);
+				case LENGTH_Z:  return va_arg(*ap, size_t);
+				case LENGTH_T:  return (uint64_t) va_arg(*ap, ptrdiff_t);
+				default:        return va_arg(*ap, unsigned);
+			}
+		case 'c':
+			return (uint64_t) va_arg(*ap, int);
+		case 'p':
+			return (uint64_t) (uintptr_t) va_arg(*ap, void *);
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+			double value = (conv->length == LENGTH_BIG_L
+					? (double) va_arg(*ap, long double)
+					: va_arg(*ap, double));
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+		case 's': {
+			const char *string = va_arg(*ap, const char *);
+			if (string == NULL) {
+				return NULL_STRING;
+			}
+			// Copy as much of the string as fits; it's truncated rather than dropped.
+			size_t offset = record->string_length;
+			size_t space = LOG_RING_STRING_SIZE - offset;
+			size_t length = strnlen(string, space > 0 ? space - 1 : 0);
+			if (space > 0) {
+				memcpy(record->strings + offset, string, length);
+				record->strings[offset + length] = 0;
+				record->string_length = (uint8_t) (offset + length + 1);
+			} else {
+				offset = LOG_RING_STRING_SIZE - 1;
+			}
+			return offset;
+		}
+		case 'n':
+			(void) va_arg(*ap, int *);
+			return 0;
+		default:
+			return 0;
+	}
+}
+
+void
+log_ring(char type, const char *format, va_list ap) {
+	uint64_t timestamp = timestamp_ns();
+	uint64_t index = atomic_fetch_add_explicit(&ring_head, 1, memory_order_relaxed);
+	struct log_record *record = &ring[index % LOG_RING_SIZE];
+	// A producer that was lapped while writing may still hold the slot. The message is dropped
+	// then rather than mixed into the other one; the dump counts it as overwritten.
+	uint64_t sequence = atomic_load_explicit(&record->sequence, memory_order_relaxed);
+	if (sequence == SLOT_BUSY || !atomic_compare_exchange_strong_explicit(&record->sequence,
+			&sequence, SLOT_BUSY, memory_order_acquire, memory_order_relaxed)) {
+		return;
+	}
+	atomic_thread_fence(memory_order_release);
+	record->timestamp = timestamp;
+	record->format = format;
+	record->type = type;
+	record->arg_count = 0;
+	record->string_length = 0;
+	// The last byte of the string space is always a NUL for strings that didn't fit.
+	record->strings[LOG_RING_STRING_SIZE - 1] = 0;
+	va_list args;
+	va_copy(args, ap);
+	struct conversion conv;
+	const char *p = format;
+	while (next_conversion(&p, &conv)) {
+		if (conv.conversion == '%' || conv.conversion == 0) {
+			continue;
+		}
+		if (record->arg_count + conv.stars + 1 > LOG_RING_MAX_ARGS) {
+			// The rest of the message is dropped; formatting stops at this conversion.
+			break;
+		}
+		for (unsigned i = 0; i < conv.stars; i++) {
+			record->args[record->arg_count++] = (uint64_t) va_arg(args, int);
+		}
+		record->args[record->arg_count++] = capture_arg(&conv, &args, record);
+	}
+	va_end(args);
+	atomic_store_explicit(&record->sequence, index + 1, memory_order_release);
+}
+
+// ---- Formatting --------------------------------------------------------------------------------
+
+// Append formatted text to a line buffer, keeping it NUL-terminated.
+static void
+append(char *line, size_t size, size_t *used, const char *text, size_t length) {
+	if (*used + length >= size) {
+		length = size - *used - 1;
+	}
+	memcpy(line + *used, text, length);
+	*used += length;
+	line[*used] = 0;
+}
+
+// Format a single argument with its conversion specification.
+static void
+format_arg(char *line, size_t size, size_t *used, const struct conversion *conv,
+		const uint64_t *args, const struct log_record *record) {
+	char spec[32];
+	size_t spec_length = conv->end - conv->start;
+	if (spec_length >= sizeof(spec)) {
+		append(line, size, used, conv->start, spec_length);
+		return;
+	}
+	memcpy(spec, conv->start, spec_length);
+	spec[spec_length] = 0;
+	int star0 = (int) args[0];
+	int star1 = (int) args[1];
+	uint64_t raw = args[conv->stars];
+	char *out = line + *used;
+	size_t left = size - *used;
+#define FORMAT_AS(value_)								\
+	do {										\
+		int n_;									\
+		switch (conv->stars) {							\
+			case 0:  n_ = snprintf(out, left, spec, value_);               break; \
+			case 1:  n_ = snprintf(out, left, spec, star0, value_);        break; \
+			default: n_ = snprintf(out, left, spec, star0, star1, value_); break; \
+		}									\
+		if (n_ > 0) {								\
+			*used += ((size_t) n_ < left ? (size_t) n_ : left - 1);		\
+		}									\
+	} while (0)
+	switch (conv->conversion) {
+		case 'd': case 'i':
+		case 'o': case 'u': case 'x': case 'X':
+			switch (conv->length) {
+				case LENGTH_HH:
+				case LENGTH_H:
+				case LENGTH_NONE:  FORMAT_AS((int) raw);                break;
+				case LENGTH_L:     FORMAT_AS((long) raw);               break;
+				case LENGTH_J:     FORMAT_AS((intmax_t) raw);           break;
+				case LENGTH_Z:     FORMAT_AS((size_t) raw);             break;
+				case LENGTH_T:     FORMAT_AS((ptrdiff_t) raw);          break;
+				default:           FORMAT_AS((long long) raw);          break;
+			}
+			break;
+		case 'c':
+			FORMAT_AS((int) raw);
+			break;
+		case 'p':
+			FORMAT_AS((void *) (uintptr_t) raw);
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+			double value;
+			memcpy(&value, &raw, sizeof(value));
+			if (conv->length == LENGTH_BIG_L) {
+				FORMAT_AS((long double) value);
+			} else {
+				FORMAT_AS(value);
+			}
+			break;
+		}
+		case 's':
+			FORMAT_AS(raw == NULL_STRING ? (const char *) NULL : record->strings + raw);
+			break;
+		default:
+			break;
+	}
+#undef FORMAT_AS
+}
+
+// Format a captured message into a line buffer.
+static void
+format_record(const struct log_record *record, char *line, size_t size) {
+	size_t used = 0;
+	size_t arg = 0;
+	const char *p = record->format;
+	const char *text = p;
+	struct conversion conv;
+	line[0] = 0;
+	while (next_conversion(&p, &conv)) {
+		append(line, size, &used, text, conv.start - text);
+		text = conv.end;
+		if (conv.conversion == '%') {
+			append(line, size, &used, "%", 1);
+			continue;
+		}
+		if (conv.conversion == 0) {
+			continue;
+		}
+		if (arg + conv.stars + 1 > record->arg_count) {
+			append(line, size, &used, "...", 3);
+			return;
+		}
+		if (conv.conversion != 'n') {
+			format_arg(line, size, &used, &conv, &record->args[arg], record);
+		}
+		arg += conv.stars + 1;
+	}
+	append(line, size, &used, text, p - text);
+}
+
+size_t
+log_ring_dump(FILE *stream) {
+	uint64_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+	uint64_t index = ring_tail;
+	if (head - index > LOG_RING_SIZE) {
+		ring_dropped += head - index - LOG_RING_SIZE;
+		index = head - LOG_RING_SIZE;
+	}
+	size_t count = 0;
+	uint64_t first_timestamp = 0;
+	for (; index < head; index++) {
+		const struct log_record *slot = &ring[index % LOG_RING_SIZE];
+		if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != index + 1) {
+			ring_dropped++;
+			continue;
+		}
+		struct log_record record;
+		memcpy((char *) &record + sizeof(record.sequence),
+				(const char *) slot + sizeof(slot->sequence),
+				sizeof(record) - sizeof(record.sequence));
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != index + 1) {
+			ring_dropped++;
+			continue;
+		}
+		if (count == 0) {
+			first_timestamp = record.timestamp;
+		}
+		char line[1024];
+		format_record(&record, line, sizeof(line));
+		char type = record.type;
+		switch (type) {
+			case 'D': type = 'D'; break;
+			case 'I': type = '+'; break;
+			case 'W': type = '!'; break;
+			case 'E': type = '-'; break;
+		}
+		uint64_t delta = record.timestamp - first_timestamp;
+		fprintf(stream, "[%c] %llu.%06llu %s\n", type,
+				(unsigned long long) (delta / 1000000000),
+				(unsigned long long) (delta % 1000000000 / 1000),
+				line);
+		count++;
+	}
+	ring_tail = head;
+	return count;
+}
+
+uint64_t
+log_ring_dropped() {
+	return ring_dropped;
+}
+
+void
+log_ring_reset() {
+	ring_tail = atomic_load_explicit(&ring_head, memory_order_acquire);
+	ring_dropped = 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * log_ring.h
+ * xSpiral
+ */
+#ifndef VOUCHER_SWAP__LOG_RING_H_
+#define VOUCHER_SWAP__LOG_RING_H_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * LOG_RING_SIZE
+ *
+ * Description:
+ * 	The number of messages the ring holds. Once it is full, each new message overwrites the
+ * 	oldest one.
+ */
+#define LOG_RING_SIZE		1024
+
+/*
+ * log_ring
+ *
+ * Description:
+ * 	A log_implementation that does not format anything or allocate memory. Each message is
+ * 	stored in a preallocated lock-free ring as a timestamp, the format pointer and the raw
+ * 	arguments. Strings passed to %s are copied, up to a small limit, because they may not
+ * 	outlive the call. Use this backend during timing-sensitive phases and format the messages
+ * 	later with log_ring_dump().
+ *
+ * 	Only the standard conversions are supported, with up to 8 arguments per message. %n and
+ * 	long double are not supported.
+ *
+ * Usage:
+ * 	log_implementation = log_ring;
+ * 	...
+ * 	log_ring_dump(stderr);
+ */
+void log_ring(char type, const char *format, va_list ap);
+
+/*
+ * log_ring_dump
+ *
+ * Description:
+ * 	Format every message still in the ring, oldest first, and write it to the given stream.
+ * 	Each line has the same prefix as the stderr backend plus the time since the first message
+ * 	in the ring. Returns the number of messages written. Do not call this while other threads
+ * 	are still logging to the ring.
+ */
+size_t log_ring_dump(FILE *stream);
+
+/*
+ * log_ring_dropped
+ *
+ * Description:
+ * 	The number of messages that were overwritten before they could be dumped.
+ */
+uint64_t log_ring_dropped(void);
+
+/*
+ * log_ring_reset
+ *
+ * Description:
+ * 	Discard all messages in the ring.
+ */
+void log_ring_reset(void);
+
+#endif
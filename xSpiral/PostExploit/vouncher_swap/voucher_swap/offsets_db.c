@@ -0,0 +1,11 @@
+/*
+ * offsets_db.c
+ * Generated by pf_gendb from 0 kernelcaches. Do not edit.
+ */
+#include "offsets_db.h"
+
+const struct offsets_db_entry offsets_db[] = {
+	{ NULL },
+};
+
+const size_t offsets_db_count = 0;
@@ -0,0 +1,59 @@
+/*
+ * offsets_db.h
+ * xSpiral
+ */
+#ifndef VOUCHER_SWAP__OFFSETS_DB_H_
+#define VOUCHER_SWAP__OFFSETS_DB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * OFFSETS_DB_FIELDS
+ *
+ * Description:
+ * 	The kernel addresses recorded per firmware. Each name has a patchfinder
+ * 	function find_<name>() that the generator runs, and a parameter
+ * 	STATIC_ADDRESS(<name>) that parameters_init() fills in.
+ */
+#define OFFSETS_DB_FIELDS(X)		\
+	X(allproc)			\
+	X(add_x0_x0_0x40_ret)		\
+	X(copyout)			\
+	X(bzero)			\
+	X(bcopy)
+
+/*
+ * struct offsets_db_entry
+ *
+ * Description:
+ * 	The unslid kernel addresses for one device and build. A field is 0 if
+ * 	the patchfinder could not find it in that kernelcache.
+ */
+struct offsets_db_entry {
+	const char *device;
+	const char *build;
+#define OFFSETS_DB_FIELD(name_)	uint64_t name_;
+	OFFSETS_DB_FIELDS(OFFSETS_DB_FIELD)
+#undef OFFSETS_DB_FIELD
+};
+
+/*
+ * offsets_db
+ *
+ * Description:
+ * 	The generated database in offsets_db.c, sorted by device and then build
+ * 	(strcmp order). Regenerate it with pf_gendb from RootUnit/patchfinder
+ * 	rather than editing it by hand.
+ */
+extern const struct offsets_db_entry offsets_db[];
+
+/*
+ * offsets_db_count
+ *
+ * Description:
+ * 	The number of entries in offsets_db.
+ */
+extern const size_t offsets_db_count;
+
+#endif
@@ -7,37 +7,16 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/sysctl.h>
-#include <sys/utsname.h>
 
 #include "log.h"
+#include "offsets_db.h"
 #include "platform.h"
 #include "platform_match.h"
 
 // ---- Initialization routines -------------------------------------------------------------------
 
-// A struct describing an initialization.
-struct initialization {
-	const char *devices;
-	const char *builds;
-	void (*init)(void);
-};
-
-// Run initializations matching this platform.
-static size_t
-run_initializations(struct initialization *inits, size_t count) {
-	size_t match_count = 0;
-	for (size_t i = 0; i < count; i++) {
-		struct initialization *init = &inits[i];
-		if (platform_matches(init->devices, init->builds)) {
-			init->init();
-			match_count++;
-		}
-	}
-	return match_count;
-}
-
 // A helper macro to get the number of elements in a static array.
 #define ARRAY_COUNT(x)	(sizeof(x) / sizeof((x)[0]))
 
@@ -55,102 +34,110 @@ init__system_parameters() {
 }
 
 // A list of general system parameter initializations by platform.
-static struct initialization system_parameters[] = {
-	{ "*", "*", init__system_parameters },
+static const struct platform_initialization system_parameters[] = {
+	{ { "*", "*" }, init__system_parameters },
 };
 
-// ---- Offset initialization ---------------------------------------------------------------------
+static struct platform_match_table system_parameters_table;
 
-// Initialization for iPhone11,8 16C50 (and similar devices).
-static void
-offsets__iphone11_8__16C50() {
-	SIZE(ipc_entry)               = 0x18;
-	OFFSET(ipc_entry, ie_object)  =  0;
-	OFFSET(ipc_entry, ie_bits)    =  8;
-	OFFSET(ipc_entry, ie_request) = 16;
-
-	SIZE(ipc_port)                  =   0xa8;
-	BLOCK_SIZE(ipc_port)            = 0x4000;
-	OFFSET(ipc_port, ip_bits)       =   0;
-	OFFSET(ipc_port, ip_references) =   4;
-	OFFSET(ipc_port, waitq_flags)   =  24;
-	OFFSET(ipc_port, imq_messages)  =  64;
-	OFFSET(ipc_port, imq_msgcount)  =  80;
-	OFFSET(ipc_port, imq_qlimit)    =  82;
-	OFFSET(ipc_port, ip_receiver)   =  96;
-	OFFSET(ipc_port, ip_kobject)    = 104;
-	OFFSET(ipc_port, ip_nsrequest)  = 112;
-	OFFSET(ipc_port, ip_requests)   = 128;
-	OFFSET(ipc_port, ip_mscount)    = 156;
-	OFFSET(ipc_port, ip_srights)    = 160;
-
-	SIZE(ipc_port_request)                = 0x10;
-	OFFSET(ipc_port_request, ipr_soright) = 0;
-
-	OFFSET(ipc_space, is_table_size) = 0x14;
-	OFFSET(ipc_space, is_table)      = 0x20;
-
-	SIZE(ipc_voucher)       =   0x50;
-	BLOCK_SIZE(ipc_voucher) = 0x4000;
-
-	OFFSET(proc, p_pid)   = 0x60;
-	OFFSET(proc, p_ucred) = 0xf8;
-
-	SIZE(sysctl_oid)                = 0x50;
-	OFFSET(sysctl_oid, oid_parent)  =  0x0;
-	OFFSET(sysctl_oid, oid_link)    =  0x8;
-	OFFSET(sysctl_oid, oid_kind)    = 0x14;
-	OFFSET(sysctl_oid, oid_handler) = 0x30;
-	OFFSET(sysctl_oid, oid_version) = 0x48;
-	OFFSET(sysctl_oid, oid_refcnt)  = 0x4c;
-
-	OFFSET(task, lck_mtx_type) =   0xb;
-	OFFSET(task, ref_count)    =  0x10;
-	OFFSET(task, active)       =  0x14;
-	OFFSET(task, map)          =  0x20;
-	OFFSET(task, itk_space)    = 0x300;
-	OFFSET(task, bsd_info)     = 0x368;
-}
+// ---- Kernel address database -------------------------------------------------------------------
 
-// Initialization for iPhone10,1 16B92 (and similar devices).
-static void
-offsets__iphone10_1__16B92() {
-	offsets__iphone11_8__16C50();
+// Order database entries by device and then build, the order pf_gendb writes them in.
+static int
+compare_offsets_db_entry(const void *a, const void *b) {
+	const struct offsets_db_entry *x = a;
+	const struct offsets_db_entry *y = b;
+	int cmp = strcmp(x->device, y->device);
+	return (cmp != 0 ? cmp : strcmp(x->build, y->build));
+}
 
-	OFFSET(task, bsd_info) = 0x358;
+// Load the static addresses recorded for exactly this device and build, if there are any.
+static bool
+init__kernel_addresses() {
+	struct offsets_db_entry key = { .device = platform.machine, .build = platform.osversion };
+	const struct offsets_db_entry *entry = bsearch(&key, offsets_db, offsets_db_count,
+			sizeof(offsets_db[0]), compare_offsets_db_entry);
+	if (entry == NULL) {
+		return false;
+	}
+#define INIT_STATIC_ADDRESS(name_)	STATIC_ADDRESS(name_) = entry->name_;
+	OFFSETS_DB_FIELDS(INIT_STATIC_ADDRESS)
+#undef INIT_STATIC_ADDRESS
+	return true;
 }
 
-// Initialize offset parameters whose values are computed from other parameters.
+// ---- Offset initialization ---------------------------------------------------------------------
+
+// Copy the selected offsets into the parameters, then compute the ones that derive from them.
 static void
-initialize_computed_offsets() {
+init__offsets() {
+#define INIT_OFFSET(struct_, field_)	OFFSET(struct_, field_) = kernel_offsets->struct_##__##field_;
+#define INIT_SIZE(struct_)		SIZE(struct_) = kernel_offsets->struct_##__size;
+#define INIT_BLOCK_SIZE(struct_)	BLOCK_SIZE(struct_) = kernel_offsets->struct_##__block_size;
+#define INIT_VALUE(name_)		name_ = kernel_offsets->name_;
+	KSTRUCT_OFFSETS(INIT_OFFSET)
+	KSTRUCT_SIZES(INIT_SIZE)
+	KSTRUCT_BLOCK_SIZES(INIT_BLOCK_SIZE)
+	KSTRUCT_VALUES(INIT_VALUE)
+#undef INIT_OFFSET
+#undef INIT_SIZE
+#undef INIT_BLOCK_SIZE
+#undef INIT_VALUE
 	COUNT_PER_BLOCK(ipc_port) = BLOCK_SIZE(ipc_port) / SIZE(ipc_port);
 	COUNT_PER_BLOCK(ipc_voucher) = BLOCK_SIZE(ipc_voucher) / SIZE(ipc_voucher);
 }
 
-// A list of offset initializations by platform.
-static struct initialization offsets[] = {
-	{ "iPhone11,*", "16A366-16C104", offsets__iphone11_8__16C50  },
-	{ "iPhone10,1", "16A366-16C101", offsets__iphone10_1__16B92  },
-    { "*",          "*",            offsets__iphone10_1__16B92 },
-	{ "*",          "*",            initialize_computed_offsets },
-};
+// ---- Public API --------------------------------------------------------------------------------
 
-// The minimum number of offsets that must match in order to declare a platform initialized.
-static const size_t min_offsets = 2;
+// The offsets tables compiled for platform_match_select().
+static struct platform_match_table kstruct_offsets_table;
+static struct platform_match_table koffset_table;
+
+// The first entry of an offsets table that matches this platform, or NULL.
+static const struct kstruct_offsets *
+select_offsets(struct platform_match_table *table, const struct kstruct_offsets_entry *db,
+		size_t count) {
+	size_t match;
+	if (platform_match_select(table, &db[0].match, count, sizeof(db[0]), &match, 1) == 0) {
+		return NULL;
+	}
+	return db[match].offsets;
+}
 
-// ---- Public API --------------------------------------------------------------------------------
+// Select the offsets for this platform from the parameters_init() and koffset() tables.
+bool
+parameters_select_offsets() {
+	if (kernel_offsets != NULL && koffset_offsets != NULL) {
+		return true;
+	}
+	platform_init();
+	kernel_offsets = select_offsets(&kstruct_offsets_table, kstruct_offsets_db,
+			kstruct_offsets_db_count);
+	koffset_offsets = select_offsets(&koffset_table, koffset_db, koffset_db_count);
+	if (kernel_offsets == NULL || koffset_offsets == NULL) {
+		return false;
+	}
+	DEBUG_TRACE(1, "offsets: %s, koffset: %s", kernel_offsets->name, koffset_offsets->name);
+	return true;
+}
 
 bool
 parameters_init() {
 	// Get general platform info.
 	platform_init();
 	// Initialize general system parameters.
-	run_initializations(system_parameters, ARRAY_COUNT(system_parameters));
+	platform_run_initializations(&system_parameters_table, system_parameters,
+			ARRAY_COUNT(system_parameters));
 	// Initialize offsets.
-	size_t count = run_initializations(offsets, ARRAY_COUNT(offsets));
-	if (count < min_offsets) {
+	if (!parameters_select_offsets()) {
 		ERROR("no offsets for %s %s", platform.machine, platform.osversion);
 		return false;
 	}
+	init__offsets();
+	// Pick up the kernel addresses for this build. Missing ones are left to the patchfinder.
+	if (!init__kernel_addresses()) {
+		DEBUG_TRACE(1, "no kernel addresses for %s %s in the database",
+				platform.machine, platform.osversion);
+	}
 	return true;
 }
@@ -9,6 +9,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "kstruct_offsets.h"
+
 #ifdef PARAMETERS_EXTERN
 #define extern PARAMETERS_EXTERN
 #endif
@@ -58,62 +60,48 @@ extern size_t max_ool_ports_per_message;
 // How much to allocate between sleeps while trying to trigger garbage collection.
 extern size_t gc_step;
 
-// Parameters for ipc_entry.
-extern size_t SIZE(ipc_entry);
-extern size_t OFFSET(ipc_entry, ie_object);
-extern size_t OFFSET(ipc_entry, ie_bits);
-extern size_t OFFSET(ipc_entry, ie_request);
-
-// Parameters for ipc_port.
-extern size_t SIZE(ipc_port);
-extern size_t BLOCK_SIZE(ipc_port);
+// Static addresses from the generated kernelcache database in offsets_db.c. Each is 0 when this
+// platform is not in the database, in which case the patchfinder has to locate it at runtime.
+extern uint64_t STATIC_ADDRESS(allproc);
+extern uint64_t STATIC_ADDRESS(add_x0_x0_0x40_ret);
+extern uint64_t STATIC_ADDRESS(copyout);
+extern uint64_t STATIC_ADDRESS(bzero);
+extern uint64_t STATIC_ADDRESS(bcopy);
+
+// Parameters for kernel structures: OFFSET(), SIZE() and BLOCK_SIZE() for each field listed in
+// kstruct_offsets.in, copied from kernel_offsets by parameters_init().
+#define PARAMETERS_DECLARE_OFFSET(struct_, field_)	extern size_t OFFSET(struct_, field_);
+#define PARAMETERS_DECLARE_SIZE(struct_)		extern size_t SIZE(struct_);
+#define PARAMETERS_DECLARE_BLOCK_SIZE(struct_)		extern size_t BLOCK_SIZE(struct_);
+#define PARAMETERS_DECLARE_VALUE(name_)			extern size_t name_;
+KSTRUCT_OFFSETS(PARAMETERS_DECLARE_OFFSET)
+KSTRUCT_SIZES(PARAMETERS_DECLARE_SIZE)
+KSTRUCT_BLOCK_SIZES(PARAMETERS_DECLARE_BLOCK_SIZE)
+KSTRUCT_VALUES(PARAMETERS_DECLARE_VALUE)
+#undef PARAMETERS_DECLARE_OFFSET
+#undef PARAMETERS_DECLARE_SIZE
+#undef PARAMETERS_DECLARE_BLOCK_SIZE
+#undef PARAMETERS_DECLARE_VALUE
+
+// The number of elements in a zalloc block, computed from SIZE() and BLOCK_SIZE().
 extern size_t COUNT_PER_BLOCK(ipc_port);
-extern size_t OFFSET(ipc_port, ip_bits);
-extern size_t OFFSET(ipc_port, ip_references);
-extern size_t OFFSET(ipc_port, waitq_flags);
-extern size_t OFFSET(ipc_port, imq_messages);
-extern size_t OFFSET(ipc_port, imq_msgcount);
-extern size_t OFFSET(ipc_port, imq_qlimit);
-extern size_t OFFSET(ipc_port, ip_receiver);
-extern size_t OFFSET(ipc_port, ip_kobject);
-extern size_t OFFSET(ipc_port, ip_nsrequest);
-extern size_t OFFSET(ipc_port, ip_requests);
-extern size_t OFFSET(ipc_port, ip_mscount);
-extern size_t OFFSET(ipc_port, ip_srights);
-
-// Parameters for ipc_port_request.
-extern size_t SIZE(ipc_port_request);
-extern size_t OFFSET(ipc_port_request, ipr_soright);
-
-// Parameters for struct ipc_space.
-extern size_t OFFSET(ipc_space, is_table_size);
-extern size_t OFFSET(ipc_space, is_table);
-
-// Parameters for ipc_voucher.
-extern size_t SIZE(ipc_voucher);
-extern size_t BLOCK_SIZE(ipc_voucher);
 extern size_t COUNT_PER_BLOCK(ipc_voucher);
 
-// Parameters for struct proc.
-extern size_t OFFSET(proc, p_pid);
-extern size_t OFFSET(proc, p_ucred);
-
-// Parameters for struct sysctl_oid.
-extern size_t SIZE(sysctl_oid);
-extern size_t OFFSET(sysctl_oid, oid_parent);
-extern size_t OFFSET(sysctl_oid, oid_link);
-extern size_t OFFSET(sysctl_oid, oid_kind);
-extern size_t OFFSET(sysctl_oid, oid_handler);
-extern size_t OFFSET(sysctl_oid, oid_version);
-extern size_t OFFSET(sysctl_oid, oid_refcnt);
-
-// Parameters for struct task.
-extern size_t OFFSET(task, lck_mtx_type);
-extern size_t OFFSET(task, ref_count);
-extern size_t OFFSET(task, active);
-extern size_t OFFSET(task, map);
-extern size_t OFFSET(task, itk_space);
-extern size_t OFFSET(task, bsd_info);
+// The kernel structure offsets for this platform, selected by parameters_select_offsets():
+// kernel_offsets from kstruct_offsets_db for parameters_init(), koffset_offsets from koffset_db
+// for koffset().
+extern const struct kstruct_offsets *kernel_offsets;
+extern const struct kstruct_offsets *koffset_offsets;
+
+/*
+ * parameters_select_offsets
+ *
+ * Description:
+ * 	Point kernel_offsets and koffset_offsets at the first kstruct_offsets_db and koffset_db
+ * 	entries that match this platform. This is all koffset() needs; parameters_init() calls it
+ * 	too. Returns false if either table has no matching entry.
+ */
+bool parameters_select_offsets(void);
 
 /*
  * parameters_init
@@ -6,7 +6,13 @@
 #define VOUCHER_SWAP__PLATFORM_H_
 
 #include <stdbool.h>
+#ifdef __APPLE__
 #include <mach/machine.h>
+#else
+// Host tools (kstruct_check.c) only need the layout.
+typedef int cpu_type_t;
+typedef int cpu_subtype_t;
+#endif
 
 #ifdef PLATFORM_EXTERN
 #define extern PLATFORM_EXTERN
@@ -5,6 +5,7 @@
 #include "platform_match.h"
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "log.h"
@@ -153,15 +154,15 @@ unknown:
 		return false;
 	}
 	// Optionally parse a separator and more versions.
-	if (*next == 0) {
-		*max_major = *min_major;
-		*max_minor = *min_minor;
-	} else if (*next == '-') {
+	if (*next == '-') {
 		next++;
 		ok = parse_device_version_internal(next, max_major, max_minor, true, &next);
 		if (!ok) {
 			goto unknown;
 		}
+	} else {
+		*max_major = *min_major;
+		*max_minor = *min_minor;
 	}
 	*end = next;
 	// Return the device_type.
@@ -327,6 +328,190 @@ match_build(const char *build, const char *builds) {
 	return (version_min <= version && version <= version_max);
 }
 
+// ---- Compiled match tables ---------------------------------------------------------------------
+
+// The current platform, parsed once for all table lookups.
+static struct {
+	bool parsed;
+	char device_type[32];
+	unsigned major;
+	unsigned minor;
+	uint64_t build;
+} current_platform;
+
+// Parse the current platform if that hasn't been done yet.
+static void
+parse_current_platform() {
+	if (!current_platform.parsed) {
+		parse_device(platform.machine, current_platform.device_type,
+				&current_platform.major, &current_platform.minor);
+		current_platform.build = parse_build_version(platform.osversion, NULL);
+		current_platform.parsed = true;
+	}
+}
+
+// Count the number of device ranges in a device match list.
+static size_t
+count_device_ranges(const char *devices) {
+	size_t count = 1;
+	if (devices != NULL) {
+		for (const char *p = devices; *p != 0; p++) {
+			count += (*p == '|');
+		}
+	}
+	return count;
+}
+
+// Compile a match spec into one range per device range alternative. Returns the number of
+// ranges written.
+static size_t
+compile_spec(const struct platform_match_spec *spec, size_t index,
+		struct platform_range *ranges) {
+	uint64_t build_min = 0;
+	uint64_t build_max = (uint64_t)(-1);
+	if (spec->builds != NULL && strcmp(spec->builds, "*") != 0) {
+		parse_build_version_range(spec->builds, &build_min, &build_max);
+	}
+	// A wildcard device list is a single range that skips the device comparison.
+	if (spec->devices == NULL || strcmp(spec->devices, "*") == 0) {
+		memset(&ranges[0], 0, sizeof(ranges[0]));
+		ranges[0].any_device = true;
+		ranges[0].build_min = build_min;
+		ranges[0].build_max = build_max;
+		ranges[0].index = index;
+		return 1;
+	}
+	size_t count = 0;
+	const char *next = spec->devices;
+	while (*next != 0) {
+		struct platform_range *range = &ranges[count++];
+		memset(range, 0, sizeof(*range));
+		range->build_min = build_min;
+		range->build_max = build_max;
+		range->index = index;
+		bool ok = parse_device_range(next, range->device_type,
+				&range->min_major, &range->min_minor,
+				&range->max_major, &range->max_minor, &next);
+		if (!ok) {
+			// An unparseable device only matches a platform with the same name.
+			break;
+		}
+		if (*next != 0) {
+			skip_spaces(&next);
+			assert(*next == '|');
+			next++;
+			skip_spaces(&next);
+			assert(*next != 0);
+		}
+	}
+	return count;
+}
+
+// Order ranges by device type, with the wildcard device ranges first.
+static int
+compare_platform_range(const void *a, const void *b) {
+	const struct platform_range *x = a;
+	const struct platform_range *y = b;
+	if (x->any_device != y->any_device) {
+		return (x->any_device ? -1 : 1);
+	}
+	int cmp = strcmp(x->device_type, y->device_type);
+	if (cmp != 0) {
+		return cmp;
+	}
+	return (x->index < y->index ? -1 : x->index > y->index);
+}
+
+// Check whether a compiled range matches the current platform.
+static bool
+platform_range_matches(const struct platform_range *range) {
+	if (current_platform.build < range->build_min
+			|| current_platform.build > range->build_max) {
+		return false;
+	}
+	return range->any_device
+		|| numerical_device_match(current_platform.major, current_platform.minor,
+				range->min_major, range->min_minor,
+				range->max_major, range->max_minor);
+}
+
+// Insert an index into a sorted list of unique indices, keeping at most max of the smallest.
+static size_t
+insert_match(size_t *matches, size_t count, size_t max, size_t index) {
+	size_t pos = count;
+	while (pos > 0 && matches[pos - 1] > index) {
+		pos--;
+	}
+	if ((pos > 0 && matches[pos - 1] == index) || pos == max) {
+		return count;
+	}
+	if (count == max) {
+		count--;
+	}
+	memmove(&matches[pos + 1], &matches[pos], (count - pos) * sizeof(*matches));
+	matches[pos] = index;
+	return count + 1;
+}
+
+// Compile the specs of a static table, count entries stride bytes apart, into match ranges.
+static bool
+platform_match_table_init(struct platform_match_table *table,
+		const struct platform_match_spec *specs, size_t count, size_t stride) {
+	size_t range_count = 0;
+	for (size_t i = 0; i < count; i++) {
+		const struct platform_match_spec *spec = (const void *)((const uint8_t *)specs + i * stride);
+		range_count += count_device_ranges(spec->devices);
+	}
+	table->ranges = malloc((range_count > 0 ? range_count : 1) * sizeof(*table->ranges));
+	table->count = 0;
+	if (table->ranges == NULL) {
+		return false;
+	}
+	for (size_t i = 0; i < count; i++) {
+		const struct platform_match_spec *spec = (const void *)((const uint8_t *)specs + i * stride);
+		table->count += compile_spec(spec, i, &table->ranges[table->count]);
+	}
+	qsort(table->ranges, table->count, sizeof(*table->ranges), compare_platform_range);
+	table->compiled = true;
+	return true;
+}
+
+// Find the entries of a compiled table that match the current platform.
+static size_t
+platform_match_table_lookup(const struct platform_match_table *table,
+		size_t *matches, size_t max_matches) {
+	parse_current_platform();
+	size_t match_count = 0;
+	// Check the wildcard device ranges at the front.
+	size_t i = 0;
+	for (; i < table->count && table->ranges[i].any_device; i++) {
+		if (platform_range_matches(&table->ranges[i])) {
+			match_count = insert_match(matches, match_count, max_matches,
+					table->ranges[i].index);
+		}
+	}
+	// Binary search for the first range with our device type.
+	size_t lo = i, hi = table->count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (strcmp(table->ranges[mid].device_type, current_platform.device_type) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	for (i = lo; i < table->count; i++) {
+		const struct platform_range *range = &table->ranges[i];
+		if (strcmp(range->device_type, current_platform.device_type) != 0) {
+			break;
+		}
+		if (platform_range_matches(range)) {
+			match_count = insert_match(matches, match_count, max_matches, range->index);
+		}
+	}
+	return match_count;
+}
+
 // ---- Public API --------------------------------------------------------------------------------
 
 bool
@@ -344,3 +529,26 @@ platform_matches(const char *device_range, const char *build_range) {
 	return platform_matches_device(device_range)
 		&& platform_matches_build(build_range);
 }
+
+size_t
+platform_match_select(struct platform_match_table *table,
+		const struct platform_match_spec *specs, size_t count, size_t stride,
+		size_t *matches, size_t max_matches) {
+	if (!table->compiled && !platform_match_table_init(table, specs, count, stride)) {
+		ERROR("could not compile platform match table");
+		return 0;
+	}
+	return platform_match_table_lookup(table, matches, max_matches);
+}
+
+size_t
+platform_run_initializations(struct platform_match_table *table,
+		const struct platform_initialization *inits, size_t count) {
+	size_t matches[count];
+	size_t match_count = platform_match_select(table, &inits[0].match, count, sizeof(inits[0]),
+			matches, count);
+	for (size_t i = 0; i < match_count; i++) {
+		inits[matches[i]].init();
+	}
+	return match_count;
+}
@@ -6,6 +6,8 @@
 #define VOUCHER_SWAP__PLATFORM_MATCH_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /*
  * platform_matches_device
@@ -59,4 +61,86 @@ bool platform_matches_build(const char *build_range);
  */
 bool platform_matches(const char *device_range, const char *build_range);
 
+/*
+ * struct platform_match_spec
+ *
+ * Description:
+ * 	A device range and a build range, in the formats accepted by platform_matches_device() and
+ * 	platform_matches_build(). A NULL range matches everything.
+ */
+struct platform_match_spec {
+	const char *devices;
+	const char *builds;
+};
+
+/*
+ * struct platform_range
+ *
+ * Description:
+ * 	One device range alternative of a platform_match_spec together with its build range,
+ * 	parsed into numeric intervals.
+ */
+struct platform_range {
+	char device_type[32];
+	bool any_device;
+	unsigned min_major;
+	unsigned min_minor;
+	unsigned max_major;
+	unsigned max_minor;
+	uint64_t build_min;
+	uint64_t build_max;
+	size_t index;
+};
+
+/*
+ * struct platform_match_table
+ *
+ * Description:
+ * 	A static list of platform_match_specs compiled into numeric ranges sorted by device type,
+ * 	so that selecting the entries for the current platform is a search rather than a string
+ * 	parse per entry. Zero-initialize it; platform_match_select() compiles it on first use.
+ */
+struct platform_match_table {
+	struct platform_range *ranges;
+	size_t count;
+	bool compiled;
+};
+
+/*
+ * platform_match_select
+ *
+ * Description:
+ * 	Find the entries of a static table that match the current platform. The table has count
+ * 	entries, stride bytes apart, and specs points at the platform_match_spec in the first one.
+ * 	The specs are compiled into table on the first call and that is reused on later calls, so
+ * 	the entries must not change. The indices of the first max_matches matching entries are
+ * 	stored in ascending order in matches and their number is returned; 0 is also returned if
+ * 	the table could not be compiled.
+ */
+size_t platform_match_select(struct platform_match_table *table,
+		const struct platform_match_spec *specs, size_t count, size_t stride,
+		size_t *matches, size_t max_matches);
+
+/*
+ * struct platform_initialization
+ *
+ * Description:
+ * 	An initialization function and the platforms it applies to.
+ */
+struct platform_initialization {
+	struct platform_match_spec match;
+	void (*init)(void);
+};
+
+/*
+ * platform_run_initializations
+ *
+ * Description:
+ * 	Run every initialization in a static list that matches the current platform, in list
+ * 	order, and return how many ran. table caches the compiled list as for
+ * 	platform_match_select().
+ */
+size_t platform_run_initializations(struct platform_match_table *table,
+		const struct platform_initialization *inits, size_t count);
+
 #endif
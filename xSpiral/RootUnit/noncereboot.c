@@ -16,6 +16,7 @@
 
 mach_port_t tfpzero = MACH_PORT_NULL;
 uint64_t kernel_base;
+struct pf_kernel kernel_image;
 
 int start_noncereboot(mach_port_t tfp0) {
     printf("Starting noncereboot1131...\n");
@@ -35,7 +36,7 @@ int start_noncereboot(mach_port_t tfp0) {
     kernel_base = slide + 0xFFFFFFF007004000;
     
     // Loads the kernel into the patch finder, which just fetches the kernel memory for patchfinder use
-    init_kernel(kernel_base, NULL);
+    init_kernel(&kernel_image, kernel_base, NULL);
     
     init_kexecute();
     
@@ -59,7 +60,7 @@ int start_noncereboot(mach_port_t tfp0) {
     
 out:
     term_kexecute();
-    term_kernel();
+    term_kernel(&kernel_image);
     return err;
 }
 
@@ -0,0 +1,130 @@
+//
+//  a64_decode.c
+//  xSpiral
+//
+
+#include "a64_decode.h"
+
+// Candidate class per top opcode byte; pf_a64_decode() checks the rest.
+// Loads and stores share the PF_A64_LDR slot and are told apart by opc.
+static const uint8_t top_class[256] = {
+    [0x10] = PF_A64_ADR, [0x30] = PF_A64_ADR, [0x50] = PF_A64_ADR, [0x70] = PF_A64_ADR,
+    [0x90] = PF_A64_ADRP, [0xB0] = PF_A64_ADRP, [0xD0] = PF_A64_ADRP, [0xF0] = PF_A64_ADRP,
+    [0x91] = PF_A64_ADD,
+    [0xF9] = PF_A64_LDR, [0xFB] = PF_A64_LDR, [0xFD] = PF_A64_LDR, [0xFF] = PF_A64_LDR,
+    [0x58] = PF_A64_LDR_LIT,
+    // B, BL
+    [0x14] = PF_A64_BRANCH, [0x15] = PF_A64_BRANCH, [0x16] = PF_A64_BRANCH, [0x17] = PF_A64_BRANCH,
+    [0x94] = PF_A64_BRANCH, [0x95] = PF_A64_BRANCH, [0x96] = PF_A64_BRANCH, [0x97] = PF_A64_BRANCH,
+    // B.cond
+    [0x54] = PF_A64_BRANCH,
+    // CBZ, CBNZ, TBZ, TBNZ
+    [0x34] = PF_A64_BRANCH, [0x35] = PF_A64_BRANCH, [0x36] = PF_A64_BRANCH, [0x37] = PF_A64_BRANCH,
+    [0xB4] = PF_A64_BRANCH, [0xB5] = PF_A64_BRANCH, [0xB6] = PF_A64_BRANCH, [0xB7] = PF_A64_BRANCH,
+    // BR, BLR, RET and friends
+    [0xD6] = PF_A64_BRANCH, [0xD7] = PF_A64_BRANCH,
+};
+
+static inline enum pf_a64_kind
+decode(uint32_t op, uint64_t pc, struct pf_a64_insn *insn)
+{
+    enum pf_a64_kind kind = top_class[op >> 24];
+    insn->rd = op & 0x1F;
+    insn->rn = (op >> 5) & 0x1F;
+
+    switch (kind) {
+        case PF_A64_ADRP: {
+            signed adr = ((op & 0x60000000) >> 18) | ((op & 0xFFFFE0) << 8);
+            insn->imm = (long long)adr * 2 + (pc & ~0xFFF);
+            break;
+        }
+        case PF_A64_ADR: {
+            signed adr = ((op & 0x60000000) >> 18) | ((op & 0xFFFFE0) << 8);
+            insn->imm = ((long long)adr >> 11) + pc;
+            break;
+        }
+        case PF_A64_ADD: {
+            unsigned shift = (op >> 22) & 3;
+            if (shift > 1) {
+                return PF_A64_OTHER;
+            }
+            insn->imm = ((op >> 10) & 0xFFF) << (shift * 12);
+            break;
+        }
+        case PF_A64_LDR:
+            switch (op & 0x00C00000) {
+                case 0x00400000: break;
+                case 0x00000000: kind = PF_A64_STR; break;
+                default: return PF_A64_OTHER;
+            }
+            insn->imm = ((op >> 10) & 0xFFF) << 3;
+            break;
+        case PF_A64_LDR_LIT: {
+            signed adr = (op & 0xFFFFE0) << 8;
+            insn->imm = ((long long)adr >> 11) + pc;
+            break;
+        }
+        case PF_A64_BRANCH:
+            if ((op >> 24) == 0x54 && (op & 0x10)) {
+                return PF_A64_OTHER;
+            }
+            break;
+        default:
+            return PF_A64_OTHER;
+    }
+    insn->kind = kind;
+    return kind;
+}
+
+enum pf_a64_kind
+pf_a64_decode(uint32_t op, uint64_t pc, struct pf_a64_insn *insn)
+{
+    return decode(op, pc, insn);
+}
+
+int
+pf_a64_track(uint64_t value[32], const struct pf_a64_insn *insn)
+{
+    switch (insn->kind) {
+        case PF_A64_ADRP:
+        case PF_A64_ADR:
+        case PF_A64_LDR_LIT:
+            value[insn->rd] = insn->imm;    // XXX address, not actual value for LDR
+            return insn->rd;
+        case PF_A64_LDR:
+            if (!insn->imm) {
+                return -1;                  // XXX not counted as true xref
+            }
+            // fall through
+        case PF_A64_ADD:
+            value[insn->rd] = value[insn->rn] + insn->imm;
+            return insn->rd;
+        default:
+            return -1;
+    }
+}
+
+uint64_t
+pf_a64_walk(const uint8_t *buf, uint64_t start, uint64_t end, unsigned kinds,
+            pf_a64_visitor visit, void *ctx)
+{
+    uint64_t i;
+    struct pf_a64_insn insn;
+    unsigned want = kinds & ~PF_A64_MASK(PF_A64_OTHER);
+    unsigned candidates = want;
+
+    if (want & PF_A64_MASK(PF_A64_STR)) {
+        candidates |= PF_A64_MASK(PF_A64_LDR);
+    }
+    end &= ~3;
+    for (i = start & ~3; i < end; i += 4) {
+        uint32_t op = *(uint32_t *)(buf + i);
+        if (!(candidates & PF_A64_MASK(top_class[op >> 24]))) {
+            continue;
+        }
+        if ((want & PF_A64_MASK(decode(op, i, &insn))) && visit(ctx, i, &insn)) {
+            return i;
+        }
+    }
+    return end;
+}
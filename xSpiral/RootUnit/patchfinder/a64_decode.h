@@ -0,0 +1,58 @@
+//
+//  a64_decode.h
+//  xSpiral
+//
+//  Decoder for the few AArch64 instructions the patchfinder cares about.
+//  The top opcode byte selects a candidate class from a 256-entry table and
+//  only candidates are decoded further, so one pass over a range costs a
+//  load and a table lookup per uninteresting word.
+//
+
+#ifndef A64_DECODE_H_
+#define A64_DECODE_H_
+
+#include <stdint.h>
+
+enum pf_a64_kind {
+    PF_A64_OTHER = 0,
+    PF_A64_ADRP,        // ADRP Xd, target
+    PF_A64_ADR,         // ADR Xd, target
+    PF_A64_ADD,         // ADD Xd, Xn, #imm
+    PF_A64_LDR,         // LDR Xd, [Xn, #imm]
+    PF_A64_STR,         // STR Xd, [Xn, #imm]
+    PF_A64_LDR_LIT,     // LDR Xd, target
+    PF_A64_BRANCH,      // B, BL, B.cond, CBZ, CBNZ, TBZ, TBNZ, BR, BLR, RET
+    PF_A64_NUM_KINDS
+};
+
+#define PF_A64_MASK(kind)   (1u << (kind))
+#define PF_A64_TRACKED      (PF_A64_MASK(PF_A64_ADRP) | PF_A64_MASK(PF_A64_ADR) | PF_A64_MASK(PF_A64_ADD) | \
+                             PF_A64_MASK(PF_A64_LDR) | PF_A64_MASK(PF_A64_LDR_LIT))
+
+// Addresses are buffer offsets, like everything else in the patchfinder.
+struct pf_a64_insn {
+    enum pf_a64_kind kind;
+    unsigned rd;        // Rt for loads and stores
+    unsigned rn;
+    uint64_t imm;       // ADD/LDR/STR: scaled immediate; ADRP/ADR/LDR_LIT: target
+};
+
+// Returns the kind of `op` at `pc`, filling *insn unless it is PF_A64_OTHER.
+enum pf_a64_kind pf_a64_decode(uint32_t op, uint64_t pc, struct pf_a64_insn *insn);
+
+// Applies `insn` to the register values the patchfinder tracks: ADRP, ADR,
+// ADD and LDR literal give addresses, LDR Xd, [Xn, #imm] gives the address
+// loaded from (not the value) and is ignored with a zero offset.  Returns
+// the register written, or -1.
+int pf_a64_track(uint64_t value[32], const struct pf_a64_insn *insn);
+
+// Called for every instruction in the walked range whose kind is in the
+// walk's mask.  A nonzero return stops the walk.
+typedef int (*pf_a64_visitor)(void *ctx, uint64_t pc, const struct pf_a64_insn *insn);
+
+// Walks [start, end) of buf (4-byte aligned offsets).  Returns the pc of the
+// instruction the visitor stopped at, or the aligned end.
+uint64_t pf_a64_walk(const uint8_t *buf, uint64_t start, uint64_t end, unsigned kinds,
+                     pf_a64_visitor visit, void *ctx);
+
+#endif
@@ -0,0 +1,227 @@
+//
+//  decompress.c
+//  xSpiral
+//
+//  complzss is decoded here with its 4K dictionary kept on the side.  LZFSE
+//  goes through libcompression's streaming interface on Apple hosts, or the
+//  reference liblzfse (one shot) elsewhere when built with HAVE_LZFSE.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "decompress.h"
+
+#ifdef __APPLE__
+#include <compression.h>
+#elif defined(HAVE_LZFSE)
+#include <lzfse.h>
+#endif
+
+struct out {
+    pf_sink_t sink;
+    void *ctx;
+    uint64_t total;
+    uint64_t limit;         // raw_size, if known; anything past it is padding
+    uint32_t a, b;          // running adler32
+};
+
+static int
+emit(struct out *o, const uint8_t *data, size_t len)
+{
+    size_t i;
+    if (o->limit && len > o->limit - o->total) {
+        len = o->limit - o->total;
+        if (!len) {
+            return 0;
+        }
+    }
+    for (i = 0; i < len; ) {
+        // 5552 is the largest run that cannot overflow b before the modulo
+        size_t n = len - i < 5552 ? len - i : 5552;
+        for (; n; n--, i++) {
+            o->a += data[i];
+            o->b += o->a;
+        }
+        o->a %= 65521;
+        o->b %= 65521;
+    }
+    o->total += len;
+    return o->sink(o->ctx, data, len);
+}
+
+/* lzss **********************************************************************/
+
+#define LZSS_N          4096
+#define LZSS_F          18
+#define LZSS_THRESHOLD  2
+
+static int
+decode_lzss(const struct pf_payload *p, struct out *o)
+{
+    uint8_t dict[LZSS_N];
+    uint8_t *chunk;
+    const uint8_t *src = p->data, *end = p->data + p->size;
+    unsigned r = LZSS_N - LZSS_F, flags = 0, i, j, k;
+    size_t used = 0;
+    int rv = 0;
+
+    chunk = malloc(PF_DECODE_CHUNK);
+    if (!chunk) {
+        return -1;
+    }
+    memset(dict, ' ', LZSS_N - LZSS_F);
+
+#define PUT(c) do { \
+        uint8_t c_ = (c); \
+        chunk[used++] = dict[r++] = c_; \
+        r &= LZSS_N - 1; \
+        if (used == PF_DECODE_CHUNK) { \
+            rv = emit(o, chunk, used); \
+            used = 0; \
+            if (rv) { \
+                goto out; \
+            } \
+        } \
+    } while (0)
+
+    while (src < end) {
+        if (((flags >>= 1) & 0x100) == 0) {
+            flags = *src++ | 0xFF00;
+            if (src == end) {
+                break;
+            }
+        }
+        if (flags & 1) {
+            PUT(*src++);
+        } else {
+            if (end - src < 2) {
+                break;
+            }
+            i = src[0] | ((src[1] & 0xF0) << 4);
+            j = (src[1] & 0x0F) + LZSS_THRESHOLD;
+            src += 2;
+            for (k = 0; k <= j; k++) {
+                PUT(dict[(i + k) & (LZSS_N - 1)]);
+            }
+        }
+    }
+    if (used) {
+        rv = emit(o, chunk, used);
+    }
+#undef PUT
+out:
+    free(chunk);
+    return rv;
+}
+
+/* lzfse *********************************************************************/
+
+static int
+decode_lzfse(const struct pf_payload *p, struct out *o)
+{
+#ifdef __APPLE__
+    compression_stream s;
+    compression_status st;
+    uint8_t *chunk;
+    int rv = 0;
+
+    chunk = malloc(PF_DECODE_CHUNK);
+    if (!chunk) {
+        return -1;
+    }
+    if (compression_stream_init(&s, COMPRESSION_STREAM_DECODE, COMPRESSION_LZFSE) != COMPRESSION_STATUS_OK) {
+        free(chunk);
+        return -1;
+    }
+    s.src_ptr = p->data;
+    s.src_size = p->size;
+    do {
+        s.dst_ptr = chunk;
+        s.dst_size = PF_DECODE_CHUNK;
+        st = compression_stream_process(&s, COMPRESSION_STREAM_FINALIZE);
+        if (st == COMPRESSION_STATUS_ERROR) {
+            rv = -1;
+            break;
+        }
+        if (s.dst_ptr != chunk) {
+            rv = emit(o, chunk, s.dst_ptr - chunk);
+        }
+    } while (!rv && st == COMPRESSION_STATUS_OK);
+    compression_stream_destroy(&s);
+    free(chunk);
+    return rv;
+#elif defined(HAVE_LZFSE)
+    // liblzfse has no streaming decoder; decode in one go and hand the
+    // result over in chunks so the caller sees the same interface.
+    size_t cap = p->raw_size ? p->raw_size + 1 : p->size * 4, n, i;
+    uint8_t *buf, *scratch;
+    int rv = 0;
+
+    scratch = malloc(lzfse_decode_scratch_size());
+    if (!scratch) {
+        return -1;
+    }
+    for (;;) {
+        buf = malloc(cap);
+        if (!buf) {
+            free(scratch);
+            return -1;
+        }
+        n = lzfse_decode_buffer(buf, cap, p->data, p->size, scratch);
+        if (n < cap) {
+            break;
+        }
+        free(buf);
+        cap *= 2;
+    }
+    free(scratch);
+    for (i = 0; i < n && !rv; i += PF_DECODE_CHUNK) {
+        rv = emit(o, buf + i, n - i < PF_DECODE_CHUNK ? n - i : PF_DECODE_CHUNK);
+    }
+    free(buf);
+    return n ? rv : -1;
+#else
+    (void)p;
+    (void)o;
+    return -1;
+#endif
+}
+
+int
+pf_decode_payload(const struct pf_payload *p, pf_sink_t sink, void *ctx)
+{
+    struct out o;
+    size_t i;
+    int rv;
+
+    o.sink = sink;
+    o.ctx = ctx;
+    o.total = 0;
+    o.limit = p->raw_size;
+    o.a = 1;
+    o.b = 0;
+
+    switch (p->kind) {
+        case PF_PAYLOAD_LZSS:
+            rv = decode_lzss(p, &o);
+            break;
+        case PF_PAYLOAD_LZFSE:
+            rv = decode_lzfse(p, &o);
+            break;
+        default:
+            for (rv = 0, i = 0; i < p->size && !rv; i += PF_DECODE_CHUNK) {
+                rv = o.sink(o.ctx, p->data + i, p->size - i < PF_DECODE_CHUNK ? p->size - i : PF_DECODE_CHUNK);
+            }
+            return rv;
+    }
+    if (rv) {
+        return rv;
+    }
+    if (p->raw_size && o.total != p->raw_size) {
+        return -1;
+    }
+    if (p->kind == PF_PAYLOAD_LZSS && p->adler32 && ((o.b << 16) | o.a) != p->adler32) {
+        return -1;
+    }
+    return 0;
+}
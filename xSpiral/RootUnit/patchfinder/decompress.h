@@ -0,0 +1,27 @@
+//
+//  decompress.h
+//  xSpiral
+//
+//  Streaming kernelcache decompression.  Output is handed to a sink in
+//  bounded chunks as it is produced, so the caller can place it directly
+//  without ever holding the whole decompressed file.
+//
+
+#ifndef DECOMPRESS_H_
+#define DECOMPRESS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "img4.h"
+
+#define PF_DECODE_CHUNK 0x10000
+
+// Receives the next `len` bytes of output.  A non-zero return aborts the
+// decode with that value.
+typedef int (*pf_sink_t)(void *ctx, const uint8_t *data, size_t len);
+
+// Decodes the payload and checks its size (and complzss checksum) when the
+// container records them.  Returns 0 on success.
+int pf_decode_payload(const struct pf_payload *p, pf_sink_t sink, void *ctx);
+
+#endif
@@ -0,0 +1,195 @@
+//
+//  fixups.c
+//  xSpiral
+//
+
+#include <string.h>
+#include "fixups.h"
+
+// dyld_chained_starts_in_segment.pointer_format values that can occur in a
+// 64-bit image.  The __thread_starts chains use the PTR_ARM64E encoding.
+#define PTR_ARM64E              1
+#define PTR_64                  2
+#define PTR_64_OFFSET           6
+#define PTR_ARM64E_KERNEL       7
+#define PTR_64_KERNEL_CACHE     8
+
+#define PAGE_START_NONE         0xFFFF
+#define PAGE_START_MULTI        0x8000
+
+#define THREAD_STARTS_END       0xFFFFFFFF
+
+// The blob is only 4-byte aligned and these reads are few; go through
+// memcpy rather than casting.
+static uint16_t rd16(const uint8_t *p) { uint16_t v; memcpy(&v, p, 2); return v; }
+static uint32_t rd32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static uint64_t rd64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+static unsigned
+stride_of(unsigned format)
+{
+    switch (format) {
+        case PTR_ARM64E:
+            return 8;
+        case PTR_64:
+        case PTR_64_OFFSET:
+        case PTR_ARM64E_KERNEL:
+        case PTR_64_KERNEL_CACHE:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// Decodes one chained pointer.  Returns 1 with the unslid VA in *value if
+// it is a rebase, 0 for a bind.  *next is the distance to the next pointer
+// in strides, 0 at the end of the chain.
+static int
+decode(unsigned format, uint64_t raw, uint64_t mh, uint64_t *value, unsigned *next)
+{
+    switch (format) {
+        case PTR_ARM64E:
+            *next = (raw >> 51) & 0x7FF;
+            if ((raw >> 62) & 1) {
+                return 0;
+            }
+            if (raw >> 63) {
+                *value = mh + (raw & 0xFFFFFFFF);               // auth: offset, PAC bits dropped
+            } else {
+                // top byte and a sign-extended 43-bit VA, as xnu rebases it
+                uint64_t low = raw & 0x7FFFFFFFFFFULL;
+                if (low & (1ULL << 42)) {
+                    low |= ~0x7FFFFFFFFFFULL;
+                }
+                *value = (((raw >> 43) & 0xFF) << 56) | (low & 0x00FFFFFFFFFFFFFFULL);
+            }
+            return 1;
+        case PTR_64:
+        case PTR_64_OFFSET:
+            *next = (raw >> 51) & 0xFFF;
+            if (raw >> 63) {
+                return 0;
+            }
+            *value = raw & 0xFFFFFFFFFULL;
+            if (format == PTR_64_OFFSET) {
+                *value += mh;
+            }
+            *value |= ((raw >> 36) & 0xFF) << 56;
+            return 1;
+        case PTR_ARM64E_KERNEL:
+        case PTR_64_KERNEL_CACHE:
+            *next = (raw >> 51) & 0xFFF;
+            *value = mh + (raw & 0x3FFFFFFF);
+            return 1;
+        default:
+            *next = 0;
+            return 0;
+    }
+}
+
+static long
+walk(uint8_t *buf, uint64_t size, uint64_t off, unsigned format, unsigned stride, uint64_t mh)
+{
+    long n = 0;
+    for (;;) {
+        uint64_t raw, value;
+        unsigned next;
+        if (off > size || size - off < 8) {
+            return -1;
+        }
+        raw = rd64(buf + off);
+        if (decode(format, raw, mh, &value, &next)) {
+            memcpy(buf + off, &value, 8);
+            n++;
+        }
+        if (!next) {
+            return n;
+        }
+        off += (uint64_t)next * stride;
+    }
+}
+
+long
+pf_fixups_threaded(uint8_t *buf, uint64_t size, uint64_t base, uint64_t mh,
+                   const uint32_t *starts, uint64_t count)
+{
+    uint64_t i;
+    unsigned stride;
+    long n = 0, rv;
+
+    if (!count) {
+        return 0;
+    }
+    if (mh < base) {
+        return -1;
+    }
+    stride = (starts[0] & 1) ? 8 : 4;
+    for (i = 1; i < count && starts[i] != THREAD_STARTS_END; i++) {
+        rv = walk(buf, size, mh - base + starts[i], PTR_ARM64E, stride, mh);
+        if (rv < 0) {
+            return -1;
+        }
+        n += rv;
+    }
+    return n;
+}
+
+long
+pf_fixups_chained(uint8_t *buf, uint64_t size, uint64_t base, uint64_t mh,
+                  const uint8_t *blob, uint64_t blob_size)
+{
+    const uint8_t *img;
+    uint64_t starts, segs, s, p;
+    long n = 0, rv;
+
+    // dyld_chained_fixups_header, then dyld_chained_starts_in_image
+    if (blob_size < 28 || mh < base) {
+        return -1;
+    }
+    starts = rd32(blob + 4);
+    if (starts > blob_size - 4) {
+        return -1;
+    }
+    img = blob + starts;
+    segs = rd32(img);
+    if (segs > (blob_size - starts - 4) / 4) {
+        return -1;
+    }
+    for (s = 0; s < segs; s++) {
+        uint64_t info = rd32(img + 4 + s * 4);
+        const uint8_t *seg = img + info;
+        unsigned page_size, format, stride, pages;
+        uint64_t seg_off;
+
+        if (!info) {
+            continue;           // no fixups in this segment
+        }
+        // dyld_chained_starts_in_segment: page_start[] begins at byte 22
+        if (info > blob_size - starts || blob_size - starts - info < 22) {
+            return -1;
+        }
+        page_size = rd16(seg + 4);
+        format = rd16(seg + 6);
+        seg_off = rd64(seg + 8);
+        pages = rd16(seg + 20);
+        stride = stride_of(format);
+        if (!stride || blob_size - starts - info - 22 < (uint64_t)pages * 2) {
+            return -1;
+        }
+        for (p = 0; p < pages; p++) {
+            unsigned start = rd16(seg + 22 + p * 2);
+            if (start == PAGE_START_NONE) {
+                continue;
+            }
+            if (start & PAGE_START_MULTI) {
+                return -1;      // only used by 32-bit formats
+            }
+            rv = walk(buf, size, mh - base + seg_off + p * page_size + start, format, stride, mh);
+            if (rv < 0) {
+                return -1;
+            }
+            n += rv;
+        }
+    }
+    return n;
+}
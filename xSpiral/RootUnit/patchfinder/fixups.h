@@ -0,0 +1,34 @@
+//
+//  fixups.h
+//  xSpiral
+//
+//  Rewrites the pointers of a loaded kernelcache into plain unslid VAs.
+//  arm64e kernelcaches store them as chains: each pointer holds a target
+//  (an offset from the image base or a packed VA, possibly with PAC
+//  diversity bits) and the distance to the next pointer in the chain.  Both
+//  chain encodings are handled: the ld64 "threaded rebase" one listed in
+//  __TEXT,__thread_starts (iOS 12-14) and LC_DYLD_CHAINED_FIXUPS (fileset
+//  kernelcaches).  Binds never occur in a kernelcache and are left as they
+//  are.
+//
+
+#ifndef FIXUPS_H_
+#define FIXUPS_H_
+
+#include <stdint.h>
+
+// buf holds the image, `size` bytes starting at VA `base`; the Mach-O
+// header the chains are relative to is at VA `mh`.  Each call is one
+// forward sweep per chain and returns the number of pointers rewritten, or
+// -1 if the description is malformed (pointers rewritten so far stay
+// rewritten).
+
+// starts[] is the raw __thread_starts section, `count` words long.
+long pf_fixups_threaded(uint8_t *buf, uint64_t size, uint64_t base, uint64_t mh,
+                        const uint32_t *starts, uint64_t count);
+
+// blob is the LC_DYLD_CHAINED_FIXUPS payload.
+long pf_fixups_chained(uint8_t *buf, uint64_t size, uint64_t base, uint64_t mh,
+                       const uint8_t *blob, uint64_t blob_size);
+
+#endif
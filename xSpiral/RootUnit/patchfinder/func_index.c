@@ -0,0 +1,92 @@
+//
+//  func_index.c
+//  xSpiral
+//
+//  One linear pass over a code range recording every frame setup that
+//  bof64() would accept.  Since the pass runs in address order the table
+//  comes out sorted.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "func_index.h"
+
+static int
+push(struct pf_func_index *idx, size_t *cap, uint64_t frame, uint64_t start)
+{
+    if (idx->count == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 0x4000;
+        struct pf_func *p = realloc(idx->funcs, ncap * sizeof(*p));
+        if (!p) {
+            return -1;
+        }
+        idx->funcs = p;
+        *cap = ncap;
+    }
+    idx->funcs[idx->count].frame = (uint32_t)frame;
+    idx->funcs[idx->count].start = (uint32_t)start;
+    idx->count++;
+    return 0;
+}
+
+int
+pf_func_index_build(struct pf_func_index *idx, const uint8_t *buf, uint64_t start, uint64_t end)
+{
+    uint64_t i;
+    size_t cap = 0;
+
+    memset(idx, 0, sizeof(*idx));
+
+    if (end > UINT32_MAX) {
+        return -1;
+    }
+    idx->start = start & ~3;
+    idx->end = end & ~3;
+
+    for (i = idx->start; i < idx->end; i += 4) {
+        uint32_t op = *(uint32_t *)(buf + i);
+        if ((op & 0xFFC003FF) == 0x910003FD) {
+            unsigned delta = (op >> 10) & 0xFFF;
+            if ((delta & 0xF) == 0) {
+                uint64_t prev = i - ((delta >> 4) + 1) * 4;
+                uint32_t au;
+                if (prev > i || prev < idx->start) {
+                    continue;
+                }
+                au = *(uint32_t *)(buf + prev);
+                if ((au & 0xFFC003E0) == 0xA98003E0 && push(idx, &cap, i, prev)) {
+                    pf_func_index_free(idx);
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+void
+pf_func_index_free(struct pf_func_index *idx)
+{
+    free(idx->funcs);
+    idx->funcs = NULL;
+    idx->count = 0;
+}
+
+uint64_t
+pf_func_index_lookup(const struct pf_func_index *idx, uint64_t where, uint64_t limit)
+{
+    size_t lo = 0, hi = idx->count;
+    // first frame above `where`
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->funcs[mid].frame <= where) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!lo || where - idx->funcs[lo - 1].frame > limit) {
+        return 0;
+    }
+    return idx->funcs[lo - 1].start;
+}
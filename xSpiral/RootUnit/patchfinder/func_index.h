@@ -0,0 +1,37 @@
+//
+//  func_index.h
+//  xSpiral
+//
+//  Sorted table of function prologues for one code range, so finding the
+//  start of the function containing an address is a binary search instead
+//  of a backwards walk.
+//
+
+#ifndef FUNC_INDEX_H_
+#define FUNC_INDEX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Both fields are offsets into the kernel buffer (VA - kerndumpbase).
+struct pf_func {
+    uint32_t frame;     // ADD X29, SP, #imm
+    uint32_t start;     // the STP x, y, [SP, #-imm]! that opens the frame
+};
+
+struct pf_func_index {
+    uint64_t start;
+    uint64_t end;
+    struct pf_func *funcs;  // sorted by frame
+    size_t count;
+};
+
+int pf_func_index_build(struct pf_func_index *idx, const uint8_t *buf, uint64_t start, uint64_t end);
+void pf_func_index_free(struct pf_func_index *idx);
+
+// Returns the start of the function whose frame setup is the closest one at
+// or below `where`, or 0 if there is none within `limit` bytes.  This is the
+// answer bof64() gives when walking backwards from `where`.
+uint64_t pf_func_index_lookup(const struct pf_func_index *idx, uint64_t where, uint64_t limit);
+
+#endif
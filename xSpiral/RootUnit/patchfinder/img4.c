@@ -0,0 +1,172 @@
+//
+//  img4.c
+//  xSpiral
+//
+//  Just enough DER to walk IMG4 -> IM4P -> payload.  An IM4P is
+//      SEQUENCE { IA5String "IM4P", IA5String type, IA5String description,
+//                 OCTET STRING payload, [OCTET STRING keybag],
+//                 [SEQUENCE { INTEGER 1, INTEGER decompressed size }] }
+//  and an IMG4 is SEQUENCE { IA5String "IMG4", IM4P, [0] IM4M ... }.
+//
+
+#include <string.h>
+#include "img4.h"
+
+#define DER_INTEGER     0x02
+#define DER_OCTETS      0x04
+#define DER_IA5STRING   0x16
+#define DER_SEQUENCE    0x30
+
+#define LZSS_HEADER_SIZE 0x180
+
+struct der {
+    const uint8_t *p;
+    const uint8_t *end;
+};
+
+// Reads one element header.  On success `value` spans its contents and
+// `d` is advanced past the whole element.
+static int
+der_next(struct der *d, unsigned *tag, struct der *value)
+{
+    size_t len, n;
+    if (d->end - d->p < 2) {
+        return -1;
+    }
+    *tag = d->p[0];
+    len = d->p[1];
+    d->p += 2;
+    if (len & 0x80) {
+        n = len & 0x7F;
+        if (n == 0 || n > sizeof(size_t) || (size_t)(d->end - d->p) < n) {
+            return -1;
+        }
+        for (len = 0; n; n--) {
+            len = (len << 8) | *d->p++;
+        }
+    }
+    if ((size_t)(d->end - d->p) < len) {
+        return -1;
+    }
+    value->p = d->p;
+    value->end = d->p + len;
+    d->p += len;
+    return 0;
+}
+
+static int
+der_string_is(const struct der *s, const char *str)
+{
+    size_t len = strlen(str);
+    return (size_t)(s->end - s->p) == len && !memcmp(s->p, str, len);
+}
+
+static uint32_t
+be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Classifies a bare payload by its magic.
+static int
+open_stream(const uint8_t *buf, size_t size, struct pf_payload *p)
+{
+    if (size >= LZSS_HEADER_SIZE && !memcmp(buf, "complzss", 8)) {
+        uint32_t csize = be32(buf + 16);
+        if (csize > size - LZSS_HEADER_SIZE) {
+            return -1;
+        }
+        p->kind = PF_PAYLOAD_LZSS;
+        p->adler32 = be32(buf + 8);
+        p->raw_size = be32(buf + 12);
+        p->data = buf + LZSS_HEADER_SIZE;
+        p->size = csize;
+        return 0;
+    }
+    if (size >= 4 && !memcmp(buf, "bvx", 3) && strchr("12n-", buf[3])) {
+        p->kind = PF_PAYLOAD_LZFSE;
+    } else {
+        p->kind = PF_PAYLOAD_RAW;
+    }
+    p->data = buf;
+    p->size = size;
+    return 0;
+}
+
+static int
+open_im4p(struct der seq, struct pf_payload *p)
+{
+    unsigned tag;
+    struct der e, payload;
+    uint64_t raw_size = 0;
+
+    // "IM4P", type, description
+    if (der_next(&seq, &tag, &e) || tag != DER_IA5STRING || !der_string_is(&e, "IM4P")) {
+        return -1;
+    }
+    if (der_next(&seq, &tag, &e) || tag != DER_IA5STRING || e.end - e.p != 4) {
+        return -1;
+    }
+    memcpy(p->type, e.p, 4);
+    p->type[4] = 0;
+    if (der_next(&seq, &tag, &e) || tag != DER_IA5STRING) {
+        return -1;
+    }
+    if (der_next(&seq, &tag, &payload) || tag != DER_OCTETS) {
+        return -1;
+    }
+    while (seq.p < seq.end) {
+        if (der_next(&seq, &tag, &e)) {
+            return -1;
+        }
+        if (tag == DER_OCTETS) {
+            return -1;                  // keybag: the payload is encrypted
+        }
+        if (tag == DER_SEQUENCE) {
+            struct der i;
+            // compression info: INTEGER algorithm (1 = LZFSE), INTEGER size
+            if (der_next(&e, &tag, &i) || tag != DER_INTEGER) {
+                return -1;
+            }
+            if (der_next(&e, &tag, &i) || tag != DER_INTEGER || i.end - i.p > 9) {
+                return -1;
+            }
+            for (raw_size = 0; i.p < i.end; i.p++) {
+                raw_size = (raw_size << 8) | *i.p;
+            }
+        }
+    }
+    if (open_stream(payload.p, payload.end - payload.p, p)) {
+        return -1;
+    }
+    if (raw_size && p->kind != PF_PAYLOAD_LZSS) {
+        p->raw_size = raw_size;
+    }
+    return 0;
+}
+
+int
+pf_payload_open(const uint8_t *buf, size_t size, struct pf_payload *p)
+{
+    unsigned tag;
+    struct der d = { buf, buf + size }, seq, e;
+
+    memset(p, 0, sizeof(*p));
+    if (size < 2 || buf[0] != DER_SEQUENCE || der_next(&d, &tag, &seq)) {
+        return open_stream(buf, size, p);
+    }
+    e = seq;
+    if (der_next(&e, &tag, &d) || tag != DER_IA5STRING) {
+        return open_stream(buf, size, p);
+    }
+    if (der_string_is(&d, "IM4P")) {
+        return open_im4p(seq, p);
+    }
+    if (der_string_is(&d, "IMG4")) {
+        if (der_next(&e, &tag, &d) || tag != DER_SEQUENCE) {
+            return -1;
+        }
+        return open_im4p(d, p);
+    }
+    return open_stream(buf, size, p);
+}
@@ -0,0 +1,35 @@
+//
+//  img4.h
+//  xSpiral
+//
+//  Locates the kernelcache inside an IMG4/IM4P container, or a bare
+//  complzss/LZFSE stream, without copying anything.
+//
+
+#ifndef IMG4_H_
+#define IMG4_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum pf_payload_kind {
+    PF_PAYLOAD_RAW,         // uncompressed, e.g. a Mach-O
+    PF_PAYLOAD_LZSS,        // "complzss"
+    PF_PAYLOAD_LZFSE,       // "bvx2" and friends
+};
+
+struct pf_payload {
+    enum pf_payload_kind kind;
+    const uint8_t *data;    // the compressed stream itself, past any header
+    size_t size;
+    uint64_t raw_size;      // decompressed size, 0 if the container does not say
+    uint32_t adler32;       // complzss checksum of the decompressed data
+    char type[5];           // IM4P type tag such as "krnl", "" if not wrapped
+};
+
+// Fills `p` from an IMG4, IM4P, complzss or LZFSE image.  Anything else is
+// returned as PF_PAYLOAD_RAW covering the whole buffer.  Returns -1 for
+// malformed or encrypted containers.
+int pf_payload_open(const uint8_t *buf, size_t size, struct pf_payload *p);
+
+#endif
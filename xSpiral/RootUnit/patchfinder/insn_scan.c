@@ -0,0 +1,150 @@
+//
+//  insn_scan.c
+//  xSpiral
+//
+
+#include <string.h>
+#include "insn_scan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LANES 8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LANES 4
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define LANES 4
+#else
+#define LANES 1
+#endif
+
+#define MAX_PATTERNS 32
+
+struct scan_state {
+    const struct pf_pattern *pats;
+    pf_scan_fn fn;
+    void *ctx;
+    unsigned active[MAX_PATTERNS];  // indices of patterns still looked for
+    unsigned nactive;
+    unsigned found;
+};
+
+static int
+match_at(const uint32_t *insn, const struct pf_pattern *pat)
+{
+    unsigned i;
+    for (i = 1; i < pat->count; i++) {
+        if ((insn[i] & pat->w[i].mask) != pat->w[i].value) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Confirms every still-active pattern at word `pos`.  Returns nonzero once
+// no pattern is left to look for.
+static int
+check_word(struct scan_state *st, const uint32_t *words, uint64_t pos, uint64_t nwords, uint64_t start)
+{
+    unsigned j = 0;
+    uint32_t op = words[pos];
+    while (j < st->nactive) {
+        unsigned p = st->active[j];
+        const struct pf_pattern *pat = &st->pats[p];
+        if ((op & pat->w[0].mask) == pat->w[0].value && pos + pat->count <= nwords && match_at(words + pos, pat)) {
+            st->found++;
+            if (st->fn(st->ctx, p, start + pos * 4)) {
+                st->active[j] = st->active[--st->nactive];
+                continue;
+            }
+        }
+        j++;
+    }
+    return st->nactive == 0;
+}
+
+unsigned
+pf_scan_each(const uint8_t *buf, uint64_t start, uint64_t end,
+             const struct pf_pattern *pats, unsigned npats, pf_scan_fn fn, void *ctx)
+{
+    struct scan_state st;
+    const uint32_t *words;
+    uint64_t nwords, pos = 0;
+    unsigned i;
+
+    if (npats > MAX_PATTERNS) {
+        npats = MAX_PATTERNS;
+    }
+    st.pats = pats;
+    st.fn = fn;
+    st.ctx = ctx;
+    st.nactive = 0;
+    st.found = 0;
+    for (i = 0; i < npats; i++) {
+        if (pats[i].count && pats[i].count <= PF_PATTERN_MAX) {
+            st.active[st.nactive++] = i;
+        }
+    }
+
+    start &= ~3ULL;
+    end &= ~3ULL;
+    if (end <= start || !st.nactive) {
+        return 0;
+    }
+    words = (const uint32_t *)(buf + start);
+    nwords = (end - start) / 4;
+
+#if LANES > 1
+    while (st.nactive && pos + LANES <= nwords) {
+        unsigned bits = 0;
+#if defined(__AVX2__)
+        __m256i v = _mm256_loadu_si256((const __m256i *)(words + pos));
+        __m256i m = _mm256_setzero_si256();
+        for (i = 0; i < st.nactive; i++) {
+            const struct pf_pattern *pat = &pats[st.active[i]];
+            __m256i x = _mm256_and_si256(v, _mm256_set1_epi32((int)pat->w[0].mask));
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi32(x, _mm256_set1_epi32((int)pat->w[0].value)));
+        }
+        bits = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(m));
+#elif defined(__SSE2__)
+        __m128i v = _mm_loadu_si128((const __m128i *)(words + pos));
+        __m128i m = _mm_setzero_si128();
+        for (i = 0; i < st.nactive; i++) {
+            const struct pf_pattern *pat = &pats[st.active[i]];
+            __m128i x = _mm_and_si128(v, _mm_set1_epi32((int)pat->w[0].mask));
+            m = _mm_or_si128(m, _mm_cmpeq_epi32(x, _mm_set1_epi32((int)pat->w[0].value)));
+        }
+        bits = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(m));
+#else
+        uint32x4_t v = vld1q_u32(words + pos);
+        uint32x4_t m = vdupq_n_u32(0);
+        for (i = 0; i < st.nactive; i++) {
+            const struct pf_pattern *pat = &pats[st.active[i]];
+            uint32x4_t x = vandq_u32(v, vdupq_n_u32(pat->w[0].mask));
+            m = vorrq_u32(m, vceqq_u32(x, vdupq_n_u32(pat->w[0].value)));
+        }
+        if (vmaxvq_u32(m)) {
+            uint32_t lanes[4];
+            vst1q_u32(lanes, m);
+            for (i = 0; i < 4; i++) {
+                bits |= (lanes[i] & 1) << i;
+            }
+        }
+#endif
+        while (bits) {
+            unsigned lane = __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (check_word(&st, words, pos + lane, nwords, start)) {
+                return st.found;
+            }
+        }
+        pos += LANES;
+    }
+#endif	/* LANES > 1 */
+
+    for (; st.nactive && pos < nwords; pos++) {
+        check_word(&st, words, pos, nwords, start);
+    }
+    return st.found;
+}
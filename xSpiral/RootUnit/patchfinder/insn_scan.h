@@ -0,0 +1,45 @@
+//
+//  insn_scan.h
+//  xSpiral
+//
+//  Masked multi-word instruction pattern search.  Several patterns are
+//  looked for in a single sweep; the first word of every pattern is
+//  filtered with SIMD compares (AVX2, SSE2 or NEON, picked at compile
+//  time) and candidates are confirmed word by word.
+//
+
+#ifndef INSN_SCAN_H_
+#define INSN_SCAN_H_
+
+#include <stdint.h>
+
+#define PF_PATTERN_MAX  8
+
+#define INSN_RET  0xD65F03C0, 0xFFFFFFFF
+#define INSN_CALL 0x94000000, 0xFC000000
+#define INSN_B    0x14000000, 0xFC000000
+#define INSN_CBZ  0x34000000, 0xFC000000
+#define INSN_ADRP 0x90000000, 0x9F000000
+#define INSN_WORD(op) (op), 0xFFFFFFFF
+
+// Words are value/mask pairs, so the INSN_* macros can be used directly:
+//     { 2, { { 0x91010000, 0xFFFFFFFF }, { INSN_RET } } }
+struct pf_pattern {
+    unsigned count;
+    struct {
+        uint32_t value;
+        uint32_t mask;
+    } w[PF_PATTERN_MAX];
+};
+
+// Called for each match of pats[which] at offset off, in increasing order
+// of off.  Returning nonzero stops the search for that pattern.
+typedef int (*pf_scan_fn)(void *ctx, unsigned which, uint64_t off);
+
+// Looks for every pattern in [start, end) of buf (4-byte aligned offsets)
+// and reports each match that lies entirely inside the range.  Returns the
+// number of matches reported.  At most 32 patterns per call.
+unsigned pf_scan_each(const uint8_t *buf, uint64_t start, uint64_t end,
+                      const struct pf_pattern *pats, unsigned npats, pf_scan_fn fn, void *ctx);
+
+#endif
@@ -0,0 +1,218 @@
+//
+//  page_cache.c
+//  xSpiral
+//
+//  The span is anonymous memory, so pages that are never fetched never
+//  cost anything.  A page's bit in `present` is only set once its bytes
+//  are in place, and it is set under the lock, so a thread that saw the
+//  range through pf_pager_need() also sees its contents.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "page_cache.h"
+
+#define PAGE_OF(off)    ((off) / PF_PAGE_SIZE)
+
+static int
+is_present(const struct pf_pager *p, uint64_t page)
+{
+    return p->present[page >> 3] & (1 << (page & 7));
+}
+
+static void
+set_present(struct pf_pager *p, uint64_t page)
+{
+    p->present[page >> 3] |= 1 << (page & 7);
+}
+
+// Bytes of the span in `page`; only the last one can be short.
+static uint64_t
+page_len(const struct pf_pager *p, uint64_t page)
+{
+    uint64_t off = page * PF_PAGE_SIZE;
+    return p->size - off < PF_PAGE_SIZE ? p->size - off : PF_PAGE_SIZE;
+}
+
+static int
+fetch(struct pf_pager *p, uint64_t off, void *buf, uint64_t len)
+{
+    p->stats.reads++;
+    p->stats.bytes += len;
+    return p->read(p->ctx, p->base + off, buf, len);
+}
+
+int
+pf_pager_init(struct pf_pager *p, uint64_t base, uint64_t size, unsigned nslots,
+              pf_pager_reader read, void *ctx)
+{
+    unsigned i;
+
+    memset(p, 0, sizeof(*p));
+    if (!size || base + size < base) {
+        return -1;
+    }
+    if (!nslots) {
+        nslots = PF_PAGER_SLOTS;
+    }
+    p->span = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (p->span == MAP_FAILED) {
+        p->span = NULL;
+        return -1;
+    }
+    p->present = calloc((PAGE_OF(size - 1) >> 3) + 1, 1);
+    p->slots = calloc(nslots, sizeof(*p->slots));
+    p->slot_data = malloc((size_t)nslots * PF_PAGE_SIZE);
+    if (!p->present || !p->slots || !p->slot_data) {
+        pf_pager_free(p);
+        return -1;
+    }
+    for (i = 0; i < nslots; i++) {
+        p->slots[i].page = -1;
+    }
+    p->nslots = nslots;
+    p->read = read;
+    p->ctx = ctx;
+    p->base = base;
+    p->size = size;
+    pthread_mutex_init(&p->lock, NULL);
+    return 0;
+}
+
+void
+pf_pager_free(struct pf_pager *p)
+{
+    if (p->span) {
+        munmap(p->span, p->size);
+    }
+    if (p->read) {
+        pthread_mutex_destroy(&p->lock);
+    }
+    free(p->present);
+    free(p->slots);
+    free(p->slot_data);
+    memset(p, 0, sizeof(*p));
+}
+
+void
+pf_pager_fill(struct pf_pager *p, uint64_t off, const void *data, size_t len)
+{
+    uint64_t page;
+
+    if (off >= p->size) {
+        return;
+    }
+    if (len > p->size - off) {
+        len = p->size - off;
+    }
+    memcpy(p->span + off, data, len);
+    pthread_mutex_lock(&p->lock);
+    for (page = PAGE_OF(off + PF_PAGE_SIZE - 1); page * PF_PAGE_SIZE < off + len; page++) {
+        if (page * PF_PAGE_SIZE + page_len(p, page) <= off + len) {
+            set_present(p, page);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+int
+pf_pager_need(struct pf_pager *p, uint64_t off, uint64_t len)
+{
+    uint64_t page, last;
+    int rv = 0;
+
+    if (off > p->size || len > p->size - off) {
+        return -1;
+    }
+    if (!len) {
+        return 0;
+    }
+    last = PAGE_OF(off + len - 1);
+    pthread_mutex_lock(&p->lock);
+    for (page = PAGE_OF(off); page <= last && !rv; page++) {
+        uint64_t run, start, n;
+        if (is_present(p, page)) {
+            continue;
+        }
+        for (run = 1; run < PF_PAGER_MAX_RUN && page + run <= last && !is_present(p, page + run); run++) {
+        }
+        start = page * PF_PAGE_SIZE;
+        n = (page + run - 1) * PF_PAGE_SIZE + page_len(p, page + run - 1) - start;
+        rv = fetch(p, start, p->span + start, n);
+        if (!rv) {
+            for (n = 0; n < run; n++) {
+                set_present(p, page + n);
+            }
+            p->stats.pages += run;
+        }
+        page += run - 1;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return rv;
+}
+
+// The page cache slot holding `page`, fetching it into the least recently
+// used one on a miss.  Called with the lock held.
+static const uint8_t *
+slot_page(struct pf_pager *p, uint64_t page)
+{
+    unsigned i, victim = 0;
+    uint8_t *data;
+
+    for (i = 0; i < p->nslots; i++) {
+        if (p->slots[i].page == page) {
+            p->slots[i].used = ++p->tick;
+            p->stats.hits++;
+            return p->slot_data + (size_t)i * PF_PAGE_SIZE;
+        }
+        if (p->slots[i].used < p->slots[victim].used) {
+            victim = i;
+        }
+    }
+    data = p->slot_data + (size_t)victim * PF_PAGE_SIZE;
+    p->slots[victim].page = -1;
+    if (fetch(p, page * PF_PAGE_SIZE, data, page_len(p, page))) {
+        p->slots[victim].used = 0;
+        return NULL;
+    }
+    p->slots[victim].page = page;
+    p->slots[victim].used = ++p->tick;
+    p->stats.cached++;
+    return data;
+}
+
+int
+pf_pager_read(struct pf_pager *p, uint64_t off, void *buf, size_t len)
+{
+    uint8_t *out = buf;
+    int rv = 0;
+
+    if (off > p->size || len > p->size - off) {
+        return -1;
+    }
+    pthread_mutex_lock(&p->lock);
+    while (len && !rv) {
+        uint64_t page = PAGE_OF(off), in = off - page * PF_PAGE_SIZE;
+        size_t n = PF_PAGE_SIZE - in < len ? PF_PAGE_SIZE - in : len;
+        const uint8_t *src = is_present(p, page) ? p->span + page * PF_PAGE_SIZE : slot_page(p, page);
+        if (!src) {
+            rv = -1;
+            break;
+        }
+        memcpy(out, src + in, n);
+        out += n;
+        off += n;
+        len -= n;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return rv;
+}
+
+void
+pf_pager_get_stats(struct pf_pager *p, struct pf_pager_stats *stats)
+{
+    pthread_mutex_lock(&p->lock);
+    *stats = p->stats;
+    pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,77 @@
+//
+//  page_cache.h
+//  xSpiral
+//
+//  Demand-paged copy of a kernel image read through a pluggable reader
+//  (kread() on the device, anything else on a host).  The image is one
+//  reserved span that the scanners index directly, but pages are only
+//  fetched when a range is asked for, runs of missing pages in one reader
+//  call.  Small scattered reads go through a little LRU cache instead, so
+//  chasing pointers does not leave pages resident in the span.
+//
+
+#ifndef PAGE_CACHE_H_
+#define PAGE_CACHE_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PF_PAGE_SIZE        0x4000
+#define PF_PAGER_MAX_RUN    64      // pages per reader call when filling the span
+#define PF_PAGER_SLOTS      8       // default page cache size
+
+// Reads len bytes at addr.  Returns 0, or -1 if any of them could not be
+// read.
+typedef int (*pf_pager_reader)(void *ctx, uint64_t addr, void *buf, size_t len);
+
+struct pf_pager_stats {
+    uint64_t reads;         // reader calls
+    uint64_t bytes;         // bytes asked of the reader
+    uint64_t pages;         // pages fetched into the span
+    uint64_t cached;        // pages fetched into the page cache
+    uint64_t hits;          // page cache hits
+};
+
+struct pf_pager_slot {
+    uint64_t page;          // page number, or -1 when empty
+    uint64_t used;          // tick of the last hit
+};
+
+struct pf_pager {
+    pf_pager_reader read;
+    void *ctx;
+    uint64_t base;          // address of span[0]
+    uint64_t size;
+    uint8_t *span;
+    uint8_t *present;       // a bit per page of the span
+    pthread_mutex_t lock;
+    struct pf_pager_slot *slots;
+    uint8_t *slot_data;
+    unsigned nslots;
+    uint64_t tick;
+    struct pf_pager_stats stats;
+};
+
+// Reserves size bytes for the image at base without reading any of it.
+// nslots 0 picks PF_PAGER_SLOTS.
+int pf_pager_init(struct pf_pager *p, uint64_t base, uint64_t size, unsigned nslots,
+                  pf_pager_reader read, void *ctx);
+void pf_pager_free(struct pf_pager *p);
+
+// Copies data already read (the header) to span offset off.  Only the
+// pages it covers completely count as fetched.
+void pf_pager_fill(struct pf_pager *p, uint64_t off, const void *data, size_t len);
+
+// Makes span[off, off + len) readable, fetching the pages not yet there.
+// Returns -1 if the range is outside the span or a read failed; the pages
+// fetched before the failure stay.  Safe to call from several threads.
+int pf_pager_need(struct pf_pager *p, uint64_t off, uint64_t len);
+
+// Copies span[off, off + len) to buf without fetching it into the span;
+// pages that are not there come from the page cache.
+int pf_pager_read(struct pf_pager *p, uint64_t off, void *buf, size_t len);
+
+void pf_pager_get_stats(struct pf_pager *p, struct pf_pager_stats *stats);
+
+#endif
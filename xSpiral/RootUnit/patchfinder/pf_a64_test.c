@@ -0,0 +1,332 @@
+//
+//  pf_a64_test.c
+//  xSpiral
+//
+//  Host test for the AArch64 decoder.  A table of fixed encodings, with
+//  the edge immediates and negative offsets of each form, is decoded and
+//  compared field by field; then a short function is walked with each
+//  mask and the registers pf_a64_track() leaves behind are checked.  Last,
+//  the xref index is checked against a scan that restarts with cleared
+//  registers after each reference, as scan_reference() does, for the first
+//  three references to every target in a fixed and a random block.  The
+//  exit status is nonzero on any mismatch.
+//
+
+/*
+ * Not part of the app.  Build from this directory with
+ *     cc -O2 -Wall -I. -o pf_a64_test pf_a64_test.c a64_decode.c xref_index.c
+ * and run "./pf_a64_test".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "a64_decode.h"
+#include "xref_index.h"
+
+#define UNSET 0xDEADBEEFULL
+
+static unsigned failures;
+
+static const struct {
+    const char *text;
+    uint32_t op;
+    uint64_t pc;
+    enum pf_a64_kind kind;
+    unsigned rd, rn;
+    uint64_t imm;
+} cases[] = {
+    { "adrp x0, #0",                0x90000000, 0x1234,      PF_A64_ADRP,    0, 0,  0x1000 },
+    { "adrp x1, #0x1000",           0xB0000001, 0x4000,      PF_A64_ADRP,    1, 0,  0x5000 },
+    { "adrp x2, #-0x1000",          0xF0FFFFE2, 0x10000,     PF_A64_ADRP,    2, 31, 0xF000 },
+    { "adrp x3, #0xfffff000",       0xF07FFFE3, 0,           PF_A64_ADRP,    3, 31, 0xFFFFF000 },
+    { "adrp x4, #-0x100000000",     0x90800004, 0x200000FFC, PF_A64_ADRP,    4, 0,  0x100000000 },
+    { "adr x5, #4",                 0x10000025, 0x100,       PF_A64_ADR,     5, 1,  0x104 },
+    { "adr x6, #-1",                0x70FFFFE6, 0x100,       PF_A64_ADR,     6, 31, 0xFF },
+    { "adr x7, #0xfffff",           0x707FFFE7, 0,           PF_A64_ADR,     7, 31, 0xFFFFF },
+    { "add x8, x9, #0xfff",         0x913FFD28, 0,           PF_A64_ADD,     8, 9,  0xFFF },
+    { "add x8, x8, #1, lsl #12",    0x91400508, 0,           PF_A64_ADD,     8, 8,  0x1000 },
+    { "add x8, x8, #0xfff, lsl #12", 0x917FFD08, 0,          PF_A64_ADD,     8, 8,  0xFFF000 },
+    { "add (reserved shift)",       0x91800000, 0,           PF_A64_OTHER,   0, 0,  0 },
+    { "ldr x9, [x8, #0x10]",        0xF9400909, 0,           PF_A64_LDR,     9, 8,  0x10 },
+    { "ldr x0, [x1, #0x7ff8]",      0xF97FFC20, 0,           PF_A64_LDR,     0, 1,  0x7FF8 },
+    { "ldr x10, [x8]",              0xF940010A, 0,           PF_A64_LDR,     10, 8, 0 },
+    { "str x1, [sp, #8]",           0xF90007E1, 0,           PF_A64_STR,     1, 31, 8 },
+    { "prfm (opc 10)",              0xF9800000, 0,           PF_A64_OTHER,   0, 0,  0 },
+    { "ldr x3, #8",                 0x58000043, 0x40,        PF_A64_LDR_LIT, 3, 2,  0x48 },
+    { "ldr x3, #-8",                0x58FFFFC3, 0x40,        PF_A64_LDR_LIT, 3, 30, 0x38 },
+    { "ldr x3, #0xffffc",           0x587FFFE3, 0,           PF_A64_LDR_LIT, 3, 31, 0xFFFFC },
+    { "ldr x3, #-0x100000",         0x58800003, 0x100000,    PF_A64_LDR_LIT, 3, 0,  0 },
+    { "bl #4",                      0x94000001, 0,           PF_A64_BRANCH,  1, 0,  0 },
+    { "b #-4",                      0x17FFFFFF, 0,           PF_A64_BRANCH,  31, 31, 0 },
+    { "b.eq #8",                    0x54000040, 0,           PF_A64_BRANCH,  0, 2,  0 },
+    { "b.nv #8",                    0x5400004F, 0,           PF_A64_BRANCH,  15, 2, 0 },
+    { "bc.eq #8",                   0x54000050, 0,           PF_A64_OTHER,   0, 0,  0 },
+    { "cbz x0, #8",                 0xB4000040, 0,           PF_A64_BRANCH,  0, 2,  0 },
+    { "tbnz w1, #0, #8",            0x37000041, 0,           PF_A64_BRANCH,  1, 2,  0 },
+    { "blr x8",                     0xD63F0100, 0,           PF_A64_BRANCH,  0, 8,  0 },
+    { "ret",                        0xD65F03C0, 0,           PF_A64_BRANCH,  0, 30, 0 },
+    { "nop",                        0xD503201F, 0,           PF_A64_OTHER,   0, 0,  0 },
+    { "mov x0, x1",                 0xAA0103E0, 0,           PF_A64_OTHER,   0, 0,  0 },
+};
+
+// ADRP page, then an address built up and loaded through, branches and
+// PC-relative forms that reach back to the start.
+static const uint32_t code[] = {
+    0xB0000008,     // 0x00 adrp x8, #0x1000
+    0x91008108,     // 0x04 add x8, x8, #0x20
+    0xD503201F,     // 0x08 nop
+    0xF9400909,     // 0x0c ldr x9, [x8, #0x10]
+    0xF940010A,     // 0x10 ldr x10, [x8]
+    0xF90007E9,     // 0x14 str x9, [sp, #8]
+    0x94000010,     // 0x18 bl #0x40
+    0x54000041,     // 0x1c b.ne #0x8
+    0x10FFFF0B,     // 0x20 adr x11, #-0x20
+    0x58FFFEEC,     // 0x24 ldr x12, #-0x24
+    0xD65F03C0,     // 0x28 ret
+};
+
+// Two references to 0x10020 from one ADRP, which a restarting scan counts
+// once, then one from a second ADRP.
+static const uint32_t xref_code[] = {
+    0x90000008,     // 0x10000 adrp x8, #0
+    0x91008100,     // 0x10004 add x0, x8, #0x20
+    0x91008101,     // 0x10008 add x1, x8, #0x20
+    0xD503201F,     // 0x1000c nop
+    0x90000009,     // 0x10010 adrp x9, #0
+    0x91008122,     // 0x10014 add x2, x9, #0x20
+};
+
+struct walk {
+    uint64_t pcs[16];
+    unsigned n;
+    uint64_t stop_at;
+    uint64_t value[32];
+};
+
+static int
+visit(void *ctx, uint64_t pc, const struct pf_a64_insn *insn)
+{
+    struct walk *w = ctx;
+    if (w->n < sizeof(w->pcs) / sizeof(w->pcs[0])) {
+        w->pcs[w->n++] = pc;
+    }
+    pf_a64_track(w->value, insn);
+    return pc == w->stop_at;
+}
+
+static void
+check_walk(const char *name, uint64_t start, uint64_t end, unsigned kinds, uint64_t stop_at,
+           uint64_t want_end, const uint64_t *want, unsigned n, struct walk *w)
+{
+    unsigned i;
+    uint64_t got;
+    memset(w, 0, sizeof(*w));
+    for (i = 0; i < 32; i++) {
+        w->value[i] = UNSET;
+    }
+    w->stop_at = stop_at;
+    got = pf_a64_walk((const uint8_t *)code, start, end, kinds, visit, w);
+    if (got != want_end || w->n != n || memcmp(w->pcs, want, n * sizeof(*want))) {
+        printf("walk %-12s stopped at 0x%llx after %u visits, want 0x%llx after %u\n", name,
+               (unsigned long long)got, w->n, (unsigned long long)want_end, n);
+        failures++;
+    }
+}
+
+static void
+check_value(unsigned reg, uint64_t value, uint64_t want)
+{
+    if (value != want) {
+        printf("x%u = 0x%llx, want 0x%llx\n", reg, (unsigned long long)value, (unsigned long long)want);
+        failures++;
+    }
+}
+
+// ---- xref index ------------------------------------------------------------
+
+#define XREF_BASE   0x10000     // where the code goes in the buffer
+#define XREF_LIMIT  0x40000
+#define XREF_WORDS  0x800
+
+struct scan {
+    uint64_t what;
+    uint64_t value[32];
+};
+
+static int
+scan_visit(void *ctx, uint64_t pc, const struct pf_a64_insn *insn)
+{
+    struct scan *s = ctx;
+    int reg = pf_a64_track(s->value, insn);
+    (void)pc;
+    return reg >= 0 && s->value[reg] == s->what;
+}
+
+// The nth reference to `what`, starting over with cleared registers after
+// each one found.
+static uint64_t
+scan_reference(const uint8_t *buf, uint64_t start, uint64_t end, uint64_t what, int n)
+{
+    struct scan s;
+    uint64_t ref;
+    s.what = what;
+    for (;;) {
+        memset(s.value, 0, sizeof(s.value));
+        ref = pf_a64_walk(buf, start, end, PF_A64_TRACKED, scan_visit, &s);
+        if (ref == end) {
+            return 0;
+        }
+        if (--n <= 0) {
+            return ref;
+        }
+        start = ref + 4;
+    }
+}
+
+static int
+collect_visit(void *ctx, uint64_t pc, const struct pf_a64_insn *insn)
+{
+    struct scan *s = ctx;
+    uint64_t *targets = (uint64_t *)s->what;
+    int reg = pf_a64_track(s->value, insn);
+    (void)pc;
+    if (reg >= 0 && s->value[reg] >= XREF_BASE && s->value[reg] < XREF_LIMIT) {
+        targets[++targets[0]] = s->value[reg];
+    }
+    return 0;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Compares the index with the restarting scan for every value the code
+// computes, which covers every target either of them can report.
+static void
+check_xrefs(const char *name, const uint32_t *words, unsigned nwords)
+{
+    static uint32_t buf[XREF_LIMIT / 4];
+    static uint64_t targets[XREF_WORDS + 1];
+    struct pf_xref_index idx;
+    struct scan s;
+    uint64_t end = XREF_BASE + nwords * 4;
+    unsigned i, checked = 0, bad = 0;
+    int n;
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf + XREF_BASE / 4, words, nwords * 4);
+    memset(&s, 0, sizeof(s));
+    targets[0] = 0;
+    s.what = (uint64_t)targets;
+    pf_a64_walk((const uint8_t *)buf, XREF_BASE, end, PF_A64_TRACKED, collect_visit, &s);
+    qsort(targets + 1, targets[0], sizeof(*targets), cmp_u64);
+    if (pf_xref_index_build(&idx, (const uint8_t *)buf, XREF_BASE, end, XREF_LIMIT)) {
+        printf("xref %-8s index could not be built\n", name);
+        failures++;
+        return;
+    }
+    for (i = 1; i <= targets[0]; i++) {
+        if (i > 1 && targets[i] == targets[i - 1]) {
+            continue;
+        }
+        for (n = 1; n <= 3; n++) {
+            uint64_t want = scan_reference((const uint8_t *)buf, XREF_BASE, end, targets[i], n);
+            uint64_t got = pf_xref_index_lookup(&idx, targets[i], n);
+            checked++;
+            if (got != want && bad++ < 4) {
+                printf("xref %-8s 0x%llx #%d: index 0x%llx, scan 0x%llx\n", name,
+                       (unsigned long long)targets[i], n, (unsigned long long)got, (unsigned long long)want);
+            }
+        }
+    }
+    pf_xref_index_free(&idx);
+    failures += bad;
+    printf("xref %-8s %u lookups, %s\n", name, checked, bad ? "MISMATCH" : "ok");
+}
+
+// A block of ADRP, ADD, LDR and NOP over x0-x3.  ADD and LDR offsets stay
+// small, so a value built on registers the scan cleared stays below the
+// code and never looks like a target.
+static void
+random_code(uint32_t *words, unsigned n, unsigned seed)
+{
+    unsigned i;
+    srand(seed);
+    for (i = 0; i < n; i++) {
+        unsigned rd = rand() & 3, rn = rand() & 3, page = rand() & 15, imm = (rand() & 0x1F) * 8;
+        switch (rand() % 5) {
+            case 0:
+                words[i] = 0x90000000 | (page & 3) << 29 | (page >> 2) << 5 | rd;
+                break;
+            case 1:
+            case 2:
+                words[i] = 0x91000000 | imm << 10 | rn << 5 | rd;
+                break;
+            case 3:
+                words[i] = 0xF9400000 | (imm ? imm / 8 : 1) << 10 | rn << 5 | rd;
+                break;
+            default:
+                words[i] = 0xD503201F;
+                break;
+        }
+    }
+}
+
+int
+main(void)
+{
+    unsigned i;
+    struct walk w;
+    static const uint64_t tracked[] = { 0x00, 0x04, 0x0c, 0x10, 0x20, 0x24 };
+    static const uint64_t branches[] = { 0x18, 0x1c, 0x28 };
+    static const uint64_t stores[] = { 0x14 };
+    static const uint64_t loads[] = { 0x0c, 0x10 };
+    static const uint64_t stopped[] = { 0x00, 0x04, 0x0c };
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        struct pf_a64_insn insn;
+        enum pf_a64_kind kind;
+        memset(&insn, 0, sizeof(insn));
+        kind = pf_a64_decode(cases[i].op, cases[i].pc, &insn);
+        if (kind != cases[i].kind ||
+            (kind != PF_A64_OTHER && (insn.kind != kind || insn.rd != cases[i].rd || insn.rn != cases[i].rn)) ||
+            (kind != PF_A64_OTHER && kind != PF_A64_BRANCH && insn.imm != cases[i].imm)) {
+            printf("%-28s 0x%08x: kind %d rd %u rn %u imm 0x%llx, want kind %d rd %u rn %u imm 0x%llx\n",
+                   cases[i].text, cases[i].op, kind, insn.rd, insn.rn, (unsigned long long)insn.imm,
+                   cases[i].kind, cases[i].rd, cases[i].rn, (unsigned long long)cases[i].imm);
+            failures++;
+        }
+    }
+    printf("decode: %u encodings, %s\n", i, failures ? "MISMATCH" : "ok");
+
+    check_walk("tracked", 0, sizeof(code), PF_A64_TRACKED, -1, sizeof(code), tracked, 6, &w);
+    check_value(8, w.value[8], 0x1020);
+    check_value(9, w.value[9], 0x1030);
+    check_value(10, w.value[10], UNSET);      // a zero offset is not tracked
+    check_value(11, w.value[11], 0);
+    check_value(12, w.value[12], 0);
+    check_walk("branches", 0, sizeof(code), PF_A64_MASK(PF_A64_BRANCH), -1, sizeof(code), branches, 3, &w);
+    check_walk("stores", 0, sizeof(code), PF_A64_MASK(PF_A64_STR), -1, sizeof(code), stores, 1, &w);
+    check_walk("loads", 0, sizeof(code), PF_A64_MASK(PF_A64_LDR), -1, sizeof(code), loads, 2, &w);
+    check_walk("stop", 0, sizeof(code), PF_A64_TRACKED, 0x0c, 0x0c, stopped, 3, &w);
+    // Offsets are aligned down, so the RET at 0x28 is outside [1, 0x2b).
+    check_walk("unaligned", 1, 0x2b, PF_A64_MASK(PF_A64_BRANCH), -1, 0x28, branches, 2, &w);
+    check_walk("empty", 0x10, 0x10, PF_A64_TRACKED, -1, 0x10, NULL, 0, &w);
+    printf("walk and track: %s\n", failures ? "MISMATCH" : "ok");
+
+    check_xrefs("fixed", xref_code, sizeof(xref_code) / sizeof(xref_code[0]));
+    {
+        static uint32_t words[XREF_WORDS];
+        for (i = 1; i <= 8; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "random%u", i);
+            random_code(words, XREF_WORDS, i);
+            check_xrefs(name, words, XREF_WORDS);
+        }
+    }
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,534 @@
+//
+//  pf_batch.c
+//  xSpiral
+//
+//  Host tool that runs the default finders over a whole archive of
+//  kernelcaches with a fixed ceiling on memory.  Every image goes through
+//  four stages: read (the file is sized from its header or container and
+//  read once into the page cache), decode (init_kernel(), which for a
+//  release kernelcache decompresses all of it), index (pf_build_indices())
+//  and find.  One thread does all the reading; a pool of workers does the
+//  rest, always taking the image furthest along first, so the memory held
+//  by one image is given back before another one is started.  Each image in
+//  flight holds a charge against a global budget, estimated when it is read
+//  and corrected to its real footprint after every stage.  The reader waits
+//  while the budget is spent, which is all the backpressure the pipeline
+//  needs.  All results go into one file, sorted by path.
+//
+
+/*
+ * Not part of the app.  Build from this directory with
+ *     cc -O2 -DPATCHFINDER_HOST -I.. -I. -o pf_batch pf_batch.c pf_driver.c \
+ *        a64_decode.c fixups.c xref_index.c insn_scan.c str_search.c func_index.c \
+ *        reg_cache.c sym_index.c pf_cache.c img4.c decompress.c page_cache.c \
+ *        pf_rules.c prelink_info.c ../patchfinder64.c -lpthread
+ * and run e.g. "./pf_batch -m 4096 -o results.tsv /archive/kernelcaches".
+ * Arguments are kernelcaches or directories of them.  -j sets the number of
+ * workers (all online CPUs by default), -m the budget in MB (half of the
+ * physical memory by default).  With -c, results and xref indices are kept
+ * in that directory as patchfinder64 -c does, and images already analysed
+ * skip the index stage.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "img4.h"
+#include "patchfinder64.h"
+#include "pf_cache.h"
+#include "pf_driver.h"
+
+#define READ_CHUNK      0x100000
+
+// Until an image is decoded its size is a guess: a Mach-O is about as
+// large as its file, a compressed one as large as its container says or,
+// when it does not, this many times its file.  Its tables are guessed at
+// half the image until they are built.
+#define UNKNOWN_RATIO   8
+#define INDEX_SHARE     2
+
+enum stage { STAGE_DECODE, STAGE_INDEX, STAGE_FIND, NUM_STAGES };
+
+static const char *const stage_names[NUM_STAGES] = { "decode", "index", "find" };
+
+struct job {
+    const char *path;
+    uint64_t charge;            // held against the budget
+    int failed;                 // could not be read or decoded
+    struct pf_kernel k;
+    struct pf_result results[PF_MAX_FINDERS];
+    struct job *next;           // in its stage's queue
+};
+
+struct pipeline {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // a queue got a job, or the input ended
+    pthread_cond_t room;        // the budget, or a place in flight, freed up
+    struct job *head[NUM_STAGES];
+    struct job **tail[NUM_STAGES];
+    int reading;                // the reader has more to come
+    uint64_t budget;
+    uint64_t used;
+    uint64_t peak;
+    unsigned in_flight;
+    unsigned max_in_flight;
+    const char *cache;
+    double stage_ms[NUM_STAGES + 1];
+};
+
+static double
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void
+push(struct pipeline *p, enum stage s, struct job *j)
+{
+    j->next = NULL;
+    *p->tail[s] = j;
+    p->tail[s] = &j->next;
+    pthread_cond_signal(&p->work);
+}
+
+// Changes j's charge to n.  Memory already held cannot be waited for, so
+// this may go over budget; only admitting new images waits.
+static void
+recharge(struct pipeline *p, struct job *j, uint64_t n)
+{
+    pthread_mutex_lock(&p->lock);
+    p->used = p->used - j->charge + n;
+    j->charge = n;
+    if (p->peak < p->used) {
+        p->peak = p->used;
+    }
+    pthread_cond_signal(&p->room);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Waits until an image charged n fits in the budget.  One larger than the
+// whole budget is let through once nothing else is in flight, to run alone.
+static void
+admit(struct pipeline *p, struct job *j, uint64_t n)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->in_flight && (p->in_flight >= p->max_in_flight || p->used + n > p->budget)) {
+        pthread_cond_wait(&p->room, &p->lock);
+    }
+    p->in_flight++;
+    p->used += n;
+    j->charge = n;
+    if (p->peak < p->used) {
+        p->peak = p->used;
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void
+retire(struct pipeline *p, struct job *j)
+{
+    pthread_mutex_lock(&p->lock);
+    p->used -= j->charge;
+    j->charge = 0;
+    p->in_flight--;
+    pthread_cond_signal(&p->room);
+    // the last one out lets the idle workers see there is nothing left
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// What the image in fd will take once decoded, going by its first bytes
+// and its container.  Also reads the whole file once, so that decoding it
+// does not wait for the disk.
+static uint64_t
+estimate(int fd, uint64_t file_size, uint8_t *buf)
+{
+    struct pf_payload payload;
+    uint64_t size = file_size, off;
+    ssize_t n;
+    void *file;
+
+    n = pread(fd, buf, READ_CHUNK, 0);
+    if (n < 4 || (*(uint32_t *)buf & ~1) != 0xfeedface) {
+        size = file_size * UNKNOWN_RATIO;
+        file = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file != MAP_FAILED) {
+            if (!pf_payload_open(file, file_size, &payload) && payload.raw_size) {
+                size = payload.raw_size;
+            }
+            munmap(file, file_size);
+        }
+    }
+    for (off = n > 0 ? (uint64_t)n : 0; n > 0 && off < file_size; off += n) {
+        n = pread(fd, buf, READ_CHUNK, off);
+    }
+    return size + size / INDEX_SHARE;
+}
+
+static void
+read_stage(struct pipeline *p, struct job *jobs, size_t n)
+{
+    size_t i;
+    uint8_t *buf = malloc(READ_CHUNK);
+    double t;
+
+    for (i = 0; i < n; i++) {
+        struct job *j = &jobs[i];
+        struct stat st;
+        uint64_t charge = 0;
+        int fd;
+        t = now_ms();
+        fd = open(j->path, O_RDONLY);
+        if (fd >= 0 && !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0 && buf) {
+            charge = estimate(fd, st.st_size, buf);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        pthread_mutex_lock(&p->lock);
+        p->stage_ms[NUM_STAGES] += now_ms() - t;
+        pthread_mutex_unlock(&p->lock);
+        if (!charge) {
+            fprintf(stderr, "%s: read failed\n", j->path);
+            j->failed = 1;
+            continue;
+        }
+        admit(p, j, charge);
+        pthread_mutex_lock(&p->lock);
+        push(p, STAGE_DECODE, j);
+        pthread_mutex_unlock(&p->lock);
+    }
+    pthread_mutex_lock(&p->lock);
+    p->reading = 0;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    free(buf);
+}
+
+static void *
+worker(void *arg)
+{
+    struct pipeline *p = arg;
+
+    for (;;) {
+        struct job *j = NULL;
+        enum stage s = NUM_STAGES;
+        uint64_t code;
+        double t;
+        int next;
+
+        pthread_mutex_lock(&p->lock);
+        for (;;) {
+            for (next = NUM_STAGES - 1; next >= 0 && !p->head[next]; next--) {
+            }
+            if (next >= 0 || (!p->reading && !p->in_flight)) {
+                break;
+            }
+            pthread_cond_wait(&p->work, &p->lock);
+        }
+        if (next >= 0) {
+            s = next;
+            j = p->head[s];
+            p->head[s] = j->next;
+            if (!p->head[s]) {
+                p->tail[s] = &p->head[s];
+            }
+        }
+        pthread_mutex_unlock(&p->lock);
+        if (!j) {
+            return NULL;
+        }
+
+        t = now_ms();
+        switch (s) {
+            case STAGE_DECODE:
+                if (init_kernel(&j->k, 0, j->path)) {
+                    fprintf(stderr, "%s: %s failed\n", j->path, stage_names[s]);
+                    j->failed = 1;
+                    break;
+                }
+                code = j->k.xnucore_size + j->k.prelink_size;
+                recharge(p, j, pf_kernel_footprint(&j->k) + code / INDEX_SHARE);
+                break;
+            case STAGE_INDEX:
+                // with a cache the indices may well not be needed
+                if (!p->cache) {
+                    pf_build_indices(&j->k);
+                }
+                recharge(p, j, pf_kernel_footprint(&j->k));
+                break;
+            default:
+                pf_run_finders_cached(&j->k, pf_default_finders, pf_num_default_finders, 1, j->results, p->cache);
+                term_kernel(&j->k);
+                break;
+        }
+        t = now_ms() - t;
+
+        pthread_mutex_lock(&p->lock);
+        p->stage_ms[s] += t;
+        if (!j->failed && s + 1 < NUM_STAGES) {
+            push(p, s + 1, j);
+            j = NULL;
+        }
+        pthread_mutex_unlock(&p->lock);
+        if (j) {
+            retire(p, j);
+        }
+    }
+}
+
+static int
+add_path(char ***paths, size_t *n, size_t *cap, char *path)
+{
+    if (!path) {
+        return -1;
+    }
+    if (*n == *cap) {
+        size_t c = *cap ? *cap * 2 : 64;
+        char **v = realloc(*paths, c * sizeof(*v));
+        if (!v) {
+            free(path);
+            return -1;
+        }
+        *paths = v;
+        *cap = c;
+    }
+    (*paths)[(*n)++] = path;
+    return 0;
+}
+
+// A file, or every regular non-hidden file directly inside a directory.
+static int
+collect(char ***paths, size_t *n, size_t *cap, const char *arg)
+{
+    struct stat st;
+    struct dirent *de;
+    DIR *dir;
+
+    if (stat(arg, &st)) {
+        perror(arg);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return add_path(paths, n, cap, strdup(arg));
+    }
+    dir = opendir(arg);
+    if (!dir) {
+        perror(arg);
+        return -1;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        char *path;
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        if (asprintf(&path, "%s/%s", arg, de->d_name) < 0) {
+            path = NULL;
+        }
+        if (path && (stat(path, &st) || !S_ISREG(st.st_mode))) {
+            free(path);
+            continue;
+        }
+        if (add_path(paths, n, cap, path)) {
+            closedir(dir);
+            return -1;
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+static int
+cmp_path(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// One line per image: its path, then every finder's value, 0 for a finder
+// that failed and "-" throughout for an image that could not be loaded.
+static void
+emit(FILE *f, const struct job *jobs, size_t n)
+{
+    size_t i;
+    unsigned j;
+    fprintf(f, "# path");
+    for (j = 0; j < pf_num_default_finders; j++) {
+        fprintf(f, "\t%s", pf_default_finders[j].name);
+    }
+    fprintf(f, "\n");
+    for (i = 0; i < n; i++) {
+        fprintf(f, "%s", jobs[i].path);
+        for (j = 0; j < pf_num_default_finders; j++) {
+            if (jobs[i].failed) {
+                fprintf(f, "\t-");
+            } else {
+                fprintf(f, "\t0x%016llx", (unsigned long long)jobs[i].results[j].value);
+            }
+        }
+        fprintf(f, "\n");
+    }
+}
+
+// The peak resident set of this process, from /proc on Linux; 0 elsewhere.
+static unsigned long
+peak_rss_kb(void)
+{
+    char line[256];
+    unsigned long kb = 0;
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmHWM: %lu kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+int
+main(int argc, char **argv)
+{
+    int ch, s, rv = 1;
+    unsigned i, nworkers = 0, failed = 0;
+    unsigned long budget_mb = 0;
+    const char *out = NULL;
+    char **paths = NULL;
+    size_t npaths = 0, cap = 0, n;
+    struct pipeline p;
+    struct job *jobs = NULL;
+    pthread_t *threads = NULL;
+    double t;
+    FILE *f = stdout;
+
+    memset(&p, 0, sizeof(p));
+    while ((ch = getopt(argc, argv, "c:j:m:o:")) != -1) {
+        switch (ch) {
+            case 'c': p.cache = optarg; break;
+            case 'j': nworkers = atoi(optarg); break;
+            case 'm': budget_mb = strtoul(optarg, NULL, 0); break;
+            case 'o': out = optarg; break;
+            default: goto usage;
+        }
+    }
+    if (optind == argc) {
+usage:
+        fprintf(stderr, "usage: %s [-c cache-dir] [-j workers] [-m budget-MB] [-o results] kernelcache-or-dir...\n", argv[0]);
+        return 1;
+    }
+    for (; optind < argc; optind++) {
+        if (collect(&paths, &npaths, &cap, argv[optind])) {
+            n = npaths;
+            goto done;
+        }
+    }
+    if (npaths) {
+        qsort(paths, npaths, sizeof(*paths), cmp_path);
+    }
+    for (i = n = 0; i < npaths; i++) {
+        if (n && !strcmp(paths[n - 1], paths[i])) {
+            free(paths[i]);
+            continue;
+        }
+        paths[n++] = paths[i];
+    }
+
+    if (!nworkers) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = ncpu > 0 ? ncpu : 1;
+    }
+    if (!budget_mb) {
+        long pages = sysconf(_SC_PHYS_PAGES), size = sysconf(_SC_PAGESIZE);
+        budget_mb = pages > 0 && size > 0 ? (unsigned long)((uint64_t)pages * size / 2 >> 20) : 1024;
+    }
+    jobs = calloc(n ? n : 1, sizeof(*jobs));
+    threads = calloc(nworkers, sizeof(*threads));
+    if (!jobs || !threads) {
+        fprintf(stderr, "out of memory\n");
+        goto done;
+    }
+    for (i = 0; i < n; i++) {
+        jobs[i].path = paths[i];
+    }
+
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.work, NULL);
+    pthread_cond_init(&p.room, NULL);
+    for (s = 0; s < NUM_STAGES; s++) {
+        p.tail[s] = &p.head[s];
+    }
+    p.reading = 1;
+    p.budget = (uint64_t)budget_mb << 20;
+    // enough to keep every stage busy, few enough not to read far ahead
+    p.max_in_flight = 2 * nworkers + 1;
+
+    t = now_ms();
+    for (i = 0; i < nworkers; i++) {
+        if (pthread_create(&threads[i], NULL, worker, &p)) {
+            break;
+        }
+    }
+    if (i < nworkers) {
+        // nothing was queued; the workers already started see that and exit
+        fprintf(stderr, "cannot start workers\n");
+        pthread_mutex_lock(&p.lock);
+        p.reading = 0;
+        pthread_cond_broadcast(&p.work);
+        pthread_mutex_unlock(&p.lock);
+        while (i) {
+            pthread_join(threads[--i], NULL);
+        }
+        goto done;
+    }
+    read_stage(&p, jobs, n);
+    for (i = 0; i < nworkers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    t = now_ms() - t;
+
+    if (out) {
+        f = fopen(out, "w");
+        if (!f) {
+            perror(out);
+            goto done;
+        }
+    }
+    emit(f, jobs, n);
+    if (out && fclose(f)) {
+        perror(out);
+        goto done;
+    }
+
+    for (i = 0; i < n; i++) {
+        failed += jobs[i].failed;
+    }
+    fprintf(stderr, "%zu images (%u could not be loaded) in %.1f ms with %u workers\n", n, failed, t, nworkers);
+    fprintf(stderr, "stage time: read %.1f ms", p.stage_ms[NUM_STAGES]);
+    for (s = 0; s < NUM_STAGES; s++) {
+        fprintf(stderr, ", %s %.1f ms", stage_names[s], p.stage_ms[s]);
+    }
+    fprintf(stderr, "\npeak charged %.1f MB of a %lu MB budget, peak resident %.1f MB\n",
+            p.peak / 1048576.0, budget_mb, peak_rss_kb() / 1024.0);
+    rv = failed ? 2 : 0;
+
+done:
+    for (i = 0; i < n; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    free(jobs);
+    free(threads);
+    return rv;
+}
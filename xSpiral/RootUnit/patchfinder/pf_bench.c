@@ -0,0 +1,735 @@
+//
+//  pf_bench.c
+//  xSpiral
+//
+//  Host tool that generates a synthetic kernelcache of a chosen size, runs
+//  every default finder against it and reports per-finder time and
+//  throughput.  The idioms the finders look for are planted near the end of
+//  their code ranges, after pseudo-random filler with a realistic mix of
+//  loads, stores, moves, branches, ADRPs and prologues, so each finder has
+//  to get through the whole range.  Every result is checked against where
+//  the idiom was planted; the exit status is nonzero on any mismatch, so
+//  the same run doubles as a regression check.  The prelinked range is
+//  split between kexts listed in a generated __PRELINK_INFO, and a string
+//  reference planted in the last one is looked up both ways, over all of
+//  __PLK_TEXT_EXEC and within that kext, to show what scoping saves.  The
+//  image is also compressed with complzss and loaded both directly and by
+//  decompressing it to a temporary file first, the way it was done before
+//  init_kernel() read containers itself.
+//
+
+/*
+ * Not part of the app.  Build from this directory with
+ *     cc -O2 -DPATCHFINDER_HOST -I.. -I. -o pf_bench pf_bench.c pf_driver.c \
+ *        a64_decode.c fixups.c xref_index.c insn_scan.c str_search.c func_index.c \
+ *        reg_cache.c sym_index.c img4.c decompress.c page_cache.c pf_rules.c \
+ *        prelink_info.c ../patchfinder64.c -lpthread
+ * and run e.g. "./pf_bench -s 64 -p 16 -n 5".  -o keeps the generated image
+ * for use with the other tools.  Last, each finder is run on an image loaded
+ * through init_kernel_paged() to report the pages and bytes it fetches.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "decompress.h"
+#include "img4.h"
+#include "macho_loader.h"
+#include "patchfinder64.h"
+#include "pf_driver.h"
+
+#define BENCH_BASE  0xFFFFFFF007004000ULL
+#define BENCH_PAGE  0x4000
+#define BENCH_KEXTS 16
+#define BENCH_PLIST (2 * BENCH_PAGE)
+
+static const char pgrp_string[] = "\"pgrp_add : pgrp is dead adding process\"";
+static const char copyout_string[] = "\"%s(%p, %p, %lu) - transfer too large\"";
+static const char kext_string[] = "\"bench kext: command queue overflow\"";
+
+// Segments are laid out back to back, in this order, both in the file and
+// in VA space.  __PRELINK_TEXT holds a header page and a string page per
+// kext; the kexts' code is __PLK_TEXT_EXEC in equal slices.
+enum { SEG_TEXT, SEG_PLK_TEXT, SEG_EXEC, SEG_PLK, SEG_DATA, SEG_LINKEDIT, SEG_PLK_INFO, NUM_SEGS };
+
+static const char *const seg_names[NUM_SEGS] = {
+    "__TEXT", "__PRELINK_TEXT", "__TEXT_EXEC", "__PLK_TEXT_EXEC", "__DATA", "__LINKEDIT", "__PRELINK_INFO",
+};
+
+// The one section of a segment, if it has one, from `offset` to its end.
+static const struct {
+    const char *name;
+    addr_t offset;
+} seg_sections[NUM_SEGS] = {
+    [SEG_TEXT] = { "__cstring", BENCH_PAGE },
+    [SEG_PLK_TEXT] = { "__text", 0 },
+    [SEG_PLK_INFO] = { "__info", 0 },
+};
+
+struct layout {
+    addr_t vmaddr[NUM_SEGS];
+    addr_t fileoff[NUM_SEGS];
+    addr_t size[NUM_SEGS];
+    addr_t cstring;
+    addr_t cstring_size;
+    addr_t file_size;
+};
+
+struct expect {
+    const char *name;
+    addr_t value;
+};
+
+static void
+kext_id(char *buf, size_t len, unsigned i)
+{
+    snprintf(buf, len, "com.apple.bench.kext%u", i);
+}
+
+static double
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static uint64_t
+xorshift(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static uint32_t
+adrp(unsigned rd, addr_t pc, addr_t target)
+{
+    int64_t imm = (int64_t)((target & ~0xFFFULL) - (pc & ~0xFFFULL)) >> 12;
+    return 0x90000000 | ((imm & 3) << 29) | (((imm >> 2) & 0x7FFFF) << 5) | rd;
+}
+
+static uint32_t
+add_imm(unsigned rd, unsigned rn, unsigned imm)
+{
+    return 0x91000000 | ((imm & 0xFFF) << 10) | (rn << 5) | rd;
+}
+
+// One filler instruction.  None of these can complete an idiom: there are
+// no RETs, no SUB SP, SP, #0x50, no DC ZVA, and ADRPs only point at __DATA,
+// which lies above every string.
+static uint32_t
+filler(uint64_t *seed, addr_t pc, const struct layout *l)
+{
+    uint64_t r = xorshift(seed);
+    unsigned rd = r & 0x1F, rn = (r >> 5) & 0x1F, imm = (r >> 10) & 0xFFF;
+    switch ((r >> 32) & 15) {
+        case 0: case 1: case 2: case 3:
+            return 0xAA0003E0 | (rn << 16) | rd;                // MOV Xd, Xn
+        case 4: case 5: case 6:
+            return 0xF9400000 | (imm << 10) | (rn << 5) | rd;   // LDR Xd, [Xn, #imm]
+        case 7: case 8:
+            return 0xF9000000 | (imm << 10) | (rn << 5) | rd;   // STR Xd, [Xn, #imm]
+        case 9:
+            return add_imm(rd, rn, imm);
+        case 10:
+            return 0x94000000 | ((r >> 40) & 0x3FFFF);          // BL
+        case 11:
+            return adrp(rd, pc, l->vmaddr[SEG_DATA]);
+        case 12:
+            return 0x54000000 | (((r >> 40) & 0x3FF) << 5) | (rd & 0xF);    // B.cond
+        case 13:
+            return 0xF1000000 | (imm << 10) | (rn << 5) | rd;   // SUBS Xd, Xn, #imm
+        default:
+            return 0xD503201F;                                  // NOP
+    }
+}
+
+static void
+fill_code(uint32_t *code, addr_t vmaddr, addr_t size, uint64_t *seed, const struct layout *l)
+{
+    addr_t i, n = size / 4;
+    for (i = 0; i < n; i++) {
+        if ((i & 0xFF) == 0 && i + 2 <= n) {
+            code[i++] = 0xA9BF7BFD;     // STP X29, X30, [SP, #-0x10]!
+            code[i] = 0x910003FD;       // ADD X29, SP, #0
+            continue;
+        }
+        code[i] = filler(seed, vmaddr + i * 4, l);
+    }
+}
+
+// Lays out and fills the whole file.  The planted idioms mirror what each
+// finder looks for; ex[] receives where they ended up.
+static uint8_t *
+build_image(struct layout *l, addr_t exec_size, addr_t plk_size, uint64_t seed, struct expect *ex)
+{
+    unsigned i;
+    uint8_t *img;
+    uint32_t *exec, *plk, *w;
+    addr_t pc, pos, s_pgrp, s_copyout, s_kext, allproc, slice;
+    struct mach_header_64 *mh;
+    uint8_t *q;
+    char *plist, id[64];
+    size_t len;
+
+    l->cstring_size = BENCH_PAGE;
+    l->size[SEG_TEXT] = BENCH_PAGE + l->cstring_size;
+    l->size[SEG_PLK_TEXT] = BENCH_KEXTS * 2 * BENCH_PAGE;
+    l->size[SEG_EXEC] = exec_size;
+    l->size[SEG_PLK] = plk_size;
+    l->size[SEG_DATA] = BENCH_PAGE;
+    l->size[SEG_LINKEDIT] = BENCH_PAGE;
+    l->size[SEG_PLK_INFO] = BENCH_PLIST;
+    for (i = 0, pos = 0; i < NUM_SEGS; i++) {
+        l->fileoff[i] = pos;
+        l->vmaddr[i] = BENCH_BASE + pos;
+        pos += l->size[i];
+    }
+    l->file_size = pos;
+    l->cstring = l->vmaddr[SEG_TEXT] + BENCH_PAGE;
+
+    img = calloc(1, l->file_size);
+    if (!img) {
+        return NULL;
+    }
+
+    // Mach-O header and one LC_SEGMENT_64 per segment, with the sections
+    // the finders look for.
+    mh = (struct mach_header_64 *)img;
+    mh->magic = MH_MAGIC_64;
+    mh->cputype = 0x0100000C;
+    mh->filetype = 2;
+    mh->ncmds = NUM_SEGS;
+    q = (uint8_t *)(mh + 1);
+    for (i = 0; i < NUM_SEGS; i++) {
+        struct segment_command_64 *seg = (struct segment_command_64 *)q;
+        seg->cmd = LC_SEGMENT_64;
+        seg->cmdsize = sizeof(*seg) + (seg_sections[i].name ? sizeof(struct section_64) : 0);
+        strncpy(seg->segname, seg_names[i], sizeof(seg->segname) - 1);
+        seg->vmaddr = l->vmaddr[i];
+        seg->vmsize = l->size[i];
+        seg->fileoff = l->fileoff[i];
+        seg->filesize = l->size[i];
+        seg->maxprot = seg->initprot = 5;
+        if (seg_sections[i].name) {
+            struct section_64 *sec = (struct section_64 *)(seg + 1);
+            strncpy(sec->sectname, seg_sections[i].name, sizeof(sec->sectname) - 1);
+            strncpy(sec->segname, seg_names[i], sizeof(sec->segname) - 1);
+            sec->addr = l->vmaddr[i] + seg_sections[i].offset;
+            sec->size = l->size[i] - seg_sections[i].offset;
+            sec->offset = l->fileoff[i] + seg_sections[i].offset;
+            seg->nsects = 1;
+        }
+        q += seg->cmdsize;
+    }
+    mh->sizeofcmds = q - (uint8_t *)(mh + 1);
+
+    s_pgrp = l->cstring + 64;
+    s_copyout = s_pgrp + sizeof(pgrp_string) + 15;
+    memcpy(img + s_pgrp - BENCH_BASE, pgrp_string, sizeof(pgrp_string));
+    memcpy(img + s_copyout - BENCH_BASE, copyout_string, sizeof(copyout_string));
+
+    exec = (uint32_t *)(img + l->fileoff[SEG_EXEC]);
+    plk = (uint32_t *)(img + l->fileoff[SEG_PLK]);
+    fill_code(exec, l->vmaddr[SEG_EXEC], exec_size, &seed, l);
+    fill_code(plk, l->vmaddr[SEG_PLK], plk_size, &seed, l);
+
+    // allproc: prologue, the string reference, then the global loaded into
+    // X8 ahead of AND W8, W8, #0xFFFFDFFF.
+    allproc = l->vmaddr[SEG_DATA] + 0x100;
+    w = exec + (exec_size - 0x50000) / 4;
+    pc = l->vmaddr[SEG_EXEC] + exec_size - 0x50000;
+    w[0] = 0xA9BF7BFD;
+    w[1] = 0x910003FD;
+    w[2] = adrp(0, pc + 8, s_pgrp);
+    w[3] = add_imm(0, 0, s_pgrp & 0xFFF);
+    w[4] = adrp(8, pc + 16, allproc);
+    w[5] = add_imm(8, 8, allproc & 0xFFF);
+    w[6] = 0xD503201F;
+    w[7] = 0xD503201F;
+    w[8] = 0x12127908;
+    ex[0] = (struct expect){ "allproc", allproc };
+
+    // copyout: SUB SP, SP, #0x50 and, inside the function, two references
+    // to its panic string.
+    w = exec + (exec_size - 0x40000) / 4;
+    pc = l->vmaddr[SEG_EXEC] + exec_size - 0x40000;
+    w[0] = 0xD10143FF;
+    for (i = 4; i <= 8; i += 4) {
+        w[i] = adrp(1, pc + i * 4, s_copyout);
+        w[i + 1] = add_imm(1, 1, s_copyout & 0xFFF);
+    }
+    ex[1] = (struct expect){ "copyout", pc };
+
+    // bzero: a function containing DC ZVA, X3.
+    w = exec + (exec_size - 0x30000) / 4;
+    pc = l->vmaddr[SEG_EXEC] + exec_size - 0x30000;
+    w[0] = 0xA9BF7BFD;
+    w[1] = 0x910003FD;
+    w[4] = 0xD50B7423;
+    ex[2] = (struct expect){ "bzero", pc };
+
+    // bcopy: the argument swap in front of memmove.
+    w = exec + (exec_size - 0x20000) / 4;
+    pc = l->vmaddr[SEG_EXEC] + exec_size - 0x20000;
+    w[0] = 0xAA0003E3;
+    w[1] = 0xAA0103E0;
+    w[2] = 0xAA0303E1;
+    w[3] = 0xD503201F;
+    ex[3] = (struct expect){ "bcopy", pc };
+
+    // The gadget only exists in the prelinked kexts, so the finder has to
+    // miss in __TEXT_EXEC first.
+    w = plk + (plk_size - 0x10000) / 4;
+    pc = l->vmaddr[SEG_PLK] + plk_size - 0x10000;
+    w[0] = 0x91010000;
+    w[1] = 0xD65F03C0;
+    ex[4] = (struct expect){ "add_x0_x0_0x40_ret", pc };
+
+    // The kexts: a header page whose __TEXT covers it and the string page
+    // after it, and a slice of __PLK_TEXT_EXEC as __TEXT_EXEC.  The plist
+    // lists them the way the kernelcache writer does, a repeated size given
+    // once with an ID and then by IDREF.
+    slice = plk_size / BENCH_KEXTS;
+    plist = (char *)img + l->fileoff[SEG_PLK_INFO];
+    len = snprintf(plist, BENCH_PLIST,
+                   "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                   "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+                   "<plist version=\"1.0\"><dict><key>_PrelinkInfoDictionary</key><array>");
+    for (i = 0; i < BENCH_KEXTS; i++) {
+        addr_t hdr = l->vmaddr[SEG_PLK_TEXT] + i * 2 * BENCH_PAGE;
+        struct segment_command_64 *seg;
+        struct section_64 *sec;
+        mh = (struct mach_header_64 *)(img + hdr - BENCH_BASE);
+        mh->magic = MH_MAGIC_64;
+        mh->cputype = 0x0100000C;
+        mh->filetype = 0xB;     // MH_KEXT_BUNDLE
+        mh->ncmds = 2;
+        mh->sizeofcmds = 2 * sizeof(*seg) + sizeof(*sec);
+        seg = (struct segment_command_64 *)(mh + 1);
+        seg->cmd = LC_SEGMENT_64;
+        seg->cmdsize = sizeof(*seg) + sizeof(*sec);
+        strncpy(seg->segname, "__TEXT", sizeof(seg->segname) - 1);
+        seg->vmaddr = hdr;
+        seg->vmsize = seg->filesize = 2 * BENCH_PAGE;
+        seg->fileoff = hdr - BENCH_BASE;
+        seg->nsects = 1;
+        sec = (struct section_64 *)(seg + 1);
+        strncpy(sec->sectname, "__cstring", sizeof(sec->sectname) - 1);
+        strncpy(sec->segname, "__TEXT", sizeof(sec->segname) - 1);
+        sec->addr = hdr + BENCH_PAGE;
+        sec->size = BENCH_PAGE;
+        sec->offset = seg->fileoff + BENCH_PAGE;
+        seg = (struct segment_command_64 *)(sec + 1);
+        seg->cmd = LC_SEGMENT_64;
+        seg->cmdsize = sizeof(*seg);
+        strncpy(seg->segname, "__TEXT_EXEC", sizeof(seg->segname) - 1);
+        seg->vmaddr = l->vmaddr[SEG_PLK] + i * slice;
+        seg->vmsize = seg->filesize = slice;
+        seg->fileoff = l->fileoff[SEG_PLK] + i * slice;
+        kext_id(id, sizeof(id), i);
+        len += snprintf(plist + len, BENCH_PLIST - len,
+                        "<dict><key>CFBundleIdentifier</key><string ID=\"%u\">%s</string>"
+                        "<key>_PrelinkExecutableLoadAddr</key><integer size=\"64\">0x%llx</integer>"
+                        "<key>_PrelinkExecutableSize</key>",
+                        i + 2, id, (unsigned long long)hdr);
+        if (i) {
+            len += snprintf(plist + len, BENCH_PLIST - len, "<integer size=\"64\" IDREF=\"1\"/></dict>");
+        } else {
+            len += snprintf(plist + len, BENCH_PLIST - len, "<integer size=\"64\" ID=\"1\">0x%llx</integer></dict>",
+                            (unsigned long long)slice);
+        }
+    }
+    snprintf(plist + len, BENCH_PLIST - len, "</array></dict></plist>\n");
+
+    // A string used by the last kext, referenced from the middle of its code.
+    // The reference is off the page boundary, so with a 128K slice it does
+    // not land on the gadget above.
+    s_kext = l->vmaddr[SEG_PLK_TEXT] + (2 * BENCH_KEXTS - 1) * BENCH_PAGE + 64;
+    memcpy(img + s_kext - BENCH_BASE, kext_string, sizeof(kext_string));
+    pc = l->vmaddr[SEG_PLK] + plk_size - slice / 2 + 64;
+    w = plk + (plk_size - slice / 2 + 64) / 4;
+    w[0] = adrp(2, pc, s_kext);
+    w[1] = add_imm(2, 2, s_kext & 0xFFF);
+    ex[5] = (struct expect){ "kext_strref", pc + 4 };
+
+    return img;
+}
+
+static addr_t
+expected(const struct expect *ex, unsigned n, const char *name)
+{
+    unsigned i;
+    for (i = 0; i < n; i++) {
+        if (!strcmp(ex[i].name, name)) {
+            return ex[i].value;
+        }
+    }
+    return 0;
+}
+
+// A greedy complzss encoder with one candidate per 3-byte hash, enough to
+// give the decoder a realistic mix of literals and matches.  Distances stay
+// within the part of the 4K dictionary the decoder has already written.
+#define LZSS_N      4096
+#define LZSS_F      18
+#define LZSS_HASH   (1 << 16)
+
+static void
+put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint8_t *
+lzss_encode(const uint8_t *src, size_t len, size_t *out_len)
+{
+    uint8_t *out = malloc(0x180 + len + len / 8 + 2);
+    uint32_t *head = calloc(LZSS_HASH, sizeof(*head));     // position + 1
+    uint32_t a = 1, b = 0;
+    size_t pos = 0, o = 0x180, flag = 0, i;
+    unsigned bit = 8;
+
+    if (!out || !head) {
+        free(out);
+        free(head);
+        return NULL;
+    }
+    memset(out, 0, 0x180);
+    while (pos < len) {
+        size_t best = 0, from = 0;
+        if (bit == 8) {
+            flag = o++;
+            out[flag] = 0;
+            bit = 0;
+        }
+        if (pos + 3 <= len) {
+            unsigned h = ((src[pos] << 8 | src[pos + 1]) * 31 + src[pos + 2] * 2654435761U) % LZSS_HASH;
+            size_t cand = head[h];
+            head[h] = (uint32_t)pos + 1;
+            if (cand-- && pos - cand <= LZSS_N - LZSS_F) {
+                while (best < LZSS_F && pos + best < len && src[cand + best] == src[pos + best]) {
+                    best++;
+                }
+                from = cand;
+            }
+        }
+        if (best >= 3) {
+            unsigned r = (LZSS_N - LZSS_F + from) & (LZSS_N - 1);
+            out[o++] = r & 0xFF;
+            out[o++] = ((r >> 4) & 0xF0) | (best - 3);
+            pos += best;
+        } else {
+            out[flag] |= 1 << bit;
+            out[o++] = src[pos++];
+        }
+        bit++;
+    }
+    free(head);
+
+    for (i = 0; i < len; ) {
+        size_t n = len - i < 5552 ? len - i : 5552;
+        for (; n; n--, i++) {
+            a += src[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    memcpy(out, "complzss", 8);
+    put_be32(out + 8, b << 16 | a);
+    put_be32(out + 12, (uint32_t)len);
+    put_be32(out + 16, (uint32_t)(o - 0x180));
+    *out_len = o;
+    return out;
+}
+
+static int
+write_file(const char *path, const void *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f || fwrite(data, 1, len, f) != len) {
+        if (f) {
+            fclose(f);
+        }
+        return -1;
+    }
+    return fclose(f);
+}
+
+static int
+write_chunk(void *ctx, const uint8_t *data, size_t len)
+{
+    return fwrite(data, 1, len, ctx) == len ? 0 : -1;
+}
+
+// What loading a compressed kernelcache took before init_kernel() read
+// containers itself: decompress the whole file to a temporary Mach-O, then
+// load that.
+static int
+load_via_temp(struct pf_kernel *k, const char *path)
+{
+    char tmp[] = "/tmp/pf_bench.raw.XXXXXX";
+    struct pf_payload payload;
+    struct stat st;
+    void *file;
+    FILE *f;
+    int fd, rv = -1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) || (file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    fd = mkstemp(tmp);
+    f = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (f) {
+        rv = pf_payload_open(file, st.st_size, &payload) || pf_decode_payload(&payload, write_chunk, f);
+        rv = fclose(f) || rv ? -1 : init_kernel(k, 0, tmp);
+        unlink(tmp);
+    }
+    munmap(file, st.st_size);
+    return rv;
+}
+
+int
+main(int argc, char **argv)
+{
+    int ch, fd, status = 0;
+    unsigned i, r, runs = 3, nthreads = 0;
+    unsigned long exec_mb = 16, plk_mb = 4;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    const char *out = NULL;
+    char tmp[] = "/tmp/pf_bench.XXXXXX";
+    char ztmp[] = "/tmp/pf_bench.lzss.XXXXXX";
+    uint8_t *z;
+    size_t zlen;
+    const char *path;
+    struct layout l;
+    struct expect ex[6];
+    struct pf_kernel k, file;
+    struct pf_pager_stats st;
+    struct pf_result results[PF_MAX_FINDERS];
+    double best, t, mb;
+    uint8_t *img;
+    char id[64];
+    unsigned long long scanned[2];
+    FILE *f;
+
+    while ((ch = getopt(argc, argv, "j:n:o:p:r:s:")) != -1) {
+        switch (ch) {
+            case 'j': nthreads = atoi(optarg); break;
+            case 'n': runs = atoi(optarg); break;
+            case 'o': out = optarg; break;
+            case 'p': plk_mb = strtoul(optarg, NULL, 0); break;
+            case 'r': seed = strtoull(optarg, NULL, 0); break;
+            case 's': exec_mb = strtoul(optarg, NULL, 0); break;
+            default: goto usage;
+        }
+    }
+    if (optind != argc || exec_mb < 1 || plk_mb < 1 || runs < 1 || !seed) {
+usage:
+        fprintf(stderr, "usage: %s [-s exec-MB] [-p prelink-MB] [-n runs] [-j threads] [-r seed] [-o image]\n", argv[0]);
+        return 1;
+    }
+
+    img = build_image(&l, exec_mb << 20, plk_mb << 20, seed, ex);
+    if (!img) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if (out) {
+        path = out;
+        f = fopen(out, "wb");
+    } else {
+        path = tmp;
+        fd = mkstemp(tmp);
+        f = fd < 0 ? NULL : fdopen(fd, "wb");
+    }
+    if (!f || fwrite(img, 1, l.file_size, f) != l.file_size || fclose(f)) {
+        fprintf(stderr, "%s: cannot write image\n", path);
+        return 1;
+    }
+    z = lzss_encode(img, l.file_size, &zlen);
+    fd = z ? mkstemp(ztmp) : -1;
+    if (fd < 0 || close(fd) || write_file(ztmp, z, zlen)) {
+        fprintf(stderr, "%s: cannot write compressed image\n", ztmp);
+        return 1;
+    }
+    free(z);
+    free(img);
+
+    mb = (double)((exec_mb + plk_mb) << 20) / (1 << 20);
+    printf("image: %lu MB __TEXT_EXEC, %lu MB __PLK_TEXT_EXEC, best of %u runs\n", exec_mb, plk_mb, runs);
+
+    // Each finder on a fresh image, so none of them benefits from tables
+    // another one built.
+    for (i = 0; i < pf_num_default_finders; i++) {
+        const struct pf_finder *fi = &pf_default_finders[i];
+        addr_t want = expected(ex, sizeof(ex) / sizeof(ex[0]), fi->name);
+        addr_t got = 0;
+        best = -1;
+        for (r = 0; r < runs; r++) {
+            if (init_kernel(&k, 0, path)) {
+                fprintf(stderr, "%s: cannot load image\n", path);
+                status = 1;
+                goto done;
+            }
+            t = now_ms();
+            got = pf_run_finder(&k, fi);
+            t = now_ms() - t;
+            term_kernel(&k);
+            if (best < 0 || t < best) {
+                best = t;
+            }
+        }
+        printf("%-24s 0x%016llx %10.3f ms %10.1f MB/s  %s\n", fi->name, got, best,
+               best > 0 ? mb / (best / 1e3) : 0, got == want ? "ok" : "MISMATCH");
+        if (got != want) {
+            status = 2;
+        }
+    }
+
+    // All of them together, sharing the lazily built tables.
+    best = -1;
+    for (r = 0; r < runs; r++) {
+        if (init_kernel(&k, 0, path)) {
+            status = 1;
+            goto done;
+        }
+        t = now_ms();
+        pf_run_finders(&k, pf_default_finders, pf_num_default_finders, nthreads, results);
+        t = now_ms() - t;
+        term_kernel(&k);
+        if (best < 0 || t < best) {
+            best = t;
+        }
+    }
+    printf("%-24s %18s %10.3f ms %10.1f MB/s\n", "all", "", best, best > 0 ? mb / (best / 1e3) : 0);
+
+    // The same image as complzss, loaded directly and the old way, through a
+    // decompressed temporary file.  Both must give the image loaded above.
+    if (init_kernel(&file, 0, path)) {
+        status = 1;
+        goto done;
+    }
+    printf("complzss image, %.2f MB for %.2f MB:\n", zlen / 1048576.0, l.file_size / 1048576.0);
+    for (i = 0; i < 2; i++) {
+        int same = 1;
+        best = -1;
+        for (r = 0; r < runs; r++) {
+            t = now_ms();
+            if (i ? load_via_temp(&k, ztmp) : init_kernel(&k, 0, ztmp)) {
+                fprintf(stderr, "%s: cannot load compressed image\n", ztmp);
+                status = 1;
+                break;
+            }
+            t = now_ms() - t;
+            same &= k.kernel_size == file.kernel_size && !memcmp(k.kernel, file.kernel, k.kernel_size);
+            term_kernel(&k);
+            if (best < 0 || t < best) {
+                best = t;
+            }
+        }
+        printf("%-24s %18s %10.3f ms %10.1f MB/s  %s\n", i ? "via temp file" : "direct", "", best,
+               best > 0 ? l.file_size / 1048576.0 / (best / 1e3) : 0, same ? "ok" : "MISMATCH");
+        if (!same) {
+            status = 2;
+        }
+    }
+    term_kernel(&file);
+
+    // Each finder once more on a fresh demand-paged image, read from the
+    // file image the way kread() reads the kernel on the device: what it
+    // fetches, out of how much.
+    if (init_kernel(&file, 0, path)) {
+        status = 1;
+        goto done;
+    }
+    printf("demand-paged, %llu pages in the image:\n", (unsigned long long)(file.kernel_size + PF_PAGE_SIZE - 1) / PF_PAGE_SIZE);
+    for (i = 0; i < pf_num_default_finders; i++) {
+        const struct pf_finder *fi = &pf_default_finders[i];
+        addr_t want = expected(ex, sizeof(ex) / sizeof(ex[0]), fi->name);
+        addr_t got;
+        if (init_kernel_paged(&k, (uint8_t *)file.kernel_mh - file.kernel + file.kerndumpbase, pf_kernel_reader, &file)) {
+            status = 1;
+            break;
+        }
+        k.use_xref_index = 0;       // as on the device
+        got = pf_run_finder(&k, fi);
+        pf_pager_get_stats(k.pager, &st);
+        term_kernel(&k);
+        printf("%-24s %8llu pages %4llu cached %6llu reads %10.2f MB read  %s\n", fi->name,
+               (unsigned long long)st.pages, (unsigned long long)st.cached, (unsigned long long)st.reads,
+               st.bytes / 1048576.0, got == want ? "ok" : "MISMATCH");
+        if (got != want) {
+            status = 2;
+        }
+    }
+
+    // The string and reference in the last kext, searched for over all of
+    // the prelinked range and over that kext alone (its ranges read from
+    // __PRELINK_INFO, which is counted against it).
+    kext_id(id, sizeof(id), BENCH_KEXTS - 1);
+    printf("%s in %s, of %u kexts:\n", kext_string, id, BENCH_KEXTS);
+    for (i = 0; i < 2; i++) {
+        addr_t want = expected(ex, sizeof(ex) / sizeof(ex[0]), "kext_strref");
+        addr_t got = 0;
+        best = -1;
+        for (r = 0; r < runs; r++) {
+            if (init_kernel(&k, 0, path)) {
+                status = 1;
+                goto done;
+            }
+            t = now_ms();
+            got = i ? find_kext_strref(&k, id, kext_string, 1) : find_strref(&k, kext_string, 1, 1);
+            t = now_ms() - t;
+            term_kernel(&k);
+            if (best < 0 || t < best) {
+                best = t;
+            }
+        }
+        if (init_kernel_paged(&k, (uint8_t *)file.kernel_mh - file.kernel + file.kerndumpbase, pf_kernel_reader, &file)) {
+            status = 1;
+            break;
+        }
+        k.use_xref_index = 0;       // as on the device
+        if ((i ? find_kext_strref(&k, id, kext_string, 1) : find_strref(&k, kext_string, 1, 1)) != got) {
+            got = 0;
+        }
+        pf_pager_get_stats(k.pager, &st);
+        term_kernel(&k);
+        scanned[i] = st.bytes;
+        printf("%-24s 0x%016llx %10.3f ms %10.2f MB read  %s\n", i ? "find_kext_strref" : "find_strref", got, best,
+               st.bytes / 1048576.0, got == want ? "ok" : "MISMATCH");
+        if (got != want) {
+            status = 2;
+        }
+    }
+    if (i == 2 && scanned[0]) {
+        printf("scoping to the kext saved %.2f MB of %.2f MB read (%.0f%%)\n", (scanned[0] - (double)scanned[1]) / 1048576.0,
+               scanned[0] / 1048576.0, 100.0 * (scanned[0] - (double)scanned[1]) / scanned[0]);
+    }
+    term_kernel(&file);
+
+done:
+    if (!out) {
+        unlink(tmp);
+    }
+    unlink(ztmp);
+    return status;
+}
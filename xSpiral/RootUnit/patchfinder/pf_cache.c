@@ -0,0 +1,244 @@
+//
+//  pf_cache.c
+//  xSpiral
+//
+//  File layout: a header, one fixed-size record per finder result (failures
+//  included, as value 0), then optionally the two xref indices exactly as
+//  pf_write_xrefs() emits them.  Files are replaced by rename() so a reader
+//  never sees a half-written cache.
+//
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "macho_loader.h"
+#include "pf_cache.h"
+
+#define CACHE_MAGIC 0x43524650  // 'PFRC'
+
+struct cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t key[16];
+    uint32_t count;
+    uint32_t has_xrefs;
+};
+
+struct cache_entry {
+    char name[32];
+    uint64_t value;
+};
+
+int
+pf_image_key(const struct pf_kernel *k, uint8_t key[16])
+{
+    const struct mach_header_64 *mh = k->kernel_mh;
+    const uint8_t *q, *end;
+    uint64_t h1 = 0xcbf29ce484222325ULL, h2 = 0x84222325cbf29ce4ULL;
+    unsigned i;
+
+    if (!mh || mh->magic != MH_MAGIC_64) {
+        return -1;
+    }
+    q = (const uint8_t *)(mh + 1);
+    end = q + mh->sizeofcmds;
+    if (end > k->kernel + k->kernel_size) {
+        return -1;
+    }
+    for (i = 0; i < mh->ncmds && q + sizeof(struct load_command) <= end; i++) {
+        const struct load_command *cmd = (const struct load_command *)q;
+        if (cmd->cmd == LC_UUID && cmd->cmdsize >= sizeof(struct uuid_command)) {
+            memcpy(key, ((const struct uuid_command *)q)->uuid, 16);
+            return 0;
+        }
+        if (cmd->cmdsize < sizeof(*cmd) || (cmd->cmdsize & 7)) {
+            break;
+        }
+        q += cmd->cmdsize;
+    }
+    // No UUID: two independent FNV-1a passes over the header and commands.
+    for (q = (const uint8_t *)mh; q < end; q++) {
+        h1 = (h1 ^ *q) * 0x100000001b3ULL;
+        h2 = (h2 ^ *q) * 0x100000001b3ULL + 1;
+    }
+    memcpy(key, &h1, 8);
+    memcpy(key + 8, &h2, 8);
+    return 0;
+}
+
+static void
+cache_path(char *path, size_t size, const char *dir, const uint8_t key[16])
+{
+    int i, n = snprintf(path, size, "%s/", dir);
+    for (i = 0; i < 16 && n > 0 && (size_t)n < size; i++) {
+        n += snprintf(path + n, size - n, "%02x", key[i]);
+    }
+    if (n > 0 && (size_t)n < size) {
+        snprintf(path + n, size - n, ".pfc");
+    }
+}
+
+// Reads the result records of a cache file.  Returns the number read, or
+// -1 if the file is missing, stale or for a different image.
+static int
+read_entries(FILE *f, const uint8_t key[16], struct cache_entry **entries, int *has_xrefs)
+{
+    struct cache_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1) {
+        return -1;
+    }
+    if (hdr.magic != CACHE_MAGIC || hdr.version != PF_CACHE_VERSION || memcmp(hdr.key, key, 16) || hdr.count > 0x10000) {
+        return -1;
+    }
+    *entries = calloc(hdr.count ? hdr.count : 1, sizeof(**entries));
+    if (!*entries) {
+        return -1;
+    }
+    if (hdr.count && fread(*entries, sizeof(**entries), hdr.count, f) != hdr.count) {
+        free(*entries);
+        *entries = NULL;
+        return -1;
+    }
+    *has_xrefs = hdr.has_xrefs;
+    return hdr.count;
+}
+
+static int
+write_cache(struct pf_kernel *k, const char *path, const uint8_t key[16],
+            const struct pf_result *results, unsigned n)
+{
+    char tmp[PATH_MAX + 16];
+    struct cache_header hdr;
+    unsigned i;
+    int rv = 0;
+    FILE *f;
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    f = fopen(tmp, "wb");
+    if (!f) {
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = CACHE_MAGIC;
+    hdr.version = PF_CACHE_VERSION;
+    memcpy(hdr.key, key, 16);
+    hdr.count = n;
+    hdr.has_xrefs = k->use_xref_index;
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        rv = -1;
+    }
+    for (i = 0; i < n && !rv; i++) {
+        struct cache_entry e;
+        memset(&e, 0, sizeof(e));
+        strncpy(e.name, results[i].name, sizeof(e.name) - 1);
+        e.value = results[i].value;
+        if (fwrite(&e, sizeof(e), 1, f) != 1) {
+            rv = -1;
+        }
+    }
+    if (!rv && hdr.has_xrefs) {
+        rv = pf_write_xrefs(k, f);
+    }
+    if (fclose(f)) {
+        rv = -1;
+    }
+    if (!rv) {
+        rv = rename(tmp, path);
+    }
+    if (rv) {
+        unlink(tmp);
+    }
+    return rv;
+}
+
+unsigned
+pf_run_finders_cached(struct pf_kernel *k, const struct pf_finder *finders, unsigned n,
+                      unsigned nthreads, struct pf_result *results, const char *dir)
+{
+    char path[PATH_MAX];
+    uint8_t key[16];
+    struct cache_entry *entries = NULL;
+    int count = -1, has_xrefs = 0;
+    unsigned i, j, nmissing = 0, failed = 0;
+    FILE *f;
+
+    if (!dir || !n || pf_image_key(k, key)) {
+        return pf_run_finders(k, finders, n, nthreads, results);
+    }
+    cache_path(path, sizeof(path), dir, key);
+
+    f = fopen(path, "rb");
+    if (f) {
+        count = read_entries(f, key, &entries, &has_xrefs);
+    }
+
+    {
+        struct pf_finder missing[n];
+        struct pf_result computed[n];
+        unsigned where[n];
+
+        for (i = 0; i < n; i++) {
+            results[i].name = finders[i].name;
+            results[i].ms = 0;
+            for (j = 0; (int)j < count; j++) {
+                if (!strncmp(entries[j].name, finders[i].name, sizeof(entries[j].name))) {
+                    break;
+                }
+            }
+            if ((int)j < count) {
+                results[i].value = entries[j].value;
+            } else {
+                where[nmissing] = i;
+                missing[nmissing++] = finders[i];
+            }
+        }
+
+        if (nmissing) {
+            // The indices only help when something has to be scanned again.
+            if (f && has_xrefs && k->use_xref_index) {
+                pf_read_xrefs(k, f);
+            }
+            pf_run_finders(k, missing, nmissing, nthreads, computed);
+            for (i = 0; i < nmissing; i++) {
+                results[where[i]] = computed[i];
+            }
+        }
+    }
+    if (f) {
+        fclose(f);
+    }
+
+    if (nmissing) {
+        // Keep results for finders that were not asked for this time.  The
+        // file can hold far more than a stack has room for.
+        struct pf_result *all = malloc((n + (count > 0 ? count : 0)) * sizeof(*all));
+        unsigned nall = n;
+        if (all) {
+            memcpy(all, results, n * sizeof(*results));
+            for (j = 0; (int)j < count; j++) {
+                for (i = 0; i < n; i++) {
+                    if (!strncmp(entries[j].name, finders[i].name, sizeof(entries[j].name))) {
+                        break;
+                    }
+                }
+                if (i == n) {
+                    all[nall].name = entries[j].name;
+                    all[nall].value = entries[j].value;
+                    all[nall].ms = 0;
+                    nall++;
+                }
+            }
+            write_cache(k, path, key, all, nall);
+            free(all);
+        }
+    }
+    free(entries);
+
+    for (i = 0; i < n; i++) {
+        if (!results[i].value) {
+            failed++;
+        }
+    }
+    return failed;
+}
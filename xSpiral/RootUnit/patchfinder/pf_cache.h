@@ -0,0 +1,30 @@
+//
+//  pf_cache.h
+//  xSpiral
+//
+//  Content-addressed on-disk cache of finder results and xref indices, so
+//  analysing a kernelcache that has been seen before skips the scans.
+//
+
+#ifndef PF_CACHE_H_
+#define PF_CACHE_H_
+
+#include "pf_driver.h"
+
+// Bump whenever a finder, or anything a finder depends on, changes what it
+// returns.  Cache files written by any other version are ignored.
+#define PF_CACHE_VERSION 3
+
+// Identifies an image by its LC_UUID or, without one, by a hash of its
+// Mach-O header and load commands.
+int pf_image_key(const struct pf_kernel *k, uint8_t key[16]);
+
+// Runs finders[0..n) like pf_run_finders(), but takes whatever results
+// <dir>/<key>.pfc already holds and only runs the rest.  When anything had
+// to be computed the file is rewritten with all results and the xref
+// indices, which are also loaded from it on the next run.  A NULL dir
+// disables the cache.
+unsigned pf_run_finders_cached(struct pf_kernel *k, const struct pf_finder *finders, unsigned n,
+                               unsigned nthreads, struct pf_result *results, const char *dir);
+
+#endif
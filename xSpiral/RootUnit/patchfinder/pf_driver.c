@@ -0,0 +1,125 @@
+//
+//  pf_driver.c
+//  xSpiral
+//
+//  Finders only read the image and build their shared lookup tables under
+//  the handle's locks, so each one can run on its own thread.  Workers pull
+//  the next finder off a shared counter until the list is exhausted.
+//
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "pf_driver.h"
+
+#define MAX_THREADS 64
+
+const struct pf_finder pf_default_finders[] = {
+    { "allproc",            find_allproc },
+    { "add_x0_x0_0x40_ret", find_add_x0_x0_0x40_ret },
+    { "copyout",            find_copyout },
+    { "bzero",              find_bzero },
+    { "bcopy",              find_bcopy },
+};
+
+const unsigned pf_num_default_finders = sizeof(pf_default_finders) / sizeof(pf_default_finders[0]);
+
+_Static_assert(sizeof(pf_default_finders) / sizeof(pf_default_finders[0]) <= PF_MAX_FINDERS, "grow PF_MAX_FINDERS");
+
+struct job {
+    struct pf_kernel *k;
+    const struct pf_finder *finders;
+    struct pf_result *results;
+    unsigned n;
+    unsigned next;
+};
+
+static double
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+addr_t
+pf_run_finder(struct pf_kernel *k, const struct pf_finder *f)
+{
+    return f->find ? f->find(k) : pf_find_rule(k, f->name);
+}
+
+static void *
+worker(void *arg)
+{
+    struct job *job = arg;
+    for (;;) {
+        unsigned i = __sync_fetch_and_add(&job->next, 1);
+        double t;
+        if (i >= job->n) {
+            break;
+        }
+        t = now_ms();
+        job->results[i].name = job->finders[i].name;
+        job->results[i].value = pf_run_finder(job->k, &job->finders[i]);
+        job->results[i].ms = now_ms() - t;
+    }
+    return NULL;
+}
+
+unsigned
+pf_run_finders(struct pf_kernel *k, const struct pf_finder *finders, unsigned n,
+               unsigned nthreads, struct pf_result *results)
+{
+    struct job job;
+    pthread_t threads[MAX_THREADS];
+    unsigned i, started = 0, failed = 0;
+
+    if (!nthreads) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (unsigned)ncpu : 1;
+    }
+    if (nthreads > n) {
+        nthreads = n;
+    }
+    if (nthreads > MAX_THREADS) {
+        nthreads = MAX_THREADS;
+    }
+
+    job.k = k;
+    job.finders = finders;
+    job.results = results;
+    job.n = n;
+    job.next = 0;
+
+    // The calling thread is always one of the workers.
+    for (i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[started], NULL, worker, &job)) {
+            break;
+        }
+        started++;
+    }
+    worker(&job);
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!results[i].value) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+void
+pf_print_results(FILE *f, const struct pf_result *results, unsigned n)
+{
+    unsigned i;
+    for (i = 0; i < n; i++) {
+        if (results[i].value) {
+            fprintf(f, "%-24s 0x%016llx %10.3f ms\n", results[i].name, results[i].value, results[i].ms);
+        } else {
+            fprintf(f, "%-24s %-18s %10.3f ms\n", results[i].name, "FAILED", results[i].ms);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+//
+//  pf_driver.h
+//  xSpiral
+//
+//  Runs a declared list of finders against one loaded image on a small
+//  pool of threads and collects a result table.
+//
+
+#ifndef PF_DRIVER_H_
+#define PF_DRIVER_H_
+
+#include <stdio.h>
+#include "patchfinder64.h"
+
+struct pf_finder {
+    const char *name;
+    addr_t (*find)(struct pf_kernel *k);    // NULL for the rule of that name (pf_rules.h)
+};
+
+struct pf_result {
+    const char *name;
+    addr_t value;       // 0 when the finder failed
+    double ms;          // wall time spent inside the finder
+};
+
+// Room for a result per default finder, for callers that keep the results
+// on the stack.  pf_driver.c checks the table against it.
+#define PF_MAX_FINDERS  16
+
+extern const struct pf_finder pf_default_finders[];
+extern const unsigned pf_num_default_finders;
+
+addr_t pf_run_finder(struct pf_kernel *k, const struct pf_finder *f);
+
+// Runs finders[0..n) with up to nthreads workers (0 picks the number of
+// online CPUs).  results[i] belongs to finders[i].  Returns the number of
+// finders that failed.
+unsigned pf_run_finders(struct pf_kernel *k, const struct pf_finder *finders, unsigned n,
+                        unsigned nthreads, struct pf_result *results);
+
+void pf_print_results(FILE *f, const struct pf_result *results, unsigned n);
+
+#endif
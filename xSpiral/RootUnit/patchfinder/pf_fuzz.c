@@ -0,0 +1,169 @@
+//
+//  pf_fuzz.c
+//  xSpiral
+//
+//  Feeds malformed kernelcaches through init_kernel(), pf_resolve_pointers(),
+//  every default finder and the kext list, and those once more through a
+//  demand-paged copy from init_kernel_paged().  Built with -fsanitize=fuzzer it is a libFuzzer
+//  target; without it, it is a standalone driver that mutates a seed image
+//  with a seeded PRNG, so a failure reproduces from the same seed.  Most
+//  mutations land in the Mach-O header and load commands, where they do the
+//  most damage, and one in four runs also truncates the file.
+//
+
+/*
+ * Not part of the app.  Build from this directory with
+ *     cc -O1 -g -fsanitize=address,undefined -DPATCHFINDER_HOST -I.. -I. \
+ *        -o pf_fuzz pf_fuzz.c pf_driver.c a64_decode.c fixups.c xref_index.c \
+ *        insn_scan.c str_search.c func_index.c reg_cache.c sym_index.c img4.c \
+ *        decompress.c page_cache.c pf_rules.c prelink_info.c ../patchfinder64.c \
+ *        -lpthread
+ * and run "./pf_fuzz [-n iterations] [-r seed] seed-image"; "pf_bench -s 1
+ * -p 1 -o seed-image" makes a small seed.  For libFuzzer add
+ * -fsanitize=fuzzer -DPF_LIBFUZZER and pass a corpus directory instead.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "patchfinder64.h"
+#include "pf_driver.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static char image_path[] = "/tmp/pf_fuzz.XXXXXX";
+static int image_fd = -1;
+
+// init_kernel() takes a path, so every input goes through one scratch file.
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    struct pf_kernel k, paged;
+    struct pf_result results[PF_MAX_FINDERS];
+
+    if (image_fd < 0) {
+        image_fd = mkstemp(image_path);
+        if (image_fd < 0) {
+            abort();
+        }
+        unlink(image_path);
+        snprintf(image_path, sizeof(image_path), "/dev/fd/%d", image_fd);
+    }
+    if (ftruncate(image_fd, 0) || pwrite(image_fd, data, size, 0) != (ssize_t)size) {
+        abort();
+    }
+    if (init_kernel(&k, 0, image_path)) {
+        return 0;
+    }
+    if (!init_kernel_paged(&paged, (uint8_t *)k.kernel_mh - k.kernel + k.kerndumpbase, pf_kernel_reader, &k)) {
+        pf_run_finders(&paged, pf_default_finders, pf_num_default_finders, 1, results);
+        pf_get_kexts(&paged);
+        term_kernel(&paged);
+    }
+    pf_resolve_pointers(&k);
+    pf_run_finders(&k, pf_default_finders, pf_num_default_finders, 1, results);
+    pf_get_kexts(&k);
+    term_kernel(&k);
+    return 0;
+}
+
+#ifndef PF_LIBFUZZER
+static uint64_t
+xorshift(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static size_t
+mutate(uint8_t *buf, size_t size, uint64_t *seed)
+{
+    unsigned i, n = 1 + xorshift(seed) % 8;
+    size_t hot = size < 0x4000 ? size : 0x4000;
+
+    for (i = 0; i < n; i++) {
+        uint64_t r = xorshift(seed);
+        size_t span = (r & 3) ? hot : size;
+        size_t off = (r >> 8) % span;
+        switch ((r >> 2) & 3) {
+            case 0:
+                buf[off] ^= 1 << ((r >> 4) & 7);
+                break;
+            case 1:
+                buf[off] = r >> 56;
+                break;
+            default:
+                // a whole field: offsets, sizes and counts are 32/64-bit
+                off &= ~(size_t)3;
+                if (off + 8 <= size) {
+                    uint64_t v = xorshift(seed);
+                    if (r & 0x10) {
+                        v &= 0xFFFF;
+                    }
+                    memcpy(buf + off, &v, (r & 0x20) ? 8 : 4);
+                }
+                break;
+        }
+    }
+    if ((xorshift(seed) & 3) == 0) {
+        size = xorshift(seed) % size;
+    }
+    return size;
+}
+
+int
+main(int argc, char **argv)
+{
+    int ch;
+    unsigned long i, iterations = 10000;
+    uint64_t seed = 1;
+    uint8_t *orig, *buf;
+    size_t size;
+    FILE *f;
+
+    while ((ch = getopt(argc, argv, "n:r:")) != -1) {
+        switch (ch) {
+            case 'n': iterations = strtoul(optarg, NULL, 0); break;
+            case 'r': seed = strtoull(optarg, NULL, 0); break;
+            default: goto usage;
+        }
+    }
+    if (optind != argc - 1 || !seed) {
+usage:
+        fprintf(stderr, "usage: %s [-n iterations] [-r seed] seed-image\n", argv[0]);
+        return 1;
+    }
+
+    f = fopen(argv[optind], "rb");
+    if (!f || fseek(f, 0, SEEK_END) || (long)(size = ftell(f)) <= 0) {
+        fprintf(stderr, "%s: cannot read\n", argv[optind]);
+        return 1;
+    }
+    orig = malloc(size);
+    buf = malloc(size);
+    rewind(f);
+    if (!orig || !buf || fread(orig, 1, size, f) != size) {
+        fprintf(stderr, "%s: cannot read\n", argv[optind]);
+        return 1;
+    }
+    fclose(f);
+
+    for (i = 0; i < iterations; i++) {
+        uint64_t s = (seed + i) * 0x9E3779B97F4A7C15ULL;
+        memcpy(buf, orig, size);
+        LLVMFuzzerTestOneInput(buf, mutate(buf, size, &s));
+        if ((i + 1) % 1000 == 0) {
+            printf("%lu inputs, seed %llu\n", i + 1, (unsigned long long)seed);
+            fflush(stdout);
+        }
+    }
+    printf("%lu inputs, no faults\n", iterations);
+    free(orig);
+    free(buf);
+    return 0;
+}
+#endif	/* !PF_LIBFUZZER */
@@ -0,0 +1,240 @@
+//
+//  pf_gendb.c
+//  xSpiral
+//
+//  Host tool that runs the patchfinder over a directory of kernelcaches (raw
+//  or IMG4/IM4P) and writes the offsets_db.c table used by parameters_init().
+//  Files must be named <device>_<build>[.anything], e.g.
+//  iPhone11,8_16C50.kernelcache.  Output is sorted by device and then build
+//  and carries no timestamps, so the same inputs always give the same file.
+//
+
+/*
+ * Not part of the app.  Build from this directory with
+ *     cc -O2 -DPATCHFINDER_HOST -I.. -I. -I../../PostExploit/vouncher_swap/voucher_swap \
+ *        -o pf_gendb pf_gendb.c pf_driver.c a64_decode.c fixups.c xref_index.c \
+ *        insn_scan.c str_search.c func_index.c reg_cache.c sym_index.c pf_cache.c \
+ *        img4.c decompress.c page_cache.c pf_rules.c prelink_info.c \
+ *        ../patchfinder64.c -lpthread
+ * With -C, the table is generated in memory and compared with an existing
+ * file instead of written; the exit status is 3 if they differ.
+ * pf_gendb.expected is the table for a pf_bench fixture, and checks out with
+ *     mkdir db && ./pf_bench -s 1 -p 1 -n 1 -o db/Bench1,1_0A000.kernelcache
+ *     ./pf_gendb -C pf_gendb.expected db
+ * The fixture is not a real build, so the app's offsets_db.c does not carry it.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "patchfinder64.h"
+#include "pf_cache.h"
+#include "offsets_db.h"
+
+static const struct pf_finder db_finders[] = {
+#define DB_FINDER(name_) { #name_, find_##name_ },
+    OFFSETS_DB_FIELDS(DB_FINDER)
+#undef DB_FINDER
+};
+
+#define NUM_FIELDS (sizeof(db_finders) / sizeof(db_finders[0]))
+
+struct image {
+    char *path;
+    char *device;
+    char *build;
+};
+
+static int
+cmp_image(const void *a, const void *b)
+{
+    const struct image *x = a, *y = b;
+    int rv = strcmp(x->device, y->device);
+    return rv ? rv : strcmp(x->build, y->build);
+}
+
+// Splits "<device>_<build>[.ext]" into its parts.  Returns -1 for anything
+// else, including hidden files.
+static int
+parse_name(const char *name, struct image *img)
+{
+    const char *sep = strchr(name, '_');
+    size_t blen;
+    if (name[0] == '.' || !sep || sep == name) {
+        return -1;
+    }
+    blen = strcspn(sep + 1, ".");
+    if (!blen) {
+        return -1;
+    }
+    img->device = strndup(name, sep - name);
+    img->build = strndup(sep + 1, blen);
+    return (img->device && img->build) ? 0 : -1;
+}
+
+// Whether the file at path holds exactly len bytes at data.
+static int
+same_file(const char *path, const char *data, size_t len)
+{
+    char buf[4096];
+    size_t n, off = 0;
+    int same = 1;
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    while (same && (n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        same = n <= len - off && !memcmp(buf, data + off, n);
+        off += n;
+    }
+    fclose(f);
+    return same && off == len;
+}
+
+static void
+emit(FILE *f, const struct image *imgs, const addr_t *values, unsigned n)
+{
+    unsigned i, j;
+    fprintf(f, "/*\n * offsets_db.c\n * Generated by pf_gendb from %u kernelcache%s. Do not edit.\n */\n", n, n == 1 ? "" : "s");
+    fprintf(f, "#include \"offsets_db.h\"\n\n");
+    fprintf(f, "const struct offsets_db_entry offsets_db[] = {\n");
+    for (i = 0; i < n; i++) {
+        fprintf(f, "\t{ \"%s\", \"%s\",\n", imgs[i].device, imgs[i].build);
+        for (j = 0; j < NUM_FIELDS; j++) {
+            fprintf(f, "\t\t.%s = 0x%016llx,\n", db_finders[j].name, values[i * NUM_FIELDS + j]);
+        }
+        fprintf(f, "\t},\n");
+    }
+    fprintf(f, "\t{ NULL },\n};\n\n");
+    fprintf(f, "const size_t offsets_db_count = %u;\n", n);
+}
+
+int
+main(int argc, char **argv)
+{
+    int ch, status = 0;
+    unsigned i, j, n = 0, cap = 0, nthreads = 0;
+    const char *out = NULL, *cache = NULL, *check = NULL;
+    char *text = NULL;
+    size_t len = 0;
+    struct image *imgs = NULL;
+    addr_t *values;
+    struct dirent *de;
+    DIR *dir;
+    FILE *f = stdout;
+
+    while ((ch = getopt(argc, argv, "C:c:j:o:")) != -1) {
+        switch (ch) {
+            case 'C': check = optarg; break;
+            case 'c': cache = optarg; break;
+            case 'j': nthreads = atoi(optarg); break;
+            case 'o': out = optarg; break;
+            default: goto usage;
+        }
+    }
+    if (optind != argc - 1 || (check && out)) {
+usage:
+        fprintf(stderr, "usage: %s [-c cache-dir] [-j threads] [-o offsets_db.c | -C offsets_db.c] kernelcache-dir\n", argv[0]);
+        return 1;
+    }
+
+    dir = opendir(argv[optind]);
+    if (!dir) {
+        perror(argv[optind]);
+        return 1;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        struct image img;
+        if (parse_name(de->d_name, &img)) {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 16;
+            imgs = realloc(imgs, cap * sizeof(*imgs));
+            if (!imgs) {
+                return 1;
+            }
+        }
+        if (asprintf(&img.path, "%s/%s", argv[optind], de->d_name) < 0) {
+            return 1;
+        }
+        imgs[n++] = img;
+    }
+    closedir(dir);
+    if (n) {
+        qsort(imgs, n, sizeof(*imgs), cmp_image);
+    }
+
+    values = calloc(n ? n * NUM_FIELDS : 1, sizeof(*values));
+    if (!values) {
+        return 1;
+    }
+    for (i = 0; i < n; i++) {
+        struct pf_kernel k;
+        struct pf_result results[NUM_FIELDS];
+        if (i && !cmp_image(&imgs[i - 1], &imgs[i])) {
+            fprintf(stderr, "%s: duplicate of %s %s\n", imgs[i].path, imgs[i].device, imgs[i].build);
+            status = 2;
+            continue;
+        }
+        if (init_kernel(&k, 0, imgs[i].path)) {
+            fprintf(stderr, "%s: not a 64-bit kernelcache\n", imgs[i].path);
+            status = 2;
+            continue;
+        }
+        if (pf_run_finders_cached(&k, db_finders, NUM_FIELDS, nthreads, results, cache)) {
+            fprintf(stderr, "%s %s: some finders failed\n", imgs[i].device, imgs[i].build);
+            pf_print_results(stderr, results, NUM_FIELDS);
+        }
+        for (j = 0; j < NUM_FIELDS; j++) {
+            values[i * NUM_FIELDS + j] = results[j].value;
+        }
+        term_kernel(&k);
+    }
+
+    // Drop the images that could not be used so the table stays dense.
+    for (i = j = 0; i < n; i++) {
+        unsigned field;
+        int empty = 1;
+        for (field = 0; field < NUM_FIELDS; field++) {
+            empty &= !values[i * NUM_FIELDS + field];
+        }
+        if (!empty) {
+            imgs[j] = imgs[i];
+            memmove(&values[j * NUM_FIELDS], &values[i * NUM_FIELDS], NUM_FIELDS * sizeof(*values));
+            j++;
+        }
+    }
+
+    if (check) {
+        f = open_memstream(&text, &len);
+        if (!f) {
+            return 1;
+        }
+        emit(f, imgs, values, j);
+        fclose(f);
+        if (!same_file(check, text, len)) {
+            fprintf(stderr, "%s: differs from what %s generates\n", check, argv[optind]);
+            status = 3;
+        }
+        free(text);
+        return status;
+    }
+    if (out) {
+        f = fopen(out, "w");
+        if (!f) {
+            perror(out);
+            return 1;
+        }
+    }
+    emit(f, imgs, values, j);
+    if (out && fclose(f)) {
+        perror(out);
+        return 1;
+    }
+    return status;
+}
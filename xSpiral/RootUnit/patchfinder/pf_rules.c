@@ -0,0 +1,64 @@
+//
+//  pf_rules.c
+//  xSpiral
+//
+//  The finders that are no more than a pattern and a window.  Adding one
+//  here and naming it in pf_default_finders is all it takes to have it
+//  looked for, benchmarked and fuzzed with the rest.
+//
+
+#include "pf_rules.h"
+
+const struct pf_rule pf_default_rules[] = {
+    {
+        // AND W8, W8, #0xFFFFDFFF after the first use of the string; X8
+        // holds &allproc two instructions before it
+        .name = "allproc",
+        .symbol = "_allproc",
+        .ranges = PF_RULE_XNU,
+        .anchor = "\"pgrp_add : pgrp is dead adding process\"",
+        .xref = 1,
+        .from = 4, .to = 0x400,
+        .pattern = { 1, { { INSN_WORD(0x12127908) } } },
+        .yield = PF_YIELD_REGISTER,
+        .reg = 8, .reg_at = -8,
+    },
+    {
+        // ADD X0, X0, #0x40; RET
+        .name = "add_x0_x0_0x40_ret",
+        .ranges = PF_RULE_XNU | PF_RULE_PRELINK,
+        .pattern = { 2, { { INSN_WORD(0x91010000) }, { INSN_RET } } },
+        .yield = PF_YIELD_MATCH,
+    },
+    {
+        // SUB SP, SP, #0x50 nearest before the second use of the string
+        .name = "copyout",
+        .symbol = "_copyout",
+        .ranges = PF_RULE_XNU,
+        .anchor = "\"%s(%p, %p, %lu) - transfer too large\"",
+        .xref = 2,
+        .from = -0x3FC, .to = 0,
+        .last = 1,
+        .pattern = { 1, { { INSN_WORD(0xd10143ff) } } },
+        .yield = PF_YIELD_MATCH,
+    },
+    {
+        // the function with SYS #3, c7, c4, #1, X3 (DC ZVA) in it
+        .name = "bzero",
+        .symbol = "_bzero",
+        .ranges = PF_RULE_XNU,
+        .pattern = { 1, { { INSN_WORD(0xd50b7423) } } },
+        .yield = PF_YIELD_FUNCTION,
+    },
+    {
+        // MOV X3, X0; MOV X0, X1; MOV X1, X3; NOP, then on into memmove
+        .name = "bcopy",
+        .symbol = "_bcopy",
+        .ranges = PF_RULE_XNU | PF_RULE_PRELINK,
+        .pattern = { 4, { { INSN_WORD(0xAA0003E3) }, { INSN_WORD(0xAA0103E0) }, { INSN_WORD(0xAA0303E1) }, { INSN_WORD(0xd503201F) } } },
+        .yield = PF_YIELD_MATCH,
+    },
+};
+
+const unsigned pf_num_default_rules = sizeof(pf_default_rules) / sizeof(pf_default_rules[0]);
+_Static_assert(sizeof(pf_default_rules) / sizeof(pf_default_rules[0]) <= PF_MAX_RULES, "grow PF_MAX_RULES");
@@ -0,0 +1,56 @@
+//
+//  pf_rules.h
+//  xSpiral
+//
+//  Finders written as data.  A rule names a symbol to try first and, for
+//  stripped images, an instruction pattern to look for: anywhere in a code
+//  range, or in a window around a reference to an anchor string.  What it
+//  yields is the match itself, the start of the function around it, or
+//  the value a register holds at a point near it.  Rules are compiled into
+//  a pattern set and a list of windows and resolved by sweeping a code
+//  range; rules without a window share one sweep of their range
+//  (pf_find_rule() in patchfinder64.c).
+//
+
+#ifndef PF_RULES_H_
+#define PF_RULES_H_
+
+#include <stdint.h>
+#include "insn_scan.h"
+
+#define PF_MAX_RULES    32
+
+// Code ranges a rule is looked for in, __TEXT_EXEC before __PLK_TEXT_EXEC.
+#define PF_RULE_XNU     1
+#define PF_RULE_PRELINK 2
+
+enum pf_rule_yield {
+    PF_YIELD_MATCH,             // address of the match
+    PF_YIELD_FUNCTION,          // start of the function containing the match
+    PF_YIELD_REGISTER,          // value of reg at match + reg_at, computed from
+                                // the start of the function holding the anchor
+                                // (the match, without one)
+};
+
+struct pf_rule {
+    const char *name;
+    const char *symbol;         // tried first, e.g. "_allproc"; NULL for none
+    unsigned ranges;
+    const char *kext;           // bundle identifier to confine the
+                                // PF_RULE_PRELINK search (and anchor) to
+    const char *anchor;         // string the window is relative to; NULL to
+                                // search the whole range
+    int xref;                   // which reference to the anchor, from 1
+    int32_t from, to;           // the match begins in [ref + from, ref + to)
+    int last;                   // take the last match in the window, i.e. the
+                                // nearest one when it ends at the reference
+    struct pf_pattern pattern;
+    enum pf_rule_yield yield;
+    int reg;
+    int32_t reg_at;
+};
+
+extern const struct pf_rule pf_default_rules[];
+extern const unsigned pf_num_default_rules;
+
+#endif
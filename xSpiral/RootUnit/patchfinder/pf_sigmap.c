@@ -0,0 +1,345 @@
+//
+//  pf_sigmap.c
+//  xSpiral
+//
+//  Host tool that carries addresses known in one kernelcache over to
+//  another build, without rerunning the heuristics or looking anything up
+//  by hand.  The known addresses come from the reference image's symbol
+//  table, from the default finders run on it, and from an optional list
+//  (either "name address" lines or kc_parameters.c lines for the reference
+//  build, pasted as they are).  Each one that lies in code gets a signature
+//  (sig_match.h), and all of them are looked for in the target in a single
+//  pass per code range.  Anything else (data, unaligned addresses) is listed
+//  but not carried over.
+//
+
+/*
+ * Not part of the app.  Build from this directory with
+ *     cc -O2 -DPATCHFINDER_HOST -I.. -I. -o pf_sigmap pf_sigmap.c sig_match.c \
+ *        pf_driver.c a64_decode.c fixups.c xref_index.c insn_scan.c str_search.c \
+ *        func_index.c reg_cache.c sym_index.c img4.c decompress.c page_cache.c \
+ *        pf_rules.c prelink_info.c ../patchfinder64.c -lpthread
+ * and run e.g. "./pf_sigmap -a known.txt iPhone11,8_16C50.kc iPhone11,8_16C101.kc".
+ * -p prints kc_parameters.c lines for the matches of at least -m confidence
+ * (0.5 by default) instead of the table, -n ignores the reference's symbols.
+ * When the target has symbols too, the table says whether each match agrees.
+ */
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "patchfinder64.h"
+#include "pf_driver.h"
+#include "sig_match.h"
+
+struct known {
+    char *name;
+    addr_t addr;                // in the reference, unslid
+    int prelink;                // which code range, or -1 if neither
+    size_t sig;                 // index into the signatures of that range
+                                // (while reading, the order read in)
+};
+
+struct known_list {
+    struct known *v;
+    size_t n;
+    size_t cap;
+};
+
+static double
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int
+add_known(struct known_list *l, const char *name, size_t len, addr_t addr)
+{
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 256;
+        struct known *v = realloc(l->v, cap * sizeof(*v));
+        if (!v) {
+            return -1;
+        }
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n].name = strndup(name, len);
+    l->v[l->n].addr = addr;
+    l->v[l->n].prelink = -1;
+    l->v[l->n].sig = l->n;
+    return l->v[l->n].name ? (int)(l->n++, 0) : -1;
+}
+
+// By name, and for one name in the order the sources were read.
+static int
+cmp_name(const void *a, const void *b)
+{
+    const struct known *x = a, *y = b;
+    int rv = strcmp(x->name, y->name);
+    return rv ? rv : (x->sig > y->sig) - (x->sig < y->sig);
+}
+
+// Keeps the first address read for each name.
+static void
+dedup_known(struct known_list *l)
+{
+    size_t i, j;
+    qsort(l->v, l->n, sizeof(*l->v), cmp_name);
+    for (i = j = 0; i < l->n; i++) {
+        if (j && !strcmp(l->v[j - 1].name, l->v[i].name)) {
+            free(l->v[i].name);
+            continue;
+        }
+        l->v[j++] = l->v[i];
+    }
+    l->n = j;
+}
+
+// "name 0xaddress" or "ADDRESS(name) = SLIDE(0xaddress);" per line;
+// anything else, comments included, is skipped.
+static int
+read_known(struct known_list *l, const char *path)
+{
+    char line[1024];
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line, *name, *end;
+        size_t len;
+        addr_t addr;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (!strncmp(p, "ADDRESS(", 8)) {
+            name = p + 8;
+            len = strcspn(name, ")");
+            p = strstr(name, "SLIDE(");
+            if (!p || name[len] != ')') {
+                continue;
+            }
+            p += 6;
+        } else {
+            name = p;
+            len = strcspn(name, " \t\r\n");
+            p = name + len;
+        }
+        if (!len || *name == '#' || *name == '/') {
+            continue;
+        }
+        addr = strtoull(p, &end, 16);
+        if (end == p || !addr) {
+            continue;
+        }
+        if (add_known(l, name, len, addr)) {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+// Every symbol of the reference.  find_symbol() builds the index the first
+// time it is asked anything.
+static int
+add_symbols(struct known_list *l, struct pf_kernel *k)
+{
+    size_t i;
+    find_symbol(k, "");
+    if (k->syms_state <= 0) {
+        return 0;
+    }
+    for (i = 0; i <= k->syms.mask; i++) {
+        const struct pf_sym *s = &k->syms.slots[i];
+        if (s->name && s->value && add_known(l, s->name, strlen(s->name), s->value)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int
+cmp_known(const void *a, const void *b)
+{
+    const struct known *x = a, *y = b;
+    if (x->addr != y->addr) {
+        return x->addr < y->addr ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+// The target's own idea of where name is, if it has symbols.
+static addr_t
+target_symbol(struct pf_kernel *k, const char *name)
+{
+    char buf[512];
+    addr_t v = find_symbol(k, name);
+    if (!v && name[0] != '_' && (size_t)snprintf(buf, sizeof(buf), "_%s", name) < sizeof(buf)) {
+        v = find_symbol(k, buf);
+    }
+    return v;
+}
+
+int
+main(int argc, char **argv)
+{
+    int ch, params = 0, use_syms = 1;
+    double min_conf = 0.5, t;
+    const char *list = NULL;
+    struct known_list known = { NULL, 0, 0 };
+    struct pf_kernel ref, target;
+    struct pf_result results[PF_MAX_FINDERS];
+    struct pf_sig *sigs[2] = { NULL, NULL };
+    struct pf_sig_match *matches[2] = { NULL, NULL };
+    size_t nsigs[2] = { 0, 0 }, i;
+    unsigned long agree = 0, differ = 0, found = 0;
+    int prelink;
+
+    while ((ch = getopt(argc, argv, "a:m:np")) != -1) {
+        switch (ch) {
+            case 'a': list = optarg; break;
+            case 'm': min_conf = strtod(optarg, NULL); break;
+            case 'n': use_syms = 0; break;
+            case 'p': params = 1; break;
+            default: goto usage;
+        }
+    }
+    if (optind != argc - 2) {
+usage:
+        fprintf(stderr, "usage: %s [-a known-addresses] [-m min-confidence] [-n] [-p] reference-kc target-kc\n", argv[0]);
+        return 1;
+    }
+    if (init_kernel(&ref, 0, argv[optind])) {
+        fprintf(stderr, "%s: not a 64-bit kernelcache\n", argv[optind]);
+        return 1;
+    }
+    if (init_kernel(&target, 0, argv[optind + 1])) {
+        fprintf(stderr, "%s: not a 64-bit kernelcache\n", argv[optind + 1]);
+        return 1;
+    }
+
+    t = now_ms();
+    if (list && read_known(&known, list)) {
+        return 1;
+    }
+    pf_run_finders(&ref, pf_default_finders, pf_num_default_finders, 0, results);
+    for (i = 0; i < pf_num_default_finders; i++) {
+        if (results[i].value && add_known(&known, results[i].name, strlen(results[i].name), results[i].value)) {
+            return 1;
+        }
+    }
+    if (use_syms && add_symbols(&known, &ref)) {
+        return 1;
+    }
+    if (known.n) {
+        dedup_known(&known);
+        qsort(known.v, known.n, sizeof(*known.v), cmp_known);
+    }
+
+    for (prelink = 0; prelink < 2; prelink++) {
+        sigs[prelink] = calloc(known.n ? known.n : 1, sizeof(**sigs));
+        matches[prelink] = calloc(known.n ? known.n : 1, sizeof(**matches));
+        if (!sigs[prelink] || !matches[prelink]) {
+            return 1;
+        }
+    }
+    for (i = 0; i < known.n; i++) {
+        struct known *kn = &known.v[i];
+        for (prelink = 0; prelink < 2; prelink++) {
+            addr_t base = prelink ? ref.prelink_base : ref.xnucore_base;
+            addr_t size = prelink ? ref.prelink_size : ref.xnucore_size;
+            struct pf_sig *sig = &sigs[prelink][nsigs[prelink]];
+            if (base + size > ref.kernel_size) {
+                size = base < ref.kernel_size ? ref.kernel_size - base : 0;
+            }
+            if (!pf_sig_extract(sig, ref.kernel, base, base + size, kn->addr - ref.kerndumpbase)) {
+                sig->name = kn->name;
+                kn->prelink = prelink;
+                kn->sig = nsigs[prelink]++;
+                break;
+            }
+        }
+    }
+    fprintf(stderr, "%zu known addresses, %zu + %zu signatures in %.1f ms\n",
+            known.n, nsigs[0], nsigs[1], now_ms() - t);
+
+    t = now_ms();
+    for (prelink = 0; prelink < 2; prelink++) {
+        addr_t base = prelink ? target.prelink_base : target.xnucore_base;
+        addr_t size = prelink ? target.prelink_size : target.xnucore_size;
+        if (base + size > target.kernel_size) {
+            size = base < target.kernel_size ? target.kernel_size - base : 0;
+        }
+        if (nsigs[prelink] &&
+            pf_sig_match(sigs[prelink], nsigs[prelink], target.kernel, base, base + size, matches[prelink]) < 0) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    fprintf(stderr, "matched in %.1f ms\n", now_ms() - t);
+
+    if (!params) {
+        printf("%-40s %-18s %-18s %9s %6s\n", "name", "reference", "target", "votes", "conf");
+    }
+    for (i = 0; i < known.n; i++) {
+        const struct known *kn = &known.v[i];
+        const struct pf_sig_match *m;
+        addr_t addr, sym;
+        if (kn->prelink < 0) {
+            if (!params) {
+                printf("%-40s 0x%016llx (not code)\n", kn->name, (unsigned long long)kn->addr);
+            }
+            continue;
+        }
+        m = &matches[kn->prelink][kn->sig];
+        addr = m->addr ? m->addr + target.kerndumpbase : 0;
+        found += addr != 0;
+        if (params) {
+            if (addr && m->confidence >= min_conf) {
+                printf("\tADDRESS(%s)%*s= SLIDE(0x%016llx);\n", kn->name,
+                       (int)(strlen(kn->name) < 47 ? 47 - strlen(kn->name) : 1), "", (unsigned long long)addr);
+            }
+            continue;
+        }
+        printf("%-40s 0x%016llx ", kn->name, (unsigned long long)kn->addr);
+        if (addr) {
+            printf("0x%016llx %4u/%-4u %6.2f", (unsigned long long)addr, m->votes, m->grams, m->confidence);
+        } else {
+            printf("%-18s %4u/%-4u %6s", "-", m->votes, m->grams, "-");
+        }
+        sym = target_symbol(&target, kn->name);
+        if (sym && addr) {
+            printf("  %s", sym == addr ? "agrees" : "differs from symbol");
+            agree += sym == addr;
+            differ += sym != addr;
+        }
+        printf("\n");
+    }
+    fprintf(stderr, "%lu of %zu code addresses found", found, nsigs[0] + nsigs[1]);
+    if (agree + differ) {
+        fprintf(stderr, ", %lu agree with the target's symbols, %lu differ", agree, differ);
+    }
+    fprintf(stderr, "\n");
+
+    for (prelink = 0; prelink < 2; prelink++) {
+        free(sigs[prelink]);
+        free(matches[prelink]);
+    }
+    for (i = 0; i < known.n; i++) {
+        free(known.v[i].name);
+    }
+    free(known.v);
+    term_kernel(&ref);
+    term_kernel(&target);
+    return 0;
+}
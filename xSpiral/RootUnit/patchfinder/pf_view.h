@@ -0,0 +1,65 @@
+//
+//  pf_view.h
+//  xSpiral
+//
+//  Bounded window onto the kernel buffer.  Every range a scanner is handed
+//  is derived from one of these, so a malformed or truncated header can at
+//  worst produce an empty view, never a read outside the image.
+//
+
+#ifndef PF_VIEW_H_
+#define PF_VIEW_H_
+
+#include <stdint.h>
+
+// [start, end) in buffer offsets; start <= end <= size of buf.
+struct pf_view {
+    const uint8_t *buf;
+    uint64_t start;
+    uint64_t end;
+};
+
+// The part of [start, start + len) that lies inside a buffer of `size`
+// bytes.  Wrapping ranges and ranges past the end give an empty view.
+static inline struct pf_view
+pf_view_make(const uint8_t *buf, uint64_t size, uint64_t start, uint64_t len)
+{
+    struct pf_view v = { buf, 0, 0 };
+    if (start < size) {
+        v.start = start;
+        v.end = len < size - start ? start + len : size;
+    }
+    return v;
+}
+
+// The intersection of v with [start, end).
+static inline struct pf_view
+pf_view_clamp(const struct pf_view *v, uint64_t start, uint64_t end)
+{
+    struct pf_view c = *v;
+    if (start > c.start) {
+        c.start = start;
+    }
+    if (end < c.end) {
+        c.end = end;
+    }
+    if (c.start > c.end) {
+        c.start = c.end;
+    }
+    return c;
+}
+
+static inline uint64_t
+pf_view_size(const struct pf_view *v)
+{
+    return v->end - v->start;
+}
+
+// Whether [off, off + len) lies entirely inside the view.
+static inline int
+pf_view_contains(const struct pf_view *v, uint64_t off, uint64_t len)
+{
+    return off >= v->start && off <= v->end && len <= v->end - off;
+}
+
+#endif
@@ -0,0 +1,324 @@
+//
+//  prelink_info.c
+//  xSpiral
+//
+//  The kernelcache writer gives every repeated string or integer an ID=
+//  the first time and an empty <string IDREF="n"/> after that, so bundle
+//  identifiers and sizes can appear either way.  The text of every element
+//  with an ID is remembered (a pointer and a length), which is all the
+//  state the walk keeps besides the depth.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "prelink_info.h"
+
+#define MAX_REF_ID  (1 << 20)   // far more than any kernelcache uses
+
+struct ref_text {
+    const char *text;
+    size_t len;
+};
+
+struct walk {
+    const char *p;
+    const char *end;
+    struct ref_text *refs;
+    size_t nrefs;
+};
+
+struct tag {
+    const char *name;
+    size_t name_len;
+    int closing;                // </name>
+    int empty;                  // <name/>
+    long id;                    // ID="n", or -1
+    long idref;                 // IDREF="n", or -1
+};
+
+static int
+same(const char *s, size_t len, const char *lit)
+{
+    return len == strlen(lit) && !memcmp(s, lit, len);
+}
+
+static uint64_t
+parse_integer(const char *s, size_t len)
+{
+    uint64_t v = 0;
+    size_t i = 0;
+    int base = 10;
+
+    while (i < len && (s[i] == ' ' || s[i] == '\n' || s[i] == '\t')) {
+        i++;
+    }
+    if (len - i > 2 && s[i] == '0' && (s[i + 1] == 'x' || s[i + 1] == 'X')) {
+        base = 16;
+        i += 2;
+    }
+    for (; i < len; i++) {
+        char c = s[i];
+        unsigned d;
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if (base == 16 && c >= 'a' && c <= 'f') {
+            d = c - 'a' + 10;
+        } else if (base == 16 && c >= 'A' && c <= 'F') {
+            d = c - 'A' + 10;
+        } else {
+            break;
+        }
+        v = v * base + d;
+    }
+    return v;
+}
+
+// The value of attribute `attr` in [p, end) if it is a plain number.
+static long
+attribute(const char *p, const char *end, const char *attr)
+{
+    size_t n = strlen(attr);
+    for (; end - p > (long)n + 2; p++) {
+        if (p[-1] == ' ' && !memcmp(p, attr, n) && p[n] == '=' && (p[n + 1] == '"' || p[n + 1] == '\'')) {
+            uint64_t v = parse_integer(p + n + 2, end - p - n - 2);
+            return v < MAX_REF_ID ? (long)v : -1;
+        }
+    }
+    return -1;
+}
+
+// Reads the tag at w->p (just past its '<').  Returns 0 at the end of the
+// input.
+static int
+next_tag(struct walk *w, struct tag *t)
+{
+    const char *p, *gt;
+
+    for (;;) {
+        p = memchr(w->p, '<', w->end - w->p);
+        if (!p || ++p == w->end) {
+            return 0;
+        }
+        if (*p == '!' || *p == '?') {
+            // comment, doctype or prolog
+            const char *close = (w->end - p > 3 && !memcmp(p, "!--", 3)) ? "-->" : ">";
+            size_t n = strlen(close);
+            for (w->p = p; w->end - w->p >= (long)n && memcmp(w->p, close, n); w->p++) {
+            }
+            if (w->end - w->p < (long)n) {
+                return 0;
+            }
+            w->p += n;
+            continue;
+        }
+        break;
+    }
+    gt = memchr(p, '>', w->end - p);
+    if (!gt) {
+        return 0;
+    }
+    t->closing = *p == '/';
+    p += t->closing;
+    t->name = p;
+    while (p < gt && *p != ' ' && *p != '/') {
+        p++;
+    }
+    t->name_len = p - t->name;
+    t->empty = gt[-1] == '/';
+    t->id = t->closing ? -1 : attribute(p, gt, "ID");
+    t->idref = t->closing ? -1 : attribute(p, gt, "IDREF");
+    w->p = gt + 1;
+    return 1;
+}
+
+static int
+remember(struct walk *w, long id, const char *text, size_t len)
+{
+    if ((size_t)id >= w->nrefs) {
+        size_t n = w->nrefs ? w->nrefs : 256;
+        struct ref_text *refs;
+        while (n <= (size_t)id) {
+            n *= 2;
+        }
+        refs = realloc(w->refs, n * sizeof(*refs));
+        if (!refs) {
+            return -1;
+        }
+        memset(refs + w->nrefs, 0, (n - w->nrefs) * sizeof(*refs));
+        w->refs = refs;
+        w->nrefs = n;
+    }
+    w->refs[id].text = text;
+    w->refs[id].len = len;
+    return 0;
+}
+
+// The text of a leaf element whose open tag was just read, or of the one
+// it refers to.  Leaves w->p after the closing tag.
+static int
+leaf_text(struct walk *w, const struct tag *t, const char **text, size_t *len)
+{
+    const char *lt;
+
+    *text = "";
+    *len = 0;
+    if (t->empty) {
+        if (t->idref >= 0 && (size_t)t->idref < w->nrefs && w->refs[t->idref].text) {
+            *text = w->refs[t->idref].text;
+            *len = w->refs[t->idref].len;
+        }
+        return 0;
+    }
+    lt = memchr(w->p, '<', w->end - w->p);
+    if (!lt) {
+        return -1;
+    }
+    *text = w->p;
+    *len = lt - w->p;
+    w->p = lt;
+    if (w->end - lt < 2 || lt[1] != '/') {
+        return -1;
+    }
+    lt = memchr(lt, '>', w->end - lt);
+    if (!lt) {
+        return -1;
+    }
+    w->p = lt + 1;
+    return t->id >= 0 ? remember(w, t->id, *text, *len) : 0;
+}
+
+long
+pf_prelink_info_parse(const char *xml, size_t len, pf_prelink_fn fn, void *ctx)
+{
+    struct walk w = { xml, xml + len, NULL, 0 };
+    struct pf_prelink_kext kext;
+    const char *root_key = "", *kext_key = "";
+    size_t root_key_len = 0, kext_key_len = 0;
+    long depth = 0, list = 0, count = 0;
+    int done = 0, bad = 0;
+    struct tag t;
+
+    memset(&kext, 0, sizeof(kext));
+    while (next_tag(&w, &t)) {
+        int container = same(t.name, t.name_len, "dict") || same(t.name, t.name_len, "array");
+        if (container) {
+            if (t.empty) {
+                continue;
+            }
+            if (t.closing) {
+                if (list && depth == list + 1 && same(t.name, t.name_len, "dict")) {
+                    count++;
+                    if (fn(ctx, &kext)) {
+                        done = 1;
+                        break;
+                    }
+                }
+                if (list && depth == list) {
+                    // the end of the kext list is as far as anyone cares
+                    done = 1;
+                    break;
+                }
+                if (--depth < 0) {
+                    bad = 1;
+                    break;
+                }
+                continue;
+            }
+            depth++;
+            if (!list && depth == 2 && same(root_key, root_key_len, "_PrelinkInfoDictionary") &&
+                same(t.name, t.name_len, "array")) {
+                list = depth;
+            }
+            if (list && depth == list + 1) {
+                memset(&kext, 0, sizeof(kext));
+            }
+            continue;
+        }
+        if (t.closing) {
+            continue;
+        }
+        if (same(t.name, t.name_len, "key") || same(t.name, t.name_len, "string") ||
+            same(t.name, t.name_len, "integer")) {
+            const char *text;
+            size_t n;
+            if (leaf_text(&w, &t, &text, &n)) {
+                bad = 1;
+                break;
+            }
+            if (same(t.name, t.name_len, "key")) {
+                if (depth == 1) {
+                    root_key = text;
+                    root_key_len = n;
+                } else if (list && depth == list + 1) {
+                    kext_key = text;
+                    kext_key_len = n;
+                }
+                continue;
+            }
+            if (!list || depth != list + 1) {
+                continue;
+            }
+            if (same(kext_key, kext_key_len, "CFBundleIdentifier")) {
+                kext.id = text;
+                kext.id_len = n;
+            } else if (same(kext_key, kext_key_len, "_PrelinkExecutableLoadAddr")) {
+                kext.load_addr = parse_integer(text, n);
+            } else if (same(kext_key, kext_key_len, "_PrelinkExecutableSize")) {
+                kext.size = parse_integer(text, n);
+            }
+        }
+    }
+    free(w.refs);
+    if (done) {
+        return count;
+    }
+    // no kext list at all is fine, a list or plist cut short is not
+    return bad || list || depth ? -1 : 0;
+}
+
+int
+pf_kext_map_add(struct pf_kext_map *map, const struct pf_kext *kext)
+{
+    struct pf_kext *k;
+    if (map->count == map->cap) {
+        size_t cap = map->cap ? map->cap * 2 : 64;
+        k = realloc(map->kexts, cap * sizeof(*k));
+        if (!k) {
+            return -1;
+        }
+        map->kexts = k;
+        map->cap = cap;
+    }
+    k = &map->kexts[map->count];
+    *k = *kext;
+    k->id = strdup(kext->id);
+    if (!k->id) {
+        return -1;
+    }
+    map->count++;
+    return 0;
+}
+
+void
+pf_kext_map_free(struct pf_kext_map *map)
+{
+    size_t i;
+    for (i = 0; i < map->count; i++) {
+        free(map->kexts[i].id);
+    }
+    free(map->kexts);
+    memset(map, 0, sizeof(*map));
+}
+
+// A few hundred kexts at most, looked up a handful of times.
+const struct pf_kext *
+pf_kext_map_lookup(const struct pf_kext_map *map, const char *id)
+{
+    size_t i;
+    for (i = 0; i < map->count; i++) {
+        if (!strcmp(map->kexts[i].id, id)) {
+            return &map->kexts[i];
+        }
+    }
+    return NULL;
+}
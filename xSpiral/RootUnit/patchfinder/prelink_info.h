@@ -0,0 +1,56 @@
+//
+//  prelink_info.h
+//  xSpiral
+//
+//  Single-pass reader for the XML plist in __PRELINK_INFO,__info.  It
+//  walks the tags in place, keeping only a depth counter and the values
+//  other elements refer back to (ID= / IDREF=), and hands each kext's
+//  dictionary from _PrelinkInfoDictionary to a callback as soon as it
+//  closes.  Nothing is copied and no tree is built, so it can run straight
+//  over the mapped image.  What the image loader makes of each kext, its
+//  code and string ranges, goes into a pf_kext_map.
+//
+
+#ifndef PRELINK_INFO_H_
+#define PRELINK_INFO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct pf_prelink_kext {
+    const char *id;             // CFBundleIdentifier, inside the plist; not
+    size_t id_len;              // NUL-terminated
+    uint64_t load_addr;         // _PrelinkExecutableLoadAddr: its Mach-O header,
+                                // 0 for a kext without code
+    uint64_t size;              // _PrelinkExecutableSize
+};
+
+// Returning nonzero stops the walk.
+typedef int (*pf_prelink_fn)(void *ctx, const struct pf_prelink_kext *kext);
+
+// Walks the len bytes at xml.  Returns the number of kexts passed to fn,
+// or -1 if the plist is malformed before the list ends or out of memory.
+long pf_prelink_info_parse(const char *xml, size_t len, pf_prelink_fn fn, void *ctx);
+
+// Offsets into the image, like every range in struct pf_kernel.
+struct pf_kext {
+    char *id;                   // bundle identifier
+    uint64_t header;            // its Mach-O header
+    uint64_t exec_base;         // its __TEXT_EXEC
+    uint64_t exec_size;
+    uint64_t cstring_base;      // its __TEXT,__cstring, or all of __TEXT
+    uint64_t cstring_size;
+};
+
+struct pf_kext_map {
+    struct pf_kext *kexts;
+    size_t count;
+    size_t cap;
+};
+
+// Adds a copy of kext, id included.
+int pf_kext_map_add(struct pf_kext_map *map, const struct pf_kext *kext);
+void pf_kext_map_free(struct pf_kext_map *map);
+const struct pf_kext *pf_kext_map_lookup(const struct pf_kext_map *map, const char *id);
+
+#endif
@@ -0,0 +1,109 @@
+//
+//  reg_cache.c
+//  xSpiral
+//
+//  Each function slot keeps a handful of snapshots.  When a slot is full
+//  the snapshot closest to its predecessor is dropped, which keeps the
+//  survivors spread across the function.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "reg_cache.h"
+
+static unsigned
+slot_of(uint64_t start)
+{
+    return (unsigned)((start >> 2) * 0x9E3779B97F4A7C15ULL >> 58) % PF_REG_CACHE_FUNCS;
+}
+
+int
+pf_reg_cache_get(const struct pf_reg_cache *cache, uint64_t start, uint64_t end, struct pf_reg_state *st)
+{
+    const struct pf_reg_func *f;
+    unsigned i;
+
+    memset(st, 0, sizeof(*st));
+    st->pc = start & ~3;
+    if (!cache->funcs) {
+        return -1;
+    }
+    f = &cache->funcs[slot_of(start)];
+    if (f->start != start) {
+        return -1;
+    }
+    for (i = f->count; i > 0; i--) {
+        if (f->blocks[i - 1].pc <= end) {
+            *st = f->blocks[i - 1];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void
+pf_reg_cache_put(struct pf_reg_cache *cache, uint64_t start, const struct pf_reg_state *st)
+{
+    struct pf_reg_func *f;
+    unsigned i, pos;
+
+    if (!cache->funcs) {
+        cache->funcs = calloc(PF_REG_CACHE_FUNCS, sizeof(*cache->funcs));
+        if (!cache->funcs) {
+            return;
+        }
+    }
+    f = &cache->funcs[slot_of(start)];
+    if (f->start != start) {
+        f->start = start;
+        f->count = 0;
+    }
+
+    for (pos = 0; pos < f->count && f->blocks[pos].pc < st->pc; pos++) {
+    }
+    if (pos < f->count && f->blocks[pos].pc == st->pc) {
+        return;
+    }
+    if (f->count == PF_REG_CACHE_BLOCKS) {
+        // evict the snapshot that adds the least coverage, counting the new one
+        uint64_t best = (uint64_t)-1, prev = start, gap;
+        unsigned victim = PF_REG_CACHE_BLOCKS;
+        for (i = 0; i < f->count; i++) {
+            if (i == pos) {
+                gap = st->pc - prev;
+                if (gap < best) {
+                    best = gap;
+                    victim = PF_REG_CACHE_BLOCKS;
+                }
+                prev = st->pc;
+            }
+            gap = f->blocks[i].pc - prev;
+            if (gap < best) {
+                best = gap;
+                victim = i;
+            }
+            prev = f->blocks[i].pc;
+        }
+        if (pos == f->count && st->pc - prev < best) {
+            victim = PF_REG_CACHE_BLOCKS;
+        }
+        if (victim == PF_REG_CACHE_BLOCKS) {
+            return;
+        }
+        memmove(&f->blocks[victim], &f->blocks[victim + 1], (f->count - victim - 1) * sizeof(*f->blocks));
+        f->count--;
+        if (victim < pos) {
+            pos--;
+        }
+    }
+    memmove(&f->blocks[pos + 1], &f->blocks[pos], (f->count - pos) * sizeof(*f->blocks));
+    f->blocks[pos] = *st;
+    f->count++;
+}
+
+void
+pf_reg_cache_free(struct pf_reg_cache *cache)
+{
+    free(cache->funcs);
+    cache->funcs = NULL;
+}
@@ -0,0 +1,40 @@
+//
+//  reg_cache.h
+//  xSpiral
+//
+//  Bounded cache of calc64() register states taken at basic block
+//  boundaries, so repeated value recovery inside one function resumes from
+//  the nearest earlier block instead of re-emulating from the prologue.
+//
+
+#ifndef REG_CACHE_H_
+#define REG_CACHE_H_
+
+#include <stdint.h>
+
+#define PF_REG_CACHE_FUNCS  64  // direct mapped by function start
+#define PF_REG_CACHE_BLOCKS 16  // snapshots kept per function
+
+// Register file after emulating [function start, pc).
+struct pf_reg_state {
+    uint64_t pc;
+    uint64_t value[32];
+};
+
+struct pf_reg_func {
+    uint64_t start;
+    unsigned count;
+    struct pf_reg_state blocks[PF_REG_CACHE_BLOCKS];    // sorted by pc
+};
+
+struct pf_reg_cache {
+    struct pf_reg_func *funcs;  // PF_REG_CACHE_FUNCS slots, allocated on first store
+};
+
+// Copies the latest snapshot with pc <= end for the function at `start` into
+// *st.  Returns -1 when there is none; *st is then the state at `start`.
+int pf_reg_cache_get(const struct pf_reg_cache *cache, uint64_t start, uint64_t end, struct pf_reg_state *st);
+void pf_reg_cache_put(struct pf_reg_cache *cache, uint64_t start, const struct pf_reg_state *st);
+void pf_reg_cache_free(struct pf_reg_cache *cache);
+
+#endif
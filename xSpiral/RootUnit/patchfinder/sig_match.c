@@ -0,0 +1,244 @@
+//
+//  sig_match.c
+//  xSpiral
+//
+//  Only the n-grams some signature contains are remembered during the
+//  scan, so memory is bounded by the signatures and not by the image.  An
+//  n-gram stops collecting positions once it is common enough to be
+//  useless (padding, veneers, inlined helpers); it then casts no votes.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "sig_match.h"
+
+struct gram {
+    uint64_t hash;              // 0 for an empty slot
+    uint32_t first;             // head of its position list, or -1
+    uint32_t count;             // positions seen, capped at PF_SIG_MAX_HITS + 1
+};
+
+struct posting {
+    uint32_t word;              // instruction index from the start of the range
+    uint32_t next;
+};
+
+struct gram_table {
+    struct gram *slots;
+    size_t mask;
+    struct posting *pos;
+    size_t npos;
+    size_t cap;
+};
+
+uint32_t
+pf_sig_normalize(uint32_t op)
+{
+    if ((op & 0x7C000000) == 0x14000000) {          // B, BL
+        return op & 0xFC000000;
+    }
+    if ((op & 0xFF000010) == 0x54000000 ||          // B.cond
+        (op & 0x7E000000) == 0x34000000 ||          // CBZ, CBNZ
+        (op & 0x3B000000) == 0x18000000) {          // LDR (literal)
+        return op & 0xFF00001F;
+    }
+    if ((op & 0x7E000000) == 0x36000000) {          // TBZ, TBNZ
+        return op & 0xFFF8001F;
+    }
+    if ((op & 0x1F000000) == 0x10000000) {          // ADR, ADRP
+        return op & 0x9F00001F;
+    }
+    if ((op & 0x1F000000) == 0x11000000 ||          // ADD, SUB (immediate)
+        (op & 0x3B000000) == 0x39000000) {          // LDR, STR (unsigned offset)
+        return op & 0xFFC003FF;
+    }
+    if ((op & 0x3A000000) == 0x28000000) {          // LDP, STP
+        return op & 0xFFC07FFF;
+    }
+    return op;
+}
+
+static uint64_t
+gram_hash(const uint32_t *w)
+{
+    uint64_t h = (((uint64_t)w[0] << 32) | w[1]) * 0x9E3779B97F4A7C15ULL;
+    h ^= (((uint64_t)w[2] << 32) | w[3]) * 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+static struct gram *
+gram_slot(const struct gram_table *t, uint64_t hash)
+{
+    size_t i = hash & t->mask;
+    while (t->slots[i].hash && t->slots[i].hash != hash) {
+        i = (i + 1) & t->mask;
+    }
+    return &t->slots[i];
+}
+
+static int
+add_posting(struct gram_table *t, struct gram *g, uint32_t word)
+{
+    if (t->npos == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 4096;
+        struct posting *pos = realloc(t->pos, cap * sizeof(*pos));
+        if (!pos) {
+            return -1;
+        }
+        t->pos = pos;
+        t->cap = cap;
+    }
+    t->pos[t->npos].word = word;
+    t->pos[t->npos].next = g->first;
+    g->first = (uint32_t)t->npos++;
+    return 0;
+}
+
+int
+pf_sig_extract(struct pf_sig *sig, const uint8_t *image, uint64_t start, uint64_t end,
+               uint64_t addr)
+{
+    uint64_t from;
+    unsigned i;
+
+    if (addr < start || addr >= end || (addr - start) & 3 || end - addr < 4 * PF_SIG_GRAM) {
+        return -1;
+    }
+    from = addr - start >= 4 * PF_SIG_BEFORE ? addr - 4 * PF_SIG_BEFORE : start;
+    sig->addr = addr;
+    sig->at = (unsigned)((addr - from) / 4);
+    sig->nwords = (end - from) / 4 < PF_SIG_WORDS ? (unsigned)((end - from) / 4) : PF_SIG_WORDS;
+    for (i = 0; i < sig->nwords; i++) {
+        uint32_t op;
+        memcpy(&op, image + from + 4 * i, 4);
+        sig->words[i] = pf_sig_normalize(op);
+    }
+    return 0;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Tallies the votes of one signature's n-grams.  cand has room for every
+// vote it can get.
+static void
+vote(const struct gram_table *t, const struct pf_sig *sig, uint64_t *cand, uint64_t start,
+     struct pf_sig_match *m)
+{
+    unsigned i, grams = sig->nwords - PF_SIG_GRAM + 1, best = 0, second = 0;
+    size_t n = 0, j, run;
+    uint64_t where = 0;
+
+    for (i = 0; i < grams; i++) {
+        const struct gram *g = gram_slot(t, gram_hash(sig->words + i));
+        uint32_t p;
+        if (g->count > PF_SIG_MAX_HITS) {
+            continue;
+        }
+        for (p = g->first; p != (uint32_t)-1; p = t->pos[p].next) {
+            // where the address is, if this occurrence is gram i
+            if (t->pos[p].word + sig->at >= i) {
+                cand[n++] = t->pos[p].word + sig->at - i;
+            }
+        }
+    }
+    qsort(cand, n, sizeof(*cand), cmp_u64);
+    for (j = 0; j < n; j += run) {
+        for (run = 1; j + run < n && cand[j + run] == cand[j]; run++) {
+        }
+        if (run > best) {
+            second = best;
+            best = (unsigned)run;
+            where = cand[j];
+        } else if (run > second) {
+            second = (unsigned)run;
+        }
+    }
+
+    memset(m, 0, sizeof(*m));
+    m->grams = grams;
+    m->votes = best;
+    m->runner_up = second;
+    // a lone n-gram is as likely to be chance as the function
+    if (best >= 2) {
+        m->addr = start + 4 * where;
+        m->confidence = (double)(best - second) / grams;
+    }
+}
+
+long
+pf_sig_match(const struct pf_sig *sigs, size_t n, const uint8_t *image, uint64_t start,
+             uint64_t end, struct pf_sig_match *out)
+{
+    struct gram_table t;
+    uint32_t ring[2 * PF_SIG_GRAM];
+    uint64_t *cand = NULL, words, w;
+    size_t i, ngrams = 0, size;
+    long matched = -1;
+    unsigned j;
+
+    memset(&t, 0, sizeof(t));
+    memset(out, 0, n * sizeof(*out));
+    for (i = 0; i < n; i++) {
+        ngrams += sigs[i].nwords - PF_SIG_GRAM + 1;
+    }
+    for (size = 1024; size < 2 * ngrams; size <<= 1) {
+    }
+    t.mask = size - 1;
+    t.slots = calloc(size, sizeof(*t.slots));
+    cand = malloc(PF_SIG_WORDS * (PF_SIG_MAX_HITS + 1) * sizeof(*cand));
+    if (!t.slots || !cand || end < start) {
+        goto out;
+    }
+    for (i = 0; i < n; i++) {
+        for (j = 0; j + PF_SIG_GRAM <= sigs[i].nwords; j++) {
+            struct gram *g = gram_slot(&t, gram_hash(sigs[i].words + j));
+            if (!g->hash) {
+                g->hash = gram_hash(sigs[i].words + j);
+                g->first = -1;
+            }
+        }
+    }
+
+    // One pass over the target.  The ring holds each window twice over so
+    // that the last PF_SIG_GRAM words are always contiguous.
+    words = (end - start) / 4;
+    if (words > UINT32_MAX) {
+        words = UINT32_MAX;
+    }
+    for (w = 0; w < words; w++) {
+        uint32_t op;
+        struct gram *g;
+        memcpy(&op, image + start + 4 * w, 4);
+        op = pf_sig_normalize(op);
+        ring[w % PF_SIG_GRAM] = ring[w % PF_SIG_GRAM + PF_SIG_GRAM] = op;
+        if (w + 1 < PF_SIG_GRAM) {
+            continue;
+        }
+        g = gram_slot(&t, gram_hash(ring + (w + 1) % PF_SIG_GRAM));
+        if (!g->hash || g->count > PF_SIG_MAX_HITS) {
+            continue;
+        }
+        if (++g->count <= PF_SIG_MAX_HITS && add_posting(&t, g, (uint32_t)(w + 1 - PF_SIG_GRAM))) {
+            goto out;
+        }
+    }
+
+    matched = 0;
+    for (i = 0; i < n; i++) {
+        vote(&t, &sigs[i], cand, start, &out[i]);
+        matched += out[i].addr != 0;
+    }
+out:
+    free(t.slots);
+    free(t.pos);
+    free(cand);
+    return matched;
+}
@@ -0,0 +1,57 @@
+//
+//  sig_match.h
+//  xSpiral
+//
+//  Carries known addresses from one kernelcache to another.  A signature is
+//  the run of instructions around an address in the reference image, with
+//  the fields that move between builds (branch and page offsets, literal
+//  and struct offsets, stack slots) masked out.  Every overlapping n-gram of
+//  every signature goes into one hash table, the target's code range is
+//  hashed once from start to end, and each hit votes for where the address
+//  would be if that n-gram is where it was.  The candidate with the most
+//  votes wins; how far it is ahead of the next one is the confidence.
+//
+
+#ifndef SIG_MATCH_H_
+#define SIG_MATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PF_SIG_WORDS    48      // instructions per signature
+#define PF_SIG_BEFORE   8       // of them before the address, where there are
+#define PF_SIG_GRAM     4       // instructions per n-gram
+#define PF_SIG_MAX_HITS 32      // n-grams seen more often than this do not vote
+
+struct pf_sig {
+    const char *name;
+    uint64_t addr;              // offset into the reference image
+    unsigned nwords;
+    unsigned at;                // index of addr in words
+    uint32_t words[PF_SIG_WORDS];
+};
+
+struct pf_sig_match {
+    uint64_t addr;              // offset into the target image, 0 if no match
+    unsigned votes;             // n-grams that agree on addr
+    unsigned runner_up;         // votes for the next best address
+    unsigned grams;             // n-grams in the signature
+    double confidence;          // (votes - runner_up) / grams
+};
+
+// The instruction with its build-specific immediates cleared.
+uint32_t pf_sig_normalize(uint32_t insn);
+
+// Fills sig from the code at offset addr of image, a code range being
+// [start, end).  Returns -1 if addr is outside the range or too close to
+// its end for a single n-gram.
+int pf_sig_extract(struct pf_sig *sig, const uint8_t *image, uint64_t start, uint64_t end,
+                   uint64_t addr);
+
+// Looks for each of sigs[0..n) in the code range [start, end) of image,
+// reading it once.  out[i] belongs to sigs[i].  Returns the number of
+// signatures matched, or -1 when out of memory.
+long pf_sig_match(const struct pf_sig *sigs, size_t n, const uint8_t *image, uint64_t start,
+                  uint64_t end, struct pf_sig_match *out);
+
+#endif
@@ -0,0 +1,199 @@
+//
+//  str_search.c
+//  xSpiral
+//
+//  The automaton is a dense DFA: every state has all 256 transitions filled
+//  in, so the scan loop is one table load per byte.  While sitting in the
+//  root state we skip ahead with memchr() to the next byte that can start a
+//  needle, which is most of __cstring.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "str_search.h"
+
+struct automaton {
+    int32_t (*go)[256];
+    int32_t *fail;
+    int32_t *out;       // first needle ending in this state, or -1
+    int32_t *next_out;  // chain of needles sharing the same end state
+    int32_t *dict;      // nearest proper suffix state with output, or 0
+    unsigned nstates;
+    uint8_t first[256];
+    int nfirst;
+    uint8_t only_first;
+};
+
+static void
+ac_free(struct automaton *ac)
+{
+    free(ac->go);
+    free(ac->fail);
+    free(ac->out);
+    free(ac->next_out);
+    free(ac->dict);
+}
+
+static int
+ac_build(struct automaton *ac, const char *const *needles, unsigned n)
+{
+    size_t total = 1;
+    unsigned i, s, head, tail;
+    int32_t *queue;
+
+    memset(ac, 0, sizeof(*ac));
+    for (i = 0; i < n; i++) {
+        total += strlen(needles[i]);
+    }
+    ac->go = malloc(total * sizeof(*ac->go));
+    ac->fail = calloc(total, sizeof(int32_t));
+    ac->out = malloc(total * sizeof(int32_t));
+    ac->dict = calloc(total, sizeof(int32_t));
+    ac->next_out = malloc(n * sizeof(int32_t) + 1);
+    queue = malloc(total * sizeof(int32_t));
+    if (!ac->go || !ac->fail || !ac->out || !ac->dict || !ac->next_out || !queue) {
+        free(queue);
+        ac_free(ac);
+        return -1;
+    }
+    memset(ac->go, -1, total * sizeof(*ac->go));
+    memset(ac->out, -1, total * sizeof(int32_t));
+    ac->nstates = 1;
+
+    // trie
+    for (i = 0; i < n; i++) {
+        const uint8_t *p = (const uint8_t *)needles[i];
+        s = 0;
+        if (!*p) {
+            ac->next_out[i] = -1;
+            continue;
+        }
+        if (!ac->first[*p]) {
+            ac->first[*p] = 1;
+            ac->only_first = *p;
+            ac->nfirst++;
+        }
+        for (; *p; p++) {
+            if (ac->go[s][*p] < 0) {
+                ac->go[s][*p] = ac->nstates++;
+            }
+            s = ac->go[s][*p];
+        }
+        ac->next_out[i] = ac->out[s];
+        ac->out[s] = i;
+    }
+
+    // failure links, breadth first, completing the DFA as we go
+    head = tail = 0;
+    for (i = 0; i < 256; i++) {
+        if (ac->go[0][i] < 0) {
+            ac->go[0][i] = 0;
+        } else {
+            queue[tail++] = ac->go[0][i];
+        }
+    }
+    while (head < tail) {
+        unsigned r = queue[head++];
+        for (i = 0; i < 256; i++) {
+            int32_t u = ac->go[r][i];
+            if (u < 0) {
+                ac->go[r][i] = ac->go[ac->fail[r]][i];
+                continue;
+            }
+            ac->fail[u] = ac->go[ac->fail[r]][i];
+            ac->dict[u] = ac->out[ac->fail[u]] >= 0 ? ac->fail[u] : ac->dict[ac->fail[u]];
+            queue[tail++] = u;
+        }
+    }
+    free(queue);
+    return 0;
+}
+
+static int
+add_hit(struct pf_str_matches *m, size_t *cap, unsigned needle, uint64_t off)
+{
+    if (m->nhits[needle] == cap[needle]) {
+        size_t ncap = cap[needle] ? cap[needle] * 2 : 4;
+        uint64_t *p = realloc(m->hits[needle], ncap * sizeof(*p));
+        if (!p) {
+            return -1;
+        }
+        m->hits[needle] = p;
+        cap[needle] = ncap;
+    }
+    m->hits[needle][m->nhits[needle]++] = off;
+    return 0;
+}
+
+int
+pf_find_strings(const uint8_t *buf, uint64_t start, uint64_t end,
+                const char *const *needles, unsigned n, struct pf_str_matches *m)
+{
+    struct automaton ac;
+    size_t *cap;
+    uint64_t i;
+    int32_t s = 0;
+    int rv = 0;
+
+    memset(m, 0, sizeof(*m));
+    m->count = n;
+    m->nhits = calloc(n + 1, sizeof(*m->nhits));
+    m->hits = calloc(n + 1, sizeof(*m->hits));
+    cap = calloc(n + 1, sizeof(*cap));
+    if (!m->nhits || !m->hits || !cap || ac_build(&ac, needles, n)) {
+        free(cap);
+        pf_str_matches_free(m);
+        return -1;
+    }
+
+    for (i = start; i < end && !rv; i++) {
+        int32_t t;
+        if (s == 0) {
+            if (!ac.nfirst) {
+                break;
+            }
+            if (ac.nfirst == 1) {
+                const uint8_t *p = memchr(buf + i, ac.only_first, end - i);
+                if (!p) {
+                    break;
+                }
+                i = p - buf;
+            } else {
+                while (i < end && !ac.first[buf[i]]) {
+                    i++;
+                }
+                if (i == end) {
+                    break;
+                }
+            }
+        }
+        s = ac.go[s][buf[i]];
+        for (t = ac.out[s] >= 0 ? s : ac.dict[s]; t && !rv; t = ac.dict[t]) {
+            int32_t id;
+            for (id = ac.out[t]; id >= 0 && !rv; id = ac.next_out[id]) {
+                rv = add_hit(m, cap, id, i + 1 - strlen(needles[id]));
+            }
+        }
+    }
+
+    ac_free(&ac);
+    free(cap);
+    if (rv) {
+        pf_str_matches_free(m);
+    }
+    return rv;
+}
+
+void
+pf_str_matches_free(struct pf_str_matches *m)
+{
+    unsigned i;
+    if (m->hits) {
+        for (i = 0; i < m->count; i++) {
+            free(m->hits[i]);
+        }
+    }
+    free(m->hits);
+    free(m->nhits);
+    memset(m, 0, sizeof(*m));
+}
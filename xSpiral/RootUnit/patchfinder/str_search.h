@@ -0,0 +1,28 @@
+//
+//  str_search.h
+//  xSpiral
+//
+//  Multi-needle substring search (Aho-Corasick).  All needles are located
+//  in a single pass over the haystack and every occurrence is reported.
+//
+
+#ifndef STR_SEARCH_H_
+#define STR_SEARCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct pf_str_matches {
+    unsigned count;     // number of needles
+    size_t *nhits;      // occurrences per needle
+    uint64_t **hits;    // ascending offsets of each occurrence, per needle
+};
+
+// Searches buf[start, end) for all needles.  Offsets in the result are
+// relative to buf, like start/end.  Needles are matched without their
+// terminating NUL, as boyermoore_horspool_memmem() did.
+int pf_find_strings(const uint8_t *buf, uint64_t start, uint64_t end,
+                    const char *const *needles, unsigned n, struct pf_str_matches *m);
+void pf_str_matches_free(struct pf_str_matches *m);
+
+#endif
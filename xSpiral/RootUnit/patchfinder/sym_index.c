@@ -0,0 +1,119 @@
+//
+//  sym_index.c
+//  xSpiral
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "macho_loader.h"
+#include "sym_index.h"
+
+static uint32_t
+hash_name(const char *s)
+{
+    uint32_t h = 0x811c9dc5;
+    while (*s) {
+        h = (h ^ (uint8_t)*s++) * 0x01000193;
+    }
+    return h;
+}
+
+static int
+grow(struct pf_sym_index *idx, size_t want)
+{
+    size_t i, n = idx->slots ? idx->mask + 1 : 0x1000;
+    struct pf_sym *slots;
+
+    while (n < want * 2) {
+        n *= 2;
+    }
+    if (idx->slots && n == idx->mask + 1) {
+        return 0;
+    }
+    slots = calloc(n, sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+    for (i = 0; idx->slots && i <= idx->mask; i++) {
+        const struct pf_sym *s = &idx->slots[i];
+        if (s->name) {
+            size_t j = s->hash & (n - 1);
+            while (slots[j].name) {
+                j = (j + 1) & (n - 1);
+            }
+            slots[j] = *s;
+        }
+    }
+    free(idx->slots);
+    idx->slots = slots;
+    idx->mask = n - 1;
+    return 0;
+}
+
+int
+pf_sym_index_add(struct pf_sym_index *idx, const struct nlist_64 *syms, uint32_t nsyms,
+                 const char *strtab, uint32_t strsize)
+{
+    uint32_t i;
+
+    if (grow(idx, idx->count + nsyms)) {
+        return -1;
+    }
+    for (i = 0; i < nsyms; i++) {
+        const struct nlist_64 *sym = &syms[i];
+        const char *name;
+        uint32_t hash;
+        size_t j;
+
+        if ((sym->n_type & N_STAB) || (sym->n_type & N_TYPE) != N_SECT || !sym->n_value) {
+            continue;
+        }
+        if (sym->n_un.n_strx >= strsize || !memchr(strtab + sym->n_un.n_strx, 0, strsize - sym->n_un.n_strx)) {
+            continue;
+        }
+        name = strtab + sym->n_un.n_strx;
+        if (!*name) {
+            continue;
+        }
+        hash = hash_name(name);
+        for (j = hash & idx->mask; idx->slots[j].name; j = (j + 1) & idx->mask) {
+            if (idx->slots[j].hash == hash && !strcmp(idx->slots[j].name, name)) {
+                break;
+            }
+        }
+        if (!idx->slots[j].name) {
+            idx->slots[j].name = name;
+            idx->slots[j].value = sym->n_value;
+            idx->slots[j].hash = hash;
+            idx->count++;
+        }
+    }
+    return 0;
+}
+
+void
+pf_sym_index_free(struct pf_sym_index *idx)
+{
+    free(idx->slots);
+    idx->slots = NULL;
+    idx->mask = 0;
+    idx->count = 0;
+}
+
+uint64_t
+pf_sym_index_lookup(const struct pf_sym_index *idx, const char *name)
+{
+    uint32_t hash;
+    size_t j;
+
+    if (!idx->slots) {
+        return 0;
+    }
+    hash = hash_name(name);
+    for (j = hash & idx->mask; idx->slots[j].name; j = (j + 1) & idx->mask) {
+        if (idx->slots[j].hash == hash && !strcmp(idx->slots[j].name, name)) {
+            return idx->slots[j].value;
+        }
+    }
+    return 0;
+}
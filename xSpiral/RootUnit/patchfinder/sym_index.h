@@ -0,0 +1,42 @@
+//
+//  sym_index.h
+//  xSpiral
+//
+//  Open-addressed hash table from symbol name to address, filled from one
+//  or more nlist_64 tables (the kernel's own LC_SYMTAB and, for fileset
+//  kernelcaches, every kext's).  Names point into the string tables, which
+//  must outlive the index.
+//
+
+#ifndef SYM_INDEX_H_
+#define SYM_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct nlist_64;
+
+struct pf_sym {
+    const char *name;   // NULL for an empty slot
+    uint64_t value;
+    uint32_t hash;
+};
+
+struct pf_sym_index {
+    struct pf_sym *slots;
+    size_t mask;        // slot count - 1, a power of two
+    size_t count;
+};
+
+// Adds every defined, non-debug symbol of one table.  strtab/strsize bound
+// the names; symbols whose name does not fit are skipped.  When a name is
+// already present the first definition is kept.
+int pf_sym_index_add(struct pf_sym_index *idx, const struct nlist_64 *syms, uint32_t nsyms,
+                     const char *strtab, uint32_t strsize);
+void pf_sym_index_free(struct pf_sym_index *idx);
+
+// Returns the address of `name` (as spelled in the table, e.g. "_allproc"),
+// or 0.
+uint64_t pf_sym_index_lookup(const struct pf_sym_index *idx, const char *name);
+
+#endif
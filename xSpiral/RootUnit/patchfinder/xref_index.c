@@ -0,0 +1,216 @@
+//
+//  xref_index.c
+//  xSpiral
+//
+//  One pf_a64_walk() over a code range tracking the same register values as
+//  scan_reference(), recording every (value, pc) pair that lands inside the
+//  image.  Lookups are then a binary search instead of a full rescan per
+//  query.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "a64_decode.h"
+#include "xref_index.h"
+
+#define XREF_MAGIC      0x52584650  // 'PFXR'
+#define XREF_VERSION    2
+
+// A reference as recorded during the walk, with the pc of the ADRP, ADR or
+// literal load its value was computed from.
+struct build_xref {
+    uint32_t to;
+    uint32_t from;
+    uint32_t origin;
+};
+
+// No register write behind the value: it stays the same however often the
+// registers are cleared.
+#define ORIGIN_NONE     UINT32_MAX
+
+static int
+cmp_xref(const void *a, const void *b)
+{
+    const struct build_xref *x = a, *y = b;
+    if (x->to != y->to) {
+        return x->to < y->to ? -1 : 1;
+    }
+    if (x->from != y->from) {
+        return x->from < y->from ? -1 : 1;
+    }
+    return 0;
+}
+
+struct build_ctx {
+    struct build_xref *refs;
+    size_t count;
+    size_t cap;
+    uint64_t limit;
+    uint64_t value[32];
+    uint32_t origin[32];
+};
+
+static int
+build_visit(void *ctx, uint64_t pc, const struct pf_a64_insn *insn)
+{
+    struct build_ctx *b = ctx;
+    int reg = pf_a64_track(b->value, insn);
+    if (reg < 0) {
+        return 0;
+    }
+    b->origin[reg] = insn->kind == PF_A64_ADD || insn->kind == PF_A64_LDR ? b->origin[insn->rn] : (uint32_t)pc;
+    if (!b->value[reg] || b->value[reg] >= b->limit) {
+        return 0;
+    }
+    if (b->count == b->cap) {
+        size_t ncap = b->cap ? b->cap * 2 : 0x10000;
+        struct build_xref *p = realloc(b->refs, ncap * sizeof(*p));
+        if (!p) {
+            return -1;
+        }
+        b->refs = p;
+        b->cap = ncap;
+    }
+    b->refs[b->count].to = (uint32_t)b->value[reg];
+    b->refs[b->count].from = (uint32_t)pc;
+    b->refs[b->count].origin = b->origin[reg];
+    b->count++;
+    return 0;
+}
+
+// scan_reference() clears the registers after each reference it finds, so
+// a later one to the same target counts only if its value was computed
+// afterwards.  The registers are never cleared here; instead, of the
+// references to one target, a reference is kept only when its origin lies
+// past the last one kept.
+static size_t
+keep_restarted(const struct build_xref *refs, size_t count, struct pf_xref *out)
+{
+    size_t i, n = 0;
+    for (i = 0; i < count; i++) {
+        if (n && out[n - 1].to == refs[i].to && refs[i].origin != ORIGIN_NONE &&
+            refs[i].origin <= out[n - 1].from) {
+            continue;
+        }
+        out[n].to = refs[i].to;
+        out[n].from = refs[i].from;
+        n++;
+    }
+    return n;
+}
+
+int
+pf_xref_index_build(struct pf_xref_index *idx, const uint8_t *buf, uint64_t start, uint64_t end, uint64_t limit)
+{
+    struct build_ctx b;
+
+    memset(idx, 0, sizeof(*idx));
+    memset(&b, 0, sizeof(b));
+
+    if (limit > UINT32_MAX) {
+        return -1;
+    }
+    idx->start = start & ~3;
+    idx->end = end & ~3;
+    b.limit = limit;
+    memset(b.origin, 0xFF, sizeof(b.origin));
+
+    if (pf_a64_walk(buf, idx->start, idx->end, PF_A64_TRACKED, build_visit, &b) != idx->end) {
+        free(b.refs);
+        return -1;
+    }
+
+    if (b.count) {
+        qsort(b.refs, b.count, sizeof(*b.refs), cmp_xref);
+    }
+    idx->refs = malloc(b.count ? b.count * sizeof(*idx->refs) : 1);
+    if (!idx->refs) {
+        free(b.refs);
+        return -1;
+    }
+    idx->count = keep_restarted(b.refs, b.count, idx->refs);
+    free(b.refs);
+    return 0;
+}
+
+void
+pf_xref_index_free(struct pf_xref_index *idx)
+{
+    free(idx->refs);
+    idx->refs = NULL;
+    idx->count = 0;
+}
+
+uint64_t
+pf_xref_index_lookup(const struct pf_xref_index *idx, uint64_t to, int n)
+{
+    size_t lo = 0, hi = idx->count;
+    if (n <= 0) {
+        n = 1;
+    }
+    // lower bound of `to`
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->refs[mid].to < to) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    lo += n - 1;
+    if (lo >= idx->count || idx->refs[lo].to != to) {
+        return 0;
+    }
+    return idx->refs[lo].from;
+}
+
+struct xref_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t start;
+    uint64_t end;
+    uint64_t count;
+};
+
+int
+pf_xref_index_write(const struct pf_xref_index *idx, FILE *f)
+{
+    struct xref_file_header hdr;
+    hdr.magic = XREF_MAGIC;
+    hdr.version = XREF_VERSION;
+    hdr.start = idx->start;
+    hdr.end = idx->end;
+    hdr.count = idx->count;
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        return -1;
+    }
+    if (idx->count && fwrite(idx->refs, sizeof(*idx->refs), idx->count, f) != idx->count) {
+        return -1;
+    }
+    return 0;
+}
+
+int
+pf_xref_index_read(struct pf_xref_index *idx, FILE *f)
+{
+    struct xref_file_header hdr;
+    memset(idx, 0, sizeof(*idx));
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1) {
+        return -1;
+    }
+    if (hdr.magic != XREF_MAGIC || hdr.version != XREF_VERSION || hdr.count > SIZE_MAX / sizeof(*idx->refs)) {
+        return -1;
+    }
+    idx->refs = malloc(hdr.count ? hdr.count * sizeof(*idx->refs) : 1);
+    if (!idx->refs) {
+        return -1;
+    }
+    if (hdr.count && fread(idx->refs, sizeof(*idx->refs), hdr.count, f) != hdr.count) {
+        pf_xref_index_free(idx);
+        return -1;
+    }
+    idx->start = hdr.start;
+    idx->end = hdr.end;
+    idx->count = hdr.count;
+    return 0;
+}
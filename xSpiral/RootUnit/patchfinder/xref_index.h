@@ -0,0 +1,37 @@
+//
+//  xref_index.h
+//  xSpiral
+//
+//  Sorted target -> referencing instruction table for one code range,
+//  built with a single decode pass.
+//
+
+#ifndef XREF_INDEX_H_
+#define XREF_INDEX_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Both fields are offsets into the kernel buffer (VA - kerndumpbase).
+struct pf_xref {
+    uint32_t to;
+    uint32_t from;
+};
+
+struct pf_xref_index {
+    uint64_t start;
+    uint64_t end;
+    struct pf_xref *refs;   // sorted by (to, from)
+    size_t count;
+};
+
+int pf_xref_index_build(struct pf_xref_index *idx, const uint8_t *buf, uint64_t start, uint64_t end, uint64_t limit);
+void pf_xref_index_free(struct pf_xref_index *idx);
+
+// Returns the n-th (1-based, in address order) instruction referencing `to`, or 0.
+uint64_t pf_xref_index_lookup(const struct pf_xref_index *idx, uint64_t to, int n);
+
+int pf_xref_index_write(const struct pf_xref_index *idx, FILE *f);
+int pf_xref_index_read(struct pf_xref_index *idx, FILE *f);
+
+#endif
@@ -9,9 +9,10 @@
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
-#include "kmem.h"
-
-typedef unsigned long long addr_t;
+#include "patchfinder64.h"
+#include "a64_decode.h"
+#include "fixups.h"
+#include "pf_view.h"
 
 #define IS64(image) (*(uint8_t *)(image) & 1)
 
@@ -78,17 +79,26 @@ boyermoore_horspool_memmem(const unsigned char* haystack, size_t hlen,
 
 /* patchfinder ***************************************************************/
 
-// Finds start of function
+// Functions are assumed to be no larger than this; bof64() gives up instead
+// of walking back through the rest of the segment.
+#define BOF_LIMIT 0x20000
+
+// Finds start of function.  Never reads below `start`; `where` must be a
+// readable instruction at or above it.
 static addr_t
 bof64(const uint8_t *buf, addr_t start, addr_t where)
 {
-    for (; where >= start; where -= 4) {
+    if (where > start + BOF_LIMIT) {
+        start = where - BOF_LIMIT;
+    }
+    for (where &= ~3; where >= start; where -= 4) {
         uint32_t op = *(uint32_t *)(buf + where);
         if ((op & 0xFFC003FF) == 0x910003FD) {
             unsigned delta = (op >> 10) & 0xFFF;
+            addr_t back = ((delta >> 4) + 1) * 4;
             //printf("%x: ADD X29, SP, #0x%x\n", where, delta);
-            if ((delta & 0xF) == 0) {
-                addr_t prev = where - ((delta >> 4) + 1) * 4;
+            if ((delta & 0xF) == 0 && where - start >= back) {
+                addr_t prev = where - back;
                 uint32_t au = *(uint32_t *)(buf + prev);
                 if ((au & 0xFFC003E0) == 0xA98003E0) {
                     //printf("%x: STP x, y, [SP,#-imm]!\n", prev);
@@ -96,127 +106,55 @@ bof64(const uint8_t *buf, addr_t start, addr_t where)
                 }
             }
         }
+        if (where < start + 4) {
+            break;              // also keeps where from wrapping at 0
+        }
     }
     return 0;
 }
 
-static addr_t
-xref64(const uint8_t *buf, addr_t start, addr_t end, addr_t what)
-{
-    addr_t i;
+struct xref64_ctx {
     uint64_t value[32];
+    addr_t what;
+};
 
-    memset(value, 0, sizeof(value));
+static int
+xref64_visit(void *ctx, uint64_t pc, const struct pf_a64_insn *insn)
+{
+    struct xref64_ctx *x = ctx;
+    int reg = pf_a64_track(x->value, insn);
+    (void)pc;
+    return reg >= 0 && x->value[reg] == x->what;
+}
 
-    end &= ~3;
-    for (i = start & ~3; i < end; i += 4) {
-        uint32_t op = *(uint32_t *)(buf + i);
-        unsigned reg = op & 0x1F;
-        if ((op & 0x9F000000) == 0x90000000) {
-            signed adr = ((op & 0x60000000) >> 18) | ((op & 0xFFFFE0) << 8);
-            //printf("%llx: ADRP X%d, 0x%llx\n", i, reg, ((long long)adr << 1) + (i & ~0xFFF));
-            value[reg] = ((long long)adr << 1) + (i & ~0xFFF);
-        /*} else if ((op & 0xFFE0FFE0) == 0xAA0003E0) {
-            unsigned rd = op & 0x1F;
-            unsigned rm = (op >> 16) & 0x1F;
-            //printf("%llx: MOV X%d, X%d\n", i, rd, rm);
-            value[rd] = value[rm];*/
-        } else if ((op & 0xFF000000) == 0x91000000) {
-            unsigned rn = (op >> 5) & 0x1F;
-            unsigned shift = (op >> 22) & 3;
-            unsigned imm = (op >> 10) & 0xFFF;
-            if (shift == 1) {
-                imm <<= 12;
-            } else {
-                //assert(shift == 0);
-                if (shift > 1) continue;
-            }
-            //printf("%llx: ADD X%d, X%d, 0x%x\n", i, reg, rn, imm);
-            value[reg] = value[rn] + imm;
-        } else if ((op & 0xF9C00000) == 0xF9400000) {
-            unsigned rn = (op >> 5) & 0x1F;
-            unsigned imm = ((op >> 10) & 0xFFF) << 3;
-            //printf("%llx: LDR X%d, [X%d, 0x%x]\n", i, reg, rn, imm);
-            if (!imm) continue;			// XXX not counted as true xref
-            value[reg] = value[rn] + imm;	// XXX address, not actual value
-        /*} else if ((op & 0xF9C00000) == 0xF9000000) {
-            unsigned rn = (op >> 5) & 0x1F;
-            unsigned imm = ((op >> 10) & 0xFFF) << 3;
-            //printf("%llx: STR X%d, [X%d, 0x%x]\n", i, reg, rn, imm);
-            if (!imm) continue;			// XXX not counted as true xref
-            value[rn] = value[rn] + imm;	// XXX address, not actual value*/
-        } else if ((op & 0x9F000000) == 0x10000000) {
-            signed adr = ((op & 0x60000000) >> 18) | ((op & 0xFFFFE0) << 8);
-            //printf("%llx: ADR X%d, 0x%llx\n", i, reg, ((long long)adr >> 11) + i);
-            value[reg] = ((long long)adr >> 11) + i;
-        } else if ((op & 0xFF000000) == 0x58000000) {
-            unsigned adr = (op & 0xFFFFE0) >> 3;
-            //printf("%llx: LDR X%d, =0x%llx\n", i, reg, adr + i);
-            value[reg] = adr + i;		// XXX address, not actual value
-        }
-        if (value[reg] == what) {
-            return i;
-        }
+static int
+calc64_visit(void *ctx, uint64_t pc, const struct pf_a64_insn *insn)
+{
+    uint64_t *value = ctx;
+    (void)pc;
+    switch (insn->kind) {
+        case PF_A64_STR:
+            if (insn->imm) {
+                value[insn->rn] += insn->imm;   // XXX address, not actual value
+            }
+            return 0;
+        case PF_A64_BRANCH:
+            return 1;
+        default:
+            pf_a64_track(value, insn);
+            return 0;
     }
-    return 0;
 }
 
+// Emulates from `start` up to and including the next branch, or up to `end`.
+// Unlike scan_reference(), stores move the base register by their offset.
+// Returns where the next basic block begins.
 static addr_t
-calc64(const uint8_t *buf, addr_t start, addr_t end, int which)
+calc64_block(const uint8_t *buf, addr_t start, addr_t end, uint64_t *value)
 {
-    addr_t i;
-    uint64_t value[32];
-
-    memset(value, 0, sizeof(value));
-
-    end &= ~3;
-    for (i = start & ~3; i < end; i += 4) {
-        uint32_t op = *(uint32_t *)(buf + i);
-        unsigned reg = op & 0x1F;
-        if ((op & 0x9F000000) == 0x90000000) {
-            signed adr = ((op & 0x60000000) >> 18) | ((op & 0xFFFFE0) << 8);
-            //printf("%llx: ADRP X%d, 0x%llx\n", i, reg, ((long long)adr << 1) + (i & ~0xFFF));
-            value[reg] = ((long long)adr << 1) + (i & ~0xFFF);
-        /*} else if ((op & 0xFFE0FFE0) == 0xAA0003E0) {
-            unsigned rd = op & 0x1F;
-            unsigned rm = (op >> 16) & 0x1F;
-            //printf("%llx: MOV X%d, X%d\n", i, rd, rm);
-            value[rd] = value[rm];*/
-        } else if ((op & 0xFF000000) == 0x91000000) {
-            unsigned rn = (op >> 5) & 0x1F;
-            unsigned shift = (op >> 22) & 3;
-            unsigned imm = (op >> 10) & 0xFFF;
-            if (shift == 1) {
-                imm <<= 12;
-            } else {
-                //assert(shift == 0);
-                if (shift > 1) continue;
-            }
-            //printf("%llx: ADD X%d, X%d, 0x%x\n", i, reg, rn, imm);
-            value[reg] = value[rn] + imm;
-        } else if ((op & 0xF9C00000) == 0xF9400000) {
-            unsigned rn = (op >> 5) & 0x1F;
-            unsigned imm = ((op >> 10) & 0xFFF) << 3;
-            //printf("%llx: LDR X%d, [X%d, 0x%x]\n", i, reg, rn, imm);
-            if (!imm) continue;			// XXX not counted as true xref
-            value[reg] = value[rn] + imm;	// XXX address, not actual value
-        } else if ((op & 0xF9C00000) == 0xF9000000) {
-            unsigned rn = (op >> 5) & 0x1F;
-            unsigned imm = ((op >> 10) & 0xFFF) << 3;
-            //printf("%llx: STR X%d, [X%d, 0x%x]\n", i, reg, rn, imm);
-            if (!imm) continue;			// XXX not counted as true xref
-            value[rn] = value[rn] + imm;	// XXX address, not actual value
-        } else if ((op & 0x9F000000) == 0x10000000) {
-            signed adr = ((op & 0x60000000) >> 18) | ((op & 0xFFFFE0) << 8);
-            //printf("%llx: ADR X%d, 0x%llx\n", i, reg, ((long long)adr >> 11) + i);
-            value[reg] = ((long long)adr >> 11) + i;
-        } else if ((op & 0xFF000000) == 0x58000000) {
-            unsigned adr = (op & 0xFFFFE0) >> 3;
-            //printf("%llx: LDR X%d, =0x%llx\n", i, reg, adr + i);
-            value[reg] = adr + i;		// XXX address, not actual value
-        }
-    }
-    return value[which];
+    addr_t i = pf_a64_walk(buf, start, end, PF_A64_TRACKED | PF_A64_MASK(PF_A64_STR) | PF_A64_MASK(PF_A64_BRANCH),
+                           calc64_visit, value);
+    return i < (end & ~3) ? i + 4 : end & ~3;
 }
 
 /* kernel iOS10 **************************************************************/
@@ -225,78 +163,134 @@ calc64(const uint8_t *buf, addr_t start, addr_t end, int which)
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <mach-o/loader.h>
+#include <pthread.h>
+#include "func_index.h"
+#include "insn_scan.h"
+#include "reg_cache.h"
+#include "str_search.h"
+#include "macho_loader.h"
 
-#ifndef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
+#if defined(HAVE_MAIN) && !defined(PATCHFINDER_HOST)
+#define PATCHFINDER_HOST
+#endif
+
+#if !defined(PATCHFINDER_HOST) && !defined(__ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__)
 #define __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
 #endif
 
+#include <sys/mman.h>
+
 #ifdef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
 #include <mach/mach.h>
 size_t kread(uint64_t where, void *p, size_t size);
+#else
+#include <sys/stat.h>
+#include "decompress.h"
+#include "img4.h"
 #endif
 
-static uint8_t *kernel = NULL;
-static size_t kernel_size = 0;
-
-static addr_t xnucore_base = 0;
-static addr_t xnucore_size = 0;
-static addr_t prelink_base = 0;
-static addr_t prelink_size = 0;
-static addr_t cstring_base = 0;
-static addr_t cstring_size = 0;
-static addr_t pstring_base = 0;
-static addr_t pstring_size = 0;
-static addr_t kerndumpbase = -1;
-static addr_t kernel_entry = 0;
-static void *kernel_mh = 0;
-static addr_t kernel_delta = 0;
-
-int
-init_kernel(addr_t base, const char *filename)
+#ifndef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
+// Maps the file-backed part of a segment read-only in place.  Whole pages come
+// straight from the page cache; only an unaligned head/tail is copied.
+static int
+map_segment(struct pf_kernel *k, int fd, const struct pf_segment *seg)
 {
-    size_t rv;
-    uint8_t buf[0x4000];
-    unsigned i, j;
-    const struct mach_header *hdr = (struct mach_header *)buf;
-    const uint8_t *q;
-    addr_t min = -1;
-    addr_t max = 0;
-    int is64 = 0;
+    uint8_t *dst = k->kernel + seg->vmaddr - k->kerndumpbase;
+    addr_t pagemask = getpagesize() - 1;
+    addr_t len = seg->filesize;
+    addr_t head, tail;
 
-#ifdef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
-#define close(f)
-    rv = kread(base, buf, sizeof(buf));
-    if (rv != sizeof(buf)) {
-        return -1;
+    if (!len) {
+        return 0;
     }
-#else	/* __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__ */
-    int fd = open(filename, O_RDONLY);
-    if (fd < 0) {
-        return -1;
+    if ((((uintptr_t)dst ^ seg->fileoff) & pagemask) == 0) {
+        head = -seg->fileoff & pagemask;
+        tail = (seg->fileoff + len) & pagemask;
+        if (head + tail < len) {
+            void *p = mmap(dst + head, len - head - tail, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, seg->fileoff + head);
+            if (p == MAP_FAILED) {
+                return -1;
+            }
+            if (head && pread(fd, dst, head, seg->fileoff) != (ssize_t)head) {
+                return -1;
+            }
+            if (tail && pread(fd, dst + len - tail, tail, seg->fileoff + len - tail) != (ssize_t)tail) {
+                return -1;
+            }
+            return 0;
+        }
     }
-
-    rv = read(fd, buf, sizeof(buf));
-    if (rv != sizeof(buf)) {
-        close(fd);
+    if (pread(fd, dst, len, seg->fileoff) != (ssize_t)len) {
         return -1;
     }
-#endif	/* __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__ */
+    return 0;
+}
 
-    if (!MACHO(buf)) {
-        close(fd);
+// Fails for a truncated file, whose missing tail would otherwise fault on
+// first touch through the mapping.
+static int
+check_file_size(const struct pf_kernel *k, int fd)
+{
+    unsigned i;
+    struct stat st;
+    if (fstat(fd, &st)) {
         return -1;
     }
+    for (i = 0; i < k->nsegments; i++) {
+        const struct pf_segment *seg = &k->segments[i];
+        if (seg->fileoff + seg->filesize > (addr_t)st.st_size) {
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif	/* !__ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__ */
+
+// Images spanning more VA than this are rejected as malformed; buffer
+// offsets are kept in 32 bits by the lookup tables anyway.
+#define PF_MAX_IMAGE    0x100000000ULL
+
+// Fills in the segment table and code/string ranges from the Mach-O header
+// in buf.  Nothing is loaded yet; kernel_size is the VA span to reserve.
+// Ranges are only checked for being well-formed here; scanners clip them
+// to the image through code_view() and string_view().
+static int
+parse_header(struct pf_kernel *k, const uint8_t *buf, size_t size)
+{
+    unsigned i, j;
+    const struct mach_header *hdr = (struct mach_header *)buf;
+    const uint8_t *q, *end = buf + size;
+    addr_t min = -1;
+    addr_t max = 0;
 
-    if (IS64(buf)) {
-        is64 = 4;
+    // Load commands are read in place as 8-byte aligned structures, which
+    // only a 64-bit header (32 bytes) followed by commands whose sizes are
+    // multiples of 8 guarantees.  buf itself must be 8-byte aligned.
+    if (!MACHO(buf) || !IS64(buf)) {
+        return -1;
     }
 
-    q = buf + sizeof(struct mach_header) + is64;
+    q = buf + sizeof(struct mach_header_64);
     for (i = 0; i < hdr->ncmds; i++) {
         const struct load_command *cmd = (struct load_command *)q;
+        if (q + sizeof(*cmd) > end || cmd->cmdsize < sizeof(*cmd) || cmd->cmdsize > (size_t)(end - q) || (cmd->cmdsize & 7)) {
+            return -1;
+        }
         if (cmd->cmd == LC_SEGMENT_64) {
             const struct segment_command_64 *seg = (struct segment_command_64 *)q;
+            // Only what is mapped is ever loaded or scanned.
+            addr_t filesize = seg->filesize < seg->vmsize ? seg->filesize : seg->vmsize;
+            if (k->nsegments == PF_MAX_SEGMENTS || cmd->cmdsize < sizeof(*seg) ||
+                seg->nsects > (cmd->cmdsize - sizeof(*seg)) / sizeof(struct section_64) ||
+                seg->vmaddr + seg->vmsize < seg->vmaddr || seg->fileoff + filesize < seg->fileoff) {
+                return -1;
+            }
+            memcpy(k->segments[k->nsegments].segname, seg->segname, sizeof(seg->segname));
+            k->segments[k->nsegments].vmaddr = seg->vmaddr;
+            k->segments[k->nsegments].vmsize = seg->vmsize;
+            k->segments[k->nsegments].fileoff = seg->fileoff;
+            k->segments[k->nsegments].filesize = filesize;
+            k->nsegments++;
             if (min > seg->vmaddr) {
                 min = seg->vmaddr;
             }
@@ -304,19 +298,28 @@ init_kernel(addr_t base, const char *filename)
                 max = seg->vmaddr + seg->vmsize;
             }
             if (!strcmp(seg->segname, "__TEXT_EXEC")) {
-                xnucore_base = seg->vmaddr;
-                xnucore_size = seg->filesize;
+                k->xnucore_base = seg->vmaddr;
+                k->xnucore_size = filesize;
             }
             if (!strcmp(seg->segname, "__PLK_TEXT_EXEC")) {
-                prelink_base = seg->vmaddr;
-                prelink_size = seg->filesize;
+                k->prelink_base = seg->vmaddr;
+                k->prelink_size = filesize;
             }
             if (!strcmp(seg->segname, "__TEXT")) {
                 const struct section_64 *sec = (struct section_64 *)(seg + 1);
                 for (j = 0; j < seg->nsects; j++) {
                     if (!strcmp(sec[j].sectname, "__cstring")) {
-                        cstring_base = sec[j].addr;
-                        cstring_size = sec[j].size;
+                        k->cstring_base = sec[j].addr;
+                        k->cstring_size = sec[j].size;
+                    }
+                }
+            }
+            if (!strcmp(seg->segname, "__PRELINK_INFO")) {
+                const struct section_64 *sec = (struct section_64 *)(seg + 1);
+                for (j = 0; j < seg->nsects; j++) {
+                    if (!strcmp(sec[j].sectname, "__info")) {
+                        k->plist_base = sec[j].addr;
+                        k->plist_size = sec[j].size;
                     }
                 }
             }
@@ -324,16 +327,16 @@ init_kernel(addr_t base, const char *filename)
                 const struct section_64 *sec = (struct section_64 *)(seg + 1);
                 for (j = 0; j < seg->nsects; j++) {
                     if (!strcmp(sec[j].sectname, "__text")) {
-                        pstring_base = sec[j].addr;
-                        pstring_size = sec[j].size;
+                        k->pstring_base = sec[j].addr;
+                        k->pstring_size = sec[j].size;
                     }
                 }
             }
 			if (!strcmp(seg->segname, "__LINKEDIT")) {
-				kernel_delta = seg->vmaddr - min - seg->fileoff;
+				k->kernel_delta = seg->vmaddr - min - seg->fileoff;
 			}
         }
-        if (cmd->cmd == LC_UNIXTHREAD) {
+        if (cmd->cmd == LC_UNIXTHREAD && cmd->cmdsize >= sizeof(*cmd) + 8 + 34 * 8 + 4) {
             uint32_t *ptr = (uint32_t *)(cmd + 1);
             uint32_t flavor = ptr[0];
             struct {
@@ -345,265 +348,1466 @@ init_kernel(addr_t base, const char *filename)
                 uint32_t cpsr;	/* Current program status register */
             } *thread = (void *)(ptr + 2);
             if (flavor == 6) {
-                kernel_entry = thread->pc;
+                k->kernel_entry = thread->pc;
             }
         }
         q = q + cmd->cmdsize;
     }
 
-    kerndumpbase = min;
-    xnucore_base -= kerndumpbase;
-    prelink_base -= kerndumpbase;
-    cstring_base -= kerndumpbase;
-    pstring_base -= kerndumpbase;
-    kernel_size = max - min;
+    // The header is read in place from the loaded image too, at the first
+    // segment's address, so that has to keep it 8-byte aligned.
+    if (!k->nsegments || max - min > PF_MAX_IMAGE || ((k->segments[0].vmaddr - min) & 7)) {
+        return -1;
+    }
+    k->kerndumpbase = min;
+    k->xnucore_base -= k->kerndumpbase;
+    k->prelink_base -= k->kerndumpbase;
+    k->cstring_base -= k->kerndumpbase;
+    k->pstring_base -= k->kerndumpbase;
+    k->plist_base -= k->kerndumpbase;
+    k->kernel_size = max - min;
+    return 0;
+}
 
-#ifdef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
-    kernel = malloc(kernel_size);
-    if (!kernel) {
+#ifndef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
+// Places decompressed file bytes into the image as they are produced.  The
+// first 0x4000 bytes are held back until the header in them can be parsed
+// and the image reserved; from then on every chunk is copied straight to
+// the segments it belongs to.
+struct stream_loader {
+    struct pf_kernel *k;
+    addr_t pos;                 // file offset of the next byte
+    uint8_t header[0x4000];
+};
+
+static void
+place(struct pf_kernel *k, addr_t pos, const uint8_t *data, size_t len)
+{
+    unsigned i;
+    for (i = 0; i < k->nsegments; i++) {
+        const struct pf_segment *seg = &k->segments[i];
+        addr_t size = seg->filesize < seg->vmsize ? seg->filesize : seg->vmsize;
+        addr_t lo = pos > seg->fileoff ? pos : seg->fileoff;
+        addr_t hi = pos + len < seg->fileoff + size ? pos + len : seg->fileoff + size;
+        if (lo < hi) {
+            memcpy(k->kernel + seg->vmaddr - k->kerndumpbase + lo - seg->fileoff, data + lo - pos, hi - lo);
+        }
+    }
+}
+
+static int
+place_chunk(void *ctx, const uint8_t *data, size_t len)
+{
+    struct stream_loader *l = ctx;
+    struct pf_kernel *k = l->k;
+
+    if (!k->kernel) {
+        size_t n = sizeof(l->header) - l->pos;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(l->header + l->pos, data, n);
+        l->pos += n;
+        data += n;
+        len -= n;
+        if (l->pos < sizeof(l->header)) {
+            return 0;
+        }
+        if (parse_header(k, l->header, sizeof(l->header))) {
+            return -1;
+        }
+        k->kernel = mmap(NULL, k->kernel_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (k->kernel == MAP_FAILED) {
+            k->kernel = NULL;
+            return -1;
+        }
+        place(k, 0, l->header, sizeof(l->header));
+    }
+    place(k, l->pos, data, len);
+    l->pos += len;
+    return 0;
+}
+
+// Loads an IMG4/IM4P-wrapped or bare compressed kernelcache, decoding it
+// in one pass directly into the image.
+static int
+load_payload(struct pf_kernel *k, int fd)
+{
+    int rv;
+    struct stat st;
+    struct pf_payload payload;
+    struct stream_loader *l;
+    void *file;
+
+    if (fstat(fd, &st) || st.st_size <= 0) {
         return -1;
     }
-    rv = kread(kerndumpbase, kernel, kernel_size);
-    if (rv != kernel_size) {
-        free(kernel);
+    file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (file == MAP_FAILED) {
         return -1;
     }
+    l = calloc(1, sizeof(*l));
+    rv = l ? pf_payload_open(file, st.st_size, &payload) : -1;
+    if (!rv && payload.kind == PF_PAYLOAD_RAW && !payload.type[0]) {
+        rv = -1;                // not a container, and not a Mach-O either
+    }
+    if (!rv) {
+        l->k = k;
+        rv = pf_decode_payload(&payload, place_chunk, l);
+    }
+    if (!rv && !k->kernel) {
+        rv = -1;                // shorter than a header
+    }
+    if (rv && k->kernel) {
+        munmap(k->kernel, k->kernel_size);
+        k->kernel = NULL;
+    }
+    if (!rv) {
+        if (k->nsegments) {
+            k->kernel_mh = k->kernel + k->segments[0].vmaddr - k->kerndumpbase;
+        }
+        mprotect(k->kernel, k->kernel_size, PROT_READ);
+    }
+    free(l);
+    munmap(file, st.st_size);
+    return rv;
+}
+#endif	/* !__ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__ */
+
+static void
+init_tables(struct pf_kernel *k)
+{
+    pthread_mutex_init(&k->xrefs_lock, NULL);
+    pthread_mutex_init(&k->rules_lock, NULL);
+    pthread_mutex_init(&k->strings_lock, NULL);
+    pthread_mutex_init(&k->funcs_lock, NULL);
+    pthread_mutex_init(&k->regs_lock, NULL);
+    pthread_mutex_init(&k->syms_lock, NULL);
+    pthread_mutex_init(&k->kexts_lock, NULL);
+    k->use_symbols = 1;
+#ifdef PATCHFINDER_HOST
+    k->use_xref_index = 1;
+#endif
+}
 
-    kernel_mh = kernel + base - min;
+#ifdef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
+static int
+kread_pages(void *ctx, uint64_t addr, void *buf, size_t len)
+{
+    (void)ctx;
+    return kread(addr, buf, len) == len ? 0 : -1;
+}
+#endif
 
+int
+init_kernel(struct pf_kernel *k, addr_t base, const char *filename)
+{
+#ifdef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
+    // Only the ranges the finders look at are ever read.
     (void)filename;
-#undef close
+    return init_kernel_paged(k, base, kread_pages, NULL);
 #else	/* __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__ */
-    kernel = calloc(1, kernel_size);
-    if (!kernel) {
+    size_t rv;
+    uint8_t buf[0x4000] __attribute__((aligned(8)));
+    unsigned i;
+    int fd;
+
+    memset(k, 0, sizeof(*k));
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    rv = read(fd, buf, sizeof(buf));
+    if (rv != sizeof(buf) || !MACHO(buf)) {
+        // Release kernelcaches come wrapped and compressed.
+        rv = load_payload(k, fd);
+        close(fd);
+        if (rv) {
+            memset(k, 0, sizeof(*k));
+            return -1;
+        }
+        goto loaded;
+    }
+
+    if (parse_header(k, buf, sizeof(buf)) || check_file_size(k, fd)) {
         close(fd);
+        memset(k, 0, sizeof(*k));
         return -1;
     }
 
-    q = buf + sizeof(struct mach_header) + is64;
-    for (i = 0; i < hdr->ncmds; i++) {
-        const struct load_command *cmd = (struct load_command *)q;
-        if (cmd->cmd == LC_SEGMENT_64) {
-            const struct segment_command_64 *seg = (struct segment_command_64 *)q;
-            size_t sz = pread(fd, kernel + seg->vmaddr - min, seg->filesize, seg->fileoff);
-            if (sz != seg->filesize) {
-                close(fd);
-                free(kernel);
-                return -1;
-            }
-            if (!kernel_mh) {
-                kernel_mh = kernel + seg->vmaddr - min;
-            }
-			printf("%s\n", seg->segname);
-            if (!strcmp(seg->segname, "__LINKEDIT")) {
-                kernel_delta = seg->vmaddr - min - seg->fileoff;
-            }
+    // Reserve the whole VA span as untouched anonymous memory, then overlay
+    // each segment's file pages on top of it.  Nothing is copied up front.
+    k->kernel = mmap(NULL, k->kernel_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (k->kernel == MAP_FAILED) {
+        k->kernel = NULL;
+        close(fd);
+        return -1;
+    }
+
+    for (i = 0; i < k->nsegments; i++) {
+        if (map_segment(k, fd, &k->segments[i])) {
+            close(fd);
+            munmap(k->kernel, k->kernel_size);
+            k->kernel = NULL;
+            return -1;
         }
-        q = q + cmd->cmdsize;
     }
+    if (k->nsegments) {
+        k->kernel_mh = k->kernel + k->segments[0].vmaddr - k->kerndumpbase;
+    }
+    mprotect(k->kernel, k->kernel_size, PROT_READ);
 
     close(fd);
 
+loaded:
     (void)base;
+    init_tables(k);
+    return 0;
 #endif	/* __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__ */
+}
+
+// Loads the image whose Mach-O header is at `base` through `read`, which is
+// called for its header now and for every other page when a finder first
+// needs it.
+int
+init_kernel_paged(struct pf_kernel *k, addr_t base, pf_pager_reader read, void *ctx)
+{
+    uint8_t buf[0x4000] __attribute__((aligned(8)));
+    struct pf_pager *p;
+
+    memset(k, 0, sizeof(*k));
+    if (read(ctx, base, buf, sizeof(buf)) || parse_header(k, buf, sizeof(buf)) ||
+        base < k->kerndumpbase || k->kernel_size < sizeof(buf) || base - k->kerndumpbase > k->kernel_size - sizeof(buf) ||
+        ((base - k->kerndumpbase) & 7)) {
+        memset(k, 0, sizeof(*k));
+        return -1;
+    }
+    p = malloc(sizeof(*p));
+    if (!p || pf_pager_init(p, k->kerndumpbase, k->kernel_size, 0, read, ctx)) {
+        free(p);
+        memset(k, 0, sizeof(*k));
+        return -1;
+    }
+    // the read above, so that the totals cover everything
+    p->stats.reads = 1;
+    p->stats.bytes = sizeof(buf);
+    pf_pager_fill(p, base - k->kerndumpbase, buf, sizeof(buf));
+    k->pager = p;
+    k->kernel = p->span;
+    k->kernel_mh = k->kernel + base - k->kerndumpbase;
+    init_tables(k);
     return 0;
 }
 
-void
-term_kernel(void)
+// A pf_pager_reader that reads another, already loaded image by VA, as a
+// stand-in for kread() when testing init_kernel_paged() off the device.
+int
+pf_kernel_reader(void *ctx, uint64_t addr, void *buf, size_t len)
 {
-    free(kernel);
+    const struct pf_kernel *src = ctx;
+    addr_t off = addr - src->kerndumpbase;
+    if (addr < src->kerndumpbase || off > src->kernel_size || len > src->kernel_size - off) {
+        return -1;
+    }
+    memcpy(buf, src->kernel + off, len);
+    return 0;
 }
 
-/* these operate on VA ******************************************************/
+void
+term_kernel(struct pf_kernel *k)
+{
+    pf_xref_index_free(&k->xrefs[0]);
+    pf_xref_index_free(&k->xrefs[1]);
+    pf_str_matches_free(&k->strings[0]);
+    pf_str_matches_free(&k->strings[1]);
+    pf_func_index_free(&k->funcs[0]);
+    pf_func_index_free(&k->funcs[1]);
+    pf_reg_cache_free(&k->regs);
+    pf_sym_index_free(&k->syms);
+    pf_kext_map_free(&k->kexts);
+    pthread_mutex_destroy(&k->xrefs_lock);
+    pthread_mutex_destroy(&k->rules_lock);
+    pthread_mutex_destroy(&k->strings_lock);
+    pthread_mutex_destroy(&k->funcs_lock);
+    pthread_mutex_destroy(&k->regs_lock);
+    pthread_mutex_destroy(&k->syms_lock);
+    pthread_mutex_destroy(&k->kexts_lock);
+    if (k->pager) {
+        pf_pager_free(k->pager);
+        free(k->pager);
+        k->pager = NULL;
+    } else if (k->kernel) {
+        munmap(k->kernel, k->kernel_size);
+    }
+    k->kernel = NULL;
+}
 
-#define INSN_RET  0xD65F03C0, 0xFFFFFFFF
-#define INSN_CALL 0x94000000, 0xFC000000
-#define INSN_B    0x14000000, 0xFC000000
-#define INSN_CBZ  0x34000000, 0xFC000000
-#define INSN_ADRP 0x90000000, 0x9F000000
+// Bytes of memory held for k: the image (only the pages fetched so far when
+// it is demand-paged) and the tables built from it.  Not to be called
+// while finders are running on k.
+uint64_t
+pf_kernel_footprint(const struct pf_kernel *k)
+{
+    int i;
+    uint64_t n = k->pager ? k->pager->stats.pages * PF_PAGE_SIZE : k->kernel_size;
+    for (i = 0; i < 2; i++) {
+        n += k->xrefs[i].count * sizeof(struct pf_xref);
+        n += k->funcs[i].count * sizeof(struct pf_func);
+    }
+    if (k->syms.slots) {
+        n += (k->syms.mask + 1) * sizeof(struct pf_sym);
+    }
+    n += k->kexts.cap * sizeof(struct pf_kext);
+    return n;
+}
 
+// Translates a VA into an offset into the kernelcache file, or -1 when the
+// address is not backed by file contents.
 addr_t
-find_register_value(addr_t where, int reg)
+pf_fileoff(const struct pf_kernel *k, addr_t va)
 {
-    addr_t val;
-    addr_t bof = 0;
-    where -= kerndumpbase;
-    if (where > xnucore_base) {
-        bof = bof64(kernel, xnucore_base, where);
-        if (!bof) {
-            bof = xnucore_base;
+    unsigned i;
+    for (i = 0; i < k->nsegments; i++) {
+        const struct pf_segment *seg = &k->segments[i];
+        if (va >= seg->vmaddr && va - seg->vmaddr < seg->filesize) {
+            return va - seg->vmaddr + seg->fileoff;
         }
-    } else if (where > prelink_base) {
-        bof = bof64(kernel, prelink_base, where);
-        if (!bof) {
-            bof = prelink_base;
+    }
+    return -1;
+}
+
+// __TEXT_EXEC or __PLK_TEXT_EXEC, clipped to the image.  Bounds only: the
+// bytes are not fetched until the view goes through fetch_view().
+static struct pf_view
+code_view(const struct pf_kernel *k, int prelink)
+{
+    if (prelink) {
+        return pf_view_make(k->kernel, k->kernel_size, k->prelink_base, k->prelink_size);
+    }
+    return pf_view_make(k->kernel, k->kernel_size, k->xnucore_base, k->xnucore_size);
+}
+
+// Scans that can stop early go this much at a time, so that a demand-paged
+// image is only fetched up to where they stop; one pager run's worth.
+#define SCAN_CHUNK (PF_PAGE_SIZE * PF_PAGER_MAX_RUN)
+
+// v, with its bytes fetched if the image is demand-paged; empty if they
+// could not be read.  Whatever a finder reads goes through here first.
+static struct pf_view
+fetch_view(const struct pf_kernel *k, struct pf_view v)
+{
+    if (k->pager && pf_pager_need(k->pager, v.start, v.end - v.start)) {
+        v.end = v.start;
+    }
+    return v;
+}
+
+// Points at the `size` bytes at file offset `off` in the image, or NULL when
+// they are not all backed by one loaded segment.
+static const uint8_t *
+file_bytes(const struct pf_kernel *k, addr_t off, addr_t size)
+{
+    unsigned i;
+    for (i = 0; i < k->nsegments; i++) {
+        const struct pf_segment *seg = &k->segments[i];
+        addr_t len = seg->filesize < seg->vmsize ? seg->filesize : seg->vmsize;
+        if (off >= seg->fileoff && off - seg->fileoff <= len && size <= len - (off - seg->fileoff)) {
+            addr_t pos = seg->vmaddr - k->kerndumpbase + off - seg->fileoff;
+            if (k->pager && pf_pager_need(k->pager, pos, size)) {
+                return NULL;
+            }
+            return k->kernel + pos;
         }
     }
-    val = calc64(kernel, bof, where, reg);
-    if (!val) {
-        return 0;
+    return NULL;
+}
+
+// The Mach-O header at buffer offset `mh`, with its load commands fetched,
+// or NULL if there is none.
+static const struct mach_header_64 *
+header_at(struct pf_kernel *k, addr_t mh)
+{
+    const struct mach_header_64 *hdr;
+
+    if (mh > k->kernel_size || k->kernel_size - mh < sizeof(*hdr) || (mh & 7)) {
+        return NULL;
+    }
+    if (k->pager && pf_pager_need(k->pager, mh, sizeof(*hdr))) {
+        return NULL;
+    }
+    hdr = (const struct mach_header_64 *)(k->kernel + mh);
+    if (hdr->magic != MH_MAGIC_64 || hdr->sizeofcmds > k->kernel_size - mh - sizeof(*hdr)) {
+        return NULL;
+    }
+    if (k->pager && pf_pager_need(k->pager, mh + sizeof(*hdr), hdr->sizeofcmds)) {
+        return NULL;
     }
-    return val + kerndumpbase;
+    return hdr;
 }
 
-addr_t
-find_reference(addr_t to, int n, int prelink)
+// Adds the LC_SYMTAB of the Mach-O header at buffer offset `mh` and, for the
+// top-level header of a fileset, those of all its entries.
+static void
+add_symtab(struct pf_kernel *k, addr_t mh, int fileset)
 {
-    addr_t ref, end;
-    addr_t base = xnucore_base;
-    addr_t size = xnucore_size;
-    if (prelink) {
-        base = prelink_base;
-        size = prelink_size;
+    unsigned i;
+    const struct mach_header_64 *hdr = header_at(k, mh);
+    const uint8_t *q, *end;
+
+    if (!hdr) {
+        return;
     }
-    if (n <= 0) {
-        n = 1;
+    q = (const uint8_t *)(hdr + 1);
+    end = q + hdr->sizeofcmds;
+    for (i = 0; i < hdr->ncmds; i++) {
+        const struct load_command *cmd = (const struct load_command *)q;
+        if (q + sizeof(*cmd) > end || cmd->cmdsize < sizeof(*cmd) || cmd->cmdsize > (size_t)(end - q) || (cmd->cmdsize & 7)) {
+            break;
+        }
+        if (cmd->cmd == LC_SYMTAB && cmd->cmdsize >= sizeof(struct symtab_command)) {
+            const struct symtab_command *st = (const struct symtab_command *)q;
+            const void *syms = file_bytes(k, st->symoff, (addr_t)st->nsyms * sizeof(struct nlist_64));
+            const void *strs = file_bytes(k, st->stroff, st->strsize);
+            if (syms && strs && st->nsyms && !(st->symoff & 7)) {
+                pf_sym_index_add(&k->syms, syms, st->nsyms, strs, st->strsize);
+            }
+        }
+        if (cmd->cmd == LC_FILESET_ENTRY && fileset && cmd->cmdsize >= sizeof(struct fileset_entry_command)) {
+            const struct fileset_entry_command *fe = (const struct fileset_entry_command *)q;
+            if (fe->vmaddr >= k->kerndumpbase) {
+                add_symtab(k, fe->vmaddr - k->kerndumpbase, 0);
+            }
+        }
+        q += cmd->cmdsize;
     }
-    end = base + size;
-    to -= kerndumpbase;
-    do {
-        ref = xref64(kernel, base, end, to);
-        if (!ref) {
-            return 0;
+}
+
+// Builds the symbol index on first use.  Returns NULL when symbols are
+// disabled or the image carries none.
+static const struct pf_sym_index *
+get_syms(struct pf_kernel *k)
+{
+    if (!k->use_symbols) {
+        return NULL;
+    }
+    pthread_mutex_lock(&k->syms_lock);
+    if (!k->syms_state) {
+        if (k->kernel_mh) {
+            add_symtab(k, (uint8_t *)k->kernel_mh - k->kernel, 1);
         }
-        base = ref + 4;
-    } while (--n > 0);
-    return ref + kerndumpbase;
+        k->syms_state = k->syms.count ? 1 : -1;
+    }
+    pthread_mutex_unlock(&k->syms_lock);
+    return k->syms_state > 0 ? &k->syms : NULL;
 }
 
-addr_t
-find_strref(const char *string, int n, int prelink)
+// Adds the kext whose Mach-O header is at buffer offset `mh`, with the
+// ranges of its __TEXT_EXEC and its strings.  Returns -1 only when out of
+// memory; a kext that cannot be read is left out.
+static int
+add_kext(struct pf_kernel *k, addr_t mh, const char *id)
 {
-    uint8_t *str;
-    addr_t base = cstring_base;
-    addr_t size = cstring_size;
-    if (prelink) {
-        base = pstring_base;
-        size = pstring_size;
+    unsigned i, j;
+    struct pf_kext kext;
+    const struct mach_header_64 *hdr = header_at(k, mh);
+    const uint8_t *q, *end;
+
+    if (!hdr) {
+        return 0;
     }
-    str = boyermoore_horspool_memmem(kernel + base, size, (uint8_t *)string, strlen(string));
-    if (!str) {
+    memset(&kext, 0, sizeof(kext));
+    kext.id = (char *)id;
+    kext.header = mh;
+    q = (const uint8_t *)(hdr + 1);
+    end = q + hdr->sizeofcmds;
+    for (i = 0; i < hdr->ncmds; i++) {
+        const struct load_command *cmd = (const struct load_command *)q;
+        const struct segment_command_64 *seg = (const struct segment_command_64 *)q;
+        if (q + sizeof(*cmd) > end || cmd->cmdsize < sizeof(*cmd) || cmd->cmdsize > (size_t)(end - q) || (cmd->cmdsize & 7)) {
+            break;
+        }
+        q += cmd->cmdsize;
+        if (cmd->cmd != LC_SEGMENT_64 || cmd->cmdsize < sizeof(*seg) || seg->vmaddr < k->kerndumpbase ||
+            seg->nsects > (cmd->cmdsize - sizeof(*seg)) / sizeof(struct section_64)) {
+            continue;
+        }
+        if (!strcmp(seg->segname, "__TEXT_EXEC")) {
+            kext.exec_base = seg->vmaddr - k->kerndumpbase;
+            kext.exec_size = seg->vmsize;
+        }
+        if (!strcmp(seg->segname, "__TEXT")) {
+            const struct section_64 *sec = (const struct section_64 *)(seg + 1);
+            kext.cstring_base = seg->vmaddr - k->kerndumpbase;
+            kext.cstring_size = seg->vmsize;
+            for (j = 0; j < seg->nsects; j++) {
+                if (!strcmp(sec[j].sectname, "__cstring") && sec[j].addr >= k->kerndumpbase) {
+                    kext.cstring_base = sec[j].addr - k->kerndumpbase;
+                    kext.cstring_size = sec[j].size;
+                }
+            }
+        }
+    }
+    return kext.exec_size ? pf_kext_map_add(&k->kexts, &kext) : 0;
+}
+
+static int
+add_prelinked_kext(void *ctx, const struct pf_prelink_kext *pk)
+{
+    struct pf_kernel *k = ctx;
+    char id[256];
+    if (!pk->load_addr || pk->load_addr < k->kerndumpbase || !pk->id_len || pk->id_len >= sizeof(id)) {
         return 0;
     }
-    return find_reference(str - kernel + kerndumpbase, n, prelink);
+    memcpy(id, pk->id, pk->id_len);
+    id[pk->id_len] = 0;
+    return add_kext(k, pk->load_addr - k->kerndumpbase, id);
 }
 
-/****** fun *******/
+// The entries of a fileset kernelcache are its kexts, named by entry id.
+static void
+add_fileset_kexts(struct pf_kernel *k, addr_t mh)
+{
+    unsigned i;
+    const struct mach_header_64 *hdr = header_at(k, mh);
+    const uint8_t *q, *end;
+
+    if (!hdr) {
+        return;
+    }
+    q = (const uint8_t *)(hdr + 1);
+    end = q + hdr->sizeofcmds;
+    for (i = 0; i < hdr->ncmds; i++) {
+        const struct load_command *cmd = (const struct load_command *)q;
+        if (q + sizeof(*cmd) > end || cmd->cmdsize < sizeof(*cmd) || cmd->cmdsize > (size_t)(end - q) || (cmd->cmdsize & 7)) {
+            break;
+        }
+        if (cmd->cmd == LC_FILESET_ENTRY && cmd->cmdsize >= sizeof(struct fileset_entry_command)) {
+            const struct fileset_entry_command *fe = (const struct fileset_entry_command *)q;
+            const char *id = (const char *)q + fe->entry_id;
+            if (fe->entry_id < cmd->cmdsize && memchr(id, 0, cmd->cmdsize - fe->entry_id) &&
+                fe->vmaddr >= k->kerndumpbase && add_kext(k, fe->vmaddr - k->kerndumpbase, id)) {
+                break;
+            }
+        }
+        q += cmd->cmdsize;
+    }
+}
+
+const struct pf_kext_map *
+pf_get_kexts(struct pf_kernel *k)
+{
+    pthread_mutex_lock(&k->kexts_lock);
+    if (!k->kexts_state) {
+        struct pf_view v = fetch_view(k, pf_view_make(k->kernel, k->kernel_size, k->plist_base, k->plist_size));
+        if (pf_view_size(&v)) {
+            pf_prelink_info_parse((const char *)k->kernel + v.start, pf_view_size(&v), add_prelinked_kext, k);
+        } else if (k->kernel_mh) {
+            add_fileset_kexts(k, (uint8_t *)k->kernel_mh - k->kernel);
+        }
+        k->kexts_state = k->kexts.count ? 1 : -1;
+    }
+    pthread_mutex_unlock(&k->kexts_lock);
+    return k->kexts_state > 0 ? &k->kexts : NULL;
+}
 
-addr_t find_add_x0_x0_0x40_ret(void) {
-	addr_t off;
-	uint32_t *k;
-	k = (uint32_t *)(kernel + xnucore_base);
-	for (off = 0; off < xnucore_size - 4; off += 4, k++) {
-		if (k[0] == 0x91010000 && k[1] == 0xD65F03C0) {
-			return off + xnucore_base + kerndumpbase;
-		}
-	}
-	k = (uint32_t *)(kernel + prelink_base);
-	for (off = 0; off < prelink_size - 4; off += 4, k++) {
-		if (k[0] == 0x91010000 && k[1] == 0xD65F03C0) {
-			return off + prelink_base + kerndumpbase;
-		}
-	}
-	return 0;
-}
-
-uint64_t find_allproc(void) {
-	// Find the first reference to the string
-	addr_t ref = find_strref("\"pgrp_add : pgrp is dead adding process\"", 1, 0);
-	if (!ref) {
-		return 0;
-	}
-	ref -= kerndumpbase;
-	
-	uint64_t start = bof64(kernel, xnucore_base, ref);
-	if (!start) {
-		return 0;
-	}
-	
-	// Find AND W8, W8, #0xFFFFDFFF - it's a pretty distinct instruction
-	addr_t weird_instruction = 0;
-	for (int i = 4; i < 4*0x100; i+=4) {
-		uint32_t op = *(uint32_t *)(kernel + ref + i);
-		if (op == 0x12127908) {
-			weird_instruction = ref+i;
-			break;
-		}
-	}
-	if (!weird_instruction) {
-		return 0;
-	}
-	
-	uint64_t val = calc64(kernel, start, weird_instruction - 8, 8);
-	if (!val) {
-		printf("Failed to calculate x8");
-		return 0;
-	}
-	
-	return val + kerndumpbase;
-}
-
-uint64_t find_copyout(void) {
-	// Find the first reference to the string
-	addr_t ref = find_strref("\"%s(%p, %p, %lu) - transfer too large\"", 2, 0);
-	if (!ref) {
-		return 0;
-	}
-	ref -= kerndumpbase;
-	
-	uint64_t start = 0;
-	for (int i = 4; i < 0x100*4; i+=4) {
-		uint32_t op = *(uint32_t*)(kernel+ref-i);
-		if (op == 0xd10143ff) { // SUB SP, SP, #0x50
-			start = ref-i;
-			break;
-		}
-	}
-	if (!start) {
-		return 0;
-	}
-	
-	return start + kerndumpbase;
-}
-
-uint64_t find_bzero(void) {
-	// Just find SYS #3, c7, c4, #1, X3, then get the start of that function
-	addr_t off;
-	uint32_t *k;
-	k = (uint32_t *)(kernel + xnucore_base);
-	for (off = 0; off < xnucore_size - 4; off += 4, k++) {
-		if (k[0] == 0xd50b7423) {
-			off += xnucore_base;
-			break;
-		}
-	}
-	
-	uint64_t start = bof64(kernel, xnucore_base, off);
-	if (!start) {
-		return 0;
-	}
-	
-	return start + kerndumpbase;
-}
-
-addr_t find_bcopy(void) {
-	// Jumps straight into memmove after switching x0 and x1 around
-	// Guess we just find the switch and that's it
-	addr_t off;
-	uint32_t *k;
-	k = (uint32_t *)(kernel + xnucore_base);
-	for (off = 0; off < xnucore_size - 4; off += 4, k++) {
-		if (k[0] == 0xAA0003E3 && k[1] == 0xAA0103E0 && k[2] == 0xAA0303E1 && k[3] == 0xd503201F) {
-			return off + xnucore_base + kerndumpbase;
-		}
-	}
-	k = (uint32_t *)(kernel + prelink_base);
-	for (off = 0; off < prelink_size - 4; off += 4, k++) {
-		if (k[0] == 0xAA0003E3 && k[1] == 0xAA0103E0 && k[2] == 0xAA0303E1 && k[3] == 0xd503201F) {
-			return off + prelink_base + kerndumpbase;
-		}
-	}
-	return 0;
+const struct pf_kext *
+pf_find_kext(struct pf_kernel *k, const char *bundle)
+{
+    const struct pf_kext_map *map = pf_get_kexts(k);
+    return map ? pf_kext_map_lookup(map, bundle) : NULL;
 }
 
+// Rewrites the image's chained/tagged pointers into plain unslid VAs, in
+// place, so that pf_read_pointer() returns addresses that can be followed.
+// Optional and not thread-safe: call it before anything else touches the
+// image.  Returns the number of pointers rewritten (0 for images that use
+// plain pointers), or -1 if the fixup description is malformed.
+long
+pf_resolve_pointers(struct pf_kernel *k)
+{
+    unsigned i, j;
+    long n = 0, rv = 0;
+    const struct mach_header_64 *hdr = k->kernel_mh;
+    const uint8_t *q, *end;
+    addr_t mh;
+
+    if (!hdr || hdr->magic != MH_MAGIC_64 || hdr->sizeofcmds > k->kernel_size - ((uint8_t *)hdr - k->kernel) - sizeof(*hdr)) {
+        return -1;
+    }
+    mh = (uint8_t *)hdr - k->kernel + k->kerndumpbase;
+    // Chains run through every data page, so a paged image is fetched
+    // whole; it is writable already.
+    for (i = 0; k->pager && i < k->nsegments; i++) {
+        const struct pf_segment *seg = &k->segments[i];
+        if (pf_pager_need(k->pager, seg->vmaddr - k->kerndumpbase, seg->filesize)) {
+            return -1;
+        }
+    }
+#ifndef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
+    if (!k->pager && mprotect(k->kernel, k->kernel_size, PROT_READ | PROT_WRITE)) {
+        return -1;
+    }
+#endif
+    q = (const uint8_t *)(hdr + 1);
+    end = q + hdr->sizeofcmds;
+    for (i = 0; i < hdr->ncmds && rv >= 0; i++) {
+        const struct load_command *cmd = (const struct load_command *)q;
+        if (q + sizeof(*cmd) > end || cmd->cmdsize < sizeof(*cmd) || cmd->cmdsize > (size_t)(end - q) || (cmd->cmdsize & 7)) {
+            rv = -1;
+            break;
+        }
+        if (cmd->cmd == LC_DYLD_CHAINED_FIXUPS && cmd->cmdsize >= sizeof(struct linkedit_data_command)) {
+            const struct linkedit_data_command *ld = (const struct linkedit_data_command *)q;
+            const uint8_t *blob = file_bytes(k, ld->dataoff, ld->datasize);
+            rv = blob ? pf_fixups_chained(k->kernel, k->kernel_size, k->kerndumpbase, mh, blob, ld->datasize) : -1;
+        }
+        if (cmd->cmd == LC_SEGMENT_64 && !strcmp(((const struct segment_command_64 *)q)->segname, "__TEXT")) {
+            const struct segment_command_64 *seg = (const struct segment_command_64 *)q;
+            const struct section_64 *sec = (const struct section_64 *)(seg + 1);
+            if (cmd->cmdsize < sizeof(*seg) || seg->nsects > (cmd->cmdsize - sizeof(*seg)) / sizeof(*sec)) {
+                rv = -1;
+                break;
+            }
+            for (j = 0; j < seg->nsects && rv >= 0; j++) {
+                if (!strcmp(sec[j].sectname, "__thread_starts")) {
+                    struct pf_view v = pf_view_make(k->kernel, k->kernel_size, sec[j].addr - k->kerndumpbase, sec[j].size);
+                    if (pf_view_size(&v) != sec[j].size || (v.start & 3)) {
+                        rv = -1;
+                        break;
+                    }
+                    rv = pf_fixups_threaded(k->kernel, k->kernel_size, k->kerndumpbase, mh,
+                                            (const uint32_t *)(k->kernel + v.start), sec[j].size / 4);
+                }
+            }
+        }
+        if (rv > 0) {
+            n += rv;
+            rv = 0;
+        }
+        q += cmd->cmdsize;
+    }
+#ifndef __ENVIRONMENT_IPHONE_OS_VERSION_MIN_REQUIRED__
+    if (!k->pager) {
+        mprotect(k->kernel, k->kernel_size, PROT_READ);
+    }
+#endif
+    return rv < 0 ? -1 : n;
+}
+
+// Builds the xref index for one code range on first use.  Returns NULL when
+// the index is disabled or could not be built; callers then use scan_reference().
+static const struct pf_xref_index *
+get_xrefs(struct pf_kernel *k, int prelink)
+{
+    const struct pf_xref_index *idx = NULL;
+    prelink = !!prelink;
+    if (!k->use_xref_index) {
+        return NULL;
+    }
+    pthread_mutex_lock(&k->xrefs_lock);
+    if (!k->xrefs_state[prelink]) {
+        struct pf_view v = fetch_view(k, code_view(k, prelink));
+        k->xrefs_state[prelink] = pf_xref_index_build(&k->xrefs[prelink], k->kernel, v.start, v.end, k->kernel_size) ? -1 : 1;
+    }
+    if (k->xrefs_state[prelink] > 0) {
+        idx = &k->xrefs[prelink];
+    }
+    pthread_mutex_unlock(&k->xrefs_lock);
+    return idx;
+}
+
+// Builds the prologue table for one code range on first use.  Returns NULL
+// when it could not be built.
+static const struct pf_func_index *
+get_funcs(struct pf_kernel *k, int prelink)
+{
+    prelink = !!prelink;
+    pthread_mutex_lock(&k->funcs_lock);
+    if (!k->funcs_state[prelink]) {
+        struct pf_view v = fetch_view(k, code_view(k, prelink));
+        k->funcs_state[prelink] = pf_func_index_build(&k->funcs[prelink], k->kernel, v.start, v.end) ? -1 : 1;
+    }
+    pthread_mutex_unlock(&k->funcs_lock);
+    return k->funcs_state[prelink] > 0 ? &k->funcs[prelink] : NULL;
+}
+
+// Start of the function containing `where` (buffer offset), or 0.  Uses the
+// prologue table for the range and falls back to bof64() if it could not be
+// built.
+static addr_t
+function_start(struct pf_kernel *k, addr_t where, int prelink)
+{
+    struct pf_view v = fetch_view(k, code_view(k, prelink));
+    const struct pf_func_index *funcs;
+    if (!pf_view_contains(&v, where, 4)) {
+        return 0;
+    }
+    funcs = get_funcs(k, prelink);
+    if (!funcs) {
+        return bof64(k->kernel, v.start, where);
+    }
+    return pf_func_index_lookup(funcs, where, BOF_LIMIT);
+}
+
+// The symbol index and, when the image has no symbols to answer from, the
+// xref and prologue tables of both code ranges, built now instead of by
+// whichever finder needs them first.
+void
+pf_build_indices(struct pf_kernel *k)
+{
+    int prelink;
+    if (get_syms(k)) {
+        return;
+    }
+    for (prelink = 0; prelink < 2; prelink++) {
+        get_xrefs(k, prelink);
+        get_funcs(k, prelink);
+    }
+}
+
+// calc64() over [start, end), resuming from the closest register state
+// already recorded for this function and recording the new block boundaries
+// it passes on the way.
+static addr_t
+calc64_cached(struct pf_kernel *k, addr_t start, addr_t end, int which)
+{
+    struct pf_reg_state st;
+
+    end &= ~3;
+    if (end > start && k->pager && pf_pager_need(k->pager, start, end - start)) {
+        return 0;
+    }
+    pthread_mutex_lock(&k->regs_lock);
+    pf_reg_cache_get(&k->regs, start, end, &st);
+    pthread_mutex_unlock(&k->regs_lock);
+
+    while (st.pc < end) {
+        st.pc = calc64_block(k->kernel, st.pc, end, st.value);
+        if (st.pc < end) {
+            pthread_mutex_lock(&k->regs_lock);
+            pf_reg_cache_put(&k->regs, start, &st);
+            pthread_mutex_unlock(&k->regs_lock);
+        }
+    }
+    return st.value[which];
+}
+
+// Writes both xref indices, building them first if needed.
+int
+pf_write_xrefs(struct pf_kernel *k, FILE *f)
+{
+    if (!get_xrefs(k, 0) || !get_xrefs(k, 1)) {
+        return -1;
+    }
+    if (pf_xref_index_write(&k->xrefs[0], f) || pf_xref_index_write(&k->xrefs[1], f)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Reads indices written by pf_write_xrefs() for this same image.  Ranges
+// that do not match the loaded segments are rejected.
+int
+pf_read_xrefs(struct pf_kernel *k, FILE *f)
+{
+    int i, rv = 0;
+    struct pf_xref_index idx[2];
+    memset(idx, 0, sizeof(idx));
+    for (i = 0; i < 2 && !rv; i++) {
+        struct pf_view v = code_view(k, i);
+        rv = pf_xref_index_read(&idx[i], f);
+        if (!rv && (idx[i].start != (v.start & ~3) || idx[i].end != (v.end & ~3))) {
+            rv = -1;
+        }
+    }
+    if (rv) {
+        pf_xref_index_free(&idx[0]);
+        pf_xref_index_free(&idx[1]);
+        return -1;
+    }
+    pthread_mutex_lock(&k->xrefs_lock);
+    for (i = 0; i < 2; i++) {
+        pf_xref_index_free(&k->xrefs[i]);
+        k->xrefs[i] = idx[i];
+        k->xrefs_state[i] = 1;
+    }
+    pthread_mutex_unlock(&k->xrefs_lock);
+    return 0;
+}
+
+int
+pf_save_xrefs(struct pf_kernel *k, const char *path)
+{
+    int rv;
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return -1;
+    }
+    rv = pf_write_xrefs(k, f);
+    if (fclose(f)) {
+        rv = -1;
+    }
+    return rv;
+}
+
+int
+pf_load_xrefs(struct pf_kernel *k, const char *path)
+{
+    int rv;
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    rv = pf_read_xrefs(k, f);
+    fclose(f);
+    return rv;
+}
+
+/* these operate on VA ******************************************************/
+
+// The 64-bit value stored at `va`, or 0 when that is outside the image.
+// Pointers read back as plain VAs once pf_resolve_pointers() has run.
+addr_t
+pf_read_pointer(const struct pf_kernel *k, addr_t va)
+{
+    struct pf_view v = pf_view_make(k->kernel, k->kernel_size, 0, k->kernel_size);
+    uint64_t value;
+    va -= k->kerndumpbase;
+    if (!pf_view_contains(&v, va, 8)) {
+        return 0;
+    }
+    if (k->pager) {
+        // through the page cache: one pointer is not worth a page of the image
+        return pf_pager_read(k->pager, va, &value, 8) ? 0 : value;
+    }
+    memcpy(&value, k->kernel + va, 8);
+    return value;
+}
+
+// Address of `name` as spelled in the symbol table (e.g. "_allproc"), or 0
+// when it is not there or the image is stripped.
+addr_t
+find_symbol(struct pf_kernel *k, const char *name)
+{
+    const struct pf_sym_index *syms = get_syms(k);
+    return syms ? pf_sym_index_lookup(syms, name) : 0;
+}
+
+addr_t
+find_register_value(struct pf_kernel *k, addr_t where, int reg)
+{
+    int prelink;
+    addr_t val;
+    addr_t bof = 0;
+    struct pf_view v;
+    where -= k->kerndumpbase;
+    for (prelink = 0; prelink < 2; prelink++) {
+        v = code_view(k, prelink);
+        if (pf_view_contains(&v, where, 0)) {
+            break;
+        }
+    }
+    if (prelink == 2) {
+        return 0;
+    }
+    bof = function_start(k, where, prelink);
+    if (!bof) {
+        bof = where - v.start > BOF_LIMIT ? where - BOF_LIMIT : v.start;
+    }
+    val = calc64_cached(k, bof, where, reg);
+    if (!val) {
+        return 0;
+    }
+    return val + k->kerndumpbase;
+}
+
+// The nth reference to buffer offset `to` from the code in v, found by
+// decoding all of it.
+static addr_t
+scan_reference(struct pf_kernel *k, struct pf_view v, addr_t to, int n)
+{
+    struct xref64_ctx x;
+    addr_t pos, ref;
+
+    memset(x.value, 0, sizeof(x.value));
+    x.what = to;
+    // The registers carry over from one chunk to the next, as in one walk.
+    for (pos = v.start & ~3; pos < v.end; ) {
+        struct pf_view c = fetch_view(k, pf_view_clamp(&v, pos, v.end - pos > SCAN_CHUNK ? pos + SCAN_CHUNK : v.end));
+        if (c.start == c.end) {
+            return 0;
+        }
+        ref = pf_a64_walk(k->kernel, c.start, c.end, PF_A64_TRACKED, xref64_visit, &x);
+        if (ref == (c.end & ~3)) {
+            pos = c.end;
+            continue;
+        }
+        if (--n <= 0) {
+            return ref + k->kerndumpbase;
+        }
+        memset(x.value, 0, sizeof(x.value));
+        pos = ref + 4;
+    }
+    return 0;
+}
+
+addr_t
+find_reference(struct pf_kernel *k, addr_t to, int n, int prelink)
+{
+    addr_t ref;
+    const struct pf_xref_index *idx;
+    struct pf_view v = code_view(k, prelink);
+    if (n <= 0) {
+        n = 1;
+    }
+    to -= k->kerndumpbase;
+    idx = get_xrefs(k, prelink);
+    if (idx) {
+        ref = pf_xref_index_lookup(idx, to, n);
+        return ref ? ref + k->kerndumpbase : 0;
+    }
+    return scan_reference(k, v, to, n);
+}
+
+// Every string a rule anchors on, each once, in pf_default_rules order.  The
+// first lookup in a string range locates all of them, every occurrence, in
+// a single pass.
+static unsigned
+rule_anchors(const char *anchors[PF_MAX_RULES])
+{
+    unsigned i, j, n = 0;
+    for (i = 0; i < pf_num_default_rules; i++) {
+        const char *anchor = pf_default_rules[i].anchor;
+        if (!anchor) {
+            continue;
+        }
+        for (j = 0; j < n; j++) {
+            if (!strcmp(anchors[j], anchor)) {
+                break;
+            }
+        }
+        if (j == n) {
+            anchors[n++] = anchor;
+        }
+    }
+    return n;
+}
+
+// __cstring or the prelinked kexts' __text, clipped to the image; not
+// fetched either.
+static struct pf_view
+string_view(const struct pf_kernel *k, int prelink)
+{
+    if (prelink) {
+        return pf_view_make(k->kernel, k->kernel_size, k->pstring_base, k->pstring_size);
+    }
+    return pf_view_make(k->kernel, k->kernel_size, k->cstring_base, k->cstring_size);
+}
+
+// The nth occurrence of string in v, searched for directly.
+static addr_t
+search_string(struct pf_kernel *k, struct pf_view v, const char *string, int n)
+{
+    uint8_t *str;
+    addr_t off = 0;
+    do {
+        str = boyermoore_horspool_memmem(k->kernel + v.start + off, pf_view_size(&v) - off, (uint8_t *)string, strlen(string));
+        if (!str) {
+            return 0;
+        }
+        off = str - k->kernel - v.start + 1;
+    } while (--n > 0);
+    return str - k->kernel + k->kerndumpbase;
+}
+
+addr_t
+find_string(struct pf_kernel *k, const char *string, int n, int prelink)
+{
+    const char *anchors[PF_MAX_RULES];
+    unsigned i, num_anchors = rule_anchors(anchors);
+    struct pf_view v = fetch_view(k, string_view(k, prelink));
+    prelink = !!prelink;
+    if (n <= 0) {
+        n = 1;
+    }
+    for (i = 0; i < num_anchors; i++) {
+        if (!strcmp(anchors[i], string)) {
+            break;
+        }
+    }
+    if (i < num_anchors) {
+        pthread_mutex_lock(&k->strings_lock);
+        if (!k->strings_state[prelink]) {
+            k->strings_state[prelink] = pf_find_strings(k->kernel, v.start, v.end, anchors, num_anchors, &k->strings[prelink]) ? -1 : 1;
+        }
+        if (k->strings_state[prelink] > 0) {
+            const struct pf_str_matches *m = &k->strings[prelink];
+            pthread_mutex_unlock(&k->strings_lock);
+            if ((size_t)n > m->nhits[i]) {
+                return 0;
+            }
+            return m->hits[i][n - 1] + k->kerndumpbase;
+        }
+        pthread_mutex_unlock(&k->strings_lock);
+    }
+    return search_string(k, v, string, n);
+}
+
+addr_t
+find_strref(struct pf_kernel *k, const char *string, int n, int prelink)
+{
+    addr_t str = find_string(k, string, 1, prelink);
+    if (!str) {
+        return 0;
+    }
+    return find_reference(k, str, n, prelink);
+}
+
+addr_t
+find_kext_string(struct pf_kernel *k, const char *bundle, const char *string, int n)
+{
+    const struct pf_kext *kext = pf_find_kext(k, bundle);
+    if (!kext) {
+        return 0;
+    }
+    if (n <= 0) {
+        n = 1;
+    }
+    return search_string(k, fetch_view(k, pf_view_make(k->kernel, k->kernel_size, kext->cstring_base, kext->cstring_size)), string, n);
+}
+
+addr_t
+find_kext_reference(struct pf_kernel *k, const char *bundle, addr_t to, int n)
+{
+    const struct pf_kext *kext = pf_find_kext(k, bundle);
+    if (!kext) {
+        return 0;
+    }
+    if (n <= 0) {
+        n = 1;
+    }
+    return scan_reference(k, pf_view_make(k->kernel, k->kernel_size, kext->exec_base, kext->exec_size), to - k->kerndumpbase, n);
+}
+
+addr_t
+find_kext_strref(struct pf_kernel *k, const char *bundle, const char *string, int n)
+{
+    addr_t str = find_kext_string(k, bundle, string, 1);
+    if (!str) {
+        return 0;
+    }
+    return find_kext_reference(k, bundle, str, n);
+}
+
+/* rules *********************************************************************/
+
+// Where one rule may match in the range being swept.
+struct rule_window {
+    const struct pf_rule *rule;
+    unsigned index;             // of the rule
+    unsigned pattern;           // into rule_sweep.patterns
+    addr_t ref;                 // the anchor's reference, or 0
+    addr_t start;               // the match begins in [start, end)
+    addr_t end;
+    addr_t hit;                 // 0 until matched
+    int done;
+};
+
+// The rules still open in one code range, compiled: identical patterns are
+// looked for once, and only the windows are swept.
+struct rule_sweep {
+    struct pf_pattern patterns[PF_MAX_RULES];
+    unsigned npatterns;
+    struct rule_window windows[PF_MAX_RULES];
+    unsigned nwindows;
+    unsigned which[PF_MAX_RULES];   // patterns of the chunk being scanned
+    addr_t limit;                   // matches from here on belong to the next chunk
+};
+
+static unsigned
+sweep_pattern(struct rule_sweep *s, const struct pf_pattern *pat)
+{
+    unsigned i;
+    for (i = 0; i < s->npatterns; i++) {
+        if (!memcmp(&s->patterns[i], pat, sizeof(*pat))) {
+            return i;
+        }
+    }
+    s->patterns[s->npatterns] = *pat;
+    return s->npatterns++;
+}
+
+// Matches arrive in address order, so a window that wants the last match
+// keeps taking them until the sweep is past its end.
+static int
+rule_match(void *ctx, unsigned which, uint64_t off)
+{
+    struct rule_sweep *s = ctx;
+    unsigned i;
+    int open = 0;
+    if (off >= s->limit) {
+        return 1;
+    }
+    which = s->which[which];
+    for (i = 0; i < s->nwindows; i++) {
+        struct rule_window *w = &s->windows[i];
+        if (w->pattern != which || w->done) {
+            continue;
+        }
+        if (off < w->start) {
+            open = 1;
+        } else if (off >= w->end) {
+            w->done = 1;
+        } else {
+            w->hit = off;
+            w->done = !w->rule->last;
+            open |= !w->done;
+        }
+    }
+    return !open;
+}
+
+static addr_t
+rule_yield(struct pf_kernel *k, const struct rule_window *w, int prelink)
+{
+    const struct pf_rule *r = w->rule;
+    addr_t start;
+    switch (r->yield) {
+        case PF_YIELD_MATCH:
+            return w->hit;
+        case PF_YIELD_FUNCTION:
+            return function_start(k, w->hit, prelink);
+        case PF_YIELD_REGISTER:
+            if ((int64_t)w->hit + r->reg_at < 0 || r->reg < 0 || r->reg > 31) {
+                return 0;
+            }
+            start = function_start(k, w->ref ? w->ref : w->hit, prelink);
+            if (!start) {
+                return 0;
+            }
+            return calc64_cached(k, start, w->hit + r->reg_at, r->reg);
+    }
+    return 0;
+}
+
+static int
+cmp_window(const void *a, const void *b)
+{
+    const struct rule_window *x = a, *y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+_Static_assert(PF_MAX_RULES <= 32, "rules_swept has a bit per rule");
+
+// Whether rule r is looked for over the whole of the range, with neither an
+// anchor nor a kext to narrow it.
+static int
+rule_spans_range(const struct pf_rule *r, int prelink)
+{
+    return !r->anchor && !(prelink && r->kext);
+}
+
+// Resolves rule `want` in this range, unless it was looked for there
+// already.  A rule that spans the range takes every other such rule still
+// open along, since either one reads all of it; a rule with a window is
+// swept alone, so a single lookup only fetches the pages it needs.  The
+// windows are sorted and merged, and each merged stretch is fetched and
+// scanned once for all the patterns still wanted.
+static void
+sweep_rules(struct pf_kernel *k, int prelink, unsigned want)
+{
+    struct pf_view code = code_view(k, prelink), range;
+    const struct pf_kext *kext;
+    struct rule_sweep s;
+    unsigned i, j;
+    int span = rule_spans_range(&pf_default_rules[want], prelink);
+
+    s.npatterns = s.nwindows = 0;
+    for (i = 0; i < pf_num_default_rules; i++) {
+        const struct pf_rule *r = &pf_default_rules[i];
+        struct rule_window *w = &s.windows[s.nwindows];
+        if ((k->rules_swept[prelink] & (1u << i)) || !(r->ranges & (prelink ? PF_RULE_PRELINK : PF_RULE_XNU)) ||
+            (i != want && !(span && rule_spans_range(r, prelink)))) {
+            continue;
+        }
+        k->rules_swept[prelink] |= 1u << i;
+        if (k->rule_values[i] || !r->pattern.count || r->pattern.count > PF_PATTERN_MAX) {
+            continue;
+        }
+        range = code;
+        kext = NULL;
+        if (prelink && r->kext) {
+            kext = pf_find_kext(k, r->kext);
+            if (!kext) {
+                continue;
+            }
+            range = pf_view_clamp(&code, kext->exec_base, kext->exec_base + kext->exec_size);
+        }
+        memset(w, 0, sizeof(*w));
+        w->rule = r;
+        w->index = i;
+        w->start = range.start;
+        w->end = range.end;
+        if (r->anchor) {
+            int64_t from, to;
+            w->ref = kext ? find_kext_strref(k, r->kext, r->anchor, r->xref) : find_strref(k, r->anchor, r->xref, prelink);
+            if (!w->ref) {
+                continue;
+            }
+            w->ref -= k->kerndumpbase;
+            from = (int64_t)w->ref + r->from;
+            to = (int64_t)w->ref + r->to;
+            w->start = from > (int64_t)range.start ? (addr_t)from : range.start;
+            w->end = to < (int64_t)range.end ? (addr_t)to : range.end;
+            if (w->start >= w->end) {
+                continue;
+            }
+        }
+        w->pattern = sweep_pattern(&s, &r->pattern);
+        s.nwindows++;
+    }
+    if (!s.nwindows) {
+        return;
+    }
+    qsort(s.windows, s.nwindows, sizeof(s.windows[0]), cmp_window);
+
+    for (i = 0; i < s.nwindows; i = j) {
+        addr_t pos, end = s.windows[i].end;
+        for (j = i + 1; j < s.nwindows && s.windows[j].start <= end; j++) {
+            if (s.windows[j].end > end) {
+                end = s.windows[j].end;
+            }
+        }
+        for (pos = s.windows[i].start; pos < end; pos = s.limit) {
+            struct pf_pattern pats[PF_MAX_RULES];
+            unsigned n = 0, p, w;
+            struct pf_view v;
+            s.limit = end - pos > SCAN_CHUNK ? pos + SCAN_CHUNK : end;
+            for (p = 0; p < s.npatterns; p++) {
+                for (w = i; w < j; w++) {
+                    if (s.windows[w].pattern == p && !s.windows[w].done && s.windows[w].end > pos) {
+                        break;
+                    }
+                }
+                if (w < j) {
+                    s.which[n] = p;
+                    pats[n++] = s.patterns[p];
+                }
+            }
+            if (!n) {
+                break;
+            }
+            // room for the rest of a match that begins at the limit
+            v = fetch_view(k, pf_view_clamp(&code, pos, s.limit + 4 * (PF_PATTERN_MAX - 1)));
+            pf_scan_each(k->kernel, v.start, v.end, pats, n, rule_match, &s);
+        }
+    }
+
+    for (i = 0; i < s.nwindows; i++) {
+        addr_t val = s.windows[i].hit ? rule_yield(k, &s.windows[i], prelink) : 0;
+        k->rule_values[s.windows[i].index] = val ? val + k->kerndumpbase : 0;
+    }
+}
+
+// Value of the default rule `name`: the address of its symbol if the image
+// has one, else what the heuristics found in its first range that has it.
+addr_t
+pf_find_rule(struct pf_kernel *k, const char *name)
+{
+    unsigned i;
+    addr_t val;
+
+    for (i = 0; i < pf_num_default_rules && strcmp(pf_default_rules[i].name, name); i++) {
+    }
+    if (i == pf_num_default_rules) {
+        return 0;
+    }
+    if (pf_default_rules[i].symbol) {
+        val = find_symbol(k, pf_default_rules[i].symbol);
+        if (val) {
+            return val;
+        }
+    }
+    pthread_mutex_lock(&k->rules_lock);
+    sweep_rules(k, 0, i);
+    if (!k->rule_values[i]) {
+        sweep_rules(k, 1, i);
+    }
+    val = k->rule_values[i];
+    pthread_mutex_unlock(&k->rules_lock);
+    return val;
+}
+
+/****** fun *******/
+
+addr_t find_add_x0_x0_0x40_ret(struct pf_kernel *k) {
+	return pf_find_rule(k, "add_x0_x0_0x40_ret");
+}
+
+addr_t find_allproc(struct pf_kernel *k) {
+	return pf_find_rule(k, "allproc");
+}
+
+addr_t find_copyout(struct pf_kernel *k) {
+	return pf_find_rule(k, "copyout");
+}
+
+addr_t find_bzero(struct pf_kernel *k) {
+	return pf_find_rule(k, "bzero");
+}
+
+addr_t find_bcopy(struct pf_kernel *k) {
+	return pf_find_rule(k, "bcopy");
+}
+
+#ifdef HAVE_MAIN
+/*
+ * Offline driver.  Build on any POSIX host with
+ *     cc -O2 -DHAVE_MAIN -I. -Ipatchfinder -o patchfinder64 patchfinder64.c \
+ *        patchfinder/a64_decode.c patchfinder/fixups.c patchfinder/xref_index.c \
+ *        patchfinder/insn_scan.c patchfinder/str_search.c \
+ *        patchfinder/func_index.c patchfinder/reg_cache.c \
+ *        patchfinder/sym_index.c patchfinder/pf_driver.c \
+ *        patchfinder/pf_cache.c patchfinder/img4.c \
+ *        patchfinder/decompress.c patchfinder/page_cache.c \
+ *        patchfinder/pf_rules.c patchfinder/prelink_info.c -lpthread
+ * and run it against a kernelcache, raw or as shipped in IMG4/IM4P form.
+ * With -c, results and xref indices are kept in a per-image file in that
+ * directory and a repeat run is served from it.  With -v, finders are run a
+ * second time with the symbol table ignored and every heuristic that
+ * disagrees with it is reported.  -r rewrites chained pointers first.  -k
+ * loads the image through init_kernel_paged(), reading the file image the
+ * way kread() reads the kernel on the device, and reports what was fetched.
+ * -l lists the prelinked kexts with their code and string ranges.
+ */
+#include <time.h>
+#include "pf_cache.h"
+
+static double
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+    int rv, ch, verify = 0, resolve = 0, paged = 0, list = 0;
+    unsigned i, failed, nthreads = 0;
+    double t;
+    struct pf_kernel kernel, file, *k = &kernel;
+    struct pf_result results[PF_MAX_FINDERS];
+    const char *xrefs = NULL, *cache = NULL;
+
+    while ((ch = getopt(argc, argv, "c:j:klrvx:")) != -1) {
+        switch (ch) {
+            case 'c': cache = optarg; break;
+            case 'j': nthreads = atoi(optarg); break;
+            case 'k': paged = 1; break;
+            case 'l': list = 1; break;
+            case 'r': resolve = 1; break;
+            case 'v': verify = 1; break;
+            case 'x': xrefs = optarg; break;
+            default: goto usage;
+        }
+    }
+    if (optind != argc - 1) {
+usage:
+        fprintf(stderr, "usage: %s [-c cache-dir] [-j threads] [-k] [-l] [-r] [-v] [-x xref-cache] kernelcache\n", argv[0]);
+        return 1;
+    }
+
+    t = now_ms();
+    rv = init_kernel(paged ? &file : k, 0, argv[optind]);
+    if (!rv && paged) {
+        rv = init_kernel_paged(k, (uint8_t *)file.kernel_mh - file.kernel + file.kerndumpbase, pf_kernel_reader, &file);
+        if (rv) {
+            term_kernel(&file);
+        }
+    }
+    if (rv) {
+        fprintf(stderr, "%s: not a 64-bit kernelcache\n", argv[optind]);
+        return 1;
+    }
+    printf("loaded %s in %.3f ms\n", argv[optind], now_ms() - t);
+
+    for (i = 0; i < k->nsegments; i++) {
+        const struct pf_segment *seg = &k->segments[i];
+        printf("%-16.16s 0x%016llx-0x%016llx fileoff 0x%llx\n", seg->segname,
+               seg->vmaddr, seg->vmaddr + seg->vmsize, seg->fileoff);
+    }
+
+    if (list) {
+        const struct pf_kext_map *kexts;
+        t = now_ms();
+        kexts = pf_get_kexts(k);
+        for (i = 0; kexts && i < kexts->count; i++) {
+            const struct pf_kext *kext = &kexts->kexts[i];
+            printf("%-48s exec 0x%016llx-0x%016llx cstring 0x%016llx-0x%016llx\n", kext->id,
+                   kext->exec_base + k->kerndumpbase, kext->exec_base + kext->exec_size + k->kerndumpbase,
+                   kext->cstring_base + k->kerndumpbase, kext->cstring_base + kext->cstring_size + k->kerndumpbase);
+        }
+        printf("%zu kexts listed in %.3f ms\n", kexts ? kexts->count : 0, now_ms() - t);
+    }
+
+    if (resolve) {
+        long n;
+        t = now_ms();
+        n = pf_resolve_pointers(k);
+        if (n < 0) {
+            fprintf(stderr, "%s: malformed pointer fixups\n", argv[optind]);
+        } else {
+            printf("resolved %ld pointers in %.3f ms\n", n, now_ms() - t);
+        }
+    }
+
+    if (xrefs) {
+        t = now_ms();
+        if (!pf_load_xrefs(k, xrefs)) {
+            printf("loaded xrefs from %s in %.3f ms\n", xrefs, now_ms() - t);
+        } else if (!pf_save_xrefs(k, xrefs)) {
+            printf("built and saved xrefs to %s in %.3f ms\n", xrefs, now_ms() - t);
+        }
+    }
+
+    t = now_ms();
+    failed = pf_run_finders_cached(k, pf_default_finders, pf_num_default_finders, nthreads, results, cache);
+    pf_print_results(stdout, results, pf_num_default_finders);
+    printf("finders took %.3f ms, %u failed\n", now_ms() - t, failed);
+
+    if (verify && !get_syms(k)) {
+        printf("no symbols to verify against\n");
+    } else if (verify) {
+        struct pf_result guess[PF_MAX_FINDERS];
+        unsigned wrong = 0;
+        k->use_symbols = 0;
+        pf_run_finders(k, pf_default_finders, pf_num_default_finders, nthreads, guess);
+        k->use_symbols = 1;
+        for (i = 0; i < pf_num_default_finders; i++) {
+            if (guess[i].value != results[i].value) {
+                printf("%-24s heuristic 0x%016llx, symbol table 0x%016llx\n", results[i].name, guess[i].value, results[i].value);
+                wrong++;
+            }
+        }
+        printf("%zu symbols, %u heuristics disagree\n", k->syms.count, wrong);
+        if (wrong) {
+            failed++;
+        }
+    }
+
+    if (paged) {
+        struct pf_pager_stats st;
+        pf_pager_get_stats(k->pager, &st);
+        printf("fetched %llu of %llu pages, %llu into the page cache (%llu hits); %llu reads, %llu bytes\n",
+               (unsigned long long)st.pages, (unsigned long long)(k->kernel_size + PF_PAGE_SIZE - 1) / PF_PAGE_SIZE,
+               (unsigned long long)st.cached, (unsigned long long)st.hits, (unsigned long long)st.reads,
+               (unsigned long long)st.bytes);
+        term_kernel(&file);
+    }
+    term_kernel(k);
+    return failed ? 2 : 0;
+}
+#endif	/* HAVE_MAIN */
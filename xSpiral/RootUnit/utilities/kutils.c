@@ -9,8 +9,10 @@
 #include "exploit_additions.h"
 #include "offsetof.h"
 #include "kernel_slide.h"
+#include "parameters.h"
 
 extern mach_port_t tfpzero;
+extern struct pf_kernel kernel_image;
 
 uint64_t cached_task_self_addr = 0;
 uint64_t task_self_addr() {
@@ -149,8 +151,17 @@ void kfree(mach_vm_address_t address, vm_size_t size){
     mach_vm_deallocate(tfpzero, address, size);
 }
 
+// Uses the address recorded in the offsets database for this build when there
+// is one, and only runs the patchfinder otherwise.
+static uint64_t allproc_address(void) {
+    if (STATIC_ADDRESS(allproc)) {
+        return STATIC_ADDRESS(allproc) + kernel_slide;
+    }
+    return find_allproc(&kernel_image);
+}
+
 uint32_t find_pid_of_proc(const char *proc_name) {
-    uint64_t proc = rk64(find_allproc());
+    uint64_t proc = rk64(allproc_address());
     while (proc) {
         uint32_t pid = (uint32_t)rk32(proc + offsetof_p_pid);
         char name[40] = {0};
@@ -164,7 +175,7 @@ uint32_t find_pid_of_proc(const char *proc_name) {
 }
 
 uint64_t get_proc_struct_for_pid(pid_t proc_pid) {
-    uint64_t proc = rk64(find_allproc());
+    uint64_t proc = rk64(allproc_address());
     while (proc) {
         uint32_t pid = (uint32_t)rk32(proc + offsetof_p_pid);
         if (pid == proc_pid){
@@ -3,9 +3,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/stat.h>
 #include <mach/mach.h>
 #include "IOKit.h"
+#include "../../XcodeGEN/file_copy.h"
 #include <CoreFoundation/CoreFoundation.h>
 
 #define kIONVRAMDeletePropertyKey   "IONVRAM-DELETE-PROPERTY"
@@ -113,46 +113,11 @@ int delgen(void) {
 }
 
 bool dump_apticket(const char *to) {
-    bool ret = false;
     const char *from = "/System/Library/Caches/apticket.der";
-    struct stat s;
-    if(stat(from, &s) != 0)
+    if(file_copy(from, to, FILE_COPY_REPLACE, NULL, NULL, NULL) != 0)
     {
-        ERROR("stat failed: %s", strerror(errno));
+        ERROR("failed to copy %s to %s: %s", from, to, strerror(errno));
+        return false;
     }
-    else
-    {
-        FILE *in  = fopen(from, "rb");
-        if(in == NULL)
-        {
-            ERROR("failed to open src: %s", strerror(errno));
-        }
-        else
-        {
-            FILE *out = fopen(to, "wb");
-            if(out == NULL)
-            {
-                ERROR("failed to open dst: %s", strerror(errno));
-            }
-            else
-            {
-                char *buf = malloc(s.st_size);
-                if(buf == NULL)
-                {
-                    ERROR("failed to alloc buf: %s", strerror(errno));
-                }
-                else
-                {
-                    fread(buf, s.st_size, 1, in);
-                    fwrite(buf, s.st_size, 1, out);
-                    free(buf);
-                    ret = true;
-                }
-                fclose(out);
-            }
-            fclose(in);
-        }
-    }
-    return ret;
+    return true;
 }
-
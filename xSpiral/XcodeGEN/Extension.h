@@ -12,7 +12,14 @@
 
 #endif /* Extension_h */
 
-NSArray *catchContentUnderPath(NSString *thisPath);
+// A sorted directory listing that only turns rows into NSStrings, and only
+// stats and counts them, when they are asked for.
+@interface DirectoryListing : NSArray
+- (BOOL)isDirectoryAtIndex:(NSUInteger)index;
+- (NSInteger)itemCountAtIndex:(NSUInteger)index;
+@end
+
+DirectoryListing *catchContentUnderPath(NSString *thisPath);
 int countItemInThePath(NSString *thisPath);
 bool isThisDirectory(NSString *thisPath);
 NSString *dropLastContentOfSplash(NSString *what);
@@ -7,6 +7,10 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "Extension.h"
+#include <errno.h>
+#include <string.h>
+#include "dir_list.h"
 
 NSString *userlandHome;
 NSString *outputString;
@@ -36,43 +40,86 @@ NSString *readUserlandHome() {
     return userlandHome;
 }
 
-NSArray *catchContentUnderPath(NSString *thisPath) {
-    
-    NSError *error;
-    
-    NSArray *contentFolder =[[NSFileManager defaultManager] contentsOfDirectoryAtPath:thisPath error:&error];
-    if (error != nil) {
-        NSLog(@"Something wrong.");
+// Rows are materialized a page at a time, about a screenful.
+#define LISTING_PAGE 64
+
+@implementation DirectoryListing {
+    struct dir_list list;
+    NSMutableDictionary<NSNumber *, NSArray<NSString *> *> *pages;
+}
+
+- (instancetype)initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        pages = [NSMutableDictionary dictionary];
+        if (dir_list_open(&list, path.fileSystemRepresentation) != 0) {
+            NSLog(@"Something wrong: %s", strerror(errno));
+            dir_list_free(&list);
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    dir_list_free(&list);
+}
+
+- (NSUInteger)count {
+    return list.count;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+    if (index >= list.count) {
+        [NSException raise:NSRangeException format:@"index %lu beyond %lu", (unsigned long)index, (unsigned long)list.count];
     }
-    NSLog(@"%@",contentFolder);
-    //
-    //    NSArray *contentFile = [[NSFileManager defaultManager] subpathsOfDirectoryAtPath:thisPath error:&error];
-    //    if (error != nil) {
-    //        NSLog(@"Something wrong.");
-    //    }
-    //    NSLog(@"%@",contentFile);
-    //
-    //    NSArray *allFiles = [NSArray alloc] init
-    
-    NSStringCompareOptions comparisonOptions = NSCaseInsensitiveSearch|NSNumericSearch|
-    NSWidthInsensitiveSearch|NSForcedOrderingSearch;
-    NSComparator sort = ^(NSString *obj1,NSString *obj2){
-        NSRange range = NSMakeRange(0,obj1.length);
-        return [obj1 compare:obj2 options:comparisonOptions range:range];
-    };
-    NSArray *resultArray = [contentFolder sortedArrayUsingComparator:sort];
-
-    return resultArray;
+    NSNumber *key = @(index / LISTING_PAGE);
+    NSArray<NSString *> *page = pages[key];
+    if (page == nil) {
+        NSUInteger start = index / LISTING_PAGE * LISTING_PAGE;
+        NSUInteger end = MIN(start + LISTING_PAGE, list.count);
+        NSMutableArray<NSString *> *rows = [NSMutableArray arrayWithCapacity:end - start];
+        for (NSUInteger i = start; i < end; i++) {
+            const char *name = dir_list_name(&list, i);
+            NSString *row = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:name length:strlen(name)];
+            if (row == nil) {
+                row = [[NSString alloc] initWithBytes:name length:strlen(name) encoding:NSISOLatin1StringEncoding];
+            }
+            [rows addObject:row];
+        }
+        page = rows;
+        pages[key] = page;
+    }
+    return page[index % LISTING_PAGE];
+}
+
+- (BOOL)isDirectoryAtIndex:(NSUInteger)index {
+    if (index >= list.count || [self[index] hasSuffix:@".plist"]) {
+        return NO;
+    }
+    return dir_list_is_dir(&list, index) != 0;
+}
+
+- (NSInteger)itemCountAtIndex:(NSUInteger)index {
+    if (index >= list.count) {
+        return 0;
+    }
+    long n = dir_list_child_count(&list, index);
+    return n < 0 ? 0 : n;
+}
+
+@end
+
+DirectoryListing *catchContentUnderPath(NSString *thisPath) {
+    return [[DirectoryListing alloc] initWithPath:thisPath];
 }
 
 int countItemInThePath(NSString *thisPath) {
-    NSError *error;
-    NSArray *contentFolder =[[NSFileManager defaultManager] contentsOfDirectoryAtPath:thisPath error:&error];
-    if (error != nil) {
+    long n = dir_count(thisPath.fileSystemRepresentation);
+    if (n < 0) {
         NSLog(@"Something wrong.");
+        return 0;
     }
-    NSLog(@"%@",contentFolder);
-    return contentFolder.count;
+    return (int)n;
 }
 
 bool isThisDirectory(NSString *thisPath) {
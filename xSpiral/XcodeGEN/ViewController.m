@@ -18,6 +18,7 @@
 #include "../PostExploit/ExploitBridger.h"
 #include "../PostExploit/offsets.h"
 #include "../RootUnit/noncereboot.h"
+#include "file_copy.h"
 
 
 @interface ViewController ()
@@ -109,7 +110,7 @@
     NSString *currentPath;
     NSString *copyFilePath;
     NSString *copyFileName;
-    NSArray *currentFileList;
+    DirectoryListing *currentFileList;
 }
 
 @property (weak, nonatomic) IBOutlet FileListTableView *tableView;
@@ -120,6 +121,26 @@
 @end
 
 
+struct paste_progress {
+    void *label;
+    int percent;
+};
+
+// file_copy() progress for pasteFile:, shown in the error label whenever
+// the percentage changes.
+static int showPasteProgress(void *ctx, const char *path, uint64_t done, uint64_t total) {
+    struct paste_progress *progress = ctx;
+    int percent = total ? (int)(done * 100 / total) : 0;
+    if (percent != progress->percent) {
+        UILabel *label = (__bridge UILabel *)progress->label;
+        progress->percent = percent;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            label.text = [[NSString alloc] initWithFormat:@"Copying... %d%%", percent];
+        });
+    }
+    return 0;
+}
+
 @implementation FileManagerViewController
 
 - (void)viewDidLoad {
@@ -258,14 +279,24 @@
     while ([[NSFileManager defaultManager] fileExistsAtPath:dest]) {
         dest = [dest stringByAppendingString:@".copy"];
     }
-    NSError *err;
-    [[NSFileManager defaultManager] copyItemAtPath:copyFilePath toPath:dest error:&err];
-    if (err != nil) {
-        NSLog(@"Copy file failed!");
-        _errorLabel.text = @"Unable to copy.";
-    }
-    currentFileList = catchContentUnderPath(currentPath);
-    _tableView.reloadData;
+    // Big trees take a while: copy off the main thread and show progress.
+    NSString *from = copyFilePath;
+    _errorLabel.text = @"Copying...";
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        struct paste_progress progress = { (__bridge void *)self->_errorLabel, -1 };
+        int rv = file_copy(from.fileSystemRepresentation, dest.fileSystemRepresentation, 0, showPasteProgress, &progress, NULL);
+        int saved = errno;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (rv != 0) {
+                NSLog(@"Copy file failed: %s", strerror(saved));
+                self->_errorLabel.text = @"Unable to copy.";
+            } else {
+                self->_errorLabel.text = @"Last error: nil";
+            }
+            self->currentFileList = catchContentUnderPath(self->currentPath);
+            self->_tableView.reloadData;
+        });
+    });
 }
 
 - (IBAction)createFolder:(id)sender {
@@ -310,15 +341,9 @@
     static NSString *cellID = @"cell";
     UITableViewCell *cell = [tableView dequeueReusableCellWithIdentifier:cellID];
     cell.textLabel.text = [@"  " stringByAppendingString: currentFileList[indexPath.row]];
-    NSString *fullPathForThisFile;
-    if ([currentPath isEqualToString:@"/"]){
-        fullPathForThisFile = [[NSString alloc] initWithFormat:@"%@%@", currentPath, currentFileList[indexPath.row]];
-    }else{
-        fullPathForThisFile = [[NSString alloc] initWithFormat:@"%@/%@", currentPath, currentFileList[indexPath.row]];
-    }
-    if (isThisDirectory(fullPathForThisFile)) {
-        int itemCount = countItemInThePath(fullPathForThisFile);
-        NSString *details = [[NSString alloc] initWithFormat:@"%d item(s)", itemCount];
+    if ([currentFileList isDirectoryAtIndex:indexPath.row]) {
+        NSInteger itemCount = [currentFileList itemCountAtIndex:indexPath.row];
+        NSString *details = [[NSString alloc] initWithFormat:@"%ld item(s)", (long)itemCount];
         cell.detailTextLabel.text = details;
         cell.imageView.image = [UIImage imageNamed:@"folder"];
     }else{
@@ -346,7 +371,7 @@
     }else{
         fullPathForThisFile = [[NSString alloc] initWithFormat:@"%@/%@", currentPath, currentFileList[indexPath.row]];
     }
-    if (isThisDirectory(fullPathForThisFile)) {
+    if ([currentFileList isDirectoryAtIndex:indexPath.row]) {
         currentPath = fullPathForThisFile;
         currentFileList = catchContentUnderPath(currentPath);
         tableView.reloadData;
@@ -356,9 +381,8 @@
         if (isRootNow()) {
             self->_errorLabel.text = @"We can't share file as root.\nBut we copied it to /var/mobile/Media/.";
             NSString *destPath = [@"/var/mobile/Media/" stringByAppendingPathComponent:currentFileList[indexPath.row]];
-            [[NSFileManager defaultManager] copyItemAtPath:filePath toPath:destPath error:&err];
-            NSLog(@"%@", err);
-            if (err != nil) {
+            if (file_copy(filePath.fileSystemRepresentation, destPath.fileSystemRepresentation, FILE_COPY_REPLACE, NULL, NULL, NULL) != 0) {
+                NSLog(@"Copy to %@ failed: %s", destPath, strerror(errno));
                 _errorLabel.text = @"Failed to copy to /var/mobile/Media/";
                 NSURL *fileUrl = [NSURL fileURLWithPath:fullPathForThisFile];
                 NSData *fileData = [NSData dataWithContentsOfURL:fileUrl];
@@ -372,8 +396,10 @@
             NSLog(@"%@", err);
         }else{
             // Let's copy file to our doc direct.
-            [[NSFileManager defaultManager] removeItemAtPath:filePath error:nil];
-            [[NSFileManager defaultManager] copyItemAtPath:fullPathForThisFile toPath:filePath error:nil];
+            // Replaces an earlier copy in one step, without deleting it first.
+            if (file_copy(fullPathForThisFile.fileSystemRepresentation, filePath.fileSystemRepresentation, FILE_COPY_REPLACE, NULL, NULL, NULL) != 0) {
+                NSLog(@"Copy to %@ failed: %s", filePath, strerror(errno));
+            }
             NSDictionary *attr=[NSDictionary dictionaryWithObject:[NSNumber numberWithUnsignedLong:0777U] forKey:NSFilePosixPermissions];
             [[NSFileManager defaultManager] setAttributes:attr ofItemAtPath:filePath error:&err];
             NSLog(@"%@", err);
@@ -0,0 +1,335 @@
+//
+//  copy_bench.c
+//  xSpiral
+//
+//  Host tool that builds a temporary tree of files (mostly small, a few
+//  large, with symlinks and nested directories), then times file_copy
+//  against the way the app used to copy: reading each file whole into a
+//  malloc() buffer and writing it back out.  Every copy is compared with
+//  the source, a cancelled copy is checked to stop, and a single large file
+//  is copied once more to show the throughput of each path.  The exit
+//  status is nonzero on any mismatch.
+//
+
+/*
+ * Not part of the app.  Build from this directory with
+ *     cc -O2 -o copy_bench copy_bench.c file_copy.c
+ * and run e.g. "./copy_bench -n 2000 -m 256".  -d creates the tree under
+ * the given path instead of $TMPDIR (use it to compare filesystems) and -k
+ * keeps it.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "file_copy.h"
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static uint64_t next(uint64_t *seed) {
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *seed >> 17;
+}
+
+static int write_file(const char *path, size_t size, uint64_t *seed) {
+    char buf[65536];
+    size_t i, n;
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    while (size) {
+        n = size < sizeof(buf) ? size : sizeof(buf);
+        for (i = 0; i < n; i += 8) {
+            uint64_t v = next(seed);
+            memcpy(buf + i, &v, n - i < 8 ? n - i : 8);
+        }
+        if (write(fd, buf, n) != (ssize_t)n) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        size -= n;
+    }
+    return close(fd);
+}
+
+// n files spread over nested directories, about one in fifty of them
+// between 1 and 8 MiB and the rest under 64 KiB, plus a symlink per
+// directory.  Returns the total file bytes, or 0 on failure.
+static uint64_t populate(const char *root, unsigned long n, uint64_t seed) {
+    char dir[8400], path[8500];
+    uint64_t total = 0;
+    unsigned long i;
+
+    snprintf(dir, sizeof(dir), "%s", root);
+    for (i = 0; i < n; i++) {
+        size_t size;
+        if (i % 64 == 0) {
+            // every fourth directory starts over from the root
+            if (i % 256 == 0 || strlen(dir) > 3500) {
+                snprintf(dir, sizeof(dir), "%s", root);
+            }
+            snprintf(path, sizeof(path), "%s/d%lu", dir, i);
+            if (mkdir(path, 0755)) {
+                perror(path);
+                return 0;
+            }
+            memcpy(dir, path, strlen(path) + 1);
+            snprintf(path, sizeof(path), "%s/link", dir);
+            if (symlink("f0", path)) {
+                perror(path);
+                return 0;
+            }
+        }
+        size = next(&seed) % 50 == 0 ? (1 << 20) + next(&seed) % (7 << 20) : next(&seed) % 65536;
+        snprintf(path, sizeof(path), "%s/f%lu", dir, i);
+        if (write_file(path, size, &seed)) {
+            return 0;
+        }
+        total += size;
+    }
+    return total;
+}
+
+static void remove_tree(const char *dir) {
+    char cmd[4200];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "%s: could not remove\n", dir);
+    }
+}
+
+static int same_trees(const char *a, const char *b) {
+    char cmd[16384];
+    snprintf(cmd, sizeof(cmd), "diff -r --no-dereference '%s' '%s' >/dev/null", a, b);
+    return system(cmd) == 0;
+}
+
+// The old dump_apticket(): the whole file through one malloc() buffer.
+static int old_copy_file(const char *from, const char *to) {
+    struct stat st;
+    FILE *in, *out;
+    char *buf;
+    int rv = -1;
+    if (stat(from, &st) || !(in = fopen(from, "rb"))) {
+        return -1;
+    }
+    if ((out = fopen(to, "wb")) != NULL) {
+        if ((buf = malloc(st.st_size ? st.st_size : 1)) != NULL) {
+            if (fread(buf, st.st_size, 1, in) == 1 || st.st_size == 0) {
+                rv = fwrite(buf, st.st_size, 1, out) == 1 || st.st_size == 0 ? 0 : -1;
+            }
+            free(buf);
+        }
+        if (fclose(out)) {
+            rv = -1;
+        }
+    }
+    fclose(in);
+    return rv;
+}
+
+static int old_copy_tree(const char *from, const char *to) {
+    char cmd[16384];
+    // directories and links as cp makes them, file data the old way
+    snprintf(cmd, sizeof(cmd), "cd '%s' && find . -type d -exec mkdir -p '%s/{}' \\; && "
+             "find . -type l -exec sh -c 'ln -s \"$(readlink \"$1\")\" \"%s/$1\"' _ {} \\;", from, to, to);
+    return system(cmd) == 0 ? 0 : -1;
+}
+
+struct walk {
+    const char *from;
+    const char *to;
+    unsigned long files;
+};
+
+static int old_walk(struct walk *w, const char *rel) {
+    char list[8500], line[4200], a[8500], b[8500];
+    FILE *p;
+    int rv = 0;
+    snprintf(list, sizeof(list), "cd '%s' && find %s -type f", w->from, rel);
+    if (!(p = popen(list, "r"))) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), p)) {
+        line[strcspn(line, "\n")] = 0;
+        snprintf(a, sizeof(a), "%s/%s", w->from, line);
+        snprintf(b, sizeof(b), "%s/%s", w->to, line);
+        if (old_copy_file(a, b)) {
+            rv = -1;
+        }
+        w->files++;
+    }
+    pclose(p);
+    return rv;
+}
+
+static int cancel_after(void *ctx, const char *path, uint64_t done, uint64_t total) {
+    unsigned long *calls = ctx;
+    (void)path;
+    (void)done;
+    (void)total;
+    return ++*calls > 3;
+}
+
+struct progress {
+    unsigned long calls;
+    uint64_t last;
+    uint64_t total;
+    int backwards;
+};
+
+static int track(void *ctx, const char *path, uint64_t done, uint64_t total) {
+    struct progress *p = ctx;
+    (void)path;
+    p->backwards |= done < p->last;
+    p->last = done;
+    p->total = total;
+    p->calls++;
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    unsigned flags;
+} modes[] = {
+    { "stream", FILE_COPY_NO_CLONE | FILE_COPY_NO_OFFLOAD },
+    { "offload", FILE_COPY_NO_CLONE },
+    { "default", 0 },
+};
+
+static double mib_s(uint64_t bytes, double ms) {
+    return ms > 0 ? bytes / 1048576.0 / (ms / 1e3) : 0;
+}
+
+int main(int argc, char **argv) {
+    int ch, keep = 0, status = 0;
+    unsigned long n = 1000, big_mib = 128, seed = 1, calls = 0;
+    const char *base = getenv("TMPDIR");
+    char root[4096], src[4200], dst[4300], big[4200], bigcopy[4300];
+    struct file_copy_stats st;
+    struct progress prog;
+    struct walk w;
+    uint64_t total, big_seed;
+    double t;
+    size_t m;
+
+    while ((ch = getopt(argc, argv, "d:km:n:r:")) != -1) {
+        switch (ch) {
+            case 'd': base = optarg; break;
+            case 'k': keep = 1; break;
+            case 'm': big_mib = strtoul(optarg, NULL, 0); break;
+            case 'n': n = strtoul(optarg, NULL, 0); break;
+            case 'r': seed = strtoul(optarg, NULL, 0); break;
+            default: goto usage;
+        }
+    }
+    if (optind != argc || !n || !big_mib) {
+usage:
+        fprintf(stderr, "usage: %s [-d base-dir] [-k] [-m big-file-MiB] [-n files] [-r seed]\n", argv[0]);
+        return 1;
+    }
+
+    snprintf(root, sizeof(root), "%s/copy_bench.XXXXXX", base ? base : "/tmp");
+    if (!mkdtemp(root)) {
+        perror(root);
+        return 1;
+    }
+    snprintf(src, sizeof(src), "%s/src", root);
+    snprintf(big, sizeof(big), "%s/big", root);
+    t = now_ms();
+    big_seed = seed;
+    if (mkdir(src, 0755) || !(total = populate(src, n, seed)) ||
+        write_file(big, big_mib << 20, &big_seed)) {
+        remove_tree(root);
+        return 1;
+    }
+    printf("created %lu files, %.1f MiB, in %.1f ms\n", n, total / 1048576.0, now_ms() - t);
+
+    snprintf(dst, sizeof(dst), "%s/old", root);
+    t = now_ms();
+    w.from = src;
+    w.to = dst;
+    w.files = 0;
+    if (old_copy_tree(src, dst) || old_walk(&w, ".")) {
+        fprintf(stderr, "old copy failed\n");
+        status = 2;
+    }
+    t = now_ms() - t;
+    printf("%-8s tree  %10.2f ms  %8.1f MiB/s  (%lu files)\n", "old", t, mib_s(total, t), w.files);
+
+    for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        snprintf(dst, sizeof(dst), "%s/%s", root, modes[m].name);
+        memset(&prog, 0, sizeof(prog));
+        t = now_ms();
+        if (file_copy(src, dst, modes[m].flags, track, &prog, &st)) {
+            perror(modes[m].name);
+            status = 2;
+            continue;
+        }
+        t = now_ms() - t;
+        printf("%-8s tree  %10.2f ms  %8.1f MiB/s  (%llu files, %llu dirs, %llu links; "
+               "%llu cloned, %llu offloaded, %llu streamed; %lu callbacks)\n",
+               modes[m].name, t, mib_s(total, t), (unsigned long long)st.files, (unsigned long long)st.dirs,
+               (unsigned long long)st.links, (unsigned long long)st.cloned, (unsigned long long)st.offloaded,
+               (unsigned long long)st.streamed, prog.calls);
+        if (!same_trees(src, dst)) {
+            fprintf(stderr, "%s: copy differs from the source\n", modes[m].name);
+            status = 2;
+        }
+        if (st.bytes != total || prog.total != total || prog.last != total || prog.backwards) {
+            fprintf(stderr, "%s: %llu bytes copied, progress ended at %llu of %llu, expected %llu\n",
+                    modes[m].name, (unsigned long long)st.bytes, (unsigned long long)prog.last,
+                    (unsigned long long)prog.total, (unsigned long long)total);
+            status = 2;
+        }
+        if (file_copy(src, dst, modes[m].flags, NULL, NULL, NULL) == 0 || errno != EEXIST) {
+            fprintf(stderr, "%s: copying over an existing tree did not fail with EEXIST\n", modes[m].name);
+            status = 2;
+        }
+    }
+
+    snprintf(dst, sizeof(dst), "%s/cancelled", root);
+    if (file_copy(src, dst, 0, cancel_after, &calls, NULL) == 0 || errno != ECANCELED) {
+        fprintf(stderr, "cancelled copy did not fail with ECANCELED\n");
+        status = 2;
+    }
+
+    snprintf(bigcopy, sizeof(bigcopy), "%s/big.old", root);
+    t = now_ms();
+    old_copy_file(big, bigcopy);
+    t = now_ms() - t;
+    printf("%-8s file  %10.2f ms  %8.1f MiB/s\n", "old", t, mib_s(big_mib << 20, t));
+    for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        // replace the previous copy each time, as the file manager does
+        t = now_ms();
+        if (file_copy(big, bigcopy, modes[m].flags | FILE_COPY_REPLACE, NULL, NULL, NULL)) {
+            perror(bigcopy);
+            status = 2;
+        }
+        t = now_ms() - t;
+        printf("%-8s file  %10.2f ms  %8.1f MiB/s\n", modes[m].name, t, mib_s(big_mib << 20, t));
+        if (!same_trees(big, bigcopy)) {
+            fprintf(stderr, "%s: big file differs\n", modes[m].name);
+            status = 2;
+        }
+    }
+    printf("%s\n", status ? "FAILED" : "ok");
+
+    if (!keep) {
+        remove_tree(root);
+    }
+    return status;
+}
@@ -0,0 +1,266 @@
+//
+//  dir_bench.c
+//  xSpiral
+//
+//  Host tool that fills a temporary directory with a large number of
+//  entries (files, subdirectories and symlinks, with mixed-case and
+//  numbered names like a cache or log directory), then times dir_list
+//  against the way the file manager used to work: read everything, sort
+//  with a comparator that folds both names on every call, and stat and
+//  re-list each row.  The dir_list order is checked against that reference
+//  comparator and every row is paged through; the exit status is nonzero on
+//  any mismatch.
+//
+
+/*
+ * Not part of the app.  Build from this directory with
+ *     cc -O2 -o dir_bench dir_bench.c dir_list.c
+ * and run e.g. "./dir_bench -n 200000 -p 50".  -d creates the directory
+ * under the given path instead of $TMPDIR and -k keeps it.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "dir_list.h"
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// The reference order, computed directly on the names: ASCII case folded,
+// digit runs compared by value, ties broken by strcmp().
+static int ref_compare(const char *a, const char *b) {
+    const char *x = a, *y = b;
+    while (*x && *y) {
+        if (*x >= '0' && *x <= '9' && *y >= '0' && *y <= '9') {
+            const char *xs, *ys;
+            size_t xl, yl;
+            int rv;
+            while (x[0] == '0' && x[1] >= '0' && x[1] <= '9') {
+                x++;
+            }
+            while (y[0] == '0' && y[1] >= '0' && y[1] <= '9') {
+                y++;
+            }
+            for (xs = x; *x >= '0' && *x <= '9'; x++) {
+            }
+            for (ys = y; *y >= '0' && *y <= '9'; y++) {
+            }
+            xl = x - xs;
+            yl = y - ys;
+            if (xl != yl) {
+                return xl < yl ? -1 : 1;
+            }
+            if ((rv = memcmp(xs, ys, xl)) != 0) {
+                return rv;
+            }
+        } else {
+            int cx = (*x >= 'A' && *x <= 'Z') ? *x + 32 : (unsigned char)*x;
+            int cy = (*y >= 'A' && *y <= 'Z') ? *y + 32 : (unsigned char)*y;
+            // a digit run sorts as '0' against anything else
+            if (*x >= '0' && *x <= '9') {
+                cx = '0';
+            }
+            if (*y >= '0' && *y <= '9') {
+                cy = '0';
+            }
+            if (cx != cy) {
+                return cx < cy ? -1 : 1;
+            }
+            x++;
+            y++;
+        }
+    }
+    if (*x || *y) {
+        return *x ? 1 : -1;
+    }
+    return strcmp(a, b);
+}
+
+static int cmp_ref(const void *a, const void *b) {
+    return ref_compare(*(char *const *)a, *(char *const *)b);
+}
+
+static const char *const stems[] = { "Log", "cache", "Snapshot ", "item-", "com.apple.", "IMG_", "tmp" };
+
+static int populate(const char *dir, unsigned long n, uint64_t seed) {
+    unsigned long i;
+    char path[4200], first_dir[256] = ".";
+    for (i = 0; i < n; i++) {
+        const char *stem;
+        int fd;
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        stem = stems[(seed >> 33) % (sizeof(stems) / sizeof(stems[0]))];
+        // i keeps the names unique; the zero padding varies so that equal
+        // values with different spellings get compared too
+        snprintf(path, sizeof(path), "%s/%s%0*lu%s", dir, stem, (int)((seed >> 20) & 7), i,
+                 (seed & 0x10) ? ".txt" : (seed & 0x20) ? "-v2" : "");
+        if (i % 97 == 0) {
+            if (mkdir(path, 0755) == 0) {
+                char child[4300];
+                if (i == 0) {
+                    snprintf(first_dir, sizeof(first_dir), "%s", strrchr(path, '/') + 1);
+                }
+                snprintf(child, sizeof(child), "%s/a", path);
+                close(open(child, O_CREAT | O_WRONLY, 0644));
+            }
+        } else if (i % 89 == 0) {
+            if (symlink(first_dir, path)) {
+                perror(path);
+                return -1;
+            }
+        } else {
+            fd = open(path, O_CREAT | O_WRONLY, 0644);
+            if (fd < 0) {
+                perror(path);
+                return -1;
+            }
+            close(fd);
+        }
+    }
+    return 0;
+}
+
+static void remove_tree(const char *dir) {
+    char cmd[4200];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "%s: could not remove\n", dir);
+    }
+}
+
+// The old file manager: list, sort with the folding comparator, then stat
+// and count every row.
+static double old_way(const char *dir, unsigned long *rows) {
+    double t = now_ms();
+    char **names = NULL, path[4200];
+    size_t n = 0, cap = 0, i;
+    struct dirent *de;
+    DIR *d = opendir(dir);
+    if (!d) {
+        return -1;
+    }
+    while ((de = readdir(d)) != NULL) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            names = realloc(names, cap * sizeof(*names));
+        }
+        names[n++] = strdup(de->d_name);
+    }
+    closedir(d);
+    qsort(names, n, sizeof(*names), cmp_ref);
+    for (i = 0; i < n; i++) {
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            dir_count(path);
+        }
+        free(names[i]);
+    }
+    free(names);
+    *rows = n;
+    return now_ms() - t;
+}
+
+int main(int argc, char **argv) {
+    int ch, keep = 0, status = 0;
+    unsigned long n = 100000, page = 50, i, rows = 0, dirs = 0, seed = 1;
+    const char *base = getenv("TMPDIR");
+    char dir[4096];
+    struct dir_list l;
+    double t, t_open, t_page, t_all, t_old;
+
+    while ((ch = getopt(argc, argv, "d:kn:p:r:")) != -1) {
+        switch (ch) {
+            case 'd': base = optarg; break;
+            case 'k': keep = 1; break;
+            case 'n': n = strtoul(optarg, NULL, 0); break;
+            case 'p': page = strtoul(optarg, NULL, 0); break;
+            case 'r': seed = strtoul(optarg, NULL, 0); break;
+            default: goto usage;
+        }
+    }
+    if (optind != argc || !n || !page) {
+usage:
+        fprintf(stderr, "usage: %s [-d base-dir] [-k] [-n entries] [-p page-rows] [-r seed]\n", argv[0]);
+        return 1;
+    }
+
+    snprintf(dir, sizeof(dir), "%s/dir_bench.XXXXXX", base ? base : "/tmp");
+    if (!mkdtemp(dir)) {
+        perror(dir);
+        return 1;
+    }
+    t = now_ms();
+    if (populate(dir, n, seed)) {
+        remove_tree(dir);
+        return 1;
+    }
+    printf("created %lu entries in %s in %.1f ms\n", n, dir, now_ms() - t);
+
+    // What the table view does first: list, then fill one page of rows
+    // with the type and child count of each.
+    t = now_ms();
+    if (dir_list_open(&l, dir)) {
+        perror(dir);
+        remove_tree(dir);
+        return 1;
+    }
+    t_open = now_ms() - t;
+    for (i = 0; i < l.count && i < page; i++) {
+        if (dir_list_is_dir(&l, i)) {
+            dir_list_child_count(&l, i);
+        }
+    }
+    t_page = now_ms() - t;
+
+    for (i = 1; i < l.count; i++) {
+        if (ref_compare(dir_list_name(&l, i - 1), dir_list_name(&l, i)) >= 0 ||
+            dir_list_compare(dir_list_name(&l, i - 1), dir_list_name(&l, i)) >= 0) {
+            fprintf(stderr, "out of order at %lu: \"%s\" \"%s\"\n", i, dir_list_name(&l, i - 1), dir_list_name(&l, i));
+            status = 2;
+            break;
+        }
+    }
+
+    // Then scrolling through the rest.
+    t = now_ms();
+    for (i = 0; i < l.count; i++) {
+        if (dir_list_is_dir(&l, i)) {
+            dirs++;
+            dir_list_child_count(&l, i);
+        }
+    }
+    t_all = t_page + now_ms() - t;
+
+    t_old = old_way(dir, &rows);
+    if (rows != l.count) {
+        fprintf(stderr, "old listing has %lu rows, dir_list %zu\n", rows, l.count);
+        status = 2;
+    }
+
+    printf("dir_list_open       %10.2f ms  (%zu entries, %lu directories)\n", t_open, l.count, dirs);
+    printf("first page          %10.2f ms  (%lu rows)\n", t_page, page);
+    printf("all rows            %10.2f ms\n", t_all);
+    printf("old way, all rows   %10.2f ms\n", t_old);
+    printf("dir_count           %10ld entries\n", dir_count(dir));
+    printf("%s\n", status ? "FAILED" : "ok");
+
+    dir_list_free(&l);
+    if (!keep) {
+        remove_tree(dir);
+    }
+    return status;
+}
@@ -0,0 +1,275 @@
+//
+//  dir_list.c
+//  xSpiral
+//
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dir_list.h"
+
+// The collation key of a name: ASCII letters folded to lower case, and every
+// run of digits replaced by '0', its length without leading zeros, and the
+// digits, so that memcmp() puts "file9" before "file10".  At most
+// 2 * len + 1 bytes.
+static size_t make_key(const char *name, size_t len, uint8_t *key) {
+    size_t i = 0, k = 0;
+    while (i < len) {
+        unsigned char c = name[i];
+        if (c >= '0' && c <= '9') {
+            size_t start;
+            while (i + 1 < len && name[i] == '0' && name[i + 1] >= '0' && name[i + 1] <= '9') {
+                i++;
+            }
+            start = i;
+            while (i < len && name[i] >= '0' && name[i] <= '9') {
+                i++;
+            }
+            key[k++] = '0';
+            key[k++] = (uint8_t)(i - start);
+            memcpy(key + k, name + start, i - start);
+            k += i - start;
+        } else {
+            key[k++] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+            i++;
+        }
+    }
+    return k;
+}
+
+struct sort_item {
+    uint64_t prefix;        // first 8 key bytes, big-endian, zero padded
+    const uint8_t *key;
+    const char *name;
+    uint32_t key_len;
+    uint32_t index;
+};
+
+static void init_item(struct sort_item *it, const uint8_t *key, size_t key_len, const char *name) {
+    size_t i;
+    it->prefix = 0;
+    for (i = 0; i < 8; i++) {
+        it->prefix = (it->prefix << 8) | (i < key_len ? key[i] : 0);
+    }
+    it->key = key;
+    it->key_len = (uint32_t)key_len;
+    it->name = name;
+}
+
+static int cmp_item(const void *a, const void *b) {
+    const struct sort_item *x = a, *y = b;
+    uint32_t n;
+    int rv;
+    if (x->prefix != y->prefix) {
+        return x->prefix < y->prefix ? -1 : 1;
+    }
+    n = x->key_len < y->key_len ? x->key_len : y->key_len;
+    if (n > 8 && (rv = memcmp(x->key + 8, y->key + 8, n - 8)) != 0) {
+        return rv;
+    }
+    if (x->key_len != y->key_len) {
+        return x->key_len < y->key_len ? -1 : 1;
+    }
+    // Equal keys ("a" and "A", "7" and "007"): keep a total order.
+    return strcmp(x->name, y->name);
+}
+
+int dir_list_compare(const char *a, const char *b) {
+    size_t la = strlen(a), lb = strlen(b);
+    uint8_t *ka = malloc(2 * la + 1), *kb = malloc(2 * lb + 1);
+    struct sort_item x, y;
+    int rv;
+    if (!ka || !kb) {
+        free(ka);
+        free(kb);
+        return strcmp(a, b);
+    }
+    init_item(&x, ka, make_key(a, la, ka), a);
+    init_item(&y, kb, make_key(b, lb, kb), b);
+    rv = cmp_item(&x, &y);
+    free(ka);
+    free(kb);
+    return rv;
+}
+
+static int is_dot(const char *name) {
+    return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+}
+
+// Reads every entry of an open directory into l, in directory order.
+static int read_entries(struct dir_list *l, DIR *d) {
+    size_t cap = 0, names_cap = 0;
+    struct dirent *de;
+
+    for (;;) {
+        size_t len;
+        errno = 0;
+        de = readdir(d);
+        if (!de) {
+            return errno ? -1 : 0;
+        }
+        if (is_dot(de->d_name)) {
+            continue;
+        }
+        len = strlen(de->d_name);
+        if (l->count == cap) {
+            size_t ncap = cap ? cap * 2 : 256;
+            struct dir_list_entry *p = realloc(l->entries, ncap * sizeof(*p));
+            if (!p) {
+                return -1;
+            }
+            l->entries = p;
+            cap = ncap;
+        }
+        if (l->names_len + len + 1 > names_cap) {
+            size_t ncap = names_cap ? names_cap * 2 : 0x4000;
+            char *p;
+            while (ncap < l->names_len + len + 1) {
+                ncap *= 2;
+            }
+            if (ncap > UINT32_MAX) {
+                errno = EOVERFLOW;
+                return -1;
+            }
+            p = realloc(l->names, ncap);
+            if (!p) {
+                return -1;
+            }
+            l->names = p;
+            names_cap = ncap;
+        }
+        memcpy(l->names + l->names_len, de->d_name, len + 1);
+        l->entries[l->count].name = (uint32_t)l->names_len;
+        l->entries[l->count].name_len = (uint16_t)len;
+        l->entries[l->count].type = de->d_type;
+        l->entries[l->count].resolved = de->d_type != DT_UNKNOWN && de->d_type != DT_LNK;
+        l->entries[l->count].count = -1;
+        l->names_len += len + 1;
+        l->count++;
+    }
+}
+
+static int sort_entries(struct dir_list *l) {
+    struct sort_item *items;
+    struct dir_list_entry *sorted;
+    uint8_t *keys;
+    size_t i, off = 0;
+
+    if (l->count < 2) {
+        return 0;
+    }
+    // names_len counts a NUL per name, so 2 * names_len covers every key
+    items = malloc(l->count * sizeof(*items));
+    keys = malloc(2 * l->names_len);
+    sorted = malloc(l->count * sizeof(*sorted));
+    if (!items || !keys || !sorted) {
+        free(items);
+        free(keys);
+        free(sorted);
+        return -1;
+    }
+    for (i = 0; i < l->count; i++) {
+        const struct dir_list_entry *e = &l->entries[i];
+        size_t n = make_key(l->names + e->name, e->name_len, keys + off);
+        init_item(&items[i], keys + off, n, l->names + e->name);
+        items[i].index = (uint32_t)i;
+        off += n;
+    }
+    qsort(items, l->count, sizeof(*items), cmp_item);
+    for (i = 0; i < l->count; i++) {
+        sorted[i] = l->entries[items[i].index];
+    }
+    free(l->entries);
+    l->entries = sorted;
+    free(items);
+    free(keys);
+    return 0;
+}
+
+int dir_list_open(struct dir_list *l, const char *path) {
+    DIR *d;
+    int fd, rv, saved;
+
+    memset(l, 0, sizeof(*l));
+    l->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (l->fd < 0) {
+        return -1;
+    }
+    fd = dup(l->fd);
+    d = fd < 0 ? NULL : fdopendir(fd);
+    if (!d) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    rv = read_entries(l, d);
+    saved = errno;
+    closedir(d);
+    if (rv == 0) {
+        rv = sort_entries(l);
+        saved = errno;
+    }
+    errno = saved;
+    return rv;
+}
+
+void dir_list_free(struct dir_list *l) {
+    if (l->fd >= 0) {
+        close(l->fd);
+    }
+    free(l->entries);
+    free(l->names);
+    memset(l, 0, sizeof(*l));
+    l->fd = -1;
+}
+
+int dir_list_is_dir(struct dir_list *l, size_t i) {
+    struct dir_list_entry *e = &l->entries[i];
+    if (!e->resolved) {
+        struct stat st;
+        if (fstatat(l->fd, dir_list_name(l, i), &st, 0) == 0) {
+            e->type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+        }
+        e->resolved = 1;
+    }
+    return e->type == DT_DIR;
+}
+
+// Counts the entries of an open directory, taking ownership of fd.
+static long count_fd(int fd) {
+    DIR *d = fdopendir(fd);
+    struct dirent *de;
+    long n = 0;
+    if (!d) {
+        close(fd);
+        return -1;
+    }
+    while ((de = readdir(d)) != NULL) {
+        n += !is_dot(de->d_name);
+    }
+    closedir(d);
+    return n;
+}
+
+long dir_list_child_count(struct dir_list *l, size_t i) {
+    struct dir_list_entry *e = &l->entries[i];
+    if (e->count < 0) {
+        int fd = openat(l->fd, dir_list_name(l, i), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        long n = fd < 0 ? -1 : count_fd(fd);
+        if (n < 0) {
+            return -1;
+        }
+        e->count = n > INT32_MAX ? INT32_MAX : (int32_t)n;
+    }
+    return e->count;
+}
+
+long dir_count(const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return fd < 0 ? -1 : count_fd(fd);
+}
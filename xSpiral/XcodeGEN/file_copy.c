@@ -0,0 +1,501 @@
+//
+//  file_copy.c
+//  xSpiral
+//
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <sys/clonefile.h>
+#elif defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#include "file_copy.h"
+
+#if defined(__APPLE__)
+#define ST_ATIM(st) ((st)->st_atimespec)
+#define ST_MTIM(st) ((st)->st_mtimespec)
+#else
+#define ST_ATIM(st) ((st)->st_atim)
+#define ST_MTIM(st) ((st)->st_mtim)
+#endif
+
+#define STREAM_CHUNK    (1 << 20)
+#define OFFLOAD_CHUNK   (16 << 20)      // per copy_file_range(), so progress keeps moving
+
+struct copy_state {
+    unsigned flags;
+    file_copy_progress_fn progress;
+    void *ctx;
+    struct file_copy_stats *stats;
+    uint64_t total;
+    char *buf;                          // the stream buffer, allocated on first use
+    int no_clone;                       // set once the destination has refused a clone
+    int no_offload;
+    dev_t root_dev;                     // the top destination directory, so that a tree
+    ino_t root_ino;                     // copied into itself is not walked again
+};
+
+struct dir_job {
+    char *from;
+    char *to;
+    mode_t mode;
+    struct timespec times[2];
+};
+
+struct dir_queue {
+    struct dir_job *jobs;
+    size_t head;
+    size_t count;
+    size_t cap;
+};
+
+static int is_dot(const char *name) {
+    return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+}
+
+static char *join(const char *dir, const char *name) {
+    size_t dl = strlen(dir), nl = strlen(name);
+    char *p = malloc(dl + nl + 2);
+    if (p) {
+        memcpy(p, dir, dl);
+        p[dl] = '/';
+        memcpy(p + dl + 1, name, nl + 1);
+    }
+    return p;
+}
+
+// Takes ownership of from and to, freeing them on failure.
+static int queue_push(struct dir_queue *q, char *from, char *to, const struct stat *st) {
+    struct dir_job *j;
+    if (q->count == q->cap) {
+        size_t ncap = q->cap ? q->cap * 2 : 64;
+        j = realloc(q->jobs, ncap * sizeof(*j));
+        if (!j) {
+            free(from);
+            free(to);
+            return -1;
+        }
+        q->jobs = j;
+        q->cap = ncap;
+    }
+    j = &q->jobs[q->count++];
+    j->from = from;
+    j->to = to;
+    if (st) {
+        j->mode = st->st_mode & 07777;
+        j->times[0] = ST_ATIM(st);
+        j->times[1] = ST_MTIM(st);
+    }
+    return 0;
+}
+
+static void queue_free(struct dir_queue *q) {
+    size_t i;
+    for (i = 0; i < q->count; i++) {
+        free(q->jobs[i].from);
+        free(q->jobs[i].to);
+    }
+    free(q->jobs);
+    memset(q, 0, sizeof(*q));
+}
+
+static int report(struct copy_state *s, const char *path) {
+    if (s->progress && s->progress(s->ctx, path, s->stats->bytes, s->total)) {
+        errno = ECANCELED;
+        return -1;
+    }
+    return 0;
+}
+
+// The bytes in the regular files under from, for the progress total.  Best
+// effort: whatever cannot be read is left out.
+static uint64_t tree_size(const char *from, const struct stat *st) {
+    struct dir_queue q = { 0 };
+    uint64_t total = 0;
+    char *root;
+
+    if (!S_ISDIR(st->st_mode)) {
+        return S_ISREG(st->st_mode) ? (uint64_t)st->st_size : 0;
+    }
+    root = strdup(from);
+    if (!root || queue_push(&q, root, NULL, NULL)) {
+        return 0;
+    }
+    while (q.head < q.count) {
+        const char *dir = q.jobs[q.head++].from;
+        struct dirent *de;
+        DIR *d = opendir(dir);
+        if (!d) {
+            continue;
+        }
+        while ((de = readdir(d)) != NULL) {
+            struct stat cst;
+            if (is_dot(de->d_name) || fstatat(dirfd(d), de->d_name, &cst, AT_SYMLINK_NOFOLLOW)) {
+                continue;
+            }
+            if (S_ISREG(cst.st_mode)) {
+                total += cst.st_size;
+            } else if (S_ISDIR(cst.st_mode)) {
+                char *child = join(dir, de->d_name);
+                if (!child || queue_push(&q, child, NULL, NULL)) {
+                    break;
+                }
+            }
+        }
+        closedir(d);
+    }
+    queue_free(&q);
+    return total;
+}
+
+static int stream_data(struct copy_state *s, int in, int out, const char *path) {
+    if (!s->buf && !(s->buf = malloc(STREAM_CHUNK))) {
+        return -1;
+    }
+    for (;;) {
+        ssize_t n = read(in, s->buf, STREAM_CHUNK), off, w;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (off = 0; off < n; off += w) {
+            w = write(out, s->buf + off, n - off);
+            if (w < 0) {
+                if (errno != EINTR) {
+                    return -1;
+                }
+                w = 0;
+            }
+        }
+        s->stats->bytes += n;
+        if (report(s, path)) {
+            return -1;
+        }
+    }
+    s->stats->streamed++;
+    return 0;
+}
+
+// Copies the data of in to out, both at offset 0.  size is what stat() said
+// and only decides whether to try the kernel copy: files in procfs and the
+// like claim 0 bytes and have to be read.
+static int copy_data(struct copy_state *s, int in, int out, off_t size, const char *path) {
+#if defined(__linux__)
+    if (size > 0 && !s->no_offload && !(s->flags & FILE_COPY_NO_OFFLOAD)) {
+        uint64_t copied = 0;
+        for (;;) {
+            ssize_t n = copy_file_range(in, NULL, out, NULL, OFFLOAD_CHUNK, 0);
+            if (n > 0) {
+                copied += n;
+                s->stats->bytes += n;
+                if (report(s, path)) {
+                    return -1;
+                }
+                continue;
+            }
+            if (n == 0) {
+                s->stats->offloaded++;
+                return 0;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (copied != 0) {
+                return -1;
+            }
+            if (errno == ENOSYS || errno == EOPNOTSUPP) {
+                s->no_offload = 1;
+            } else if (errno != EXDEV && errno != EINVAL) {
+                return -1;
+            }
+            break;
+        }
+    }
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    (void)size;
+#endif
+    return stream_data(s, in, out, path);
+}
+
+// Copies the regular file sname in sdfd to the new file dname in ddfd.
+static int copy_file_at(struct copy_state *s, int sdfd, const char *sname, int ddfd, const char *dname,
+                        const struct stat *st, const char *path) {
+    struct timespec times[2];
+    int in, out, cloned = 0, rv, saved;
+
+    in = openat(sdfd, sname, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in < 0) {
+        return -1;
+    }
+#if defined(__APPLE__)
+    // A clone carries the mode and times along, so it is all there is to do.
+    if (!s->no_clone && !(s->flags & FILE_COPY_NO_CLONE)) {
+        if (fclonefileat(in, ddfd, dname, 0) == 0) {
+            close(in);
+            s->stats->bytes += st->st_size;
+            s->stats->files++;
+            s->stats->cloned++;
+            return report(s, path);
+        }
+        if (errno == EEXIST) {
+            close(in);
+            return -1;
+        }
+        s->no_clone = 1;
+    }
+#endif
+    out = openat(ddfd, dname, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (out < 0) {
+        saved = errno;
+        close(in);
+        errno = saved;
+        return -1;
+    }
+#if defined(__linux__) && defined(FICLONE)
+    if (!s->no_clone && !(s->flags & FILE_COPY_NO_CLONE)) {
+        if (ioctl(out, FICLONE, in) == 0) {
+            cloned = 1;
+            s->stats->bytes += st->st_size;
+            s->stats->cloned++;
+        } else {
+            s->no_clone = 1;
+        }
+    }
+#endif
+    times[0] = ST_ATIM(st);
+    times[1] = ST_MTIM(st);
+    rv = (!cloned && copy_data(s, in, out, st->st_size, path)) ||
+         fchmod(out, st->st_mode & 07777) || futimens(out, times) ? -1 : 0;
+    saved = errno;
+    if (close(out) && rv == 0) {
+        rv = -1;
+        saved = errno;
+    }
+    close(in);
+    if (rv) {
+        unlinkat(ddfd, dname, 0);
+        errno = saved;
+        return -1;
+    }
+    s->stats->files++;
+    return cloned ? report(s, path) : 0;
+}
+
+static int copy_link_at(struct copy_state *s, int sdfd, const char *sname, int ddfd, const char *dname) {
+    char target[PATH_MAX];
+    ssize_t n = readlinkat(sdfd, sname, target, sizeof(target) - 1);
+    if (n < 0) {
+        return -1;
+    }
+    target[n] = 0;
+    if (symlinkat(target, ddfd, dname)) {
+        return -1;
+    }
+    s->stats->links++;
+    return 0;
+}
+
+static int copy_entry(struct copy_state *s, int sdfd, const char *sname, int ddfd, const char *dname,
+                      const struct stat *st, const char *path) {
+    if (S_ISREG(st->st_mode)) {
+        return copy_file_at(s, sdfd, sname, ddfd, dname, st, path);
+    }
+    if (S_ISLNK(st->st_mode)) {
+        return copy_link_at(s, sdfd, sname, ddfd, dname);
+    }
+    errno = ENOTSUP;
+    return -1;
+}
+
+// Copies the entries of the queued directory idx, creating its
+// subdirectories and queueing them in turn.
+static int copy_dir(struct copy_state *s, struct dir_queue *q, size_t idx) {
+    const char *from = q->jobs[idx].from, *to = q->jobs[idx].to;
+    struct dirent *de;
+    int sfd, dfd, rv = -1, saved;
+    DIR *d;
+
+    sfd = open(from, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (sfd < 0) {
+        return -1;
+    }
+    dfd = open(to, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    d = dfd < 0 ? NULL : fdopendir(sfd);
+    if (!d) {
+        saved = errno;
+        close(sfd);
+        if (dfd >= 0) {
+            close(dfd);
+        }
+        errno = saved;
+        return -1;
+    }
+    for (;;) {
+        struct stat cst;
+        char *cfrom, *cto;
+        errno = 0;
+        de = readdir(d);
+        if (!de) {
+            rv = errno ? -1 : 0;
+            break;
+        }
+        if (is_dot(de->d_name)) {
+            continue;
+        }
+        if (fstatat(sfd, de->d_name, &cst, AT_SYMLINK_NOFOLLOW)) {
+            break;
+        }
+        if (S_ISDIR(cst.st_mode)) {
+            if (cst.st_dev == s->root_dev && cst.st_ino == s->root_ino) {
+                continue;
+            }
+            cfrom = join(from, de->d_name);
+            cto = join(to, de->d_name);
+            if (!cfrom || !cto || mkdirat(dfd, de->d_name, (cst.st_mode & 07777) | S_IRWXU)) {
+                free(cfrom);
+                free(cto);
+                break;
+            }
+            // from and to may move with the queue
+            if (queue_push(q, cfrom, cto, &cst)) {
+                break;
+            }
+            from = q->jobs[idx].from;
+            to = q->jobs[idx].to;
+            s->stats->dirs++;
+        } else if (S_ISREG(cst.st_mode) || S_ISLNK(cst.st_mode)) {
+            int err;
+            if (!(cfrom = join(from, de->d_name))) {
+                break;
+            }
+            err = copy_entry(s, sfd, de->d_name, dfd, de->d_name, &cst, cfrom);
+            free(cfrom);
+            if (err) {
+                break;
+            }
+        } else {
+            s->stats->skipped++;
+        }
+    }
+    saved = errno;
+    closedir(d);
+    close(dfd);
+    errno = saved;
+    return rv;
+}
+
+static int copy_tree(struct copy_state *s, const char *from, const char *to, const struct stat *st) {
+    struct dir_queue q = { 0 };
+    struct stat rst;
+    char *f, *t;
+    int rv = -1, saved;
+    size_t i;
+
+    // Owner access is needed to fill the copy in; the real mode is set at
+    // the end, with the times that filling it in changed.
+    if (mkdir(to, (st->st_mode & 07777) | S_IRWXU)) {
+        return -1;
+    }
+    if (stat(to, &rst) == 0) {
+        s->root_dev = rst.st_dev;
+        s->root_ino = rst.st_ino;
+    }
+    s->stats->dirs++;
+    f = strdup(from);
+    t = strdup(to);
+    if (!f || !t) {
+        free(f);
+        free(t);
+        return -1;
+    }
+    if (queue_push(&q, f, t, st) == 0) {
+        while (q.head < q.count && copy_dir(s, &q, q.head) == 0) {
+            q.head++;
+        }
+        rv = q.head < q.count ? -1 : 0;
+    }
+    saved = errno;
+    for (i = q.count; i-- > 0;) {
+        utimensat(AT_FDCWD, q.jobs[i].to, q.jobs[i].times, 0);
+        chmod(q.jobs[i].to, q.jobs[i].mode);
+    }
+    queue_free(&q);
+    errno = saved;
+    return rv;
+}
+
+// Copies the non-directory from to a temporary name beside to and renames
+// it over to.
+static int replace_entry(struct copy_state *s, const char *from, const char *to, const struct stat *st) {
+    size_t len = strlen(to) + 32;
+    char *tmp = malloc(len);
+    int rv = -1, saved, i;
+
+    if (!tmp) {
+        return -1;
+    }
+    for (i = 0; i < 100; i++) {
+        snprintf(tmp, len, "%s.%ld-%d.copy", to, (long)getpid(), i);
+        rv = copy_entry(s, AT_FDCWD, from, AT_FDCWD, tmp, st, from);
+        if (rv == 0 || errno != EEXIST) {
+            break;
+        }
+    }
+    if (rv == 0 && rename(tmp, to)) {
+        saved = errno;
+        unlink(tmp);
+        errno = saved;
+        rv = -1;
+    }
+    free(tmp);
+    return rv;
+}
+
+int file_copy(const char *from, const char *to, unsigned flags,
+              file_copy_progress_fn progress, void *ctx, struct file_copy_stats *stats) {
+    struct file_copy_stats local;
+    struct copy_state s;
+    struct stat st;
+    int rv, saved;
+
+    if (lstat(from, &st)) {
+        return -1;
+    }
+    memset(&s, 0, sizeof(s));
+    s.flags = flags;
+    s.progress = progress;
+    s.ctx = ctx;
+    s.stats = stats ? stats : &local;
+    memset(s.stats, 0, sizeof(*s.stats));
+    if (progress) {
+        s.total = tree_size(from, &st);
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        rv = copy_tree(&s, from, to, &st);
+    } else if (flags & FILE_COPY_REPLACE) {
+        rv = replace_entry(&s, from, to, &st);
+    } else {
+        rv = copy_entry(&s, AT_FDCWD, from, AT_FDCWD, to, &st, from);
+    }
+    saved = errno;
+    free(s.buf);
+    errno = saved;
+    return rv;
+}
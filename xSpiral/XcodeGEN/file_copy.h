@@ -0,0 +1,53 @@
+//
+//  file_copy.h
+//  xSpiral
+//
+//  Copying files and directory trees for the file manager and the ticket
+//  dump, in plain C.  Each regular file is cloned when the filesystem can
+//  share blocks (fclonefileat() on APFS, FICLONE on Linux), copied inside
+//  the kernel with copy_file_range() where that exists, and streamed
+//  through one reused buffer otherwise.  Directories are walked breadth
+//  first from a work queue instead of by recursion, and an optional
+//  callback can follow the progress of a copy and cancel it.
+//
+
+#ifndef file_copy_h
+#define file_copy_h
+
+#include <stdint.h>
+
+enum {
+    // If from is not a directory, copy it next to to and rename() it over
+    // to, so that to is replaced in one step or left alone.
+    FILE_COPY_REPLACE       = 1 << 0,
+    // Always copy the data, even where it could be cloned.
+    FILE_COPY_NO_CLONE      = 1 << 1,
+    // Never use copy_file_range(); clone or stream only.
+    FILE_COPY_NO_OFFLOAD    = 1 << 2,
+};
+
+struct file_copy_stats {
+    uint64_t bytes;         // file data copied, cloned files included
+    uint64_t files;
+    uint64_t dirs;
+    uint64_t links;
+    uint64_t skipped;       // fifos, sockets and devices inside a tree
+    uint64_t cloned;        // files by how their data was copied
+    uint64_t offloaded;
+    uint64_t streamed;
+};
+
+// Called after each chunk and each file with the source path and the bytes
+// copied so far out of total, or total 0 when it is not known.  A nonzero
+// return cancels the copy, which then fails with ECANCELED.
+typedef int (*file_copy_progress_fn)(void *ctx, const char *path, uint64_t done, uint64_t total);
+
+// Copies the file, symlink or directory tree at from to the new path to,
+// keeping permissions and times but not ownership.  Symlinks are copied as
+// symlinks.  When progress is given the tree is sized up front so that the
+// callback gets a total.  Returns 0, or -1 with errno set; a failed tree
+// copy leaves what it had copied in place.  stats may be NULL.
+int file_copy(const char *from, const char *to, unsigned flags,
+              file_copy_progress_fn progress, void *ctx, struct file_copy_stats *stats);
+
+#endif /* file_copy_h */